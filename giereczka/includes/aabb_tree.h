@@ -0,0 +1,298 @@
+#pragma once
+
+#include "pch.h"
+
+#include "bounds.h"
+
+namespace game_engine {
+	// Dynamic bounding volume hierarchy over axis aligned boxes, updated incrementally. Leaves store a
+	// fattened copy of their box, so objects moving inside the margin do not touch the tree at all, and
+	// insertions and removals keep it balanced with AVL style rotations. Queries test internal nodes
+	// against the fat boxes and leaves against the exact boxes, callbacks receive the user_data given
+	// to create_proxy. Not thread safe, queries may run concurrently with each other only.
+	class AabbTree {
+	public:
+		static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+		static constexpr float DEFAULT_MARGIN = 0.1f;
+		// How many frames of the last displacement a reinserted fat box is stretched for
+		static constexpr float DISPLACEMENT_MULTIPLIER = 4.f;
+
+		explicit AabbTree(float margin = DEFAULT_MARGIN);
+
+		AabbTree(const AabbTree&) = delete;
+		AabbTree& operator=(const AabbTree&) = delete;
+
+		// Returns the proxy for move_proxy and destroy_proxy
+		uint32_t create_proxy(const BoundingBox& box, uint32_t user_data);
+		void destroy_proxy(uint32_t proxy);
+		// Returns true when the proxy had to be reinserted, false when the fat box still fit. displacement
+		// is how far the object moved since the last call, the new fat box is stretched ahead of it so
+		// steadily moving objects are reinserted only every few frames.
+		bool move_proxy(uint32_t proxy, const BoundingBox& box, const glm::vec3& displacement = glm::vec3(0.f));
+
+		uint32_t get_user_data(uint32_t proxy) const { return nodes[proxy].user_data; }
+		const BoundingBox& get_box(uint32_t proxy) const { return nodes[proxy].leaf_box; }
+		const BoundingBox& get_fat_box(uint32_t proxy) const { return nodes[proxy].box; }
+
+		uint32_t get_proxy_count() const { return proxy_count; }
+		uint32_t get_node_count() const { return node_count; }
+		uint32_t get_height() const { return root == INVALID_NODE ? 0 : nodes[root].height; }
+		// Summed surface area of every node over the root's, lower means a better tree
+		float get_area_ratio() const;
+
+		// The callback takes the user data and returns false to stop the query
+		template <typename Callback>
+		void query(const BoundingBox& box, Callback&& callback) const;
+
+		template <typename Callback>
+		void query(const glm::vec3& center, float radius, Callback&& callback) const;
+
+		// Planes point inwards, see Camera::get_frustum_planes. Subtrees completely inside the frustum are
+		// reported without further tests.
+		template <typename Callback>
+		void query(const std::array<glm::vec4, 6>& planes, Callback&& callback) const;
+
+		// The callback takes the user data and the distance along the ray to the leaf box, and returns the
+		// new maximum distance: 0 stops the cast, the hit distance keeps looking for closer boxes only and
+		// max_distance keeps every hit. direction does not need to be normalized, distances are in its units.
+		template <typename Callback>
+		void ray_cast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, Callback&& callback) const;
+
+	private:
+		struct Node {
+			// Fattened for leaves
+			BoundingBox box;
+			// Exact box, leaves only
+			BoundingBox leaf_box;
+			// Next free node while on the free list
+			uint32_t parent = INVALID_NODE;
+			uint32_t child1 = INVALID_NODE;
+			uint32_t child2 = INVALID_NODE;
+			// 0 for leaves
+			uint32_t height = 0;
+			uint32_t user_data = 0;
+
+			bool is_leaf() const { return child1 == INVALID_NODE; }
+		};
+
+		// Marks nodes on the free list
+		static constexpr uint32_t FREE_NODE_HEIGHT = UINT32_MAX;
+
+		// Stack depth that covers any balanced tree a frame can hold, deeper trees spill to the heap
+		static constexpr size_t INLINE_STACK_SIZE = 256;
+
+		class NodeStack {
+		public:
+			void push(uint32_t node)
+			{
+				if (size < INLINE_STACK_SIZE) inline_nodes[size] = node;
+				else overflow.push_back(node);
+				size++;
+			}
+
+			uint32_t pop()
+			{
+				size--;
+				if (size < INLINE_STACK_SIZE) return inline_nodes[size];
+				uint32_t node = overflow.back();
+				overflow.pop_back();
+				return node;
+			}
+
+			bool is_empty() const { return size == 0; }
+
+		private:
+			std::array<uint32_t, INLINE_STACK_SIZE> inline_nodes;
+			std::vector<uint32_t> overflow;
+			size_t size = 0;
+		};
+
+		uint32_t allocate_node();
+		void free_node(uint32_t node);
+
+		void insert_leaf(uint32_t leaf);
+		void remove_leaf(uint32_t leaf);
+		// Refits boxes and heights from node up to the root, rotating unbalanced nodes on the way
+		void refit_ancestors(uint32_t node);
+		uint32_t balance(uint32_t node);
+
+		// Reports every leaf below node, for subtrees already known to pass a query
+		template <typename Callback>
+		bool report_subtree(uint32_t node, Callback& callback, NodeStack& stack) const;
+
+		float margin;
+		std::vector<Node> nodes;
+		uint32_t root = INVALID_NODE;
+		uint32_t free_list = INVALID_NODE;
+		uint32_t node_count = 0;
+		uint32_t proxy_count = 0;
+	};
+
+	template <typename Callback>
+	void AabbTree::query(const BoundingBox& box, Callback&& callback) const
+	{
+		if (root == INVALID_NODE) return;
+
+		NodeStack stack;
+		stack.push(root);
+		while (!stack.is_empty())
+		{
+			const Node& node = nodes[stack.pop()];
+			if (!node.box.intersects(box)) continue;
+
+			if (node.is_leaf())
+			{
+				if (node.leaf_box.intersects(box) && !callback(node.user_data)) return;
+			}
+			else
+			{
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+	template <typename Callback>
+	void AabbTree::query(const glm::vec3& center, float radius, Callback&& callback) const
+	{
+		if (root == INVALID_NODE) return;
+
+		auto touches = [&](const BoundingBox& box)
+		{
+			glm::vec3 offset = glm::clamp(center, box.min, box.max) - center;
+			return glm::dot(offset, offset) <= radius * radius;
+		};
+
+		NodeStack stack;
+		stack.push(root);
+		while (!stack.is_empty())
+		{
+			const Node& node = nodes[stack.pop()];
+			if (!touches(node.box)) continue;
+
+			if (node.is_leaf())
+			{
+				if (touches(node.leaf_box) && !callback(node.user_data)) return;
+			}
+			else
+			{
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+	template <typename Callback>
+	void AabbTree::query(const std::array<glm::vec4, 6>& planes, Callback&& callback) const
+	{
+		if (root == INVALID_NODE) return;
+
+		enum class Containment { outside, intersecting, inside };
+		auto classify = [&](const BoundingBox& box)
+		{
+			glm::vec3 center = box.get_center();
+			glm::vec3 extent = box.get_extent();
+			Containment containment = Containment::inside;
+			for (const glm::vec4& plane : planes)
+			{
+				float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+				float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+				if (distance + radius < 0.f) return Containment::outside;
+				if (distance - radius < 0.f) containment = Containment::intersecting;
+			}
+			return containment;
+		};
+
+		NodeStack stack;
+		NodeStack subtree_stack;
+		stack.push(root);
+		while (!stack.is_empty())
+		{
+			uint32_t index = stack.pop();
+			const Node& node = nodes[index];
+			Containment containment = classify(node.box);
+			if (containment == Containment::outside) continue;
+
+			if (containment == Containment::inside)
+			{
+				if (!report_subtree(index, callback, subtree_stack)) return;
+			}
+			else if (node.is_leaf())
+			{
+				if (classify(node.leaf_box) != Containment::outside && !callback(node.user_data)) return;
+			}
+			else
+			{
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+	template <typename Callback>
+	void AabbTree::ray_cast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, Callback&& callback) const
+	{
+		if (root == INVALID_NODE) return;
+
+		// Slab test, infinities from zero components compare correctly
+		const glm::vec3 inverse_direction = 1.f / direction;
+		auto entry_distance = [&](const BoundingBox& box, float& distance)
+		{
+			glm::vec3 t1 = (box.min - origin) * inverse_direction;
+			glm::vec3 t2 = (box.max - origin) * inverse_direction;
+			glm::vec3 t_min = glm::min(t1, t2);
+			glm::vec3 t_max = glm::max(t1, t2);
+			float t_enter = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.f));
+			float t_exit = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, max_distance));
+			distance = t_enter;
+			return t_enter <= t_exit;
+		};
+
+		NodeStack stack;
+		stack.push(root);
+		while (!stack.is_empty())
+		{
+			const Node& node = nodes[stack.pop()];
+			float distance;
+			if (!entry_distance(node.box, distance)) continue;
+
+			if (node.is_leaf())
+			{
+				if (entry_distance(node.leaf_box, distance))
+				{
+					max_distance = callback(node.user_data, distance);
+					if (max_distance <= 0.f) return;
+				}
+			}
+			else
+			{
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+	template <typename Callback>
+	bool AabbTree::report_subtree(uint32_t node, Callback& callback, NodeStack& stack) const
+	{
+		stack.push(node);
+		while (!stack.is_empty())
+		{
+			const Node& current = nodes[stack.pop()];
+			if (current.is_leaf())
+			{
+				if (!callback(current.user_data))
+				{
+					while (!stack.is_empty()) stack.pop();
+					return false;
+				}
+			}
+			else
+			{
+				stack.push(current.child1);
+				stack.push(current.child2);
+			}
+		}
+		return true;
+	}
+}
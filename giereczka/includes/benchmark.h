@@ -0,0 +1,106 @@
+#pragma once
+
+#include "pch.h"
+
+#include "device.h"
+#include "pipelines/pipeline_state_cache.h"
+#include "headless_renderer.h"
+#include "descriptors.h"
+#include "systems/object_manager_system.h"
+#include "job_system.h"
+#include "thread_command_pools.h"
+#include "systems/gpu_culling_system.h"
+#include "render_queue.h"
+
+#include <set>
+
+namespace game_engine {
+	enum class CullingMode {
+		// Every object is recorded on the CPU, nothing is culled
+		none,
+		// GpuCullingSystem, falls back to none on devices without multiDrawIndirect
+		gpu,
+		// GpuCullingSystem with a DepthPyramid, frustum and two phase occlusion culling
+		occlusion,
+		// Recorded on the CPU like none, after frustum and MaskedOcclusionCuller culling
+		software
+	};
+
+	struct BenchmarkSettings {
+		uint32_t width = 1366;
+		uint32_t height = 768;
+		uint32_t frames = 300;
+		uint32_t warmup_frames = 10;
+		// Job system threads, the calling thread included
+		uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+		// Extra copies of the animated model laid out on a grid, to scale the draw count
+		uint32_t extra_objects = 0;
+		CullingMode culling = CullingMode::gpu;
+		// Sort CPU recorded draws by state, see RenderSystem::set_draw_sorting
+		bool sort_draws = true;
+		// Measured frame indices (0 based, warmup excluded) whose color target is read back
+		std::set<uint32_t> capture_frames;
+	};
+
+	struct BenchmarkFrame {
+		uint32_t index;
+		double frame_ms;
+		double cpu_ms;
+		double gpu_ms;
+	};
+
+	struct BenchmarkResult {
+		std::string device_name;
+		uint32_t width;
+		uint32_t height;
+		uint32_t warmup_frames;
+		uint32_t threads;
+		size_t object_count;
+		CullingMode culling;
+		// GPU culling only, zero otherwise, warmup frames included
+		CullingStatistics culling_statistics;
+		bool sort_draws;
+		// Of the last frame, CPU recording only
+		RenderStatistics render_statistics;
+		bool gpu_timestamps;
+		std::vector<BenchmarkFrame> frames;
+		std::vector<CapturedFrame> captures;
+		// Pipeline creation cost of the run, warm when pipeline_cache.bin from an earlier run was used
+		PipelineCacheStatistics pipelines;
+		// How many pipeline requests the PSO cache folded into distinct pipelines
+		PipelineStateStatistics pipeline_states;
+		// Device memory usage at the end of the run, with the whole scene still loaded
+		MemoryStatistics memory;
+	};
+
+	// Runs the default scene on a headless device along a scripted camera path with a fixed
+	// timestep, so consecutive runs render exactly the same frames.
+	class Benchmark {
+	public:
+		static constexpr float FIXED_TIMESTEP = 1.f / 60.f;
+
+		Benchmark(const BenchmarkSettings& settings);
+		~Benchmark();
+
+		Benchmark(const Benchmark&) = delete;
+		Benchmark& operator=(const Benchmark&) = delete;
+
+		BenchmarkResult run();
+
+	private:
+		void add_extra_objects();
+
+		BenchmarkSettings settings;
+
+		Device device{};
+		HeadlessRenderer renderer;
+		JobSystem job_system;
+		ThreadCommandPools command_pools;
+		ObjectManagerSystem object_manager_system;
+
+		std::unique_ptr<DescriptorAllocator> global_descriptor_allocator;
+		std::unique_ptr<DescriptorAllocator> materials_descriptor_allocator;
+		std::unique_ptr<DescriptorSetLayout> global_descriptor_set_layout;
+		std::unique_ptr<DescriptorSetLayout> joint_descriptor_set_layout;
+	};
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "pch.h"
+
+#include <limits>
+
+namespace game_engine {
+	// Axis aligned bounding box. Default constructed it is empty and grows with expand().
+	struct BoundingBox {
+		glm::vec3 min{std::numeric_limits<float>::max()};
+		glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+		bool is_empty() const { return min.x > max.x; }
+		glm::vec3 get_center() const { return (min + max) * 0.5f; }
+		// Half the size along each axis
+		glm::vec3 get_extent() const { return (max - min) * 0.5f; }
+
+		void expand(const glm::vec3& point)
+		{
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+
+		void expand(const BoundingBox& other)
+		{
+			if (other.is_empty()) return;
+			min = glm::min(min, other.min);
+			max = glm::max(max, other.max);
+		}
+
+		bool contains(const BoundingBox& other) const
+		{
+			return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::lessThanEqual(other.max, max));
+		}
+
+		bool intersects(const BoundingBox& other) const
+		{
+			return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::lessThanEqual(other.min, max));
+		}
+
+		BoundingBox merged(const BoundingBox& other) const
+		{
+			return BoundingBox{glm::min(min, other.min), glm::max(max, other.max)};
+		}
+
+		BoundingBox expanded(float margin) const
+		{
+			return BoundingBox{min - glm::vec3(margin), max + glm::vec3(margin)};
+		}
+
+		float get_surface_area() const
+		{
+			glm::vec3 size = max - min;
+			return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+		}
+
+		// Box around the transformed box (Arvo), tight for rotations of the box itself
+		BoundingBox transformed(const glm::mat4& transform) const
+		{
+			if (is_empty()) return *this;
+
+			glm::vec3 center = glm::vec3(transform * glm::vec4(get_center(), 1.f));
+			glm::vec3 extent = get_extent();
+			glm::vec3 world_extent{
+				std::abs(transform[0][0]) * extent.x + std::abs(transform[1][0]) * extent.y + std::abs(transform[2][0]) * extent.z,
+				std::abs(transform[0][1]) * extent.x + std::abs(transform[1][1]) * extent.y + std::abs(transform[2][1]) * extent.z,
+				std::abs(transform[0][2]) * extent.x + std::abs(transform[1][2]) * extent.y + std::abs(transform[2][2]) * extent.z
+			};
+			return BoundingBox{center - world_extent, center + world_extent};
+		}
+	};
+
+	// Sphere in xyz/w form around a set of points, centered on their box. Not the minimal sphere, but
+	// close enough for culling and cheap to build.
+	template <typename Points, typename GetPosition>
+	glm::vec4 compute_bounding_sphere(const BoundingBox& box, const Points& points, GetPosition get_position)
+	{
+		if (box.is_empty()) return glm::vec4(0.f);
+
+		glm::vec3 center = box.get_center();
+		float radius_squared = 0.f;
+		for (const auto& point : points)
+		{
+			glm::vec3 offset = get_position(point) - center;
+			radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+		}
+		return glm::vec4(center, std::sqrt(radius_squared));
+	}
+}
@@ -34,6 +34,7 @@ namespace game_engine {
 		VkResult invalidate_index(int index);
 
 		VkBuffer get_buffer() const { return buffer; }
+		const Allocation& get_allocation() const { return allocation; }
 		void* get_mapped_memory() const { return mapped_memory; }
 		uint32_t get_instance_count() const { return instance_count; }
 		VkDeviceSize get_instance_size() const { return instance_size; }
@@ -48,7 +49,7 @@ namespace game_engine {
 		Device& device;
 		void* mapped_memory = nullptr;
 		VkBuffer buffer = VK_NULL_HANDLE;
-		VkDeviceMemory buffer_memory = VK_NULL_HANDLE;
+		Allocation allocation;
 		
 		VkDeviceSize buffer_size;
 		uint32_t instance_count;
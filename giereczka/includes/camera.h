@@ -4,6 +4,7 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <array>
 #include <cassert>
 
 namespace game_engine {
@@ -32,6 +33,9 @@ namespace game_engine {
 		const glm::mat4& get_projection_matrix() const { return projection_matrix; }
 		const glm::mat4& get_view_matrix() const { return view_matrix; }
 		const glm::mat4& get_inverse_view_matrix() const { return inverse_view_matrix; }
+		// World space planes (xyz normal pointing inwards, w distance), normalized: left, right,
+		// bottom, top, near, far. A point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all.
+		std::array<glm::vec4, 6> get_frustum_planes() const;
 	private:
 		glm::mat4 projection_matrix{ 1.f };
 		glm::mat4 view_matrix{ 1.f };
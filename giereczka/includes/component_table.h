@@ -0,0 +1,162 @@
+#pragma once
+
+#include "pch.h"
+
+#include <span>
+#include <tuple>
+
+namespace game_engine {
+	// Refers to an entry of a ComponentTable. The generation changes every time the slot is freed, so a
+	// handle to a removed entry stays invalid after its slot is reused.
+	struct ObjectHandle {
+		static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+		uint32_t index = INVALID_INDEX;
+		uint32_t generation = 0;
+
+		bool is_valid() const { return index != INVALID_INDEX; }
+		bool operator==(const ObjectHandle& other) const = default;
+	};
+
+	// Entries with one of each component, stored as a sparse set: every component type has its own densely
+	// packed array, all in the same order, so systems walk them linearly. Handles index a sparse array of
+	// slots that point into the dense arrays. Removing swaps the last entry into the hole, which keeps the
+	// arrays packed but reorders them, dense indices and references are only stable until the next
+	// insert or erase. Freed slots are reused last in, first out.
+	template <typename... Components>
+	class ComponentTable {
+	public:
+		static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+		ObjectHandle insert(Components... components)
+		{
+			uint32_t index;
+			if (free_list != NOT_FOUND)
+			{
+				index = free_list;
+				free_list = slots[index].dense;
+			}
+			else
+			{
+				index = static_cast<uint32_t>(slots.size());
+				slots.emplace_back();
+			}
+
+			slots[index].dense = static_cast<uint32_t>(handles.size());
+			ObjectHandle handle{index, slots[index].generation};
+			handles.push_back(handle);
+			std::apply([&](auto&... column) { (column.push_back(std::move(components)), ...); }, columns);
+			return handle;
+		}
+
+		// Returns false when the handle was already removed
+		bool erase(ObjectHandle handle)
+		{
+			uint32_t dense = find(handle);
+			if (dense == NOT_FOUND)
+			{
+				return false;
+			}
+
+			uint32_t last = static_cast<uint32_t>(handles.size() - 1);
+			if (dense != last)
+			{
+				handles[dense] = handles[last];
+				slots[handles[dense].index].dense = dense;
+				std::apply([&](auto&... column) { ((column[dense] = std::move(column[last])), ...); }, columns);
+			}
+			handles.pop_back();
+			std::apply([](auto&... column) { (column.pop_back(), ...); }, columns);
+
+			Slot& slot = slots[handle.index];
+			slot.generation++;
+			slot.dense = free_list;
+			free_list = handle.index;
+			return true;
+		}
+
+		void clear()
+		{
+			for (const ObjectHandle& handle : handles)
+			{
+				Slot& slot = slots[handle.index];
+				slot.generation++;
+				slot.dense = free_list;
+				free_list = handle.index;
+			}
+			handles.clear();
+			std::apply([](auto&... column) { (column.clear(), ...); }, columns);
+		}
+
+		void reserve(size_t count)
+		{
+			handles.reserve(count);
+			std::apply([&](auto&... column) { (column.reserve(count), ...); }, columns);
+		}
+
+		// Dense index of the handle's entry, NOT_FOUND when it was removed
+		uint32_t find(ObjectHandle handle) const
+		{
+			if (handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+			{
+				return NOT_FOUND;
+			}
+			return slots[handle.index].dense;
+		}
+
+		bool contains(ObjectHandle handle) const { return find(handle) != NOT_FOUND; }
+
+		// Handle of the live entry in a slot, for code that only kept the index
+		ObjectHandle get_handle(uint32_t index) const { return {index, slots[index].generation}; }
+
+		template <typename Component>
+		Component& get(ObjectHandle handle)
+		{
+			uint32_t dense = find(handle);
+			assert(dense != NOT_FOUND && "Handle refers to a removed entry");
+			return std::get<std::vector<Component>>(columns)[dense];
+		}
+
+		template <typename Component>
+		const Component& get(ObjectHandle handle) const
+		{
+			uint32_t dense = find(handle);
+			assert(dense != NOT_FOUND && "Handle refers to a removed entry");
+			return std::get<std::vector<Component>>(columns)[dense];
+		}
+
+		// Every entry's component in dense order, the same order as get_handles
+		template <typename Component>
+		std::span<Component> get() { return std::get<std::vector<Component>>(columns); }
+
+		template <typename Component>
+		std::span<const Component> get() const { return std::get<std::vector<Component>>(columns); }
+
+		std::span<const ObjectHandle> get_handles() const { return handles; }
+		// Every handle's index is below it, for arrays indexed by slot
+		size_t get_slot_count() const { return slots.size(); }
+
+		size_t size() const { return handles.size(); }
+		bool empty() const { return handles.empty(); }
+
+	private:
+		struct Slot {
+			// Next free slot while on the free list
+			uint32_t dense = NOT_FOUND;
+			uint32_t generation = 0;
+		};
+
+		std::vector<Slot> slots;
+		uint32_t free_list = NOT_FOUND;
+		std::vector<ObjectHandle> handles;
+		std::tuple<std::vector<Components>...> columns;
+	};
+}
+
+template <>
+struct std::hash<game_engine::ObjectHandle> {
+	size_t operator()(const game_engine::ObjectHandle& handle) const noexcept
+	{
+		return std::hash<uint64_t>{}(static_cast<uint64_t>(handle.generation) << 32 | handle.index);
+	}
+};
@@ -6,6 +6,8 @@
 #include "object_manager_system.h"
 #include "player_controller.h"
 #include "performance_counter.h"
+#include "masked_occlusion_culling.h"
+#include "render_queue.h"
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_vulkan.h"
 #include "implot.h"
@@ -22,15 +24,19 @@ namespace game_engine {
         void init_debug_ui(VkRenderPass render_pass, uint32_t image_count);
 
 		bool is_free_camera() { return free_camera; }
-		int get_debug_object_id() { return debug_object_id; }
+		ObjectManagerSystem::id_t get_debug_object_id() { return debug_object_id; }
 		bool is_render_wireframe() { return render_wireframe; }
     	bool is_render_raytracing() { return render_raytracing; }
+		bool is_software_occlusion_culling() { return software_occlusion_culling; }
+		bool is_draw_sorting() { return draw_sorting; }
 
         void draw(
             VkCommandBuffer command_buffer,
             ObjectManagerSystem& object_manager_system,
             PlayerController& player_controller,
-			PerformanceCounter& performance_counter
+			PerformanceCounter& performance_counter,
+			const OcclusionCullingStatistics& occlusion_statistics,
+			const RenderStatistics& render_statistics
         );
     private:
         void init_imgui(VkRenderPass render_pass, uint32_t image_count);
@@ -42,13 +48,15 @@ namespace game_engine {
         std::unique_ptr<DescriptorPool> imgui_descriptor_pool;
 
 		int selected_object = -1;
-		int previous_selected_object = -1;
 
-		int debug_object_id = 0;
+		// Highlighted game object, invalid until one is selected
+		ObjectManagerSystem::id_t debug_object_id;
 
 		bool free_camera = false;
 
 		bool render_wireframe = false;
     	bool render_raytracing = false;
+		bool software_occlusion_culling = true;
+		bool draw_sorting = true;
     };
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "pch.h"
+
+#include "device.h"
+#include "descriptors.h"
+#include "pipelines/culling_pipeline.h"
+
+namespace game_engine {
+	// Hierarchical depth buffer for occlusion culling. Level 0 is the depth attachment reduced to the
+	// power of two at or below its size, every further level halves the one above, and each texel keeps
+	// the farthest depth of the texels it covers. Anything whose nearest depth lies behind the texels
+	// covering its screen rectangle is hidden. The pyramid is shared by all frames in flight, builds and
+	// reads of consecutive frames are ordered by the barriers build() records.
+	class DepthPyramid {
+	public:
+		static constexpr uint32_t WORKGROUP_SIZE = 8;
+
+		DepthPyramid(Device& device, VkExtent2D depth_extent, VkFormat depth_format, int frames_in_flight);
+		~DepthPyramid();
+
+		DepthPyramid(const DepthPyramid&) = delete;
+		DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+		// Recreates the pyramid for a resized depth attachment. The device has to be idle.
+		void resize(VkExtent2D depth_extent);
+
+		VkExtent2D get_depth_extent() const { return depth_extent; }
+		// Size of level 0
+		VkExtent2D get_extent() const { return extent; }
+		uint32_t get_level_count() const { return static_cast<uint32_t>(levels.size()); }
+
+		// Every level in VK_IMAGE_LAYOUT_GENERAL, sampled with nearest filtering and clamped coordinates
+		VkDescriptorImageInfo descriptor_info() const;
+
+		// Records the reduction of the depth attachment into every level, outside of a render pass and
+		// after the pass that wrote depth ended in VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL. Depth
+		// is left in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, ready for a load render pass, and
+		// the pyramid is ready for compute shaders.
+		void build(VkCommandBuffer command_buffer, int frame_index, VkImage depth_image, VkImageView depth_image_view);
+
+	private:
+		struct ReducePushConstants {
+			glm::ivec2 source_size;
+			glm::ivec2 destination_size;
+		};
+
+		struct Level {
+			VkImageView view = VK_NULL_HANDLE;
+			VkExtent2D extent{};
+			// Reads the level above, unused for level 0 which reads the depth attachment and with push
+			// descriptors
+			VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+		};
+
+		void create_pyramid();
+		void destroy_pyramid();
+		void create_pipeline_layout();
+
+		Device& device;
+		VkExtent2D depth_extent;
+		VkFormat depth_format;
+		VkExtent2D extent{};
+
+		VkImage image = VK_NULL_HANDLE;
+		Allocation image_memory;
+		VkImageView view = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		std::vector<Level> levels;
+		// Level 0 sets, per frame in flight since the depth attachment changes with the swapchain image
+		std::vector<VkDescriptorSet> depth_sets;
+
+		// With VK_KHR_push_descriptor every dispatch pushes its images and no sets are allocated
+		bool push_descriptors;
+		std::unique_ptr<DescriptorSetLayout> set_layout;
+		std::unique_ptr<DescriptorAllocator> descriptor_allocator;
+		VkPipelineLayout pipeline_layout;
+		std::unique_ptr<CullingPipeline> pipeline;
+	};
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "pch.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace game_engine {
+	// Deduplicates descriptor set layouts. Layouts are keyed by their flags and bindings, binding
+	// order does not matter, so systems that describe the same set share one VkDescriptorSetLayout and
+	// the pipeline layouts built from it stay compatible. The cache owns every layout. Thread safe.
+	class DescriptorSetLayoutCache {
+	public:
+		explicit DescriptorSetLayoutCache(VkDevice device);
+		~DescriptorSetLayoutCache();
+
+		DescriptorSetLayoutCache(const DescriptorSetLayoutCache&) = delete;
+		DescriptorSetLayoutCache& operator=(const DescriptorSetLayoutCache&) = delete;
+
+		// The only pNext structure understood is VkDescriptorSetLayoutBindingFlagsCreateInfo
+		VkDescriptorSetLayout get_layout(const VkDescriptorSetLayoutCreateInfo& create_info);
+
+		size_t get_layout_count() const;
+
+	private:
+		struct LayoutBinding {
+			VkDescriptorSetLayoutBinding binding;
+			VkDescriptorBindingFlags flags;
+		};
+
+		struct LayoutKey {
+			VkDescriptorSetLayoutCreateFlags flags = 0;
+			// Sorted by binding number
+			std::vector<LayoutBinding> bindings;
+
+			bool operator==(const LayoutKey& other) const;
+		};
+
+		struct LayoutKeyHash {
+			size_t operator()(const LayoutKey& key) const;
+		};
+
+		VkDevice device;
+
+		mutable std::mutex mutex;
+		std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> layouts;
+	};
+}
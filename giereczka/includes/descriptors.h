@@ -5,6 +5,7 @@
 #include <vulkan/vulkan.h>
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <cassert>
@@ -22,19 +23,24 @@ namespace game_engine {
 				VkShaderStageFlags stage_flags,
 				uint32_t count = 1
 			);
-
-
+			// VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR for sets written with DescriptorWriter::push
+			Builder& set_flags(VkDescriptorSetLayoutCreateFlags flags);
 
 			std::unique_ptr<DescriptorSetLayout> build() const;
 
 		private:
 			Device& device;
 			std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+			VkDescriptorSetLayoutCreateFlags flags = 0;
 		};
 
-		DescriptorSetLayout(Device& device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+		// The VkDescriptorSetLayout comes from the device's DescriptorSetLayoutCache, which owns it
+		DescriptorSetLayout(
+			Device& device,
+			std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+			VkDescriptorSetLayoutCreateFlags flags = 0
+		);
 
-		~DescriptorSetLayout();
 		DescriptorSetLayout(const DescriptorSetLayout&) = delete;
 		DescriptorSetLayout& operator=(const DescriptorSetLayout&) = delete;
 
@@ -91,18 +97,69 @@ namespace game_engine {
 		friend class DescriptorWriter;
 	};
 
+	// Growable descriptor allocator. Pool sizes are given per set, as ratios, and every pool it creates
+	// holds more sets than the last one, up to MAX_SETS_PER_POOL, so callers do not have to guess the
+	// totals up front. Pools that ran out are kept until reset(), which recycles all of them at once:
+	// give each frame in flight its own allocator for transient sets and reset it once the frame's fence
+	// has signaled. Thread safe.
+	class DescriptorAllocator {
+	public:
+		struct PoolSizeRatio {
+			VkDescriptorType type;
+			// Descriptors of this type per set
+			float ratio;
+		};
+
+		static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+		DescriptorAllocator(
+			Device& device,
+			uint32_t initial_sets,
+			std::vector<PoolSizeRatio> pool_ratios,
+			VkDescriptorPoolCreateFlags pool_flags = 0
+		);
+		~DescriptorAllocator();
+		DescriptorAllocator(const DescriptorAllocator&) = delete;
+		DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+		// Only fails when a brand new pool cannot fit the set either
+		bool allocate_descriptor(VkDescriptorSetLayout layout, VkDescriptorSet& descriptor);
+
+		// Every set allocated so far becomes invalid
+		void reset();
+
+		size_t get_pool_count() const;
+	private:
+		VkDescriptorPool get_pool();
+		VkDescriptorPool create_pool(uint32_t set_count) const;
+
+		Device& device;
+		std::vector<PoolSizeRatio> pool_ratios;
+		VkDescriptorPoolCreateFlags pool_flags;
+		uint32_t sets_per_pool;
+
+		mutable std::mutex mutex;
+		std::vector<VkDescriptorPool> ready_pools;
+		std::vector<VkDescriptorPool> full_pools;
+	};
+
 	class DescriptorWriter {
 	public:
-		DescriptorWriter(DescriptorSetLayout& set_layout, DescriptorPool& pool);
+		DescriptorWriter(DescriptorSetLayout& set_layout, DescriptorAllocator& allocator);
+		// Writer that can only push, see push()
+		explicit DescriptorWriter(DescriptorSetLayout& set_layout);
 
 		DescriptorWriter& write_buffer(uint32_t binding, VkDescriptorBufferInfo* buffer_info);
 		DescriptorWriter& write_image(uint32_t binding, VkDescriptorImageInfo* image_info);
 
 		bool build(VkDescriptorSet& set);
 		void overwrite(VkDescriptorSet set);
+		// Records the writes straight into the command buffer with VK_KHR_push_descriptor, no set is
+		// allocated. Needs Device::has_push_descriptors() and a layout built with the push descriptor flag.
+		void push(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set);
 	private:
 		DescriptorSetLayout& set_layout;
-		DescriptorPool& pool;
+		DescriptorAllocator* allocator;
 		std::vector<VkWriteDescriptorSet> writes;
 	};
 }
\ No newline at end of file
@@ -10,7 +10,7 @@
 namespace game_engine {
 	class MaterialDescriptor {
 	public:
-		MaterialDescriptor(Device& device, std::unique_ptr<DescriptorPool>& descriptor_pool);
+		MaterialDescriptor(Device& device, DescriptorAllocator& descriptor_allocator);
 
 		void write_texture(VkImageView image_view, VkSampler sampler, uint32_t index);
 
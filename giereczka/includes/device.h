@@ -1,6 +1,9 @@
 #pragma once
 
 #include "window.h"
+#include "memory_allocator.h"
+#include "pipeline_cache.h"
+#include "descriptor_set_layout_cache.h"
 
 #include <string>
 #include <vector>
@@ -9,6 +12,10 @@
 #include <unordered_set>
 
 namespace game_engine {
+	class UploadBatcher;
+	class PipelineStateCache;
+	class GeometryPool;
+
 	struct SwapChainSupportDetails {
 		VkSurfaceCapabilitiesKHR capabilities;
 		std::vector<VkSurfaceFormatKHR> formats;
@@ -18,11 +25,35 @@ namespace game_engine {
 	struct QueueFamilyIndices {
 		uint32_t graphics_family;
 		uint32_t present_family;
+		// A family without graphics support, so copies run alongside rendering. Optional.
+		uint32_t transfer_family;
 		bool graphics_family_has_value = false;
 		bool present_family_has_value = false;
+		bool transfer_family_has_value = false;
 		bool is_complete() { return graphics_family_has_value && present_family_has_value; }
 	};
 
+	// Fixed-function state that may be set while recording instead of being baked into pipelines.
+	// Each group is enabled when the device exposes the extension, the entry points are loaded for it.
+	struct ExtendedDynamicState {
+		// VK_EXT_extended_dynamic_state: cull mode, front face, topology, depth test, write and compare op
+		bool basic = false;
+		// VK_EXT_extended_dynamic_state2: depth bias enable and primitive restart enable
+		bool state2 = false;
+		// VK_EXT_extended_dynamic_state3, only the polygon mode feature is used
+		bool polygon_mode = false;
+
+		PFN_vkCmdSetCullModeEXT cmd_set_cull_mode = nullptr;
+		PFN_vkCmdSetFrontFaceEXT cmd_set_front_face = nullptr;
+		PFN_vkCmdSetPrimitiveTopologyEXT cmd_set_primitive_topology = nullptr;
+		PFN_vkCmdSetDepthTestEnableEXT cmd_set_depth_test_enable = nullptr;
+		PFN_vkCmdSetDepthWriteEnableEXT cmd_set_depth_write_enable = nullptr;
+		PFN_vkCmdSetDepthCompareOpEXT cmd_set_depth_compare_op = nullptr;
+		PFN_vkCmdSetDepthBiasEnableEXT cmd_set_depth_bias_enable = nullptr;
+		PFN_vkCmdSetPrimitiveRestartEnableEXT cmd_set_primitive_restart_enable = nullptr;
+		PFN_vkCmdSetPolygonModeEXT cmd_set_polygon_mode = nullptr;
+	};
+
 	class Device {
 	public:
 #ifdef NDEBUG
@@ -31,6 +62,8 @@ namespace game_engine {
 		const bool enable_validation_layers = true;
 #endif
 		Device(Window& window);
+		// Headless device: no surface, no swapchain extension, present queue aliases the graphics queue.
+		Device();
 		~Device();
 
 		Device(const Device&) = delete;
@@ -42,9 +75,13 @@ namespace game_engine {
 		VkSurfaceKHR get_surface();
 		VkQueue get_graphics_queue();
 		VkQueue get_present_queue();
+		// Aliases the graphics queue when there is no dedicated transfer family
+		VkQueue get_transfer_queue() { return transfer_queue; }
+		bool has_dedicated_transfer_queue() const { return transfer_queue != graphics_queue; }
 
 		VkInstance get_instance();
 		VkPhysicalDevice get_physical_device() { return physical_device; }
+		bool is_headless() const { return window == nullptr; }
 
 		SwapChainSupportDetails get_swap_chain_support();
 		uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties);
@@ -54,22 +91,36 @@ namespace game_engine {
 			VkImageTiling tiling,
 			VkFormatFeatureFlags features);
 
+		MemoryAllocator& get_memory_allocator() { return *memory_allocator; }
+		UploadBatcher& get_upload_batcher() { return *upload_batcher; }
+		GeometryPool& get_geometry_pool() { return *geometry_pool; }
+		PipelineCache& get_pipeline_cache() { return *pipeline_cache; }
+		PipelineStateCache& get_pipeline_state_cache() { return *pipeline_state_cache; }
+		const ExtendedDynamicState& get_extended_dynamic_state() const { return extended_dynamic_state; }
+		DescriptorSetLayoutCache& get_descriptor_set_layout_cache() { return *descriptor_set_layout_cache; }
+		// VK_KHR_push_descriptor, null when the device does not support it
+		PFN_vkCmdPushDescriptorSetKHR get_cmd_push_descriptor_set() const { return cmd_push_descriptor_set; }
+		bool has_push_descriptors() const { return cmd_push_descriptor_set != nullptr; }
+		// multiDrawIndirect and drawIndirectFirstInstance, what GPU-driven drawing needs at minimum
+		bool has_multi_draw_indirect() const { return multi_draw_indirect; }
+		// VK_KHR_draw_indirect_count, null when the device does not support it
+		PFN_vkCmdDrawIndexedIndirectCountKHR get_cmd_draw_indexed_indirect_count() const { return cmd_draw_indexed_indirect_count; }
+
+		// Memory comes from the suballocator, release it with get_memory_allocator().free()
 		void create_buffer(
 			VkDeviceSize size,
 			VkBufferUsageFlags usage,
 			VkMemoryPropertyFlags properties,
 			VkBuffer& buffer,
-			VkDeviceMemory& bufferMemory
+			Allocation& buffer_allocation
 		);
 		VkCommandBuffer begin_single_time_commands();
 		void end_single_time_commands(VkCommandBuffer command_buffer);
-		void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size);
-		void copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layer_count);
 		void create_image_with_info(
 			const VkImageCreateInfo& image_info,
 			VkMemoryPropertyFlags properties,
 			VkImage& image,
-			VkDeviceMemory& image_memory
+			Allocation& image_allocation
 		);
 		VkPhysicalDeviceProperties properties;
 
@@ -90,23 +141,36 @@ namespace game_engine {
 		bool check_device_extension_support(VkPhysicalDevice device);
 		SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device);
 		bool check_descriptor_indexing_support(VkPhysicalDevice device);
+		void load_extended_dynamic_state();
 
 		VkInstance instance;
 		VkDebugUtilsMessengerEXT debug_messenger;
 		VkPhysicalDevice physical_device = VK_NULL_HANDLE;
-		Window& window;
+		Window* window = nullptr;
 		VkCommandPool command_pool;
 
 		VkDevice device_;
-		VkSurfaceKHR surface_;
+		VkSurfaceKHR surface_ = VK_NULL_HANDLE;
 		VkQueue graphics_queue;
 		VkQueue present_queue;
+		VkQueue transfer_queue;
+
+		std::unique_ptr<MemoryAllocator> memory_allocator;
+		std::unique_ptr<UploadBatcher> upload_batcher;
+		std::unique_ptr<GeometryPool> geometry_pool;
+		std::unique_ptr<PipelineCache> pipeline_cache;
+		std::unique_ptr<PipelineStateCache> pipeline_state_cache;
+		std::unique_ptr<DescriptorSetLayoutCache> descriptor_set_layout_cache;
+		ExtendedDynamicState extended_dynamic_state;
+		PFN_vkCmdPushDescriptorSetKHR cmd_push_descriptor_set = nullptr;
+		bool multi_draw_indirect = false;
+		PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count = nullptr;
 
 		const std::vector<const char*> validation_layers = {
 			"VK_LAYER_KHRONOS_validation"
 		};
 
-		const std::vector<const char*> device_extensions = {
+		std::vector<const char*> device_extensions = {
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 			VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
 		};
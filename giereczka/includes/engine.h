@@ -24,6 +24,10 @@
 #include "descriptors/material_descriptor.h"
 #include "systems/texture_manager_system.h"
 #include "systems/raytracing_render_system.h"
+#include "scenes/default_scene.h"
+#include "job_system.h"
+#include "system_scheduler.h"
+#include "thread_command_pools.h"
 
 namespace game_engine {
 	class Engine {
@@ -47,10 +51,13 @@ namespace game_engine {
 		Window window{WIDTH, HEIGHT, "Vulkan"};
 		Device device{window};
 		Renderer renderer{window, device};
+		JobSystem job_system;
+		ThreadCommandPools command_pools{device, SwapChain::MAX_FRAMES_IN_FLIGHT, job_system.get_thread_count()};
 		ObjectManagerSystem object_manager_system;
 		DebugUI debug_ui{window.get_window(), device};
 
-		std::unique_ptr<DescriptorPool> global_descriptor_pool;
+		std::unique_ptr<DescriptorAllocator> global_descriptor_allocator;
+		std::unique_ptr<DescriptorAllocator> materials_descriptor_allocator;
 		std::unique_ptr<DescriptorSetLayout> global_descriptor_set_layout;
 		std::unique_ptr<DescriptorSetLayout> joint_descriptor_set_layout;
 		std::unique_ptr<DescriptorSetLayout> materials_descriptor_set_layout;
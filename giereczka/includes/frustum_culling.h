@@ -0,0 +1,51 @@
+#pragma once
+
+#include "pch.h"
+
+#include "bounds.h"
+
+namespace game_engine {
+	enum class CullingKernel {
+		scalar,
+		// AVX2, SSE2 or NEON depending on what the engine was compiled for, scalar without any of them
+		simd
+	};
+
+	// World space boxes kept as structure of arrays (centers and extents per axis) so the SIMD kernels
+	// can test a batch of BATCH_SIZE boxes against all six planes with plain vector loads. The arrays
+	// are padded to whole batches, refill them with clear() and add() whenever objects move.
+	class FrustumCuller {
+	public:
+		static constexpr uint32_t BATCH_SIZE = 8;
+
+		void clear();
+		void reserve(size_t count);
+
+		// Returns the index cull() reports the box under, boxes are numbered in the order they are added
+		uint32_t add(const BoundingBox& world_box);
+		size_t size() const { return count; }
+
+		// Appends the indices of the boxes inside or intersecting the frustum to visible, in ascending
+		// order. Planes point inwards and are normalized, see Camera::get_frustum_planes.
+		void cull(
+			const std::array<glm::vec4, 6>& planes,
+			std::vector<uint32_t>& visible,
+			CullingKernel kernel = CullingKernel::simd
+		) const;
+
+		// Instruction set behind CullingKernel::simd
+		static const char* get_simd_name();
+
+	private:
+		void cull_scalar(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible) const;
+		void cull_simd(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible) const;
+
+		size_t count = 0;
+		std::vector<float> center_x;
+		std::vector<float> center_y;
+		std::vector<float> center_z;
+		std::vector<float> extent_x;
+		std::vector<float> extent_y;
+		std::vector<float> extent_z;
+	};
+}
@@ -43,6 +43,13 @@ namespace game_engine {
 		}
 	};
 
+	// What RenderSystem and GpuCullingSystem draw a game object with
+	struct RenderComponent {
+		std::shared_ptr<GltfModel> gltf_model;
+		glm::vec3 color{};
+	};
+
+	// Describes a game object to ObjectManagerSystem::add_game_object, which splits it into components
 	class GameObject {
 	public:
         GameObject();
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "pch.h"
+
+#include "device.h"
+#include "buffer.h"
+#include "descriptors.h"
+#include "tlsf_allocator.h"
+
+#include <atomic>
+#include <mutex>
+#include <span>
+
+namespace game_engine {
+	// Where a mesh lives in the geometry pool, in elements rather than bytes so the values can be
+	// passed straight to vkCmdDrawIndexed as vertexOffset and firstIndex. vertex_offset counts vertices
+	// of the mesh's own stride, shaders find a vertex at gl_VertexIndex * vertex_stride bytes.
+	// first_index is in the index buffer of index_type. Meshes with meshlets (see allocate_meshlets)
+	// have meshlet_count of them from first_meshlet on in the meshlet buffer.
+	struct GeometryAllocation {
+		uint32_t vertex_handle = TlsfAllocator::INVALID_HANDLE;
+		uint32_t index_handle = TlsfAllocator::INVALID_HANDLE;
+		uint32_t meshlet_handle = TlsfAllocator::INVALID_HANDLE;
+		int32_t vertex_offset = 0;
+		uint32_t vertex_stride = 0;
+		uint32_t vertex_count = 0;
+		uint32_t first_index = 0;
+		uint32_t index_count = 0;
+		VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+		uint32_t first_meshlet = 0;
+		uint32_t meshlet_count = 0;
+
+		bool is_valid() const { return vertex_handle != TlsfAllocator::INVALID_HANDLE; }
+	};
+
+	// Meshlet as the culling shaders read it, mirrored by Meshlet in cull_meshlets.comp (std430)
+	struct GpuMeshlet {
+		// Center in xyz and radius in w, in the space of the mesh's quantized positions like
+		// Model::get_quantized_bounding_sphere
+		glm::vec4 bounding_sphere{0.f};
+		// Axis in xyz and cutoff in w, see Meshlet
+		glm::vec4 cone{0.f, 0.f, 1.f, 1.f};
+		// Absolute, in the index buffer of the mesh's index type
+		uint32_t first_index = 0;
+		uint32_t triangle_count = 0;
+		uint32_t padding[2]{};
+	};
+
+	struct GeometryPoolStatistics {
+		// In bytes, meshes have different vertex formats
+		VkDeviceSize vertex_capacity = 0;
+		VkDeviceSize vertex_bytes_used = 0;
+		VkDeviceSize index16_capacity = 0;
+		VkDeviceSize index16_used = 0;
+		VkDeviceSize index32_capacity = 0;
+		VkDeviceSize index32_used = 0;
+		VkDeviceSize meshlet_capacity = 0;
+		VkDeviceSize meshlets_used = 0;
+		uint32_t allocation_count = 0;
+	};
+
+	// One vertex buffer and two index buffers shared by every mesh, suballocated with TlsfAllocator.
+	// Indices are relative to the mesh's first vertex, so every mesh with fewer than 65536 vertices gets
+	// 16-bit indices and only larger ones need the 32-bit buffer.
+	// Vertices are not bound as vertex attributes: shaders read them from a storage buffer indexed by
+	// gl_VertexIndex (vertex pulling), so drawing any mesh only needs the offsets in its
+	// GeometryAllocation and the pool is bound once per command buffer. The vertex buffer is untyped,
+	// every mesh brings its own stride (see vertex_format.h).
+	// A buffer that runs out of space is replaced by one at least twice as large, which waits for the
+	// device to go idle and copies the old contents over on the graphics queue. Allocating is thread
+	// safe, but an allocation that grows the pool has to come from the thread that submits frames, like
+	// UploadBatcher::flush; assets are loaded there. Sets written with the buffers must be rewritten
+	// once get_generation changes.
+	class GeometryPool {
+	public:
+		static constexpr VkDeviceSize DEFAULT_VERTEX_CAPACITY = 16 * 1024 * 1024;
+		static constexpr VkDeviceSize DEFAULT_INDEX16_CAPACITY = 4 * 1024 * 1024;
+		static constexpr VkDeviceSize DEFAULT_INDEX32_CAPACITY = 1024 * 1024;
+		static constexpr VkDeviceSize DEFAULT_MESHLET_CAPACITY = 64 * 1024;
+
+		// Initial capacities, vertex capacity is in bytes, the others in elements
+		GeometryPool(
+			Device& device,
+			VkDeviceSize vertex_capacity = DEFAULT_VERTEX_CAPACITY,
+			VkDeviceSize index16_capacity = DEFAULT_INDEX16_CAPACITY,
+			VkDeviceSize index32_capacity = DEFAULT_INDEX32_CAPACITY,
+			VkDeviceSize meshlet_capacity = DEFAULT_MESHLET_CAPACITY
+		);
+		~GeometryPool();
+
+		GeometryPool(const GeometryPool&) = delete;
+		GeometryPool& operator=(const GeometryPool&) = delete;
+
+		// Uploads through the device's UploadBatcher. vertex_stride is in bytes and a multiple of 4, the
+		// vertices start at a multiple of it. Indices are relative to the mesh's first vertex and narrowed
+		// to 16 bits when they fit, index_count may be 0 for non-indexed meshes.
+		GeometryAllocation allocate(
+			const void* vertices,
+			uint32_t vertex_count,
+			uint32_t vertex_stride,
+			const uint32_t* indices,
+			uint32_t index_count
+		);
+		// Adds the meshlets of an allocated mesh, with first_index already made absolute. Meshlets are
+		// optional, meshes without them are culled and drawn whole.
+		void allocate_meshlets(GeometryAllocation& allocation, std::span<const GpuMeshlet> meshlets);
+		// The GPU must be done with the allocation
+		void free(GeometryAllocation& allocation);
+
+		// Storage buffer with every vertex at binding 0, for the vertex stage. Shaders read it as uints.
+		VkDescriptorSetLayout get_descriptor_set_layout() const { return descriptor_set_layout->get_descriptor_set_layout(); }
+		VkDescriptorSet get_descriptor_set() const { return descriptor_set; }
+		VkBuffer get_vertex_buffer() const { return vertex_buffer->get_buffer(); }
+		VkBuffer get_index_buffer(VkIndexType index_type) const;
+		// For compute passes reading the meshlets and indices as storage buffers
+		VkDescriptorBufferInfo get_meshlet_buffer_info() const { return meshlet_buffer->descriptor_info(); }
+		VkDescriptorBufferInfo get_index_buffer_info(VkIndexType index_type) const;
+
+		// Binds the vertex set and the 16-bit index buffer, call after binding a pipeline using set as the
+		// pool's set
+		void bind(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t set) const;
+		// Switches between the index buffers, Model::draw binds the one of its mesh
+		void bind_index_buffer(VkCommandBuffer command_buffer, VkIndexType index_type) const;
+
+		// Changes every time the pool replaces one of its buffers, its own descriptor set is rewritten
+		uint32_t get_generation() const { return generation; }
+
+		GeometryPoolStatistics get_statistics() const;
+		void print_statistics(std::ostream& out) const;
+
+	private:
+		// Replaces buffer with one large enough for required more units of allocator, unit_size bytes
+		// each. Called with the mutex held.
+		void grow(std::unique_ptr<Buffer>& buffer, TlsfAllocator& allocator, VkDeviceSize unit_size, VkDeviceSize required);
+
+		Device& device;
+
+		std::unique_ptr<Buffer> vertex_buffer;
+		std::unique_ptr<Buffer> index16_buffer;
+		std::unique_ptr<Buffer> index32_buffer;
+		std::unique_ptr<Buffer> meshlet_buffer;
+
+		std::unique_ptr<DescriptorSetLayout> descriptor_set_layout;
+		std::unique_ptr<DescriptorAllocator> descriptor_allocator;
+		VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+
+		mutable std::mutex mutex;
+		TlsfAllocator vertex_allocator;
+		TlsfAllocator index16_allocator;
+		TlsfAllocator index32_allocator;
+		TlsfAllocator meshlet_allocator;
+		std::atomic<uint32_t> generation{0};
+	};
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "device.h"
+#include "swapchain.h"
+#include "descriptors.h"
+
+#include <memory>
+#include <vector>
+#include <cassert>
+
+namespace game_engine {
+	struct CapturedFrame {
+		uint64_t frame_number;
+		uint32_t width;
+		uint32_t height;
+		std::vector<uint8_t> rgba;
+	};
+
+	// Renders into offscreen VkImage targets instead of swapchain images, so the engine can run
+	// on machines without a display (CI, render farm nodes, software ICDs such as lavapipe).
+	// Mirrors the Renderer interface and adds GPU timestamps and color target readback.
+	class HeadlessRenderer {
+	public:
+		static constexpr int MAX_FRAMES_IN_FLIGHT = SwapChain::MAX_FRAMES_IN_FLIGHT;
+		static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+		HeadlessRenderer(Device& device, VkExtent2D extent);
+		~HeadlessRenderer();
+
+		HeadlessRenderer(const HeadlessRenderer&) = delete;
+		HeadlessRenderer& operator=(const HeadlessRenderer&) = delete;
+
+		VkRenderPass get_render_pass() const { return render_pass; }
+		// Loads color and depth instead of clearing them, see SwapChain::get_load_render_pass
+		VkRenderPass get_load_render_pass() const { return load_render_pass; }
+		VkExtent2D get_extent() const { return extent; }
+		VkFormat get_depth_format() const { return depth_format; }
+		float get_aspect_ratio() const;
+		bool is_frame_in_progress() const;
+
+		VkCommandBuffer get_current_command_buffer() const;
+		VkFramebuffer get_current_framebuffer() const;
+		VkImage get_current_depth_image() const;
+		VkImageView get_current_depth_image_view() const;
+
+		int get_frame_index() const;
+		uint64_t get_frame_number() const { return frame_number; }
+		// Sets allocated here are valid until this frame index comes around again
+		DescriptorAllocator& get_frame_descriptor_allocator() const { return *frame_descriptor_allocators[current_frame_index]; }
+
+		VkCommandBuffer begin_frame();
+
+		void end_frame();
+		void begin_render_pass(VkCommandBuffer command_buffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+		// Begins get_load_render_pass, with depth in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+		void continue_render_pass(VkCommandBuffer command_buffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+		void end_render_pass(VkCommandBuffer command_buffer);
+
+		// Copies the color target of the frame currently being recorded to host memory once it completes
+		void request_capture();
+		// Waits for every submitted frame and collects its timestamps and captures
+		void wait_idle();
+
+		bool has_gpu_timestamps() const { return timestamps_supported; }
+		// GPU time of each completed frame in milliseconds, indexed by frame number, negative when unknown
+		const std::vector<double>& get_gpu_frame_times() const { return gpu_frame_times; }
+		// Time the last begin_frame() spent blocked on the GPU, in milliseconds
+		double get_last_fence_wait_ms() const { return last_fence_wait_ms; }
+		std::vector<CapturedFrame>& get_captured_frames() { return captured_frames; }
+
+	private:
+		struct FrameTarget {
+			VkImage color_image;
+			Allocation color_image_memory;
+			VkImageView color_image_view;
+			VkImage depth_image;
+			Allocation depth_image_memory;
+			VkImageView depth_image_view;
+			VkFramebuffer framebuffer;
+
+			VkFence in_flight_fence;
+			VkBuffer readback_buffer;
+			Allocation readback_buffer_memory;
+			void* readback_mapped;
+
+			bool pending = false;
+			bool capture = false;
+			uint64_t submitted_frame = 0;
+		};
+
+		static constexpr uint32_t FRAME_DESCRIPTOR_SETS = 64;
+
+		VkFormat find_depth_format();
+		void create_render_pass();
+		void create_frame_targets();
+		void create_command_buffers();
+		void create_frame_descriptor_allocators();
+		void create_query_pool();
+		void collect_frame(FrameTarget& target);
+		void begin_render_pass(VkCommandBuffer command_buffer, VkRenderPass pass, VkSubpassContents contents);
+
+		Device& device;
+		VkExtent2D extent;
+		VkFormat depth_format;
+
+		VkRenderPass render_pass;
+		VkRenderPass load_render_pass;
+		std::array<FrameTarget, MAX_FRAMES_IN_FLIGHT> frame_targets;
+		std::vector<VkCommandBuffer> command_buffers;
+		std::vector<std::unique_ptr<DescriptorAllocator>> frame_descriptor_allocators;
+
+		bool timestamps_supported = false;
+		uint64_t timestamp_mask = ~0ull;
+		VkQueryPool query_pool = VK_NULL_HANDLE;
+
+		std::vector<double> gpu_frame_times;
+		std::vector<CapturedFrame> captured_frames;
+		double last_fence_wait_ms = 0.0;
+
+		uint64_t frame_number = 0;
+		int current_frame_index = 0;
+		bool is_frame_started = false;
+	};
+}
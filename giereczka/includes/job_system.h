@@ -0,0 +1,116 @@
+#pragma once
+
+#include "pch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+
+namespace game_engine {
+	class JobSystem;
+
+	// A scheduled unit of work. It becomes runnable once all of its dependencies have finished; a job
+	// whose dependency threw is skipped and carries that exception on to its own dependents.
+	class Job {
+	public:
+		bool is_finished() const { return finished.load(); }
+
+	private:
+		friend class JobSystem;
+
+		std::function<void(uint32_t)> function;
+		// Starts at one so the job cannot run before schedule() has registered all its dependencies
+		std::atomic<uint32_t> pending_dependencies{1};
+		std::atomic<bool> finished{false};
+
+		std::mutex mutex;
+		std::vector<std::shared_ptr<Job>> dependents;
+		std::exception_ptr exception;
+	};
+
+	using JobHandle = std::shared_ptr<Job>;
+
+	// Work-stealing scheduler. Every worker owns a deque: it pushes and pops its own jobs at the back,
+	// which keeps freshly spawned work in cache, and idle workers steal the oldest jobs from the front
+	// of the others. The thread that created the job system takes part as worker 0 whenever it waits,
+	// so a job system of one thread runs everything inline.
+	class JobSystem {
+	public:
+		using JobFunction = std::function<void(uint32_t worker_index)>;
+		using RangeFunction = std::function<void(uint32_t worker_index, size_t begin, size_t end)>;
+
+		explicit JobSystem(uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency()));
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		uint32_t get_thread_count() const { return thread_count; }
+		// Index of the calling worker, 0 for the thread that owns the job system. Per-thread resources
+		// such as command pools are indexed by it.
+		uint32_t get_worker_index() const;
+
+		// Runs function once every job in dependencies has finished. Null handles are ignored.
+		JobHandle schedule(JobFunction function, std::span<const JobHandle> dependencies = {});
+
+		// Long running work that frames must never wait behind, such as pipeline compilation. Only the
+		// helper threads run it, and only when they have no regular jobs, so the owning thread never
+		// picks it up while waiting on a frame. Without helper threads it runs inline.
+		JobHandle schedule_background(JobFunction function);
+
+		// Splits [0, count) into ranges of at most grain_size items, one job each. The returned handle
+		// finishes when every range is done.
+		JobHandle schedule_parallel_for(
+			size_t count,
+			size_t grain_size,
+			RangeFunction function,
+			std::span<const JobHandle> dependencies = {}
+		);
+
+		// Executes queued jobs on the calling thread until job has finished, then rethrows the exception
+		// it failed with, if any. Safe to call from inside a job.
+		void wait(const JobHandle& job);
+
+		// Blocking parallel_for. function is never called with an empty range; without a grain size the
+		// range is split into a few chunks per worker so stealing can even out uneven items.
+		void parallel_for(size_t count, size_t grain_size, const RangeFunction& function);
+		void parallel_for(size_t count, const RangeFunction& function);
+
+		size_t default_grain_size(size_t count) const;
+
+	private:
+		struct WorkerQueue {
+			std::mutex mutex;
+			std::deque<JobHandle> jobs;
+		};
+
+		void worker_loop(uint32_t worker_index);
+		JobHandle find_job(uint32_t worker_index);
+		JobHandle find_background_job();
+		void push(uint32_t worker_index, JobHandle job);
+		void release(uint32_t worker_index, JobHandle job);
+		void execute(uint32_t worker_index, const JobHandle& job);
+		void finish(uint32_t worker_index, const JobHandle& job);
+		static void inherit_exception(Job& job, const std::exception_ptr& exception);
+
+		uint32_t thread_count;
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<WorkerQueue>> queues;
+		WorkerQueue background_queue;
+
+		std::atomic<uint32_t> queued_jobs{0};
+		std::atomic<uint32_t> queued_background_jobs{0};
+		std::atomic<uint32_t> waiting_threads{0};
+
+		std::mutex sleep_mutex;
+		std::condition_variable work_available;
+		std::condition_variable job_finished;
+		bool stopping = false;
+	};
+}
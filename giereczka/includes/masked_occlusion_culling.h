@@ -0,0 +1,119 @@
+#pragma once
+
+#include "pch.h"
+
+#include "bounds.h"
+#include "job_system.h"
+#include "model.h"
+
+namespace game_engine {
+	// Per frame counters of the software occlusion pass, zero while it is not running
+	struct OcclusionCullingStatistics {
+		uint32_t occluders = 0;
+		uint32_t occluder_triangles = 0;
+		uint32_t tested = 0;
+		uint32_t occluded = 0;
+		double rasterize_ms = 0.0;
+		double test_ms = 0.0;
+	};
+
+	// Software occlusion culling after "Masked Software Occlusion Culling" (Hasselgren, Andersson and
+	// Akenine-Moller). A few large occluders are rasterized into a low resolution buffer of 8x8 pixel
+	// tiles. A tile does not keep per pixel depth: it keeps a reference layer, the farthest depth over the
+	// whole tile, and a working layer, a coverage mask with the farthest depth of the triangles that set
+	// it. Once the mask is full the working layer replaces the reference one. Every stored depth is an
+	// upper bound of what lies in front of it, so a box whose nearest depth is behind it is hidden.
+	//
+	// The buffer is split into bands of tile rows and every band is rasterized by its own job, so tiles
+	// are never shared between threads. Coverage masks come from the AVX2, SSE2 or NEON kernel the
+	// engine was compiled for, like FrustumCuller.
+	class MaskedOcclusionCuller {
+	public:
+		static constexpr uint32_t TILE_SIZE = 8;
+		static constexpr uint32_t DEFAULT_WIDTH = 256;
+		static constexpr uint32_t DEFAULT_HEIGHT = 144;
+
+		// Multiples of TILE_SIZE
+		explicit MaskedOcclusionCuller(uint32_t width = DEFAULT_WIDTH, uint32_t height = DEFAULT_HEIGHT);
+
+		MaskedOcclusionCuller(const MaskedOcclusionCuller&) = delete;
+		MaskedOcclusionCuller& operator=(const MaskedOcclusionCuller&) = delete;
+
+		uint32_t get_width() const { return width; }
+		uint32_t get_height() const { return height; }
+
+		// Clears the buffer and the queued occluders. Depth goes from 0 at the near plane to 1 at the far
+		// one, as with Camera's projections.
+		void begin_frame(const glm::mat4& view_projection);
+
+		// Queues the triangles of model for render_occluders. They have to be where the model is drawn,
+		// skinned meshes only are in their bind pose. The model has to outlive render_occluders.
+		void add_occluder(const Model& model, const glm::mat4& model_matrix);
+		uint32_t get_occluder_count() const { return static_cast<uint32_t>(occluders.size()); }
+		uint32_t get_occluder_triangle_count() const { return occluder_triangle_count; }
+
+		// Rasterizes the queued occluders, blocks until every band is done
+		void render_occluders(JobSystem& job_system);
+
+		// False when every pixel the box covers on screen has an occluder in front of the box. Boxes
+		// crossing the near plane are always visible. Safe to call from several threads once
+		// render_occluders returned.
+		bool is_visible(const BoundingBox& world_box) const;
+
+		// Instruction set behind the coverage masks
+		static const char* get_simd_name();
+
+	private:
+		// Tile rows rasterized by one job
+		static constexpr uint32_t BAND_HEIGHT = 2;
+		// Triangles reaching this far outside the buffer are dropped instead of risking float precision in
+		// their edge functions, leaving out an occluder only makes culling less effective
+		static constexpr float GUARD_BAND = 4096.f;
+
+		struct Occluder {
+			const Model* model;
+			glm::mat4 model_view_projection;
+			uint32_t first_triangle;
+		};
+
+		// Screen space triangle with counter-clockwise edges, inside where all three edge functions
+		// a * x + b * y + c are non-negative
+		struct Triangle {
+			std::array<glm::vec3, 3> edges;
+			// Depth at x = y = 0 and its x and y slopes
+			glm::vec3 depth_plane;
+			float min_depth;
+			float max_depth;
+			// Inclusive tile range, empty for dropped triangles
+			int min_tile_x;
+			int min_tile_y;
+			int max_tile_x;
+			int max_tile_y;
+		};
+
+		struct Tile {
+			// Bit y * TILE_SIZE + x for pixel (x, y) of the tile
+			uint64_t mask;
+			// Reference layer, bounds every pixel of the tile
+			float z_max0;
+			// Working layer, bounds the pixels in mask
+			float z_max1;
+		};
+
+		void setup_triangles(const Occluder& occluder);
+		void rasterize_band(uint32_t first_tile_row, uint32_t end_tile_row);
+		static void update_tile(Tile& tile, uint64_t coverage, float depth);
+		static uint64_t compute_coverage(const Triangle& triangle, float tile_x, float tile_y);
+
+		uint32_t width;
+		uint32_t height;
+		uint32_t tiles_x;
+		uint32_t tiles_y;
+		glm::mat4 view_projection{1.f};
+
+		std::vector<Tile> tiles;
+		std::vector<Occluder> occluders;
+		std::vector<Triangle> triangles;
+		uint32_t occluder_triangle_count = 0;
+	};
+}
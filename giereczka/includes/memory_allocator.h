@@ -0,0 +1,130 @@
+#pragma once
+
+#include "pch.h"
+
+#include "tlsf_allocator.h"
+
+#include <mutex>
+#include <ostream>
+
+namespace game_engine {
+	class MemoryBlock;
+
+	// Which block pool a resource is placed in. Linear resources (buffers, linear images) and optimal
+	// images never share a VkDeviceMemory block, so bufferImageGranularity can never be violated
+	// between neighbours and needs no padding.
+	enum class MemoryResourceKind : uint32_t {
+		linear,
+		optimal_image,
+		count
+	};
+
+	struct Allocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// Start of the allocation when the memory type is host visible, blocks stay mapped for their whole lifetime
+		void* mapped = nullptr;
+		uint32_t memory_type = 0;
+
+		bool is_valid() const { return memory != VK_NULL_HANDLE; }
+		bool is_dedicated() const { return block == nullptr && memory != VK_NULL_HANDLE; }
+
+	private:
+		friend class MemoryAllocator;
+
+		MemoryBlock* block = nullptr;
+		uint32_t handle = TlsfAllocator::INVALID_HANDLE;
+	};
+
+	struct MemoryTypeStatistics {
+		uint32_t memory_type = 0;
+		VkMemoryPropertyFlags property_flags = 0;
+		uint32_t block_count = 0;
+		VkDeviceSize block_bytes = 0;
+		uint32_t allocation_count = 0;
+		VkDeviceSize allocated_bytes = 0;
+		uint32_t dedicated_count = 0;
+		VkDeviceSize dedicated_bytes = 0;
+	};
+
+	struct MemoryStatistics {
+		// Live VkDeviceMemory objects, blocks plus dedicated allocations, against maxMemoryAllocationCount
+		uint32_t device_memory_count = 0;
+		uint32_t max_memory_allocation_count = 0;
+		uint32_t block_count = 0;
+		VkDeviceSize block_bytes = 0;
+		uint32_t allocation_count = 0;
+		VkDeviceSize allocated_bytes = 0;
+		uint32_t dedicated_count = 0;
+		VkDeviceSize dedicated_bytes = 0;
+		// vkAllocateMemory calls since startup, what the suballocation saves
+		uint64_t total_device_allocations = 0;
+		std::vector<MemoryTypeStatistics> memory_types;
+	};
+
+	// Suballocates buffers and images from large VkDeviceMemory blocks, one set of blocks per memory
+	// type and resource kind, placed with a TLSF allocator. Blocks grow geometrically up to a size
+	// derived from the heap. Resources the driver wants on their own memory, and those too large to
+	// share a block, get a dedicated allocation. Thread safe.
+	class MemoryAllocator {
+	public:
+		static constexpr VkDeviceSize MAX_BLOCK_SIZE = 256ull * 1024 * 1024;
+		// Images at least this large always get their own memory
+		static constexpr VkDeviceSize DEDICATED_IMAGE_SIZE = 16ull * 1024 * 1024;
+
+		MemoryAllocator(VkPhysicalDevice physical_device, VkDevice device, const VkPhysicalDeviceLimits& limits);
+		~MemoryAllocator();
+
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+		// Allocate memory for the resource and bind it
+		Allocation allocate_buffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+		Allocation allocate_image(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties);
+		void free(Allocation& allocation);
+
+		// Ranges are relative to the allocation. No-ops on host coherent memory.
+		VkResult flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		VkResult invalidate(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+		uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+		const VkPhysicalDeviceMemoryProperties& get_memory_properties() const { return memory_properties; }
+
+		MemoryStatistics get_statistics() const;
+		void print_statistics(std::ostream& out) const;
+
+	private:
+		Allocation allocate(
+			const VkMemoryRequirements& requirements,
+			VkMemoryPropertyFlags properties,
+			MemoryResourceKind kind,
+			bool dedicated,
+			VkBuffer dedicated_buffer,
+			VkImage dedicated_image
+		);
+		Allocation allocate_dedicated(
+			const VkMemoryRequirements& requirements,
+			uint32_t memory_type,
+			VkBuffer dedicated_buffer,
+			VkImage dedicated_image
+		);
+		MemoryBlock* create_block(uint32_t memory_type, MemoryResourceKind kind, VkDeviceSize minimum_size);
+		VkDeviceSize preferred_block_size(uint32_t memory_type) const;
+		bool is_host_visible(uint32_t memory_type) const;
+		bool is_non_coherent(uint32_t memory_type) const;
+		VkMappedMemoryRange mapped_range(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+		VkDevice device;
+		VkPhysicalDeviceMemoryProperties memory_properties{};
+		VkDeviceSize non_coherent_atom_size;
+		uint32_t max_memory_allocation_count;
+
+		mutable std::mutex mutex;
+		// Indexed by memory type * MemoryResourceKind::count + kind
+		std::vector<std::vector<std::unique_ptr<MemoryBlock>>> pools;
+		std::vector<uint32_t> dedicated_counts;
+		std::vector<VkDeviceSize> dedicated_bytes;
+		uint64_t total_device_allocations = 0;
+	};
+}
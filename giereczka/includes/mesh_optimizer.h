@@ -0,0 +1,65 @@
+#pragma once
+
+#include "pch.h"
+
+#include <span>
+
+namespace game_engine {
+	// Post-transform vertex cache efficiency of a triangle list under a FIFO cache, the model most GPUs
+	// come closest to
+	struct VertexCacheStatistics {
+		// Average cache miss ratio, vertex shader invocations per triangle. 0.5 is the best a large
+		// regular grid can do, 3 means no reuse at all.
+		float acmr = 0.f;
+		// Average transform to vertex ratio, vertex shader invocations per referenced vertex. 1 is
+		// optimal.
+		float atvr = 0.f;
+	};
+
+	constexpr uint32_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+	VertexCacheStatistics analyze_vertex_cache(
+		std::span<const uint32_t> indices,
+		size_t vertex_count,
+		uint32_t cache_size = DEFAULT_VERTEX_CACHE_SIZE
+	);
+
+	// Reorders triangles for vertex cache locality after "Linear-Speed Vertex Cache Optimisation" (Tom
+	// Forsyth). Triangles are emitted greedily by the scores of their vertices, which favour vertices
+	// recently used in a simulated LRU cache and vertices with few triangles left.
+	std::vector<uint32_t> optimize_vertex_cache(std::span<const uint32_t> indices, size_t vertex_count);
+
+	// Reorders a vertex cache optimized triangle list to reduce overdraw, after "Fast Triangle Reordering
+	// for Vertex Locality and Reduced Overdraw" (Sander, Nehab and Barczak). The list is cut into
+	// clusters wherever the cache would start cold anyway, or where a cluster starting cold still has an
+	// ACMR within threshold of the whole list. Clusters then go front to back by how far they face away
+	// from the mesh's center, so the outside of a convex-ish mesh is drawn before what it hides.
+	std::vector<uint32_t> optimize_overdraw(
+		std::span<const uint32_t> indices,
+		std::span<const glm::vec3> positions,
+		float threshold = 1.05f
+	);
+
+	// Finds bitwise identical vertices with an open addressing hash table. Returns the new index of every
+	// vertex: the first copy of each keeps its relative order, later copies share its index. unique_count
+	// receives how many vertices remain. vertex_size must be a multiple of 4 and the vertex free of padding.
+	std::vector<uint32_t> weld_vertices_remap(const void* vertices, size_t vertex_count, size_t vertex_size, size_t& unique_count);
+
+	// Renumbers vertices in order of first use so vertex fetches walk memory forward, rewriting indices in
+	// place. Returns the new position of every old vertex, unreferenced vertices go last.
+	std::vector<uint32_t> optimize_vertex_fetch_remap(std::span<uint32_t> indices, size_t vertex_count);
+
+	// Moves vertices to the positions given by optimize_vertex_fetch_remap or weld_vertices_remap. After
+	// welding only the first unique_count vertices are meaningful.
+	template<typename Vertex>
+	void remap_vertices(std::span<Vertex> vertices, std::span<const uint32_t> remap)
+	{
+		assert(vertices.size() == remap.size() && "Remap table does not match the vertices");
+
+		std::vector<Vertex> original(vertices.begin(), vertices.end());
+		for (size_t vertex = 0; vertex < original.size(); vertex++)
+		{
+			vertices[remap[vertex]] = original[vertex];
+		}
+	}
+}
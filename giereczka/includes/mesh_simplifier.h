@@ -0,0 +1,23 @@
+#pragma once
+
+#include "pch.h"
+
+#include <span>
+
+namespace game_engine {
+	// Quadric error metric simplification (Garland and Heckbert) by edge collapses onto existing
+	// vertices, so the result indexes the same vertex buffer as its input and only needs a new index
+	// range. Vertices on borders, attribute seams (split vertices sharing a position) and non-manifold
+	// edges never move, which keeps UVs and normals intact at the cost of simplifying less there.
+	//
+	// Returns a triangle list of at most target_index_count indices unless that would move the surface
+	// further than target_error, in units of positions; then it stops early. error receives the largest
+	// error of the collapses made.
+	std::vector<uint32_t> simplify_mesh(
+		std::span<const glm::vec3> positions,
+		std::span<const uint32_t> indices,
+		size_t target_index_count,
+		float target_error,
+		float* error = nullptr
+	);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pch.h"
+
+#include <span>
+
+namespace game_engine {
+	// Sizes the GPU culling pass is tuned for, one meshlet's triangles fit one 64 thread workgroup's
+	// copy loop and 124 triangles leave room for per triangle data in mesh shader style output
+	constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+	constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+	// A run of consecutive triangles of a mesh's index buffer
+	struct Meshlet {
+		// Relative to the index list it was built from
+		uint32_t first_index = 0;
+		uint32_t triangle_count = 0;
+		uint32_t vertex_count = 0;
+		// Center in xyz, radius in w, in the space of the positions it was built from
+		glm::vec4 bounding_sphere{0.f};
+		// Every front face normal is within the cone around axis. Seen from a camera with
+		// dot(center - camera, cone_axis) >= cone_cutoff * length(center - camera) + radius all
+		// triangles face away. A cutoff of 1 never culls.
+		glm::vec3 cone_axis{0.f, 0.f, 1.f};
+		float cone_cutoff = 1.f;
+	};
+
+	// Splits a triangle list into meshlets of at most MESHLET_MAX_VERTICES unique vertices and
+	// MESHLET_MAX_TRIANGLES triangles, greedily in index order. Indices are left where they are, so a
+	// vertex cache optimized list (see optimize_vertex_cache) gives compact meshlets without being
+	// reordered. Front faces wind counter-clockwise as in glTF.
+	std::vector<Meshlet> build_meshlets(std::span<const uint32_t> indices, std::span<const glm::vec3> positions);
+}
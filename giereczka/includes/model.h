@@ -4,6 +4,9 @@
 #include "buffer.h"
 #include "utils.h"
 #include "material.h"
+#include "geometry_pool.h"
+#include "bounds.h"
+#include "vertex_format.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -12,11 +15,14 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+#include <algorithm>
 #include <vector>
 
 namespace game_engine {
 	class Model {
 	public:
+		// Full precision vertex as imported, kept for CPU side work. The geometry pool gets PackedVertex
+		// or PackedSkinnedVertex instead.
 		struct Vertex {
 			glm::vec3 position{}; // layout(location = 0)
 			glm::vec3 color{}; // layout(location = 1)
@@ -26,9 +32,6 @@ namespace game_engine {
 			glm::ivec4 joint_ids{};	// layout(location = 5)
 			glm::vec4 joint_weights{}; // layout(location = 6)
 
-			static std::vector<VkVertexInputBindingDescription> get_binding_descriptions();
-			static std::vector<VkVertexInputAttributeDescription> get_attribute_descriptions();
-
 			bool operator==(const Vertex& other) const {
 				return position == other.position && color == other.color && normal == other.normal && uv == other.uv;
 			};
@@ -41,8 +44,32 @@ namespace game_engine {
 			uint32_t vertex_count;
 			uint32_t instance_count;
 			std::shared_ptr<Material> material;
+			// Model space, around the submesh's own vertices
+			BoundingBox bounding_box;
+			glm::vec4 bounding_sphere{0.f};
 		};
 
+		// Index range of one level of detail, in the geometry pool like GeometryAllocation::first_index
+		struct Lod {
+			uint32_t first_index;
+			uint32_t index_count;
+			// Largest distance the simplification moved the surface by, in model units
+			float error;
+		};
+
+		static constexpr uint32_t MAX_LOD_COUNT = 4;
+		// Smaller meshes keep their single level of detail
+		static constexpr uint32_t MIN_LOD_TRIANGLES = 256;
+		// Simplification stops short of halving the triangles rather than moving the surface further than
+		// this fraction of the bounding box diagonal
+		static constexpr float MAX_LOD_ERROR = 0.05f;
+		// Meshes this dense get meshlets for the GPU culling to cull within them
+		static constexpr uint32_t MIN_MESHLET_TRIANGLES = 4096;
+
+		// Indexed meshes get a chain of simplified levels of detail, each about half the triangles of the
+		// one before. They share the vertices and follow the full mesh in its index allocation. Vertices
+		// with any joint weight make the mesh use the skinned layout. Dense static meshes are also split
+		// into meshlets at full detail, skinned ones would move out of their bounds.
 		Model(Device& device, std::vector<Vertex> vertices, std::vector<uint32_t> indices);
 		~Model();
 
@@ -51,26 +78,55 @@ namespace game_engine {
 
 		std::vector<Vertex>& get_vertices();
 		std::vector<uint32_t>& get_indices();
-
-		uint32_t get_vertex_count() const { return vertex_count; }
-
-		void bind(VkCommandBuffer command_buffer);
-		void draw(VkCommandBuffer command_buffer);
+		const std::vector<Vertex>& get_vertices() const { return vertices; }
+		const std::vector<uint32_t>& get_indices() const { return indices; }
+
+		uint32_t get_vertex_count() const { return geometry.vertex_count; }
+		uint32_t get_lod_count() const { return static_cast<uint32_t>(lods.size()); }
+		// Levels past the last one give the coarsest. Non-indexed meshes have a single level with no indices.
+		const Lod& get_lod(uint32_t lod) const { return lods[std::min(lod, get_lod_count() - 1)]; }
+		const GeometryAllocation& get_geometry() const { return geometry; }
+		// Of level 0, the coarser levels are small enough to cull whole
+		uint32_t get_meshlet_count() const { return geometry.meshlet_count; }
+		VertexLayout get_vertex_layout() const { return vertex_layout; }
+		// Goes between the model matrix and the quantized positions in the geometry pool
+		const glm::mat4& get_dequantization_matrix() const { return dequantization_matrix; }
+		// get_bounding_sphere in the space of the quantized positions, for use with the dequantized matrix
+		glm::vec4 get_quantized_bounding_sphere() const;
+		// Model space center in xyz and radius in w, encloses every vertex of the bind pose
+		const glm::vec4& get_bounding_sphere() const { return bounding_sphere; }
+		const BoundingBox& get_bounding_box() const { return bounding_box; }
+		// Unique among the models created in this process, in creation order
+		uint32_t get_id() const { return id; }
+
+		// Expects the device's GeometryPool to be bound, see GeometryPool::bind, with the index buffer of
+		// get_geometry().index_type. Binding it is left to the caller so consecutive draws of the same index
+		// type can share it. gl_InstanceIndex starts at first_instance.
+		void draw(VkCommandBuffer command_buffer, uint32_t lod = 0, uint32_t instance_count = 1, uint32_t first_instance = 0);
 	private:
-		void create_vertex_buffers(const std::vector<Vertex> &vertices);
-		void create_index_buffers(const std::vector<uint32_t>& indices);
+		// Appends the simplified levels to pool_indices, after the full mesh
+		void generate_lods(std::vector<uint32_t>& pool_indices);
+		// Builds the meshlets of the full mesh once it has its allocation
+		void allocate_meshlets();
+		std::vector<glm::vec3> get_positions() const;
+		// Returns vertex_layout's packed vertices as raw bytes
+		std::vector<uint8_t> pack_vertices() const;
 
 		Device& device;
+		const uint32_t id;
 
 		std::vector<Vertex> vertices;
+		// Full detail only, the other levels live in the geometry pool
 		std::vector<uint32_t> indices;
 
-		std::unique_ptr<Buffer> vertex_buffer;
-		uint32_t vertex_count;
+		GeometryAllocation geometry;
+		std::vector<Lod> lods;
+		BoundingBox bounding_box;
+		glm::vec4 bounding_sphere{0.f};
 
-		bool has_index_buffer = false;
-		std::unique_ptr<Buffer> index_buffer;
-		uint32_t index_count;
+		VertexLayout vertex_layout = VertexLayout::static_mesh;
+		PositionQuantization quantization;
+		glm::mat4 dequantization_matrix{1.f};
 
 		const std::string file_path;
 	};
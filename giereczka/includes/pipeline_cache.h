@@ -0,0 +1,55 @@
+#pragma once
+
+#include "pch.h"
+
+#include <mutex>
+
+namespace game_engine {
+	struct PipelineCacheStatistics {
+		// Whether usable cache data was loaded from disk at startup
+		bool warm_start = false;
+		size_t loaded_bytes = 0;
+		uint32_t pipeline_count = 0;
+		// Wall time spent inside vkCreate*Pipelines
+		double creation_ms = 0.0;
+	};
+
+	// Engine-wide VkPipelineCache persisted between runs. The file is only used when its header
+	// matches the running device and driver (vendorID, deviceID, pipelineCacheUUID), otherwise the
+	// cache starts empty and the file is overwritten on shutdown. Pipeline creation goes through here
+	// so cold and warm start creation times can be compared. Thread safe.
+	class PipelineCache {
+	public:
+		static constexpr const char* DEFAULT_PATH = "pipeline_cache.bin";
+
+		PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, std::string path = DEFAULT_PATH);
+		// Saves the cache back to disk
+		~PipelineCache();
+
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache& operator=(const PipelineCache&) = delete;
+
+		VkPipelineCache get_pipeline_cache() const { return pipeline_cache; }
+
+		VkResult create_graphics_pipeline(const VkGraphicsPipelineCreateInfo& pipeline_info, VkPipeline* pipeline);
+		VkResult create_compute_pipeline(const VkComputePipelineCreateInfo& pipeline_info, VkPipeline* pipeline);
+
+		void save() const;
+
+		PipelineCacheStatistics get_statistics() const;
+		void print_statistics(std::ostream& out) const;
+
+	private:
+		std::vector<char> load() const;
+		bool is_compatible(const std::vector<char>& data) const;
+		void record_creation(std::chrono::steady_clock::duration duration);
+
+		VkDevice device;
+		VkPhysicalDeviceProperties properties;
+		std::string path;
+		VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+
+		mutable std::mutex statistics_mutex;
+		PipelineCacheStatistics statistics;
+	};
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "pch.h"
+
+#include "pipeline.h"
+
+namespace game_engine {
+    // Compute pipeline of the culling passes: instance culling, occlusion culling and the depth pyramid
+    class CullingPipeline : public Pipeline {
+    public:
+        CullingPipeline(Device& device,
+            const std::string& compute_shader_file_path,
+            const pipeline_config_info& config_info,
+            JobSystem* job_system = nullptr,
+            PipelineCompileMode compile_mode = PipelineCompileMode::immediate
+            );
+    };
+}
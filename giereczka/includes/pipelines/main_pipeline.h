@@ -12,7 +12,9 @@ namespace game_engine {
         MainPipeline(Device& device,
             const std::string& vertex_shader_file_path,
             const std::string& fragment_shader_file_path,
-            const pipeline_config_info& config_info
+            const pipeline_config_info& config_info,
+            JobSystem* job_system = nullptr,
+            PipelineCompileMode compile_mode = PipelineCompileMode::immediate
             );
     private:
         void create_graphics_pipeline(
@@ -20,8 +22,5 @@ namespace game_engine {
             const std::string& fragment_shader_file_path,
             const pipeline_config_info& config_info
         );
-
-        VkShaderModule vertex_shader_module;
-        VkShaderModule fragment_shader_module;
     };
 }
\ No newline at end of file
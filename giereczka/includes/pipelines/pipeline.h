@@ -7,6 +7,7 @@
 #include <cassert>
 
 #include "device.h"
+#include "job_system.h"
 #include "model.h"
 #include "skeletal_animations/gltf_model.h"
 
@@ -32,23 +33,83 @@ namespace game_engine {
 		uint32_t subpass = 0;
 	};
 
+	struct ShaderStage {
+		VkShaderStageFlagBits stage;
+		std::string file_path;
+	};
+
+	// Fixed-function values a pipeline was requested with. Where the device supports extended dynamic
+	// state they are set when binding instead of being baked in, so pipelines that only differ in
+	// these share one VkPipeline.
+	struct DynamicPipelineState {
+		VkCullModeFlags cull_mode = VK_CULL_MODE_NONE;
+		VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkBool32 primitive_restart_enable = VK_FALSE;
+		VkBool32 depth_test_enable = VK_TRUE;
+		VkBool32 depth_write_enable = VK_TRUE;
+		VkCompareOp depth_compare_op = VK_COMPARE_OP_LESS;
+		VkBool32 depth_bias_enable = VK_FALSE;
+		VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+
+		static DynamicPipelineState from_config(const pipeline_config_info& config_info);
+	};
+
+	enum class PipelineCompileMode {
+		// Compiled before the constructor returns
+		immediate,
+		// Compiled on a background job right away
+		background,
+		// Compiled on a background job the first time it is bound or requested
+		on_first_use
+	};
+
+	// Handle to a pipeline owned by the device's PipelineStateCache, identical requests share it.
+	// Pipelines that are not compiled immediately bind their fallback, or nothing, until they are ready.
 	class Pipeline {
 	public:
-		Pipeline(Device& device);
+		// job_system is required for the background modes
+		Pipeline(Device& device, JobSystem* job_system = nullptr,
+		         PipelineCompileMode compile_mode = PipelineCompileMode::immediate);
+		// Waits for a compile still in flight
 		~Pipeline();
 
 		Pipeline(const Pipeline&) = delete;
 		Pipeline& operator=(const Pipeline&) = delete;
 
-		void bind(VkCommandBuffer command_buffer);
+		// Binds the pipeline, or its fallback while it is still compiling. Returns false when neither
+		// is ready, in which case nothing was bound and the caller should skip its draws.
+		bool bind(VkCommandBuffer command_buffer);
+
+		bool is_ready() const { return graphics_pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE; }
+		// Starts compiling an on_first_use pipeline, does nothing once compilation has started
+		void request();
+		// Blocks until the pipeline is compiled and rethrows the error if compilation failed
+		void wait();
+		// Bound instead of this pipeline until it is ready, it must use the same pipeline layout
+		void set_fallback(Pipeline* fallback_pipeline) { fallback = fallback_pipeline; }
 
 		static void default_pipeline_config_info(pipeline_config_info& config_info);
+		// pipeline_config_info points into itself, this copies it and fixes those pointers up
+		static void copy_pipeline_config_info(const pipeline_config_info& source, pipeline_config_info& destination);
 	protected:
-		static std::vector<char> read_file(const std::string& file_path);
-
-		void create_shader_module(const std::vector<char>& code, VkShaderModule* shader_module);
+		void create_graphics_pipeline(const std::vector<ShaderStage>& stages, const pipeline_config_info& config_info);
+		void create_compute_pipeline(const std::string& compute_shader_file_path, const pipeline_config_info& config_info);
 
 		Device& device;
-		VkPipeline graphics_pipeline{};
+		std::atomic<VkPipeline> graphics_pipeline{VK_NULL_HANDLE};
+		VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		DynamicPipelineState dynamic_state;
+
+	private:
+		void compile(std::function<VkPipeline()> compile_function);
+
+		JobSystem* job_system;
+		PipelineCompileMode compile_mode;
+		Pipeline* fallback = nullptr;
+
+		std::mutex compile_mutex;
+		std::function<VkPipeline()> pending_compile;
+		JobHandle compile_job;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "pch.h"
+
+#include "device.h"
+#include "pipelines/pipeline.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace game_engine {
+	struct PipelineStateStatistics {
+		// Pipeline requests from systems, against the distinct VkPipelines they resolved to
+		uint32_t requests = 0;
+		uint32_t pipelines = 0;
+		uint32_t shader_modules = 0;
+	};
+
+	// Owns every pipeline and shader module on the device. Requests are keyed by the shader files,
+	// the pipeline_config_info state that actually ends up in the VkPipeline, the layout and the
+	// compatibility class of the render pass, so identical requests share one pipeline. State the
+	// device can set dynamically (see ExtendedDynamicState) is left out of the key and set by
+	// Pipeline::bind instead. Thread safe.
+	class PipelineStateCache {
+	public:
+		PipelineStateCache(Device& device);
+		~PipelineStateCache();
+
+		PipelineStateCache(const PipelineStateCache&) = delete;
+		PipelineStateCache& operator=(const PipelineStateCache&) = delete;
+
+		// Pipelines for render passes with the same attachment formats, sample counts and subpass
+		// references are shared. Unregistered render passes only share with themselves.
+		void register_render_pass(VkRenderPass render_pass, const VkRenderPassCreateInfo& create_info);
+		void unregister_render_pass(VkRenderPass render_pass);
+
+		VkPipeline get_graphics_pipeline(const std::vector<ShaderStage>& stages, const pipeline_config_info& config_info);
+		VkPipeline get_compute_pipeline(const std::string& compute_shader_file_path, VkPipelineLayout pipeline_layout);
+		VkShaderModule get_shader_module(const std::string& file_path);
+
+		// Sets the part of the state that is dynamic on this device, call after binding the pipeline
+		void set_dynamic_state(VkCommandBuffer command_buffer, const DynamicPipelineState& state) const;
+
+		PipelineStateStatistics get_statistics() const;
+		void print_statistics(std::ostream& out) const;
+
+	private:
+		static std::vector<char> read_file(const std::string& file_path);
+
+		std::string make_graphics_key(const std::vector<ShaderStage>& stages, const pipeline_config_info& config_info) const;
+		std::vector<VkDynamicState> get_dynamic_states(const pipeline_config_info& config_info) const;
+		// Inserts the pipeline unless another thread got there first, returns the one to use
+		VkPipeline insert_pipeline(const std::string& key, VkPipeline pipeline);
+
+		Device& device;
+		const ExtendedDynamicState& extended_dynamic_state;
+
+		mutable std::mutex mutex;
+		std::unordered_map<std::string, VkPipeline> pipelines;
+		std::unordered_map<std::string, VkShaderModule> shader_modules;
+		std::unordered_map<VkRenderPass, std::string> render_pass_keys;
+		uint32_t requests = 0;
+	};
+}
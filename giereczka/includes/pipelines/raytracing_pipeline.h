@@ -11,14 +11,14 @@ namespace game_engine {
     public:
         RaytracingPipeline(Device& device,
             const std::string& compute_shader_file_path,
-            const pipeline_config_info& config_info
+            const pipeline_config_info& config_info,
+            JobSystem* job_system = nullptr,
+            PipelineCompileMode compile_mode = PipelineCompileMode::immediate
             );
     private:
         void create_graphics_pipeline(
             const std::string& compute_shader_file_path,
             const pipeline_config_info& config_info
         );
-
-        VkShaderModule compute_shader_module;
     };
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "pch.h"
+
+#include "job_system.h"
+#include "vertex_format.h"
+
+#include <span>
+
+namespace game_engine {
+	// Pipeline a draw is recorded with, the most significant field of its key
+	enum class DrawPipeline : uint32_t {
+		main = 0,
+		wireframe = 1
+	};
+
+	// Packs a draw's state into a sort key, most significant first: pipeline (2 bits), vertex layout (1),
+	// index type (1), mesh (26), level of detail (2) and depth (16), with the low 16 bits unused. Sorted
+	// draws bind each state as rarely as possible, and draws sharing all of it go front to back. Textures
+	// are indices into the bindless material set and cost no bind, so they are not part of the key.
+	uint64_t make_draw_key(
+		DrawPipeline pipeline,
+		VertexLayout vertex_layout,
+		VkIndexType index_type,
+		uint32_t mesh_id,
+		uint32_t lod,
+		float depth
+	);
+
+	// Commands recorded for a frame's draws on the CPU, counting calls rather than the sets or buffers
+	// they bind. Binds skipped because the state was already current are not counted.
+	struct RenderStatistics {
+		uint32_t draws = 0;
+		uint32_t instances = 0;
+		uint32_t pipeline_binds = 0;
+		uint32_t descriptor_set_binds = 0;
+		uint32_t index_buffer_binds = 0;
+		uint32_t push_constant_updates = 0;
+		double sort_ms = 0.0;
+
+		RenderStatistics& operator+=(const RenderStatistics& other);
+	};
+
+	// Keys with a 32-bit payload each, usually an index into the caller's list of draws. The queue is
+	// meant to be refilled every frame and keeps its memory.
+	class RenderQueue {
+	public:
+		void clear();
+		void reserve(size_t count);
+		// Not thread safe
+		void push(uint64_t key, uint32_t value);
+
+		// Stable least significant digit radix sort, 8 bits per pass. Passes whose digit is the same for
+		// every key are skipped, so unused and constant key bits cost nothing. Every pass histograms and
+		// scatters fixed chunks on the job system when one is given, offsets are laid out digit major and
+		// chunk minor so the chunks keep their order.
+		void sort(JobSystem* job_system = nullptr);
+
+		size_t size() const { return keys.size(); }
+		bool empty() const { return keys.empty(); }
+		std::span<const uint64_t> get_keys() const { return keys; }
+		std::span<const uint32_t> get_values() const { return values; }
+
+	private:
+		static constexpr uint32_t RADIX_BITS = 8;
+		static constexpr uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+		// Below this a chunk's histogram costs more than it saves
+		static constexpr size_t MIN_CHUNK_SIZE = 4096;
+
+		std::vector<uint64_t> keys;
+		std::vector<uint32_t> values;
+		std::vector<uint64_t> scratch_keys;
+		std::vector<uint32_t> scratch_values;
+		// RADIX_SIZE counters per chunk, turned into scatter offsets in place
+		std::vector<uint32_t> histograms;
+	};
+}
@@ -3,6 +3,7 @@
 #include "window.h"
 #include "device.h"
 #include "swapchain.h"
+#include "descriptors.h"
 
 #include <memory>
 #include <vector>
@@ -22,24 +23,48 @@ namespace game_engine {
 		bool is_frame_in_progress() const;
 
 		VkCommandBuffer get_current_command_buffer() const;
+		VkFramebuffer get_current_framebuffer() const;
+		VkExtent2D get_swap_chain_extent() const;
 
 		int get_frame_index() const;
+		// Sets allocated here are valid until this frame index comes around again
+		DescriptorAllocator& get_frame_descriptor_allocator() const { return *frame_descriptor_allocators[current_frame_index]; }
 
 		VkCommandBuffer begin_frame();
 
 		void end_frame();
-		void begin_swap_chain_render_pass(VkCommandBuffer command_buffer);
+		// With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the pass only accepts vkCmdExecuteCommands,
+		// viewport and scissor are then left to the secondary command buffers
+		void begin_swap_chain_render_pass(
+			VkCommandBuffer command_buffer,
+			VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE
+		);
+		// Begins SwapChain::get_load_render_pass on the current framebuffer, after the first pass ended
+		// and its depth was moved to VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+		void continue_swap_chain_render_pass(
+			VkCommandBuffer command_buffer,
+			VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE
+		);
 		void end_swap_chain_render_pass(VkCommandBuffer command_buffer);
 
+		VkFormat get_depth_format() const;
+		VkImage get_current_depth_image() const;
+		VkImageView get_current_depth_image_view() const;
+
 		std::unique_ptr<SwapChain> swap_chain;
 	private:
+		static constexpr uint32_t FRAME_DESCRIPTOR_SETS = 64;
+
 		void create_command_buffers();
+		void create_frame_descriptor_allocators();
 		void free_command_buffers();
 		void recreate_swap_chain();
+		void begin_render_pass(VkCommandBuffer command_buffer, VkRenderPass render_pass, VkSubpassContents contents);
 
 		Window& window;
 		Device& device;
 		std::vector<VkCommandBuffer> command_buffers;
+		std::vector<std::unique_ptr<DescriptorAllocator>> frame_descriptor_allocators;
 
 		uint32_t current_image_index = 0;
 		int current_frame_index = 0;
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "device.h"
+#include "systems/object_manager_system.h"
+#include "systems/texture_manager_system.h"
+
+namespace game_engine {
+	// Ring of point lights around the animated model standing on a plane.
+	// Shared by the interactive engine and the headless benchmark so both measure the same scene.
+	void load_default_scene(
+		Device& device,
+		ObjectManagerSystem& object_manager_system,
+		TextureManagerSystem& texture_manager_system
+	);
+}
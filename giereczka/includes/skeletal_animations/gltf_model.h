@@ -10,6 +10,7 @@
 #include "texture.h"
 #include "model.h"
 #include "material.h"
+#include "bounds.h"
 
 namespace game_engine {
 	class GltfModel {
@@ -30,12 +31,15 @@ namespace game_engine {
 		uint32_t texture_id = 0;
 
         Texture& get_texture(uint32_t index);
+		// Model space box around every mesh in the bind pose
+		const BoundingBox& get_bounding_box() const { return bounding_box; }
 	private:
 		Device& device;
 
 		std::vector<Model::Vertex> vertices;
 		std::vector<uint32_t> indices;
 
+		BoundingBox bounding_box;
 
 		void load_skeletons();
         void load_textures();
@@ -50,6 +54,9 @@ namespace game_engine {
 
         void load_vertex_data(uint32_t const mesh_index);
 
+		// Welds the submesh's identical vertices, reorders its triangles for the vertex cache and overdraw,
+		// then its vertices in order of first use. Only for the submesh loaded last.
+		void optimize_submesh(Model::Submesh& submesh);
 		void calculate_tangents();
 		void calculate_tangents_from_index_buffer(const std::vector<uint32_t>& indices);
 
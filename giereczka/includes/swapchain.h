@@ -22,9 +22,17 @@ namespace game_engine {
 
 		VkFramebuffer get_framebuffer(size_t index);
 		VkRenderPass get_render_pass();
+		// Compatible with get_render_pass and its framebuffers, but loads color and depth instead of
+		// clearing them, so a frame can leave the pass for compute work and come back. Depth has to be
+		// in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL when it begins.
+		VkRenderPass get_load_render_pass();
 		VkImageView get_image_view(size_t index);
+		// Depth is stored at the end of the render pass and can be sampled, see DepthPyramid
+		VkImage get_depth_image(size_t index);
+		VkImageView get_depth_image_view(size_t index);
 		size_t image_count();
 		VkFormat get_swap_chain_image_format();
+		VkFormat get_swap_chain_depth_format();
 		VkExtent2D get_swap_chain_extent();
 		uint32_t width();
 		uint32_t height();
@@ -55,9 +63,10 @@ namespace game_engine {
 
 		std::vector<VkFramebuffer> swap_chain_framebuffers;
 		VkRenderPass render_pass;
+		VkRenderPass load_render_pass;
 
 		std::vector<VkImage> depth_images;
-		std::vector<VkDeviceMemory> depth_image_memories;
+		std::vector<Allocation> depth_image_memories;
 		std::vector<VkImageView> depth_image_views;
 		std::vector<VkImage> swap_chain_images;
 		std::vector<VkImageView> swap_chain_image_views;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "pch.h"
+
+#include "job_system.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+
+namespace game_engine {
+	// Per-frame data that systems read or write
+	enum class FrameResource : uint32_t {
+		game_objects,
+		point_lights,
+		global_ubo,
+		command_buffers,
+		count
+	};
+
+	struct SystemAccess {
+		std::vector<FrameResource> reads;
+		std::vector<FrameResource> writes;
+	};
+
+	// Runs the engine's per-frame systems as jobs. Systems are registered once, in the order a single
+	// thread would run them. Each one depends on the last earlier writer of every resource it touches,
+	// and a writer also depends on the readers since that write. Systems without conflicts overlap, and
+	// the results match the sequential order.
+	class SystemScheduler {
+	public:
+		explicit SystemScheduler(JobSystem& job_system);
+
+		SystemScheduler(const SystemScheduler&) = delete;
+		SystemScheduler& operator=(const SystemScheduler&) = delete;
+
+		void add_system(std::string name, const SystemAccess& access, std::function<void()> update);
+
+		// Schedules every system and blocks until all of them are done. The calling thread helps out,
+		// and the first exception thrown by a system is rethrown here.
+		void run();
+
+		size_t get_system_count() const { return systems.size(); }
+
+	private:
+		struct System {
+			std::string name;
+			std::function<void()> update;
+			std::vector<size_t> dependencies;
+		};
+
+		struct ResourceState {
+			std::optional<size_t> last_writer;
+			std::vector<size_t> readers;
+		};
+
+		JobSystem& job_system;
+		std::vector<System> systems;
+		std::array<ResourceState, static_cast<size_t>(FrameResource::count)> resources;
+
+		std::vector<JobHandle> handles;
+		std::vector<JobHandle> dependency_handles;
+	};
+}
@@ -0,0 +1,333 @@
+#pragma once
+
+#include "pch.h"
+
+#include "device.h"
+#include "buffer.h"
+#include "camera.h"
+#include "descriptors.h"
+#include "depth_pyramid.h"
+#include "job_system.h"
+#include "object_manager_system.h"
+#include "pipelines/culling_pipeline.h"
+#include "vertex_format.h"
+
+#include <functional>
+
+namespace game_engine {
+    // One drawable model, mirrored by Instance in the culling shaders and indirect_vert_shader.vert (std430)
+    struct GpuInstance {
+        // Includes the model's dequantization matrix, see Model::get_dequantization_matrix
+        glm::mat4 model_matrix{1.f};
+        // Center in xyz and radius in w, see Model::get_quantized_bounding_sphere
+        glm::vec4 bounding_sphere{0.f};
+        glm::vec3 color{0.f};
+        int32_t texture_index = -1;
+        uint32_t index_count = 0;
+        uint32_t first_index = 0;
+        int32_t vertex_offset = 0;
+        VertexLayout vertex_layout = VertexLayout::static_mesh;
+        // Also the stream of draw commands the instance goes to, unless it has meshlets
+        VkIndexType index_type = VK_INDEX_TYPE_UINT16;
+        // In the geometry pool's meshlet buffer, meshlet_count is 0 unless the instance is drawn at level
+        // of detail 0 of a mesh with meshlets. The culling places its surviving triangles in the frame's
+        // compacted index buffer.
+        uint32_t first_meshlet = 0;
+        uint32_t meshlet_count = 0;
+        uint32_t padding = 0;
+    };
+
+    // A scene buffer slot to overwrite, mirrored by Update in scatter_instances.comp (std430)
+    struct GpuInstanceUpdate {
+        uint32_t slot;
+        uint32_t padding[3];
+        GpuInstance instance;
+    };
+
+    static_assert(sizeof(GpuInstance) == 128, "GpuInstance layout no longer matches the shaders");
+    static_assert(sizeof(GpuInstanceUpdate) == 144, "GpuInstanceUpdate layout no longer matches the shaders");
+
+    // Per frame averages of what the culling passes did with the indexed instances
+    struct CullingStatistics {
+        double drawn = 0.0;
+        double frustum_culled = 0.0;
+        // Always 0 without occlusion culling
+        double occlusion_culled = 0.0;
+        // Of the drawn instances with meshlets
+        double meshlets_drawn = 0.0;
+        double meshlets_culled = 0.0;
+        // Scene buffer slots rewritten, out of scene_instances
+        double uploaded_instances = 0.0;
+        double scene_instances = 0.0;
+    };
+
+    // Frustum culling on the GPU. The models of all game objects live in a persistent device local scene
+    // buffer, a slot per model for as long as its object exists. Only the slots of objects changed
+    // through ObjectManagerSystem's setters, or whose level of detail changed, are staged each frame and
+    // scattered into the scene buffer by a compute pass, so a scene where few objects move uploads little.
+    // A compute pass then tests the bounding spheres against the camera frustum and appends a
+    // VkDrawIndexedIndirectCommand per visible instance, with the instance index as firstInstance. The
+    // scene is then drawn with a vkCmdDrawIndexedIndirectCount per index type of the geometry pool, or
+    // a zero-filled vkCmdDrawIndexedIndirect without VK_KHR_draw_indirect_count, so recording no longer
+    // grows with the object count. Each frame in flight has its own buffers besides the scene buffer.
+    //
+    // Given a DepthPyramid the culling also tests occlusion, in two phases. cull() only draws what was
+    // visible last frame, which is most of what is visible now and makes a good occluder set, the
+    // pyramid is built from that depth, and cull_occluded() tests everything against it, draws the
+    // newly visible instances in a second pass that loads the first one's attachments and records
+    // which instances were visible for the next frame. Both phases draw from the same buffers, so the
+    // command buffer draw() recorded is executed once in each pass.
+    //
+    // Visible instances of meshes with meshlets (see Model::get_meshlet_count) are culled further. The
+    // instance pass queues them for cull_meshlets.comp, which tests every meshlet against the frustum and
+    // its normal cone and copies the surviving triangles into a per frame index buffer, drawn as a third
+    // stream after the two index types. The instance pass hands out the ranges of that buffer to the
+    // visible instances. Meshlets are not tested for occlusion, their instance is.
+    class GpuCullingSystem {
+    public:
+        static constexpr uint32_t WORKGROUP_SIZE = 64;
+        static constexpr uint32_t INITIAL_CAPACITY = 1024;
+
+        GpuCullingSystem(Device &device, int frames_in_flight, DepthPyramid *depth_pyramid = nullptr);
+        ~GpuCullingSystem();
+
+        GpuCullingSystem(const GpuCullingSystem &) = delete;
+        GpuCullingSystem &operator=(const GpuCullingSystem &) = delete;
+
+        static bool is_supported(const Device &device) { return device.has_multi_draw_indirect(); }
+
+        bool is_occlusion_culling() const { return depth_pyramid != nullptr; }
+
+        // Returns the object's level of detail for its world space box
+        using LodSelector = std::function<uint32_t(ObjectHandle handle, const BoundingBox &world_box)>;
+
+        // Scene buffer at binding 0, readable from the vertex stage
+        VkDescriptorSetLayout get_instance_set_layout() const { return instance_set_layout->get_descriptor_set_layout(); }
+        VkDescriptorSet get_instance_set(int frame_index) const { return frames[frame_index].descriptor_set; }
+
+        // Collects the object manager's scene changes for the next write_instances. Call on the main thread
+        // every frame before the scheduled systems run, changes pile up until write_instances takes them.
+        void take_scene_changes(ObjectManagerSystem &object_manager_system);
+
+        // Stages the slots the collected scene changes touch for cull() to upload. Every object's level of
+        // detail is selected again from its cached world box, objects whose level changed are staged too.
+        // Only reads the game objects. Call once the frame's fence has been waited on, the buffers grow
+        // when needed. cull() has to be recorded before the next call.
+        void write_instances(
+            int frame_index,
+            const ObjectManagerSystem::GameObjectTable &game_objects,
+            const LodSelector &select_lod
+        );
+
+        // Records the scene buffer upload, the culling dispatch and the barrier in front of the indirect
+        // draws, outside of a render pass and before the command buffers that draw. Consumes the instances
+        // written this frame, unless the occlusion phase still has to run.
+        void cull(VkCommandBuffer command_buffer, int frame_index, const Camera &camera);
+
+        // True when cull() drew the first phase of an occlusion culled frame, the render pass has to be
+        // ended, the pyramid built and cull_occluded() recorded before the draws run again
+        bool needs_occlusion_pass(int frame_index) const;
+
+        // Records the second phase, after DepthPyramid::build and outside of a render pass. The draw
+        // buffers are reused, so the first phase's draws have to be recorded before it.
+        void cull_occluded(VkCommandBuffer command_buffer, int frame_index, const Camera &camera);
+
+        // Records the indirect draws, with the geometry pool and the instance set bound
+        void draw(VkCommandBuffer command_buffer, int frame_index) const;
+
+        // Counted on the GPU and read back once the frame's fence signaled, so a couple of frames behind
+        CullingStatistics get_statistics() const;
+        void print_statistics(std::ostream &out) const;
+
+    private:
+        // Mirrored by MESHLET_STREAM in the culling shaders
+        static constexpr uint32_t MESHLET_STREAM = 2;
+        static constexpr uint32_t DRAW_STREAM_COUNT = 3;
+
+        struct CullPushConstants {
+            std::array<glm::vec4, 6> frustum_planes;
+            uint32_t instance_count;
+        };
+
+        // Mirrored in cull_occlusion.comp, fits the 128 bytes every device has
+        struct OcclusionPushConstants {
+            glm::mat4 view;
+            // Normalized side planes in view space, x and z of the right one, y and z of the bottom one
+            glm::vec4 frustum;
+            // P[0][0], P[1][1], P[2][2] and P[3][2] of the perspective projection
+            glm::vec4 projection;
+            float z_near;
+            float z_far;
+            glm::vec2 pyramid_size;
+            uint32_t instance_count;
+            // Instances of the previous frame's visibility buffer, 0 when there is none
+            uint32_t visibility_count;
+            uint32_t late;
+        };
+
+        // Mirrored in cull_meshlets.comp
+        struct MeshletPushConstants {
+            std::array<glm::vec4, 6> frustum_planes;
+            glm::vec4 camera_position;
+            uint32_t draw_offset;
+        };
+
+        // Mirrored in the culling shaders. Only the members before drawn are reset between the phases.
+        struct Counters {
+            // Indexed by VkIndexType, UINT16 is 0 and UINT32 is 1, then MESHLET_STREAM
+            uint32_t draw_counts[DRAW_STREAM_COUNT];
+            // Indices claimed in the compacted index buffer by the visible meshlet instances
+            uint32_t compacted_index_count;
+            uint32_t drawn;
+            uint32_t frustum_culled;
+            uint32_t occlusion_culled;
+            uint32_t meshlets_drawn;
+            uint32_t meshlets_culled;
+        };
+
+        // Header of the meshlet work buffer, an instance index and draw slot pair per queued instance
+        // follows. The dispatch is folded into rows of 65535 workgroups so it stays within every
+        // device's maxComputeWorkGroupCount. Reset before every instance pass.
+        struct MeshletWork {
+            VkDispatchIndirectCommand dispatch;
+            uint32_t item_count;
+        };
+
+        // Mirrored in scatter_instances.comp
+        struct ScatterPushConstants {
+            uint32_t update_count;
+        };
+
+        // The scene buffer slots of a game object, one per model, and what they were last written from
+        struct SceneObject {
+            std::vector<uint32_t> slots;
+            glm::mat4 model_matrix{1.f};
+            BoundingBox world_box;
+            // Level of detail the slots hold, UINT32_MAX until they are written
+            uint32_t lod = UINT32_MAX;
+        };
+
+        struct FrameBuffers {
+            // Host visible GpuInstanceUpdates staged by write_instances
+            std::unique_ptr<Buffer> updates;
+            std::unique_ptr<Buffer> draw_commands;
+            std::unique_ptr<Buffer> counters;
+            std::unique_ptr<Buffer> counters_readback;
+            // One uint per instance, written by the second phase and read by the next frame
+            std::unique_ptr<Buffer> visibility;
+            std::unique_ptr<Buffer> meshlet_work;
+            // 32-bit indices, created once an instance has meshlets
+            std::unique_ptr<Buffer> compacted_indices;
+            // Instances per stream, stream s starts s * instance_count commands in
+            std::array<uint32_t, DRAW_STREAM_COUNT> stream_counts{};
+            VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+            VkDescriptorSet occlusion_set = VK_NULL_HANDLE;
+            VkDescriptorSet meshlet_set = VK_NULL_HANDLE;
+            VkDescriptorSet scatter_set = VK_NULL_HANDLE;
+            // Scene buffer the sets were written with
+            const Buffer *bound_scene_buffer = nullptr;
+            // GeometryPool::get_generation the meshlet set was written with
+            uint32_t geometry_generation = 0;
+            uint32_t capacity = 0;
+            uint32_t compacted_capacity = 0;
+            uint32_t update_capacity = 0;
+            uint32_t update_count = 0;
+            uint32_t instance_count = 0;
+            bool counters_pending = false;
+        };
+
+        // A buffer the next frame may still read when it was replaced
+        struct RetiredBuffer {
+            std::unique_ptr<Buffer> buffer;
+            int frames_left;
+        };
+
+        void create_frame_buffers(FrameBuffers &frame, uint32_t capacity);
+        void create_compacted_indices(FrameBuffers &frame, uint32_t capacity);
+        // Meshlets and indices come from the geometry pool, whose buffers change when it grows
+        void write_meshlet_set(FrameBuffers &frame);
+        void create_update_buffer(FrameBuffers &frame, uint32_t capacity);
+        // The previous scene buffer is retired, every slot is staged again
+        void create_scene_buffer(uint32_t capacity);
+        // Points the frame's instance and scatter sets at its buffers and the current scene buffer
+        void write_frame_sets(FrameBuffers &frame);
+        void create_pipeline_layout();
+        void create_pipeline();
+        void create_occlusion_pipeline();
+        void create_meshlet_pipeline();
+        void create_scatter_pipeline();
+
+        // Rewrites the slots of a scene object from its game object's render component
+        void write_scene_object(SceneObject &scene_object, const RenderComponent &render, uint32_t lod);
+        uint32_t allocate_slot();
+        // Overwrites the CPU copy of a slot, keeps the stream counts and stages it for upload
+        void set_slot(uint32_t slot, const GpuInstance &instance);
+        void stage_slot(uint32_t slot);
+        // Empties the slots for reuse
+        void free_slots(SceneObject &scene_object, size_t first = 0);
+        // Records the scatter of the frame's staged slots into the scene buffer
+        void upload_instances(VkCommandBuffer command_buffer, FrameBuffers &frame);
+        // Clears the counters and, without the count draw, the draw commands
+        void reset_draws(VkCommandBuffer command_buffer, FrameBuffers &frame, bool reset_statistics);
+        // Makes the draws visible to the draw stage, after the last phase also copies the counters for
+        // write_instances to pick up
+        void finish_draws(VkCommandBuffer command_buffer, FrameBuffers &frame, bool read_back_counters);
+        void dispatch_occlusion(VkCommandBuffer command_buffer, FrameBuffers &frame, const Camera &camera, bool late);
+        // Culls the meshlets the instance pass before it queued, nothing to do without meshlet instances
+        void dispatch_meshlets(VkCommandBuffer command_buffer, FrameBuffers &frame, const Camera &camera);
+
+        Device &device;
+        DepthPyramid *depth_pyramid;
+        int frames_in_flight;
+        uint32_t max_draw_count;
+
+        std::unique_ptr<DescriptorSetLayout> instance_set_layout;
+        std::unique_ptr<DescriptorSetLayout> occlusion_set_layout;
+        std::unique_ptr<DescriptorSetLayout> meshlet_set_layout;
+        std::unique_ptr<DescriptorSetLayout> scatter_set_layout;
+        std::unique_ptr<DescriptorAllocator> descriptor_allocator;
+        std::vector<FrameBuffers> frames;
+        std::vector<RetiredBuffer> retired_buffers;
+
+        // Read by every frame in flight, frames upload into it in submission order
+        std::unique_ptr<Buffer> scene_buffer;
+        uint32_t scene_capacity = 0;
+        // CPU copy of every slot, freed ones are empty and skipped by the culling
+        std::vector<GpuInstance> scene_instances;
+        std::vector<uint32_t> free_scene_slots;
+        std::unordered_map<ObjectManagerSystem::id_t, SceneObject> scene_objects;
+        // Slots to upload with the next frame, each once
+        std::vector<uint32_t> pending_slots;
+        std::vector<uint8_t> slot_pending;
+        // Of the slots in use, like FrameBuffers::stream_counts
+        std::array<uint32_t, DRAW_STREAM_COUNT> scene_stream_counts{};
+        // Compacted index buffer room every meshlet instance being visible would need
+        uint32_t scene_compacted_index_count = 0;
+        // Since the last write_instances
+        std::vector<ObjectManagerSystem::id_t> changed_objects;
+        std::vector<ObjectManagerSystem::id_t> removed_objects;
+
+        // Frame whose visibility buffer the next frame reads, -1 after a frame without the occlusion pass
+        int visibility_frame = -1;
+        uint32_t visibility_count = 0;
+
+        VkPipelineLayout pipeline_layout;
+        std::unique_ptr<CullingPipeline> pipeline;
+        VkPipelineLayout occlusion_pipeline_layout = VK_NULL_HANDLE;
+        std::unique_ptr<CullingPipeline> occlusion_pipeline;
+        VkPipelineLayout meshlet_pipeline_layout = VK_NULL_HANDLE;
+        std::unique_ptr<CullingPipeline> meshlet_pipeline;
+        VkPipelineLayout scatter_pipeline_layout = VK_NULL_HANDLE;
+        std::unique_ptr<CullingPipeline> scatter_pipeline;
+
+        uint64_t counted_frames = 0;
+        uint64_t total_drawn = 0;
+        uint64_t total_frustum_culled = 0;
+        uint64_t total_occlusion_culled = 0;
+        uint64_t total_meshlets_drawn = 0;
+        uint64_t total_meshlets_culled = 0;
+        uint64_t upload_frames = 0;
+        uint64_t total_uploaded_instances = 0;
+        uint64_t total_scene_instances = 0;
+    };
+}
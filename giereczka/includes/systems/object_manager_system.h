@@ -2,23 +2,35 @@
 
 #include "game_object.h"
 #include "point_light_object.h"
+#include "aabb_tree.h"
+#include "component_table.h"
 
-#include <unordered_map>
+#include <optional>
+#include <unordered_set>
 
 namespace game_engine {
 	class ObjectManagerSystem {
 	public:
-		using id_t = unsigned int;
-		using ObjectMap = std::unordered_map<id_t, GameObject>;
-		using PointLightMap = std::unordered_map<id_t, PointLightObject>;
+		using id_t = ObjectHandle;
+
+		// Proxy of a game object with a model in the spatial index, whose user data is the handle's index
+		struct SpatialProxy {
+			uint32_t proxy = AabbTree::INVALID_NODE;
+		};
+
+		// Game objects are split into components by how often they are read: transforms and render data
+		// every frame, names only by the debug UI
+		using GameObjectTable = ComponentTable<transform_component, RenderComponent, SpatialProxy, std::string>;
+		using PointLightTable = ComponentTable<PointLightObject>;
 
 		ObjectManagerSystem();
 		~ObjectManagerSystem();
 		ObjectManagerSystem(const ObjectManagerSystem&) = delete;
 		ObjectManagerSystem& operator=(const ObjectManagerSystem&) = delete;
 
-		void add_game_object(GameObject& game_object);
-		void add_point_light(PointLightObject& point_light);
+		// Handles stay valid until their object is removed, both are O(1)
+		id_t add_game_object(GameObject& game_object);
+		id_t add_point_light(PointLightObject& point_light);
 
 		void remove_game_object(id_t id);
 		void remove_point_light(id_t id);
@@ -27,6 +39,15 @@ namespace game_engine {
 		void scale_game_object(id_t id, float scale);
 		void rotate_game_object(id_t id, const glm::vec3& rotation);
 		void set_model_color(id_t id, const glm::vec3& color);
+		// For transforms changed directly through get_game_objects(), the setters above do it themselves.
+		// Also marks the object changed. Removed objects are ignored by all the setters.
+		void update_bounds(id_t id);
+
+		// Appends the game objects added or changed through the setters since the last call, and the ones
+		// removed since then, for GpuCullingSystem to upload only what changed. An object can be in both
+		// when it was changed before its removal. Not thread safe with the setters, call it from the main
+		// thread outside the scheduled systems.
+		void take_scene_changes(std::vector<id_t>& changed, std::vector<id_t>& removed);
 
 		void set_point_light_position(id_t id, const glm::vec3& position);
 		void set_point_light_intensity(id_t id, float intensity);
@@ -35,16 +56,40 @@ namespace game_engine {
 
 		long long get_vertex_count() const { return vertex_count; }
 
-		ObjectMap& get_game_objects() { return game_objects; };
-		PointLightMap& get_point_lights() { return point_lights; };
+		// Spatial queries over the world space boxes of the game objects, ids are appended to the output
+		void query_frustum(const std::array<glm::vec4, 6>& planes, std::vector<id_t>& ids) const;
+		void query_sphere(const glm::vec3& center, float radius, std::vector<id_t>& ids) const;
+		void query_box(const BoundingBox& box, std::vector<id_t>& ids) const;
+		// Closest object whose box the ray hits, for picking. distance is in units of direction.
+		std::optional<id_t> ray_cast(
+			const glm::vec3& origin,
+			const glm::vec3& direction,
+			float max_distance,
+			float* distance = nullptr
+		) const;
+
+		const AabbTree& get_spatial_index() const { return spatial_index; }
+
+		// The tables must not be inserted into or erased from directly, the spatial index and scene changes
+		// would miss it
+		GameObjectTable& get_game_objects() { return game_objects; };
+		const GameObjectTable& get_game_objects() const { return game_objects; };
+		PointLightTable& get_point_lights() { return point_lights; };
 	private:
-		ObjectMap game_objects;
-		PointLightMap point_lights;
+		GameObjectTable game_objects;
+		PointLightTable point_lights;
 
-		id_t current_id = 0;
+		BoundingBox get_world_bounding_box(const transform_component& transform, const RenderComponent& render) const;
+		// Fits the object's proxy to its world box again
+		void update_proxy(uint32_t dense, const glm::vec3& displacement = glm::vec3(0.f));
+		void mark_changed(id_t id) { changed_objects.insert(id); }
 
-		id_t assign_id();
+		AabbTree spatial_index;
 
 		long long vertex_count = 0;
+
+		// Since the last take_scene_changes
+		std::unordered_set<id_t> changed_objects;
+		std::vector<id_t> removed_objects;
 	};
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "camera.h"
 #include "global_ubo.h"
 #include "object_manager_system.h"
+#include "system_scheduler.h"
 
 #include <memory>
 #include <vector>
@@ -20,27 +21,35 @@ namespace game_engine {
 
 	class PointLightSystem {
 	public:
-		PointLightSystem(Device& device, VkRenderPass render_pass, VkDescriptorSetLayout global_set_layout);
+		// The light pipeline compiles in the background, lights are not drawn until it is ready
+		PointLightSystem(Device& device, JobSystem& job_system, VkRenderPass render_pass, VkDescriptorSetLayout global_set_layout);
 		~PointLightSystem();
 
 		PointLightSystem(const PointLightSystem&) = delete;
 		PointLightSystem& operator=(const PointLightSystem&) = delete;
 
+		void wait_for_pipelines();
+
+		static SystemAccess update_access()
+		{
+			return {{FrameResource::point_lights}, {FrameResource::global_ubo}};
+		}
+
 		void update(
-			ObjectManagerSystem::PointLightMap& point_lights,
+			const ObjectManagerSystem::PointLightTable& point_lights,
 			GlobalUbo& global_ubo,
 			float dt
 		);
 
 		void render(
 			VkCommandBuffer command_buffer,
-			game_engine::ObjectManagerSystem::PointLightMap& point_lights,
+			const game_engine::ObjectManagerSystem::PointLightTable& point_lights,
 			const Camera& camera,
 			const VkDescriptorSet global_descriptor_set
 		);
 	private:
 		void create_pipeline_layout(VkDescriptorSetLayout global_set_layout);
-		void create_pipeline(VkRenderPass render_pass);
+		void create_pipeline(JobSystem& job_system, VkRenderPass render_pass);
 
 		Device& device;
 
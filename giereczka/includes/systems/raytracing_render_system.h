@@ -14,8 +14,10 @@
 namespace game_engine {
     class RaytracingRenderSystem {
     public:
+        // The compute pipeline is only compiled once the scene is first raytraced
         RaytracingRenderSystem(
             Device &device,
+            JobSystem &job_system,
             VkRenderPass render_pass,
             VkDescriptorSetLayout global_set_layout,
             VkDescriptorSetLayout joint_set_layout,
@@ -31,7 +33,7 @@ namespace game_engine {
 
         void render_raytraced_scene(
             VkCommandBuffer command_buffer,
-            game_engine::ObjectManagerSystem::ObjectMap &game_objects,
+            game_engine::ObjectManagerSystem::GameObjectTable &game_objects,
             const Camera &camera,
             const VkDescriptorSet global_descriptor_set,
             const VkDescriptorSet joint_descriptor_set,
@@ -42,7 +44,7 @@ namespace game_engine {
         );
 
         void create_mesh_storage_buffers(
-            game_engine::ObjectManagerSystem::ObjectMap &game_objects
+            game_engine::ObjectManagerSystem::GameObjectTable &game_objects
         );
 
         std::unique_ptr<Buffer> vertex_storage_buffer;
@@ -56,7 +58,7 @@ namespace game_engine {
             VkDescriptorSetLayout mesh_data_set_layout
         );
 
-        void create_raytracing_pipeline(VkRenderPass render_pass);
+        void create_raytracing_pipeline(JobSystem &job_system, VkRenderPass render_pass);
 
         Device &device;
         std::unique_ptr<RaytracingPipeline> raytracing_pipeline;
@@ -9,53 +9,198 @@
 #include "camera.h"
 #include "pipelines/main_pipeline.h"
 #include "skeletal_animations/gltf_model.h"
+#include "job_system.h"
+#include "system_scheduler.h"
+#include "thread_command_pools.h"
+#include "systems/gpu_culling_system.h"
+#include "frustum_culling.h"
+#include "masked_occlusion_culling.h"
+#include "render_queue.h"
+
+#include <optional>
+#include <span>
 
 namespace game_engine {
     struct PushConstantData {
+        // Includes the model's dequantization matrix, see Model::get_dequantization_matrix
+        glm::mat4 model_matrix{1.f};
+        glm::vec3 color{0.f, 0.f, 0.f};
+        int texture_index = 0;
+        VertexLayout vertex_layout = VertexLayout::static_mesh;
+    };
+
+    // Per instance values of the main pipeline, mirrored by Instance in vert_shader.vert (std430)
+    struct InstanceData {
+        // Includes the model's dequantization matrix, see Model::get_dequantization_matrix
         glm::mat4 model_matrix{1.f};
         glm::vec3 color{0.f, 0.f, 0.f};
         int texture_index = 0;
     };
 
+    // Push constants of the main pipeline, the same for every instance of a draw
+    struct InstancedPushConstantData {
+        VertexLayout vertex_layout = VertexLayout::static_mesh;
+    };
+
+    // Draws game objects with the main, wireframe or indirect pipeline. Draws recorded on the CPU go
+    // through a RenderQueue sorted by state, see make_draw_key, and recording skips binds and push
+    // constants that are already current. Shaded objects are then grouped by model and level of
+    // detail, so all objects sharing a GltfModel cost one instanced draw per model, with their
+    // transforms, colors and textures in a per frame instance buffer. The wireframe view draws every
+    // object on its own.
     class RenderSystem {
     public:
         RenderSystem(
 
             Device &device,
+            JobSystem &job_system,
             VkRenderPass render_pass,
             VkDescriptorSetLayout global_set_layout,
             VkDescriptorSetLayout joint_set_layout,
-            VkDescriptorSetLayout materials_set_layout
+            VkDescriptorSetLayout materials_set_layout,
+            int frames_in_flight,
+            GpuCullingSystem *gpu_culling_system = nullptr
         );
 
         ~RenderSystem();
         RenderSystem(const RenderSystem &) = delete;
         RenderSystem &operator=(const RenderSystem &) = delete;
 
-        void render_game_objects(
-            VkCommandBuffer command_buffer,
-            game_engine::ObjectManagerSystem::ObjectMap &game_objects,
+        // The main pipeline compiles in the background and draws with an unlit fallback until then.
+        // Blocks until it is ready, for callers that need every frame to be representative. The same goes
+        // for the indirect pipeline when GPU culling is used.
+        void wait_for_pipelines();
+
+        // Objects recorded on the CPU are also tested against the largest visible objects, rasterized
+        // by a MaskedOcclusionCuller. Off by default.
+        void set_software_occlusion_culling(bool enabled) { software_occlusion_culling = enabled; }
+        // Of the last record_game_objects, zero when it drew indirectly or occlusion culling was off
+        const OcclusionCullingStatistics &get_occlusion_statistics() const { return occlusion_statistics; }
+        // Without sorting draws are recorded in the object table's order, for comparison. On by default.
+        void set_draw_sorting(bool enabled) { draw_sorting = enabled; }
+        // Of the last frame recorded on the CPU, zero when record_game_objects drew indirectly
+        const RenderStatistics &get_render_statistics() const { return render_statistics; }
+
+        // Levels of detail are kept in RenderSystem, recording only reads the game objects
+        static SystemAccess record_access()
+        {
+            return {{FrameResource::game_objects}, {FrameResource::command_buffers}};
+        }
+
+        // Culls the objects against the camera frustum and splits the visible ones into chunks on the job
+        // system, each chunk is recorded into a secondary command buffer from the per-frame pool of the
+        // worker that runs it. The buffers are appended to secondary_command_buffers in object order,
+        // ready for vkCmdExecuteCommands inside a render pass
+        // begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Every drawn object gets the level of
+        // detail that matches its size on screen.
+        // With a GpuCullingSystem the shaded objects are instead kept in its scene buffer, updated from the
+        // scene changes GpuCullingSystem::take_scene_changes collected, and a single secondary buffer draws
+        // them indirectly, GpuCullingSystem::cull has to be recorded before it runs.
+        // With occlusion culling a second one goes to late_command_buffers, for the pass after
+        // GpuCullingSystem::cull_occluded.
+        void record_game_objects(
+            JobSystem &job_system,
+            ThreadCommandPools &command_pools,
+            int frame_index,
+            const SecondaryRecordingInfo &recording_info,
+            DescriptorAllocator &frame_descriptor_allocator,
+            const ObjectManagerSystem::GameObjectTable &game_objects,
             const Camera &camera,
             const VkDescriptorSet global_descriptor_set,
             const VkDescriptorSet joint_descriptor_set,
-            const VkDescriptorSet texture_descriptor_set
+            const VkDescriptorSet texture_descriptor_set,
+            bool wireframe,
+            std::vector<VkCommandBuffer> &secondary_command_buffers,
+            std::vector<VkCommandBuffer> &late_command_buffers
         );
+    private:
+        // Descriptor set index of the geometry pool's vertex buffer in all pipeline layouts
+        static constexpr uint32_t GEOMETRY_SET = 3;
+        // Descriptor set index of the instance buffer in the main and indirect pipeline layouts, the
+        // indirect one binds GpuCullingSystem's
+        static constexpr uint32_t INSTANCE_SET = 4;
+        static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 1024;
+        // An object switches to level of detail n + 1 once its bounding sphere is less than
+        // LOD_SCREEN_SIZE / 2^n of the screen height tall, and back once it is LOD_HYSTERESIS taller
+        // than that again, so objects hovering around a threshold do not pop every frame
+        static constexpr float LOD_SCREEN_SIZE = 0.5f;
+        static constexpr float LOD_HYSTERESIS = 0.1f;
+        // Occluders are the objects with the largest bounding radius over distance, up to these limits
+        static constexpr uint32_t MAX_OCCLUDERS = 16;
+        static constexpr uint32_t MAX_OCCLUDER_TRIANGLES = 64 * 1024;
+        static constexpr float MIN_OCCLUDER_SIZE = 0.1f;
+
+        // Instances of one model at one level of detail, drawn by a single instanced draw
+        struct InstanceGroup {
+            Model *model;
+            uint32_t lod;
+            uint32_t first_instance;
+            uint32_t instance_count;
+        };
+
+        // A model of one of draw_list's objects, indexed by render_queue's values. object indexes draw_list.
+        struct InstanceRef {
+            Model *model;
+            uint32_t lod;
+            uint32_t object;
+        };
 
-        void render_wireframe_game_objects(
+        struct FrameInstances {
+            std::unique_ptr<Buffer> buffer;
+            uint32_t capacity = 0;
+        };
+
+        // What a command buffer has bound so far, so recording can skip what is already current
+        struct RecordingState {
+            VkIndexType index_type = VK_INDEX_TYPE_MAX_ENUM;
+            std::optional<VertexLayout> vertex_layout;
+            RenderStatistics statistics;
+        };
+
+        // Returns false when no pipeline could be bound and the draws have to be skipped
+        bool bind_main_pipeline(
             VkCommandBuffer command_buffer,
-            game_engine::ObjectManagerSystem::ObjectMap &game_objects,
-            const Camera &camera,
             const VkDescriptorSet global_descriptor_set,
-            const VkDescriptorSet joint_descriptor_set
+            const VkDescriptorSet joint_descriptor_set,
+            const VkDescriptorSet texture_descriptor_set,
+            RecordingState &state
         );
-    private:
+
+        bool bind_wireframe_pipeline(
+            VkCommandBuffer command_buffer,
+            const VkDescriptorSet global_descriptor_set,
+            const VkDescriptorSet joint_descriptor_set,
+            RecordingState &state
+        );
+
+        // Binds the geometry pool's index buffer of the model's index type unless it already is
+        void bind_index_buffer(VkCommandBuffer command_buffer, const Model &model, RecordingState &state) const;
+
+        // Points handles, transforms and renders at the table's components, makes room in object_lods for
+        // every slot and fills draw_list and world_boxes with its objects that have a model
+        void collect_game_objects(const ObjectManagerSystem::GameObjectTable &game_objects);
+
+        // Picks the level of detail of draw_list's objects and queues every model of them, sorted unless
+        // draw sorting is off. Runs on the job system when one is given.
+        void build_render_queue(JobSystem *job_system, const Camera &camera, DrawPipeline draw_pipeline);
+        // Writes render_queue's instances to the frame's buffer in queue order and merges consecutive
+        // ones of the same model and level of detail into instance_groups, instance_set is allocated from
+        // frame_descriptor_allocator for them
+        void write_instance_groups(JobSystem *job_system, int frame_index, DescriptorAllocator &frame_descriptor_allocator);
+        // Records instance_groups[begin, end) with the main pipeline bound
+        void draw_instance_groups(VkCommandBuffer command_buffer, size_t begin, size_t end, RecordingState &state) const;
+        // Records render_queue's entries [begin, end) with the wireframe pipeline bound
+        void draw_wireframe_entries(VkCommandBuffer command_buffer, size_t begin, size_t end, RecordingState &state) const;
+        // The frame's earlier submissions must be complete
+        void create_instance_buffer(FrameInstances &frame, uint32_t capacity);
+
         void create_main_pipeline_layout(
             VkDescriptorSetLayout global_set_layout,
             VkDescriptorSetLayout joint_set_layout,
             VkDescriptorSetLayout texture_set_layout
         );
 
-        void create_main_pipeline(VkRenderPass render_pass);
+        void create_main_pipeline(JobSystem &job_system, VkRenderPass render_pass);
 
         void create_wireframe_pipeline_layout(
             VkDescriptorSetLayout global_set_layout,
@@ -63,12 +208,80 @@ namespace game_engine {
             VkDescriptorSetLayout texture_set_layout
             );
 
-        void create_wireframe_pipeline(VkRenderPass render_pass);
+        void create_wireframe_pipeline(JobSystem &job_system, VkRenderPass render_pass);
+
+        void create_indirect_pipeline_layout(
+            VkDescriptorSetLayout global_set_layout,
+            VkDescriptorSetLayout joint_set_layout,
+            VkDescriptorSetLayout texture_set_layout
+        );
+
+        void create_indirect_pipeline(JobSystem &job_system, VkRenderPass render_pass);
+
+        // Picks the object's level of detail from its projected size and keeps it in object_lods. Objects
+        // are independent, so different ones can be selected concurrently.
+        uint32_t select_lod(ObjectHandle handle, const BoundingBox &world_box, const Camera &camera);
+
+        // Removes the objects of draw_list hidden behind the selected occluders, keeping the order
+        void cull_occluded_objects(JobSystem &job_system, const Camera &camera);
+
+        void record_indirect_game_objects(
+            JobSystem &job_system,
+            ThreadCommandPools &command_pools,
+            int frame_index,
+            const SecondaryRecordingInfo &recording_info,
+            const ObjectManagerSystem::GameObjectTable &game_objects,
+            const Camera &camera,
+            const VkDescriptorSet global_descriptor_set,
+            const VkDescriptorSet joint_descriptor_set,
+            const VkDescriptorSet texture_descriptor_set,
+            std::vector<VkCommandBuffer> &secondary_command_buffers,
+            std::vector<VkCommandBuffer> &late_command_buffers
+        );
 
         Device &device;
+        // Declared first so it outlives the pipeline that falls back to it
+        std::unique_ptr<MainPipeline> fallback_pipeline;
         std::unique_ptr<MainPipeline> pipeline;
         VkPipelineLayout pipeline_layout;
         std::unique_ptr<Pipeline> wireframe_pipeline;
         VkPipelineLayout wireframe_pipeline_layout;
+        GpuCullingSystem *gpu_culling_system;
+        std::unique_ptr<MainPipeline> indirect_pipeline;
+        VkPipelineLayout indirect_pipeline_layout = VK_NULL_HANDLE;
+
+        // Components of the table being drawn, only valid during the call that set them
+        std::span<const ObjectHandle> handles;
+        std::span<const transform_component> transforms;
+        std::span<const RenderComponent> renders;
+        // Level of detail every object was drawn with last, kept for hysteresis. Indexed by the handles'
+        // slot, so the shared object table stays read only while recording.
+        std::vector<uint32_t> object_lods;
+        // Dense indices into transforms and renders
+        std::vector<uint32_t> draw_list;
+        FrustumCuller frustum_culler;
+        std::vector<uint32_t> visible_objects;
+        // World boxes of draw_list, in the same order
+        std::vector<BoundingBox> world_boxes;
+
+        MaskedOcclusionCuller occlusion_culler;
+        bool software_occlusion_culling = false;
+        OcclusionCullingStatistics occlusion_statistics;
+        std::vector<std::pair<float, uint32_t>> occluder_candidates;
+        std::vector<uint8_t> object_visibility;
+        std::vector<VkCommandBuffer> chunk_command_buffers;
+
+        std::unique_ptr<DescriptorSetLayout> instance_set_layout;
+        std::vector<FrameInstances> frame_instances;
+        // Of the frame being recorded
+        VkDescriptorSet instance_set = VK_NULL_HANDLE;
+        std::vector<InstanceRef> instance_refs;
+        std::vector<InstanceGroup> instance_groups;
+
+        RenderQueue render_queue;
+        bool draw_sorting = true;
+        RenderStatistics render_statistics;
+        // One per chunk of record_game_objects, summed into render_statistics
+        std::vector<RenderStatistics> chunk_statistics;
     };
 }
@@ -33,10 +33,8 @@ namespace game_engine {
 		static constexpr bool USE_SRGB = true;
 		static constexpr bool USE_UNORM = false;
 	private:
-		void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory);
+		void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& buffer_allocation);
 		void create_image(VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
-		void transition_image_layout(VkImageLayout old_layout, VkImageLayout new_layout);
-		void generate_mipmaps();
 
 		VkFilter set_filter(int min_mag_filter);
 		VkFilter set_filter_mip(int min_filter);
@@ -58,7 +56,7 @@ namespace game_engine {
 
 		VkFormat image_format{ VkFormat::VK_FORMAT_UNDEFINED };
 		VkImage texture_image{ nullptr };
-		VkDeviceMemory texture_image_memory{ nullptr };
+		Allocation texture_image_memory;
 		VkImageLayout image_layout{ VkImageLayout::VK_IMAGE_LAYOUT_UNDEFINED };
 		VkImageView texture_image_view{ nullptr };
 		VkSampler texture_sampler{ nullptr };
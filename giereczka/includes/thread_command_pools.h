@@ -0,0 +1,46 @@
+#pragma once
+
+#include "pch.h"
+
+#include "device.h"
+
+namespace game_engine {
+	// Render pass state a secondary command buffer continues
+	struct SecondaryRecordingInfo {
+		VkRenderPass render_pass;
+		VkFramebuffer framebuffer;
+		VkExtent2D extent;
+	};
+
+	// One transient command pool per frame in flight and per recording thread. Command pools are
+	// externally synchronized, so each thread only ever touches its own pool, and a frame's pools
+	// are reset wholesale once that frame's fence has signaled.
+	class ThreadCommandPools {
+	public:
+		ThreadCommandPools(Device& device, uint32_t frame_count, uint32_t thread_count);
+		~ThreadCommandPools();
+
+		ThreadCommandPools(const ThreadCommandPools&) = delete;
+		ThreadCommandPools& operator=(const ThreadCommandPools&) = delete;
+
+		uint32_t get_thread_count() const { return thread_count; }
+
+		// Recycles every secondary command buffer of the frame, call after begin_frame()
+		void reset(int frame_index);
+
+		// Begins a secondary command buffer that continues the given render pass, with viewport and
+		// scissor already set since dynamic state is not inherited from the primary
+		VkCommandBuffer begin_secondary(int frame_index, uint32_t thread_index, const SecondaryRecordingInfo& info);
+
+	private:
+		struct ThreadPoolSlot {
+			VkCommandPool command_pool;
+			std::vector<VkCommandBuffer> command_buffers;
+			uint32_t used = 0;
+		};
+
+		Device& device;
+		uint32_t thread_count;
+		std::vector<std::vector<ThreadPoolSlot>> frames;
+	};
+}
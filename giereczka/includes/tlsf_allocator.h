@@ -0,0 +1,74 @@
+#pragma once
+
+#include "pch.h"
+
+namespace game_engine {
+	// Two-level segregated fit allocator over an abstract [0, size) range. It only hands out offsets,
+	// the memory itself lives elsewhere (a VkDeviceMemory block, a geometry buffer, ...).
+	// Free regions are kept in size-class lists indexed by two bitmaps, so allocation and free are O(1)
+	// and freed regions are merged with their free neighbours immediately.
+	class TlsfAllocator {
+	public:
+		static constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
+
+		explicit TlsfAllocator(VkDeviceSize size);
+
+		TlsfAllocator(const TlsfAllocator&) = delete;
+		TlsfAllocator& operator=(const TlsfAllocator&) = delete;
+
+		// Returns a handle for free(), or INVALID_HANDLE when no free region is large enough.
+		// alignment must be a power of two.
+		uint32_t allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		void free(uint32_t handle);
+		// Extends the range to [0, new_size), the added space joins the last region when it is free
+		void grow(VkDeviceSize new_size);
+
+		VkDeviceSize get_size() const { return size; }
+		VkDeviceSize get_used_size() const { return used_size; }
+		uint32_t get_allocation_count() const { return allocation_count; }
+		uint32_t get_free_region_count() const { return free_region_count; }
+		VkDeviceSize get_largest_free_region() const;
+		bool is_empty() const { return allocation_count == 0; }
+
+	private:
+		static constexpr uint32_t SL_LOG2 = 5;
+		static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+		static constexpr uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+		// Smaller remainders stay attached to the allocation instead of becoming unusable free regions
+		static constexpr VkDeviceSize MIN_REGION_SIZE = 16;
+
+		struct Region {
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+			uint32_t prev_physical = INVALID_HANDLE;
+			uint32_t next_physical = INVALID_HANDLE;
+			uint32_t prev_free = INVALID_HANDLE;
+			uint32_t next_free = INVALID_HANDLE;
+			bool is_free = false;
+		};
+
+		static void mapping_insert(VkDeviceSize size, uint32_t& fl, uint32_t& sl);
+		static void mapping_search(VkDeviceSize size, uint32_t& fl, uint32_t& sl);
+
+		uint32_t find_free_region(VkDeviceSize size);
+		void insert_free_region(uint32_t index);
+		void remove_free_region(uint32_t index);
+		uint32_t split_region(uint32_t index, VkDeviceSize first_size);
+		uint32_t merge_with_next(uint32_t index);
+
+		uint32_t create_region();
+		void destroy_region(uint32_t index);
+
+		VkDeviceSize size;
+		VkDeviceSize used_size = 0;
+		uint32_t allocation_count = 0;
+		uint32_t free_region_count = 0;
+
+		uint64_t fl_bitmap = 0;
+		std::array<uint32_t, FL_COUNT> sl_bitmaps{};
+		std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> free_lists;
+
+		std::vector<Region> regions;
+		std::vector<uint32_t> unused_regions;
+	};
+}
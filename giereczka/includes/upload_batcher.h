@@ -0,0 +1,125 @@
+#pragma once
+
+#include "pch.h"
+
+#include "device.h"
+#include "buffer.h"
+
+#include <deque>
+#include <mutex>
+
+namespace game_engine {
+	struct ImageUpload {
+		VkImage image = VK_NULL_HANDLE;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mip_levels = 1;
+		// Fill levels 1..mip_levels-1 by blitting down from level 0, the format must support linear blits
+		bool generate_mipmaps = false;
+		VkFilter mip_filter = VK_FILTER_LINEAR;
+		// Tightly packed level 0 texels
+		const void* data = nullptr;
+		VkDeviceSize size = 0;
+	};
+
+	// Collects buffer and image uploads into one command buffer and submits them together, instead of
+	// a vkQueueWaitIdle per copy. Source data is copied into a persistently mapped staging ring right
+	// away, so callers may free it on return. Each submission is tracked by fences and identified by
+	// an increasing batch value; ring space is reclaimed as batches complete.
+	//
+	// With a dedicated transfer queue the copies run there, alongside rendering. The batch releases
+	// ownership of its resources to the graphics family and signals a semaphore; flush() then submits
+	// the matching acquire, plus mip generation which needs a graphics queue, on the graphics queue
+	// waiting on that semaphore. Without one, everything is a single graphics queue submission.
+	// Either way, work submitted to the graphics queue after flush() sees the uploads.
+	//
+	// flush(), wait() and wait_idle() submit to the graphics queue, call them from the thread that
+	// submits frames; the renderers flush before each frame submission. Uploads may be recorded from
+	// any thread when there is a dedicated transfer queue, as they only ever submit to that one.
+	class UploadBatcher {
+	public:
+		static constexpr VkDeviceSize DEFAULT_RING_SIZE = 64ull * 1024 * 1024;
+
+		UploadBatcher(Device& device, VkDeviceSize ring_size = DEFAULT_RING_SIZE);
+		~UploadBatcher();
+
+		UploadBatcher(const UploadBatcher&) = delete;
+		UploadBatcher& operator=(const UploadBatcher&) = delete;
+
+		// Memory properties for static GPU data that is written once through this batcher. Device
+		// local and host visible when the device exposes a large such heap (resizable BAR, UMA), so
+		// upload_buffer() can write it directly without staging.
+		VkMemoryPropertyFlags get_static_buffer_properties() const { return static_buffer_properties; }
+
+		// The destination range must not be in use by the GPU
+		void upload_buffer(Buffer& buffer, const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+		// Leaves every mip level in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+		void upload_image(const ImageUpload& upload);
+
+		// Submits the pending uploads, returns the value of the last submitted batch
+		uint64_t flush();
+		// True once the batch has finished on the graphics queue and its resources are usable anywhere
+		bool is_complete(uint64_t batch_value);
+		void wait(uint64_t batch_value);
+		void wait_idle();
+
+	private:
+		struct Batch {
+			VkCommandPool transfer_command_pool = VK_NULL_HANDLE;
+			VkCommandBuffer transfer_command_buffer = VK_NULL_HANDLE;
+			VkFence transfer_fence = VK_NULL_HANDLE;
+
+			// Only with a dedicated transfer queue
+			VkCommandPool graphics_command_pool = VK_NULL_HANDLE;
+			VkCommandBuffer graphics_command_buffer = VK_NULL_HANDLE;
+			VkFence graphics_fence = VK_NULL_HANDLE;
+			VkSemaphore transfer_finished = VK_NULL_HANDLE;
+
+			// Queue family ownership transfers, recorded as releases on the transfer queue and as
+			// acquires on the graphics queue
+			std::vector<VkBufferMemoryBarrier> buffer_transfers;
+			std::vector<VkImageMemoryBarrier> image_transfers;
+			// Images still waiting for their mip chain and final layout on the graphics queue
+			std::vector<ImageUpload> pending_images;
+
+			uint64_t value = 0;
+			bool transfer_done = false;
+			bool graphics_submitted = false;
+			// Ring bytes used by this batch, padding and wrap-around included
+			VkDeviceSize ring_bytes = 0;
+			// Staging buffers for uploads too large for the ring
+			std::vector<std::pair<VkBuffer, Allocation>> oversized_staging;
+		};
+
+		static void record_image_finish(VkCommandBuffer command_buffer, const ImageUpload& upload);
+
+		// Returns the batch being recorded, beginning a new one if needed
+		Batch& get_recording_batch();
+		VkDeviceSize allocate_staging(VkDeviceSize size, VkBuffer& staging_buffer, void*& mapped);
+		void submit_recording_batch();
+		void submit_pending_graphics();
+		// Waits for the oldest batch still copying, which frees its staging ring space
+		void wait_oldest_transfer();
+		void retire_completed_batches();
+
+		Device& device;
+		bool dedicated_transfer;
+		uint32_t transfer_family;
+		uint32_t graphics_family;
+		VkMemoryPropertyFlags static_buffer_properties;
+		VkDeviceSize copy_alignment;
+
+		VkBuffer ring_buffer = VK_NULL_HANDLE;
+		Allocation ring_allocation;
+		VkDeviceSize ring_size;
+		VkDeviceSize ring_head = 0;
+		VkDeviceSize ring_in_use = 0;
+
+		std::mutex mutex;
+		std::unique_ptr<Batch> recording;
+		std::deque<std::unique_ptr<Batch>> in_flight;
+		std::vector<std::unique_ptr<Batch>> free_batches;
+		uint64_t next_batch_value = 1;
+		uint64_t completed_batch_value = 0;
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pch.h"
+
+#include "bounds.h"
+
+namespace game_engine {
+	// How a mesh's vertices are packed in the geometry pool, mirrored by VERTEX_LAYOUT_SKINNED in the
+	// vertex shaders which pick the stride from it
+	enum class VertexLayout : uint32_t {
+		static_mesh = 0,
+		skinned = 1
+	};
+
+	// Vertex of static meshes in the geometry pool, 16 bytes instead of the 88 of Model::Vertex. Shaders
+	// read it as four uints with the unpack*() built-ins, so members must not straddle them.
+	struct PackedVertex {
+		// unorm16 within the mesh's PositionQuantization
+		uint16_t position[3];
+		// Octahedral snorm8, see encode_octahedral
+		int8_t normal[2];
+		// Half floats
+		uint16_t uv[2];
+		int8_t tangent[2];
+		// rgb565, red in the high bits
+		uint16_t color;
+	};
+
+	// Vertex of skinned meshes, joints index the 100 joint transforms of JointUbo
+	struct PackedSkinnedVertex {
+		PackedVertex base;
+		uint8_t joint_ids[4];
+		// unorm8, summing to exactly 255
+		uint8_t joint_weights[4];
+	};
+
+	static_assert(sizeof(PackedVertex) == 16, "PackedVertex layout no longer matches the shaders");
+	static_assert(sizeof(PackedSkinnedVertex) == 24, "PackedSkinnedVertex layout no longer matches the shaders");
+
+	// Positions are stored as offset + unorm16 * scale with one scale for every axis. Dequantizing is
+	// then a translation and a uniform scale, which the renderer folds into the model matrix so normals
+	// transformed by it keep their direction.
+	struct PositionQuantization {
+		glm::vec3 offset{0.f};
+		float scale = 1.f;
+
+		static PositionQuantization from_bounds(const BoundingBox& box);
+
+		std::array<uint16_t, 3> quantize(const glm::vec3& position) const;
+		// Maps quantized positions in [0, 1] back to model space
+		glm::mat4 dequantization_matrix() const;
+	};
+
+	uint32_t get_vertex_stride(VertexLayout layout);
+
+	// Unit vector onto the octahedron unfolded into [-1, 1]^2, as snorm8
+	std::array<int8_t, 2> encode_octahedral(const glm::vec3& direction);
+	uint16_t pack_rgb565(const glm::vec3& color);
+}
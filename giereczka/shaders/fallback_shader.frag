@@ -0,0 +1,18 @@
+#version 450
+
+// Unlit stand-in used while the main fragment shader's pipeline compiles in the background
+
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec3 fragPosWorld;
+layout (location = 2) in vec3 fragNormalWorld;
+layout (location = 3) in vec2 fragUV;
+layout (location = 5) flat in vec3 fragOverrideColor;
+
+layout (location = 0) out vec4 color;
+
+void main()
+{
+	vec3 base_color = length(fragOverrideColor) > 0.0 ? fragOverrideColor : inColor;
+	float shade = 0.5 + 0.5 * abs(normalize(fragNormalWorld).y);
+	color = vec4(base_color * shade, 1.0);
+}
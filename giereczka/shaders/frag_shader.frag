@@ -7,6 +7,9 @@ layout (location = 0) in vec3 inColor;
 layout (location = 1) in vec3 fragPosWorld;
 layout (location = 2) in vec3 fragNormalWorld;
 layout (location = 3) in vec2 fragUV;     // Add UV coordinates input
+// Per instance values, from RenderSystem's or GpuCullingSystem's instance buffer
+layout (location = 4) flat in int fragTextureIndex;
+layout (location = 5) flat in vec3 fragOverrideColor;
 
 layout (location = 0) out vec4 color;
 
@@ -27,12 +30,6 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 // Add texture sampler binding
 layout(set = 2, binding = 0) uniform sampler2D texSampler[];
 
-layout(push_constant) uniform Push {
-	mat4 model_matrix;
-	vec3 color;
-	int texture_index;
-} push;
-
 void main()
 {
 	vec3 diffuse_light = ubo.ambient_light_color.xyz * ubo.ambient_light_color.w;
@@ -66,13 +63,13 @@ void main()
 	vec3 base_color = inColor;
 	
 	// Use texture if available
-	if (push.texture_index >= -1) {
-		base_color = texture(texSampler[push.texture_index], fragUV).rgb;
+	if (fragTextureIndex >= -1) {
+		base_color = texture(texSampler[fragTextureIndex], fragUV).rgb;
 	}
 
-	if(length(push.color) > 0.0)
+	if(length(fragOverrideColor) > 0.0)
 	{
-		color = vec4(push.color, 1.0);
+		color = vec4(fragOverrideColor, 1.0);
 	}
 	else color = vec4(diffuse_light * base_color + specular_light * base_color, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+#version 450
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out vec2 fragUV;
+layout(location = 4) flat out int fragTextureIndex;
+layout(location = 5) flat out vec3 fragOverrideColor;
+
+struct PointLight {
+	vec4 position;
+	vec4 color;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 projection_matrix;
+	mat4 view_matrix;
+	mat4 inverse_view_matrix;
+	vec4 ambient_light_color;
+	PointLight point_lights[10];
+	int num_point_lights;
+} ubo;
+
+layout(set = 1, binding = 0) uniform JointUbo {
+	mat4 joint_transforms[100];
+	int num_joints;
+} joint_ubo;
+
+// GpuInstance, firstInstance of every indirect draw is the index of the instance it draws
+struct Instance {
+	mat4 model_matrix;
+	vec4 bounding_sphere;
+	vec3 color;
+	int texture_index;
+	uint index_count;
+	uint first_index;
+	int vertex_offset;
+	uint vertex_layout;
+	// VkIndexType, also the stream of draw commands
+	uint index_type;
+	// Non-zero meshlet_count draws the triangles cull_meshlets.comp compacts
+	uint first_meshlet;
+	uint meshlet_count;
+	uint padding;
+};
+
+layout(set = 4, binding = 0) readonly buffer Instances {
+	Instance instances[];
+} scene;
+
+const float AMBIENT = 0.02;
+
+const uint VERTEX_LAYOUT_SKINNED = 1;
+
+// PackedVertex or PackedSkinnedVertex of every mesh as uints, fetched by gl_VertexIndex
+// (vertexOffset/firstVertex included) times the stride of the mesh's layout
+layout(set = 3, binding = 0) readonly buffer GeometryPool {
+	uint words[];
+} geometry;
+
+vec3 decode_octahedral(vec2 encoded)
+{
+	vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-direction.z, 0.0);
+	direction.xy += vec2(direction.x >= 0.0 ? -fold : fold, direction.y >= 0.0 ? -fold : fold);
+	return normalize(direction);
+}
+
+void main()
+{
+	Instance instance = scene.instances[gl_InstanceIndex];
+	uint stride = instance.vertex_layout == VERTEX_LAYOUT_SKINNED ? 6 : 4;
+	uint base = uint(gl_VertexIndex) * stride;
+	uint position_z_normal = geometry.words[base + 1];
+	uint color_bits = geometry.words[base + 3] >> 16;
+
+	// Quantized within the mesh's bounds, model_matrix includes the dequantization
+	vec3 position = vec3(unpackUnorm2x16(geometry.words[base]), unpackUnorm2x16(position_z_normal).x);
+	vec3 normal = decode_octahedral(unpackSnorm4x8(position_z_normal).zw);
+	vec3 color = vec3(uvec3(color_bits >> 11, (color_bits >> 5) & 63u, color_bits & 31u)) / vec3(31.0, 63.0, 31.0);
+	vec2 uv = unpackHalf2x16(geometry.words[base + 2]);
+	ivec4 jointIds = ivec4(0);
+	vec4 weights = vec4(0.0);
+	if (instance.vertex_layout == VERTEX_LAYOUT_SKINNED)
+	{
+		jointIds = ivec4((uvec4(geometry.words[base + 4]) >> uvec4(0, 8, 16, 24)) & 0xFFu);
+		weights = unpackUnorm4x8(geometry.words[base + 5]);
+	}
+
+	vec4 animated_position = vec4(0.0f);
+	mat4 joint_transform = mat4(0.0f);
+	for(int i = 0; i < 4; ++i)
+	{
+		if(weights[i] == 0) continue;
+		if(jointIds[i] >= joint_ubo.num_joints)
+		{
+			animated_position = vec4(position, 1.0f);
+			joint_transform = mat4(1.0f);
+			break;
+		}
+
+		vec4 local_position = joint_ubo.joint_transforms[jointIds[i]] * vec4(position, 1.0f);
+		animated_position += local_position * weights[i];
+		joint_transform += joint_ubo.joint_transforms[jointIds[i]] * weights[i];
+	}
+
+	vec4 position_world = instance.model_matrix * vec4(position, 1.0);
+
+	//vec4 position_world = normalize(instance.model_matrix * animated_position);
+	gl_Position = ubo.projection_matrix * ubo.view_matrix * position_world;
+
+	fragNormalWorld = normalize(mat3(instance.model_matrix) * normal);
+	fragPosWorld = position_world.xyz;
+	fragUV = uv;  // Pass UV coordinates to fragment shader
+	fragColor = color;
+	fragTextureIndex = instance.texture_index;
+	fragOverrideColor = instance.color;
+}
\ No newline at end of file
@@ -1,17 +1,11 @@
 #version 450
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 color;
-layout(location = 2) in vec3 normal;
-layout(location = 3) in vec2 uv;
-layout(location = 4) in vec3 tangent;
-layout(location = 5) in ivec4 jointIds;
-layout(location = 6) in vec4 weights;
-
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
 layout(location = 3) out vec2 fragUV;
+layout(location = 4) flat out int fragTextureIndex;
+layout(location = 5) flat out vec3 fragOverrideColor;
 
 struct PointLight {
 	vec4 position;
@@ -32,16 +26,61 @@ layout(set = 1, binding = 0) uniform JointUbo {
 	int num_joints;
 } joint_ubo;
 
-layout(push_constant) uniform Push {
+// RenderSystem's InstanceData, firstInstance of every draw is the first instance of its group
+struct Instance {
 	mat4 model_matrix;
 	vec3 color;
 	int texture_index;
+};
+
+layout(set = 4, binding = 0) readonly buffer Instances {
+	Instance instances[];
+} scene;
+
+// InstancedPushConstantData
+layout(push_constant) uniform Push {
+	uint vertex_layout;
 } push;
 
 const float AMBIENT = 0.02;
 
+const uint VERTEX_LAYOUT_SKINNED = 1;
+
+// PackedVertex or PackedSkinnedVertex of every mesh as uints, fetched by gl_VertexIndex
+// (vertexOffset/firstVertex included) times the stride of the mesh's layout
+layout(set = 3, binding = 0) readonly buffer GeometryPool {
+	uint words[];
+} geometry;
+
+vec3 decode_octahedral(vec2 encoded)
+{
+	vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-direction.z, 0.0);
+	direction.xy += vec2(direction.x >= 0.0 ? -fold : fold, direction.y >= 0.0 ? -fold : fold);
+	return normalize(direction);
+}
+
 void main()
 {
+	Instance instance = scene.instances[gl_InstanceIndex];
+	uint stride = push.vertex_layout == VERTEX_LAYOUT_SKINNED ? 6 : 4;
+	uint base = uint(gl_VertexIndex) * stride;
+	uint position_z_normal = geometry.words[base + 1];
+	uint color_bits = geometry.words[base + 3] >> 16;
+
+	// Quantized within the mesh's bounds, model_matrix includes the dequantization
+	vec3 position = vec3(unpackUnorm2x16(geometry.words[base]), unpackUnorm2x16(position_z_normal).x);
+	vec3 normal = decode_octahedral(unpackSnorm4x8(position_z_normal).zw);
+	vec3 color = vec3(uvec3(color_bits >> 11, (color_bits >> 5) & 63u, color_bits & 31u)) / vec3(31.0, 63.0, 31.0);
+	vec2 uv = unpackHalf2x16(geometry.words[base + 2]);
+	ivec4 jointIds = ivec4(0);
+	vec4 weights = vec4(0.0);
+	if (push.vertex_layout == VERTEX_LAYOUT_SKINNED)
+	{
+		jointIds = ivec4((uvec4(geometry.words[base + 4]) >> uvec4(0, 8, 16, 24)) & 0xFFu);
+		weights = unpackUnorm4x8(geometry.words[base + 5]);
+	}
+
 	vec4 animated_position = vec4(0.0f);
 	mat4 joint_transform = mat4(0.0f);
 	for(int i = 0; i < 4; ++i)
@@ -59,13 +98,15 @@ void main()
 		joint_transform += joint_ubo.joint_transforms[jointIds[i]] * weights[i];
 	}
 
-	vec4 position_world = push.model_matrix * vec4(position, 1.0);
+	vec4 position_world = instance.model_matrix * vec4(position, 1.0);
 
-	//vec4 position_world = normalize(push.model_matrix * animated_position);
+	//vec4 position_world = normalize(instance.model_matrix * animated_position);
 	gl_Position = ubo.projection_matrix * ubo.view_matrix * position_world;
 
-	fragNormalWorld = normalize(mat3(push.model_matrix) * normal);
+	fragNormalWorld = normalize(mat3(instance.model_matrix) * normal);
 	fragPosWorld = position_world.xyz;
 	fragUV = uv;  // Pass UV coordinates to fragment shader
 	fragColor = color;
+	fragTextureIndex = instance.texture_index;
+	fragOverrideColor = instance.color;
 }
\ No newline at end of file
@@ -1,10 +1,5 @@
 #version 450
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 color;
-layout(location = 2) in vec3 normal;
-layout(location = 3) in vec2 uv;
-
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
@@ -26,8 +21,37 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 layout(push_constant) uniform Push {
 	mat4 model_matrix;
 	vec3 color;
+	int texture_index;
+	uint vertex_layout;
 } push;
+
+const uint VERTEX_LAYOUT_SKINNED = 1;
+
+// PackedVertex or PackedSkinnedVertex of every mesh as uints, fetched by gl_VertexIndex
+// (vertexOffset/firstVertex included) times the stride of the mesh's layout
+layout(set = 3, binding = 0) readonly buffer GeometryPool {
+	uint words[];
+} geometry;
+
+vec3 decode_octahedral(vec2 encoded)
+{
+	vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-direction.z, 0.0);
+	direction.xy += vec2(direction.x >= 0.0 ? -fold : fold, direction.y >= 0.0 ? -fold : fold);
+	return normalize(direction);
+}
+
 void main() {
+	uint stride = push.vertex_layout == VERTEX_LAYOUT_SKINNED ? 6 : 4;
+	uint base = uint(gl_VertexIndex) * stride;
+	uint position_z_normal = geometry.words[base + 1];
+	uint color_bits = geometry.words[base + 3] >> 16;
+
+	// Quantized within the mesh's bounds, model_matrix includes the dequantization
+	vec3 position = vec3(unpackUnorm2x16(geometry.words[base]), unpackUnorm2x16(position_z_normal).x);
+	vec3 normal = decode_octahedral(unpackSnorm4x8(position_z_normal).zw);
+	vec3 color = vec3(uvec3(color_bits >> 11, (color_bits >> 5) & 63u, color_bits & 31u)) / vec3(31.0, 63.0, 31.0);
+
 	vec4 position_world = push.model_matrix * vec4(position, 1.0);
 	gl_Position = ubo.projection_matrix * ubo.view_matrix * position_world;
 
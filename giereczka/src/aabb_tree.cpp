@@ -0,0 +1,357 @@
+#include "aabb_tree.h"
+
+#include <cassert>
+
+game_engine::AabbTree::AabbTree(float margin) : margin(margin)
+{
+}
+
+uint32_t game_engine::AabbTree::create_proxy(const BoundingBox& box, uint32_t user_data)
+{
+	assert(!box.is_empty() && "Cannot insert an empty box");
+
+	uint32_t proxy = allocate_node();
+	nodes[proxy].box = box.expanded(margin);
+	nodes[proxy].leaf_box = box;
+	nodes[proxy].user_data = user_data;
+	nodes[proxy].height = 0;
+
+	insert_leaf(proxy);
+	proxy_count++;
+	return proxy;
+}
+
+void game_engine::AabbTree::destroy_proxy(uint32_t proxy)
+{
+	assert(proxy < nodes.size() && nodes[proxy].is_leaf() && "Not a proxy of this tree");
+
+	remove_leaf(proxy);
+	free_node(proxy);
+	proxy_count--;
+}
+
+bool game_engine::AabbTree::move_proxy(uint32_t proxy, const BoundingBox& box, const glm::vec3& displacement)
+{
+	assert(proxy < nodes.size() && nodes[proxy].is_leaf() && "Not a proxy of this tree");
+
+	Node& node = nodes[proxy];
+	node.leaf_box = box;
+
+	// Still inside the fat box, unless the object shrank so much that the fat box would keep catching
+	// queries far away from it
+	if (node.box.contains(box) && !node.box.contains(box.expanded(4.f * margin)))
+	{
+		return false;
+	}
+
+	BoundingBox fat_box = box.expanded(margin);
+	glm::vec3 stretch = displacement * DISPLACEMENT_MULTIPLIER;
+	fat_box.min += glm::min(stretch, glm::vec3(0.f));
+	fat_box.max += glm::max(stretch, glm::vec3(0.f));
+
+	remove_leaf(proxy);
+	nodes[proxy].box = fat_box;
+	insert_leaf(proxy);
+	return true;
+}
+
+float game_engine::AabbTree::get_area_ratio() const
+{
+	if (root == INVALID_NODE)
+	{
+		return 0.f;
+	}
+
+	float root_area = nodes[root].box.get_surface_area();
+	float total_area = 0.f;
+	for (const Node& node : nodes)
+	{
+		if (node.height == FREE_NODE_HEIGHT) continue;
+		total_area += node.box.get_surface_area();
+	}
+	return root_area > 0.f ? total_area / root_area : 0.f;
+}
+
+uint32_t game_engine::AabbTree::allocate_node()
+{
+	uint32_t node;
+	if (free_list != INVALID_NODE)
+	{
+		node = free_list;
+		free_list = nodes[node].parent;
+		nodes[node] = Node{};
+	}
+	else
+	{
+		node = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+	}
+
+	node_count++;
+	return node;
+}
+
+void game_engine::AabbTree::free_node(uint32_t node)
+{
+	nodes[node] = Node{};
+	nodes[node].parent = free_list;
+	nodes[node].height = FREE_NODE_HEIGHT;
+	free_list = node;
+	node_count--;
+}
+
+void game_engine::AabbTree::insert_leaf(uint32_t leaf)
+{
+	if (root == INVALID_NODE)
+	{
+		root = leaf;
+		nodes[root].parent = INVALID_NODE;
+		return;
+	}
+
+	// Descend towards the sibling with the lowest surface area cost, stopping where pairing with the
+	// current node is cheaper than pushing the leaf further down
+	const BoundingBox leaf_box = nodes[leaf].box;
+	uint32_t index = root;
+	while (!nodes[index].is_leaf())
+	{
+		const Node& node = nodes[index];
+		float area = node.box.get_surface_area();
+		float combined_area = node.box.merged(leaf_box).get_surface_area();
+
+		// Cost of a new parent for this node and the leaf, and the growth every ancestor pays anyway
+		float cost = 2.f * combined_area;
+		float inheritance_cost = 2.f * (combined_area - area);
+
+		auto descend_cost = [&](uint32_t child)
+		{
+			const Node& child_node = nodes[child];
+			float merged_area = child_node.box.merged(leaf_box).get_surface_area();
+			if (child_node.is_leaf())
+			{
+				return merged_area + inheritance_cost;
+			}
+			return merged_area - child_node.box.get_surface_area() + inheritance_cost;
+		};
+
+		float cost1 = descend_cost(node.child1);
+		float cost2 = descend_cost(node.child2);
+		if (cost < cost1 && cost < cost2)
+		{
+			break;
+		}
+
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	uint32_t sibling = index;
+	uint32_t old_parent = nodes[sibling].parent;
+
+	// May grow the node array, so no references are held across it
+	uint32_t new_parent = allocate_node();
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].box = nodes[sibling].box.merged(leaf_box);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].child1 = sibling;
+	nodes[new_parent].child2 = leaf;
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	if (old_parent != INVALID_NODE)
+	{
+		if (nodes[old_parent].child1 == sibling)
+		{
+			nodes[old_parent].child1 = new_parent;
+		}
+		else
+		{
+			nodes[old_parent].child2 = new_parent;
+		}
+	}
+	else
+	{
+		root = new_parent;
+	}
+
+	refit_ancestors(nodes[leaf].parent);
+}
+
+void game_engine::AabbTree::remove_leaf(uint32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = INVALID_NODE;
+		return;
+	}
+
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandparent = nodes[parent].parent;
+	uint32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	// The sibling takes the parent's place
+	if (grandparent != INVALID_NODE)
+	{
+		if (nodes[grandparent].child1 == parent)
+		{
+			nodes[grandparent].child1 = sibling;
+		}
+		else
+		{
+			nodes[grandparent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandparent;
+		free_node(parent);
+
+		refit_ancestors(grandparent);
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = INVALID_NODE;
+		free_node(parent);
+	}
+
+	nodes[leaf].parent = INVALID_NODE;
+}
+
+void game_engine::AabbTree::refit_ancestors(uint32_t node)
+{
+	uint32_t index = node;
+	while (index != INVALID_NODE)
+	{
+		index = balance(index);
+
+		Node& current = nodes[index];
+		const Node& child1 = nodes[current.child1];
+		const Node& child2 = nodes[current.child2];
+		current.height = 1 + std::max(child1.height, child2.height);
+		current.box = child1.box.merged(child2.box);
+
+		index = current.parent;
+	}
+}
+
+// Rotates the taller child up when the children's heights differ by more than one, returns the node
+// now at a's place
+uint32_t game_engine::AabbTree::balance(uint32_t a)
+{
+	Node& node_a = nodes[a];
+	if (node_a.is_leaf() || node_a.height < 2)
+	{
+		return a;
+	}
+
+	uint32_t b = node_a.child1;
+	uint32_t c = node_a.child2;
+	Node& node_b = nodes[b];
+	Node& node_c = nodes[c];
+
+	int32_t difference = static_cast<int32_t>(node_c.height) - static_cast<int32_t>(node_b.height);
+
+	// Rotate c up
+	if (difference > 1)
+	{
+		uint32_t f = node_c.child1;
+		uint32_t g = node_c.child2;
+		Node& node_f = nodes[f];
+		Node& node_g = nodes[g];
+
+		node_c.child1 = a;
+		node_c.parent = node_a.parent;
+		node_a.parent = c;
+
+		if (node_c.parent != INVALID_NODE)
+		{
+			if (nodes[node_c.parent].child1 == a)
+			{
+				nodes[node_c.parent].child1 = c;
+			}
+			else
+			{
+				nodes[node_c.parent].child2 = c;
+			}
+		}
+		else
+		{
+			root = c;
+		}
+
+		// The taller grandchild stays under c, the other one moves under a
+		if (node_f.height > node_g.height)
+		{
+			node_c.child2 = f;
+			node_a.child2 = g;
+			node_g.parent = a;
+			node_a.box = node_b.box.merged(node_g.box);
+			node_c.box = node_a.box.merged(node_f.box);
+			node_a.height = 1 + std::max(node_b.height, node_g.height);
+			node_c.height = 1 + std::max(node_a.height, node_f.height);
+		}
+		else
+		{
+			node_c.child2 = g;
+			node_a.child2 = f;
+			node_f.parent = a;
+			node_a.box = node_b.box.merged(node_f.box);
+			node_c.box = node_a.box.merged(node_g.box);
+			node_a.height = 1 + std::max(node_b.height, node_f.height);
+			node_c.height = 1 + std::max(node_a.height, node_g.height);
+		}
+
+		return c;
+	}
+
+	// Rotate b up
+	if (difference < -1)
+	{
+		uint32_t d = node_b.child1;
+		uint32_t e = node_b.child2;
+		Node& node_d = nodes[d];
+		Node& node_e = nodes[e];
+
+		node_b.child1 = a;
+		node_b.parent = node_a.parent;
+		node_a.parent = b;
+
+		if (node_b.parent != INVALID_NODE)
+		{
+			if (nodes[node_b.parent].child1 == a)
+			{
+				nodes[node_b.parent].child1 = b;
+			}
+			else
+			{
+				nodes[node_b.parent].child2 = b;
+			}
+		}
+		else
+		{
+			root = b;
+		}
+
+		if (node_d.height > node_e.height)
+		{
+			node_b.child2 = d;
+			node_a.child1 = e;
+			node_e.parent = a;
+			node_a.box = node_c.box.merged(node_e.box);
+			node_b.box = node_a.box.merged(node_d.box);
+			node_a.height = 1 + std::max(node_c.height, node_e.height);
+			node_b.height = 1 + std::max(node_a.height, node_d.height);
+		}
+		else
+		{
+			node_b.child2 = e;
+			node_a.child1 = d;
+			node_d.parent = a;
+			node_a.box = node_c.box.merged(node_d.box);
+			node_b.box = node_a.box.merged(node_e.box);
+			node_a.height = 1 + std::max(node_c.height, node_d.height);
+			node_b.height = 1 + std::max(node_a.height, node_e.height);
+		}
+
+		return b;
+	}
+
+	return a;
+}
@@ -0,0 +1,464 @@
+// cull_bench.cpp : CPU culling and mesh optimization microbenchmarks, no Vulkan device is needed.
+//
+// Usage: giereczka_cull_bench [--mode frustum|aabb-tree|vertex-cache] [--objects N] [--iterations N]
+//                             [--grid N]
+//
+// frustum: fills a FrustumCuller with random world space boxes and reports how many boxes per
+// millisecond the scalar and SIMD kernels test. About a tenth of the boxes end up in view. The SIMD
+// kernel is SSE2 on x64 by default, configure with -DGIERECZKA_AVX2=ON for the AVX2 one.
+//
+// aabb-tree: checks AabbTree's box, sphere, frustum and ray queries against brute force over random
+// boxes, then moves two thirds of the boxes along steady velocities for --iterations frames and reports
+// the update cost, checks the queries again and finally teleports the moving boxes so they all
+// reinsert. Fails when any query disagrees with brute force.
+//
+// vertex-cache: builds a UV sphere of --grid by --grid quads with its triangles shuffled, then runs the
+// import time vertex cache and overdraw passes and reports ACMR and ATVR under the default FIFO cache
+// after each, with the best time of --iterations runs.
+
+#include "frustum_culling.h"
+#include "aabb_tree.h"
+#include "camera.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <optional>
+#include <random>
+
+namespace {
+	enum class Mode {
+		frustum,
+		aabb_tree,
+		vertex_cache
+	};
+
+	constexpr uint32_t FRUSTUM_DEFAULT_OBJECTS = 100000;
+	constexpr uint32_t AABB_TREE_DEFAULT_OBJECTS = 20000;
+	// Of every query type, before and after the boxes move
+	constexpr uint32_t AABB_TREE_QUERIES = 1000;
+	constexpr float FRAME_TIME = 1.f / 60.f;
+	constexpr uint32_t DEFAULT_GRID_SIZE = 100;
+
+	void print_usage()
+	{
+		std::cerr << "usage: giereczka_cull_bench [--mode frustum|aabb-tree|vertex-cache] [--objects N] [--iterations N]"
+			" [--grid N]" << std::endl;
+	}
+
+	double elapsed_ms(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Best of all iterations, the others mostly measure the scheduler
+	double measure_ms(
+		const game_engine::FrustumCuller& culler,
+		const std::array<glm::vec4, 6>& planes,
+		game_engine::CullingKernel kernel,
+		uint32_t iterations,
+		std::vector<uint32_t>& visible
+	)
+	{
+		double best_ms = std::numeric_limits<double>::max();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			visible.clear();
+			auto start = std::chrono::high_resolution_clock::now();
+			culler.cull(planes, visible, kernel);
+			best_ms = std::min(best_ms, elapsed_ms(start));
+		}
+		return best_ms;
+	}
+
+	game_engine::BoundingBox random_box(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> position{-100.f, 100.f};
+		std::uniform_real_distribution<float> half_size{0.1f, 2.f};
+
+		glm::vec3 center{position(random), position(random), position(random)};
+		glm::vec3 extent{half_size(random), half_size(random), half_size(random)};
+		return game_engine::BoundingBox{center - extent, center + extent};
+	}
+
+	glm::vec3 random_direction(std::mt19937& random)
+	{
+		std::normal_distribution<float> normal;
+		glm::vec3 direction{normal(random), normal(random), normal(random)};
+		return glm::length(direction) > 1e-6f ? glm::normalize(direction) : glm::vec3(0.f, 0.f, 1.f);
+	}
+
+	int run_frustum(uint32_t object_count, uint32_t iterations)
+	{
+		// Fixed seed, so runs are comparable
+		std::mt19937 random{1234};
+
+		game_engine::FrustumCuller culler;
+		culler.reserve(object_count);
+		for (uint32_t i = 0; i < object_count; i++)
+		{
+			culler.add(random_box(random));
+		}
+
+		game_engine::Camera camera;
+		camera.set_perspective_projection(16.f / 9.f, glm::radians(60.f), 0.1f, 150.f);
+		camera.set_view_target(glm::vec3(0.f), glm::vec3(0.f, 0.f, 1.f));
+		const auto planes = camera.get_frustum_planes();
+
+		std::vector<uint32_t> scalar_visible;
+		std::vector<uint32_t> simd_visible;
+		scalar_visible.reserve(object_count);
+		simd_visible.reserve(object_count);
+
+		double scalar_ms = measure_ms(culler, planes, game_engine::CullingKernel::scalar, iterations, scalar_visible);
+		double simd_ms = measure_ms(culler, planes, game_engine::CullingKernel::simd, iterations, simd_visible);
+
+		if (scalar_visible != simd_visible)
+		{
+			std::cerr << "SIMD kernel disagrees with the scalar kernel" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::cout << std::fixed << std::setprecision(4);
+		std::cout << object_count << " objects, " << scalar_visible.size() << " visible, best of " << iterations
+			<< " iterations" << std::endl;
+		std::cout << "scalar: " << scalar_ms << " ms, " << std::setprecision(0) << object_count / scalar_ms
+			<< " objects/ms" << std::endl;
+		std::cout << std::setprecision(4) << game_engine::FrustumCuller::get_simd_name() << ": " << simd_ms << " ms, "
+			<< std::setprecision(0) << object_count / simd_ms << " objects/ms" << std::endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	// Runs AABB_TREE_QUERIES of every query type on the tree and by brute force over boxes, returns how
+	// many disagreed
+	uint32_t check_aabb_tree_queries(
+		const game_engine::AabbTree& tree,
+		const std::vector<game_engine::BoundingBox>& boxes,
+		std::mt19937& random
+	)
+	{
+		std::uniform_real_distribution<float> position{-100.f, 100.f};
+		std::uniform_real_distribution<float> size{5.f, 20.f};
+		std::vector<uint32_t> expected;
+		std::vector<uint32_t> found;
+		uint32_t mismatches = 0;
+
+		auto compare = [&]
+		{
+			std::sort(expected.begin(), expected.end());
+			std::sort(found.begin(), found.end());
+			if (expected != found)
+			{
+				mismatches++;
+			}
+			expected.clear();
+			found.clear();
+		};
+		auto collect = [&](uint32_t user_data)
+		{
+			found.push_back(user_data);
+			return true;
+		};
+
+		game_engine::Camera camera;
+		camera.set_perspective_projection(16.f / 9.f, glm::radians(60.f), 0.1f, 50.f);
+
+		for (uint32_t query = 0; query < AABB_TREE_QUERIES; query++)
+		{
+			glm::vec3 center{position(random), position(random), position(random)};
+
+			glm::vec3 extent{size(random), size(random), size(random)};
+			game_engine::BoundingBox query_box{center - extent, center + extent};
+			for (uint32_t i = 0; i < boxes.size(); i++)
+			{
+				if (boxes[i].intersects(query_box)) expected.push_back(i);
+			}
+			tree.query(query_box, collect);
+			compare();
+
+			float radius = size(random);
+			for (uint32_t i = 0; i < boxes.size(); i++)
+			{
+				glm::vec3 offset = glm::clamp(center, boxes[i].min, boxes[i].max) - center;
+				if (glm::dot(offset, offset) <= radius * radius) expected.push_back(i);
+			}
+			tree.query(center, radius, collect);
+			compare();
+
+			camera.set_view_direction(center, random_direction(random));
+			const auto planes = camera.get_frustum_planes();
+			for (uint32_t i = 0; i < boxes.size(); i++)
+			{
+				glm::vec3 box_center = boxes[i].get_center();
+				glm::vec3 box_extent = boxes[i].get_extent();
+				bool outside = false;
+				for (const glm::vec4& plane : planes)
+				{
+					float distance = glm::dot(glm::vec3(plane), box_center) + plane.w;
+					outside = outside || distance + glm::dot(glm::abs(glm::vec3(plane)), box_extent) < 0.f;
+				}
+				if (!outside) expected.push_back(i);
+			}
+			tree.query(planes, collect);
+			compare();
+
+			// Closest hit only, ties may pick either box so distances are compared
+			glm::vec3 direction = random_direction(random);
+			float max_distance = 200.f;
+			float expected_distance = max_distance;
+			bool expected_hit = false;
+			glm::vec3 inverse_direction = 1.f / direction;
+			for (const game_engine::BoundingBox& box : boxes)
+			{
+				glm::vec3 t1 = (box.min - center) * inverse_direction;
+				glm::vec3 t2 = (box.max - center) * inverse_direction;
+				glm::vec3 t_min = glm::min(t1, t2);
+				glm::vec3 t_max = glm::max(t1, t2);
+				float t_enter = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.f));
+				float t_exit = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, max_distance));
+				if (t_enter <= t_exit && t_enter <= expected_distance)
+				{
+					expected_distance = t_enter;
+					expected_hit = true;
+				}
+			}
+
+			float found_distance = max_distance;
+			bool found_hit = false;
+			tree.ray_cast(center, direction, max_distance, [&](uint32_t, float distance)
+			{
+				if (distance < found_distance || !found_hit)
+				{
+					found_distance = distance;
+					found_hit = true;
+				}
+				return found_distance;
+			});
+			if (found_hit != expected_hit || std::abs(found_distance - expected_distance) > 1e-4f)
+			{
+				mismatches++;
+			}
+		}
+
+		return mismatches;
+	}
+
+	int run_aabb_tree(uint32_t object_count, uint32_t iterations)
+	{
+		std::mt19937 random{1234};
+		std::cout << std::fixed << std::setprecision(3);
+
+		std::vector<game_engine::BoundingBox> boxes(object_count);
+		std::vector<uint32_t> proxies(object_count);
+		game_engine::AabbTree tree;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < object_count; i++)
+		{
+			boxes[i] = random_box(random);
+			proxies[i] = tree.create_proxy(boxes[i], i);
+		}
+		std::cout << object_count << " objects, built in " << elapsed_ms(start) << " ms, height " << tree.get_height()
+			<< ", area ratio " << tree.get_area_ratio() << std::endl;
+
+		uint32_t mismatches = check_aabb_tree_queries(tree, boxes, random);
+		std::cout << AABB_TREE_QUERIES << " box, sphere, frustum and ray queries: " << mismatches
+			<< " disagree with brute force" << std::endl;
+
+		// Up to 5 units per second, most moves stay inside the fat boxes once they are stretched ahead
+		uint32_t moving_count = object_count * 2 / 3;
+		std::vector<glm::vec3> velocities(moving_count);
+		std::uniform_real_distribution<float> speed{0.f, 5.f};
+		for (glm::vec3& velocity : velocities)
+		{
+			velocity = random_direction(random) * speed(random);
+		}
+
+		double total_ms = 0.0;
+		double max_ms = 0.0;
+		uint64_t total_reinserts = 0;
+		for (uint32_t frame = 0; frame < iterations; frame++)
+		{
+			start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < moving_count; i++)
+			{
+				glm::vec3 displacement = velocities[i] * FRAME_TIME;
+				boxes[i] = game_engine::BoundingBox{boxes[i].min + displacement, boxes[i].max + displacement};
+				total_reinserts += tree.move_proxy(proxies[i], boxes[i], displacement) ? 1 : 0;
+			}
+			double frame_ms = elapsed_ms(start);
+			total_ms += frame_ms;
+			max_ms = std::max(max_ms, frame_ms);
+		}
+		std::cout << "moving " << moving_count << " objects for " << iterations << " frames: " << total_ms / iterations
+			<< " ms per frame, " << max_ms << " ms worst, " << std::setprecision(1)
+			<< static_cast<double>(total_reinserts) / iterations << " reinserts per frame" << std::setprecision(3)
+			<< std::endl;
+
+		uint32_t moved_mismatches = check_aabb_tree_queries(tree, boxes, random);
+		std::cout << "after moving: " << moved_mismatches << " queries disagree with brute force" << std::endl;
+		mismatches += moved_mismatches;
+
+		// Far outside the fat boxes, every move reinserts
+		uint32_t teleports = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < moving_count; i++)
+		{
+			boxes[i] = random_box(random);
+			teleports += tree.move_proxy(proxies[i], boxes[i]) ? 1 : 0;
+		}
+		double teleport_ms = elapsed_ms(start);
+		std::cout << "teleporting " << moving_count << " objects: " << teleport_ms << " ms, " << teleports
+			<< " reinserts, " << teleport_ms * 1000.0 / std::max(teleports, 1u) << " us per reinsert" << std::endl;
+
+		if (mismatches > 0)
+		{
+			std::cerr << "AabbTree queries disagree with brute force" << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	void print_vertex_cache(const char* stage, const game_engine::VertexCacheStatistics& statistics, double ms)
+	{
+		std::cout << stage << ": ACMR " << statistics.acmr << ", ATVR " << statistics.atvr;
+		if (ms >= 0.0)
+		{
+			std::cout << ", " << ms << " ms";
+		}
+		std::cout << std::endl;
+	}
+
+	int run_vertex_cache(uint32_t grid_size, uint32_t iterations)
+	{
+		// Rings from pole to pole, the seam and poles keep duplicate vertices like an imported mesh
+		std::vector<glm::vec3> positions;
+		for (uint32_t ring = 0; ring <= grid_size; ring++)
+		{
+			float theta = glm::pi<float>() * ring / grid_size;
+			for (uint32_t segment = 0; segment <= grid_size; segment++)
+			{
+				float phi = glm::two_pi<float>() * segment / grid_size;
+				positions.emplace_back(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			}
+		}
+
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (uint32_t ring = 0; ring < grid_size; ring++)
+		{
+			for (uint32_t segment = 0; segment < grid_size; segment++)
+			{
+				uint32_t corner = ring * (grid_size + 1) + segment;
+				uint32_t below = corner + grid_size + 1;
+				triangles.push_back({corner, below, corner + 1});
+				triangles.push_back({corner + 1, below, below + 1});
+			}
+		}
+
+		std::mt19937 random{1234};
+		std::shuffle(triangles.begin(), triangles.end(), random);
+		std::vector<uint32_t> indices;
+		for (const auto& triangle : triangles)
+		{
+			indices.insert(indices.end(), triangle.begin(), triangle.end());
+		}
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << grid_size << "x" << grid_size << " sphere grid, " << positions.size() << " vertices, "
+			<< triangles.size() << " triangles, best of " << iterations << " iterations" << std::endl;
+		print_vertex_cache("shuffled", game_engine::analyze_vertex_cache(indices, positions.size()), -1.0);
+
+		std::vector<uint32_t> cache_optimized;
+		double cache_ms = std::numeric_limits<double>::max();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			cache_optimized = game_engine::optimize_vertex_cache(indices, positions.size());
+			cache_ms = std::min(cache_ms, elapsed_ms(start));
+		}
+		print_vertex_cache("vertex cache", game_engine::analyze_vertex_cache(cache_optimized, positions.size()), cache_ms);
+
+		std::vector<uint32_t> overdraw_optimized;
+		double overdraw_ms = std::numeric_limits<double>::max();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			overdraw_optimized = game_engine::optimize_overdraw(cache_optimized, positions);
+			overdraw_ms = std::min(overdraw_ms, elapsed_ms(start));
+		}
+		print_vertex_cache("overdraw", game_engine::analyze_vertex_cache(overdraw_optimized, positions.size()), overdraw_ms);
+
+		return EXIT_SUCCESS;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Mode mode = Mode::frustum;
+	std::optional<uint32_t> object_count;
+	uint32_t iterations = 100;
+	uint32_t grid_size = DEFAULT_GRID_SIZE;
+
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string option = argv[i];
+			if (option == "--help" || option == "-h")
+			{
+				print_usage();
+				return EXIT_SUCCESS;
+			}
+			if (i + 1 >= argc)
+			{
+				throw std::runtime_error("missing value for " + option);
+			}
+
+			std::string value = argv[++i];
+			if (option == "--mode")
+			{
+				if (value == "frustum") mode = Mode::frustum;
+				else if (value == "aabb-tree") mode = Mode::aabb_tree;
+				else if (value == "vertex-cache") mode = Mode::vertex_cache;
+				else throw std::runtime_error("unknown mode " + value);
+			}
+			else if (option == "--objects")
+			{
+				object_count = static_cast<uint32_t>(std::stoul(value));
+			}
+			else if (option == "--iterations")
+			{
+				iterations = static_cast<uint32_t>(std::stoul(value));
+			}
+			else if (option == "--grid")
+			{
+				grid_size = static_cast<uint32_t>(std::stoul(value));
+			}
+			else
+			{
+				throw std::runtime_error("unknown option " + option);
+			}
+		}
+
+		if (object_count == 0u || iterations == 0 || grid_size == 0)
+		{
+			throw std::runtime_error("objects, iterations and grid must be greater than zero");
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	if (mode == Mode::aabb_tree)
+	{
+		return run_aabb_tree(object_count.value_or(AABB_TREE_DEFAULT_OBJECTS), iterations);
+	}
+	if (mode == Mode::vertex_cache)
+	{
+		return run_vertex_cache(grid_size, iterations);
+	}
+	return run_frustum(object_count.value_or(FRUSTUM_DEFAULT_OBJECTS), iterations);
+}
@@ -0,0 +1,404 @@
+// giereczka_bench.cpp : Headless frame benchmark. Renders N frames of the default scene
+// offscreen and reports per-frame CPU and GPU times as JSON.
+//
+// Usage: giereczka_bench [--frames N] [--warmup N] [--width W] [--height H]
+//                        [--threads N] [--objects N] [--culling none|gpu|occlusion|software]
+//                        [--sort-draws on|off] [--dump 0,10,100] [--dump-dir DIR] [--out FILE]
+//
+// Recording scaling is measured by running the same --objects count (e.g. 10000 and 100000)
+// with --threads 1, 2, 4, ... and comparing cpu_ms. With --culling gpu (the default) the objects
+// are culled and drawn indirectly, so cpu_ms should stay flat as --objects grows; --culling none
+// records every object on the CPU for comparison. --culling occlusion adds two phase occlusion
+// culling against a depth pyramid, culling_statistics reports how many objects each test rejected
+// and how many of the scene buffer's instances were uploaded per frame.
+// --culling software records on the CPU like none, minus what the software occlusion culler hides.
+// CPU recorded draws are sorted by state unless --sort-draws off, render_statistics reports the
+// binds and draws of the last frame either way.
+//
+// The report goes to bench_results.json by default; "--out -" writes it to stdout, mixed with
+// the device log.
+//
+// Runs without a display; point VK_DRIVER_FILES (or VK_ICD_FILENAMES) at a software ICD such as
+// lavapipe to run it on machines without a GPU.
+
+#include "benchmark.h"
+
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+	void print_usage()
+	{
+		std::cerr << "usage: giereczka_bench [--frames N] [--warmup N] [--width W] [--height H]"
+			<< " [--threads N] [--objects N] [--culling none|gpu|occlusion|software] [--sort-draws on|off] [--dump 0,10,100] [--dump-dir DIR] [--out FILE]"
+			<< std::endl;
+	}
+
+	const char* culling_name(game_engine::CullingMode culling)
+	{
+		switch (culling)
+		{
+		case game_engine::CullingMode::gpu:
+			return "gpu";
+		case game_engine::CullingMode::occlusion:
+			return "occlusion";
+		case game_engine::CullingMode::software:
+			return "software";
+		default:
+			return "none";
+		}
+	}
+
+	uint32_t parse_count(const std::string& value, const std::string& option)
+	{
+		try
+		{
+			return static_cast<uint32_t>(std::stoul(value));
+		}
+		catch (const std::exception&)
+		{
+			throw std::runtime_error("invalid value for " + option + ": " + value);
+		}
+	}
+
+	struct Statistics {
+		double average = 0.0;
+		double min = 0.0;
+		double max = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+	};
+
+	Statistics compute_statistics(std::vector<double> values)
+	{
+		Statistics statistics{};
+		values.erase(std::remove_if(values.begin(), values.end(), [](double v) { return v < 0.0; }), values.end());
+		if (values.empty())
+		{
+			return statistics;
+		}
+
+		std::sort(values.begin(), values.end());
+		auto percentile = [&values](double p) {
+			size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+			return values[index];
+		};
+
+		double sum = 0.0;
+		for (double value : values)
+		{
+			sum += value;
+		}
+
+		statistics.average = sum / values.size();
+		statistics.min = values.front();
+		statistics.max = values.back();
+		statistics.p50 = percentile(0.50);
+		statistics.p95 = percentile(0.95);
+		statistics.p99 = percentile(0.99);
+		return statistics;
+	}
+
+	void write_time(std::ostream& out, double ms)
+	{
+		if (ms < 0.0)
+		{
+			out << "null";
+		}
+		else
+		{
+			out << ms;
+		}
+	}
+
+	void write_statistics(std::ostream& out, const char* name, const Statistics& statistics)
+	{
+		out << "    \"" << name << "\": {"
+			<< "\"avg\": " << statistics.average
+			<< ", \"min\": " << statistics.min
+			<< ", \"max\": " << statistics.max
+			<< ", \"p50\": " << statistics.p50
+			<< ", \"p95\": " << statistics.p95
+			<< ", \"p99\": " << statistics.p99
+			<< "}";
+	}
+
+	std::string escape_json(const std::string& value)
+	{
+		std::string escaped;
+		for (char c : value)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	void write_report(std::ostream& out, const game_engine::BenchmarkResult& result,
+	                  const std::vector<std::string>& dumped_files)
+	{
+		std::vector<double> frame_times, cpu_times, gpu_times;
+		for (const auto& frame : result.frames)
+		{
+			frame_times.push_back(frame.frame_ms);
+			cpu_times.push_back(frame.cpu_ms);
+			gpu_times.push_back(frame.gpu_ms);
+		}
+
+		out << std::fixed << std::setprecision(4);
+		out << "{\n";
+		out << "  \"device\": \"" << escape_json(result.device_name) << "\",\n";
+		out << "  \"width\": " << result.width << ",\n";
+		out << "  \"height\": " << result.height << ",\n";
+		out << "  \"warmup_frames\": " << result.warmup_frames << ",\n";
+		out << "  \"threads\": " << result.threads << ",\n";
+		out << "  \"objects\": " << result.object_count << ",\n";
+		out << "  \"culling\": \"" << culling_name(result.culling) << "\",\n";
+		out << "  \"frame_count\": " << result.frames.size() << ",\n";
+		out << "  \"gpu_timestamps\": " << (result.gpu_timestamps ? "true" : "false") << ",\n";
+		out << "  \"summary\": {\n";
+		write_statistics(out, "frame_ms", compute_statistics(frame_times));
+		out << ",\n";
+		write_statistics(out, "cpu_ms", compute_statistics(cpu_times));
+		out << ",\n";
+		write_statistics(out, "gpu_ms", compute_statistics(gpu_times));
+		out << "\n  },\n";
+
+		const auto& pipelines = result.pipelines;
+		out << "  \"pipelines\": {"
+			<< "\"warm_start\": " << (pipelines.warm_start ? "true" : "false")
+			<< ", \"cache_bytes_loaded\": " << pipelines.loaded_bytes
+			<< ", \"count\": " << pipelines.pipeline_count
+			<< ", \"creation_ms\": " << pipelines.creation_ms
+			<< ", \"requests\": " << result.pipeline_states.requests
+			<< ", \"shader_modules\": " << result.pipeline_states.shader_modules
+			<< "},\n";
+
+		const auto& culling = result.culling_statistics;
+		out << "  \"culling_statistics\": {"
+			<< "\"drawn\": " << culling.drawn
+			<< ", \"frustum_culled\": " << culling.frustum_culled
+			<< ", \"occlusion_culled\": " << culling.occlusion_culled
+			<< ", \"meshlets_drawn\": " << culling.meshlets_drawn
+			<< ", \"meshlets_culled\": " << culling.meshlets_culled
+			<< ", \"uploaded_instances\": " << culling.uploaded_instances
+			<< ", \"scene_instances\": " << culling.scene_instances
+			<< "},\n";
+
+		const auto& render = result.render_statistics;
+		out << "  \"render_statistics\": {"
+			<< "\"sorted\": " << (result.sort_draws ? "true" : "false")
+			<< ", \"draws\": " << render.draws
+			<< ", \"instances\": " << render.instances
+			<< ", \"pipeline_binds\": " << render.pipeline_binds
+			<< ", \"descriptor_set_binds\": " << render.descriptor_set_binds
+			<< ", \"index_buffer_binds\": " << render.index_buffer_binds
+			<< ", \"push_constant_updates\": " << render.push_constant_updates
+			<< ", \"sort_ms\": " << render.sort_ms
+			<< "},\n";
+
+		const auto& memory = result.memory;
+		out << "  \"memory\": {"
+			<< "\"device_memory_objects\": " << memory.device_memory_count
+			<< ", \"max_memory_allocation_count\": " << memory.max_memory_allocation_count
+			<< ", \"vk_allocate_memory_calls\": " << memory.total_device_allocations
+			<< ", \"blocks\": " << memory.block_count
+			<< ", \"block_bytes\": " << memory.block_bytes
+			<< ", \"allocations\": " << memory.allocation_count
+			<< ", \"allocated_bytes\": " << memory.allocated_bytes
+			<< ", \"dedicated_allocations\": " << memory.dedicated_count
+			<< ", \"dedicated_bytes\": " << memory.dedicated_bytes
+			<< "},\n";
+
+		out << "  \"dumps\": [";
+		for (size_t i = 0; i < dumped_files.size(); i++)
+		{
+			out << (i == 0 ? "" : ", ") << "\"" << escape_json(dumped_files[i]) << "\"";
+		}
+		out << "],\n";
+
+		out << "  \"frames\": [\n";
+		for (size_t i = 0; i < result.frames.size(); i++)
+		{
+			const auto& frame = result.frames[i];
+			out << "    {\"frame\": " << frame.index << ", \"frame_ms\": ";
+			write_time(out, frame.frame_ms);
+			out << ", \"cpu_ms\": ";
+			write_time(out, frame.cpu_ms);
+			out << ", \"gpu_ms\": ";
+			write_time(out, frame.gpu_ms);
+			out << "}" << (i + 1 < result.frames.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n";
+		out << "}\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	game_engine::BenchmarkSettings settings{};
+	std::string dump_dir = "bench_frames";
+	std::string out_path = "bench_results.json";
+
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string option = argv[i];
+			if (option == "--help" || option == "-h")
+			{
+				print_usage();
+				return EXIT_SUCCESS;
+			}
+			if (i + 1 >= argc)
+			{
+				throw std::runtime_error("missing value for " + option);
+			}
+
+			std::string value = argv[++i];
+			if (option == "--frames")
+			{
+				settings.frames = parse_count(value, option);
+			}
+			else if (option == "--warmup")
+			{
+				settings.warmup_frames = parse_count(value, option);
+			}
+			else if (option == "--width")
+			{
+				settings.width = parse_count(value, option);
+			}
+			else if (option == "--height")
+			{
+				settings.height = parse_count(value, option);
+			}
+			else if (option == "--threads")
+			{
+				settings.threads = parse_count(value, option);
+			}
+			else if (option == "--objects")
+			{
+				settings.extra_objects = parse_count(value, option);
+			}
+			else if (option == "--culling")
+			{
+				if (value == "none")
+				{
+					settings.culling = game_engine::CullingMode::none;
+				}
+				else if (value == "gpu")
+				{
+					settings.culling = game_engine::CullingMode::gpu;
+				}
+				else if (value == "occlusion")
+				{
+					settings.culling = game_engine::CullingMode::occlusion;
+				}
+				else if (value == "software")
+				{
+					settings.culling = game_engine::CullingMode::software;
+				}
+				else
+				{
+					throw std::runtime_error("--culling must be none, gpu, occlusion or software");
+				}
+			}
+			else if (option == "--sort-draws")
+			{
+				if (value != "on" && value != "off")
+				{
+					throw std::runtime_error("--sort-draws must be on or off");
+				}
+				settings.sort_draws = value == "on";
+			}
+			else if (option == "--dump")
+			{
+				std::stringstream frames(value);
+				std::string frame;
+				while (std::getline(frames, frame, ','))
+				{
+					settings.capture_frames.insert(parse_count(frame, option));
+				}
+			}
+			else if (option == "--dump-dir")
+			{
+				dump_dir = value;
+			}
+			else if (option == "--out")
+			{
+				out_path = value;
+			}
+			else
+			{
+				throw std::runtime_error("unknown option " + option);
+			}
+		}
+
+		if (settings.frames == 0 || settings.width == 0 || settings.height == 0 || settings.threads == 0)
+		{
+			throw std::runtime_error("frames, width, height and threads must be greater than zero");
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		game_engine::BenchmarkResult result;
+		{
+			game_engine::Benchmark benchmark{settings};
+			result = benchmark.run();
+		}
+
+		std::vector<std::string> dumped_files;
+		if (!result.captures.empty())
+		{
+			std::filesystem::create_directories(dump_dir);
+		}
+		for (const auto& captured : result.captures)
+		{
+			std::string path = (std::filesystem::path(dump_dir) /
+				("frame_" + std::to_string(captured.frame_number) + ".png")).string();
+			if (!stbi_write_png(path.c_str(), captured.width, captured.height, 4,
+			                    captured.rgba.data(), captured.width * 4))
+			{
+				throw std::runtime_error("failed to write " + path);
+			}
+			dumped_files.push_back(path);
+		}
+
+		if (out_path == "-")
+		{
+			write_report(std::cout, result, dumped_files);
+		}
+		else
+		{
+			std::ofstream out(out_path);
+			if (!out)
+			{
+				throw std::runtime_error("failed to open " + out_path);
+			}
+			write_report(out, result, dumped_files);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,365 @@
+#include "benchmark.h"
+
+#include "buffer.h"
+#include "camera.h"
+#include "global_ubo.h"
+#include "buffers/skeletal_animation_uniform.h"
+#include "descriptors/material_descriptor.h"
+#include "systems/render_system.h"
+#include "systems/point_light_system.h"
+#include "systems/texture_manager_system.h"
+#include "system_scheduler.h"
+#include "scenes/default_scene.h"
+
+game_engine::Benchmark::Benchmark(const BenchmarkSettings& settings)
+	: settings(settings),
+	  renderer(device, VkExtent2D{settings.width, settings.height}),
+	  job_system(settings.threads),
+	  command_pools(device, HeadlessRenderer::MAX_FRAMES_IN_FLIGHT, job_system.get_thread_count())
+{
+}
+
+game_engine::Benchmark::~Benchmark()
+{
+}
+
+game_engine::BenchmarkResult game_engine::Benchmark::run()
+{
+	constexpr int frames_in_flight = HeadlessRenderer::MAX_FRAMES_IN_FLIGHT;
+
+	// Per-frame uniform buffer sets, the allocator adds pools if systems ask for more
+	global_descriptor_allocator = std::make_unique<DescriptorAllocator>(
+		device,
+		frames_in_flight * 2,
+		std::vector<DescriptorAllocator::PoolSizeRatio>{
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.f},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.f}
+		}
+	);
+
+	// The bindless texture array is updated after bind, so it needs its own pool flags
+	materials_descriptor_allocator = std::make_unique<DescriptorAllocator>(
+		device,
+		1,
+		std::vector<DescriptorAllocator::PoolSizeRatio>{
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<float>(MAX_TEXTURES)}
+		},
+		VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT
+	);
+
+	global_descriptor_set_layout = DescriptorSetLayout::Builder{device}
+	                               .add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	                                            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT |
+	                                            VK_SHADER_STAGE_FRAGMENT_BIT)
+	                               .build();
+
+	joint_descriptor_set_layout = DescriptorSetLayout::Builder{device}
+	                              .add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	                                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT |
+	                                           VK_SHADER_STAGE_FRAGMENT_BIT)
+	                              .build();
+
+	auto materials_descriptor = std::make_unique<
+		MaterialDescriptor>(MaterialDescriptor(device, *materials_descriptor_allocator));
+
+	std::vector<std::unique_ptr<Buffer>> uniform_buffers{frames_in_flight};
+	std::vector<std::unique_ptr<Buffer>> joint_buffers{frames_in_flight};
+	std::vector<VkDescriptorSet> global_descriptor_sets(frames_in_flight);
+	std::vector<VkDescriptorSet> joint_descriptor_sets(frames_in_flight);
+	for (int i = 0; i < frames_in_flight; i++)
+	{
+		uniform_buffers[i] = std::make_unique<Buffer>(
+			device,
+			sizeof(GlobalUbo),
+			1,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			device.properties.limits.minUniformBufferOffsetAlignment
+		);
+		uniform_buffers[i]->map();
+
+		joint_buffers[i] = std::make_unique<Buffer>(
+			device,
+			sizeof(JointUbo),
+			1,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			device.properties.limits.minUniformBufferOffsetAlignment
+		);
+		joint_buffers[i]->map();
+
+		auto buffer_info = uniform_buffers[i]->descriptor_info();
+		bool result = DescriptorWriter(*global_descriptor_set_layout, *global_descriptor_allocator)
+		              .write_buffer(0, &buffer_info)
+		              .build(global_descriptor_sets[i]);
+		assert(result && "Failed to build global descriptor set");
+
+		auto joint_buffer_info = joint_buffers[i]->descriptor_info();
+		result = DescriptorWriter(*joint_descriptor_set_layout, *global_descriptor_allocator)
+		         .write_buffer(0, &joint_buffer_info)
+		         .build(joint_descriptor_sets[i]);
+		assert(result && "Failed to build joint descriptor set");
+	}
+
+	std::unique_ptr<DepthPyramid> depth_pyramid;
+	std::unique_ptr<GpuCullingSystem> gpu_culling_system;
+	bool gpu_culling = settings.culling == CullingMode::gpu || settings.culling == CullingMode::occlusion;
+	if (gpu_culling && GpuCullingSystem::is_supported(device))
+	{
+		if (settings.culling == CullingMode::occlusion)
+		{
+			depth_pyramid = std::make_unique<DepthPyramid>(
+				device, renderer.get_extent(), renderer.get_depth_format(), frames_in_flight);
+		}
+		gpu_culling_system = std::make_unique<GpuCullingSystem>(device, frames_in_flight, depth_pyramid.get());
+	}
+
+	RenderSystem render_system{
+		device,
+		job_system,
+		renderer.get_render_pass(),
+		global_descriptor_set_layout->get_descriptor_set_layout(),
+		joint_descriptor_set_layout->get_descriptor_set_layout(),
+		materials_descriptor->get_descriptor_set_layout(),
+		frames_in_flight,
+		gpu_culling_system.get()
+	};
+	render_system.set_software_occlusion_culling(settings.culling == CullingMode::software);
+	render_system.set_draw_sorting(settings.sort_draws);
+
+	PointLightSystem point_light_system{
+		device, job_system, renderer.get_render_pass(), global_descriptor_set_layout->get_descriptor_set_layout()
+	};
+
+	TextureManagerSystem texture_manager_system(materials_descriptor);
+
+	load_default_scene(device, object_manager_system, texture_manager_system);
+	add_extra_objects();
+
+	// Pipelines compiled in the background while the scene loaded, measured frames must not use fallbacks
+	render_system.wait_for_pipelines();
+	point_light_system.wait_for_pipelines();
+
+	Camera camera;
+	camera.set_perspective_projection(renderer.get_aspect_ratio(), glm::radians(60.f), 0.1f, 100.f);
+
+	BenchmarkResult result{};
+	result.device_name = device.properties.deviceName;
+	result.width = settings.width;
+	result.height = settings.height;
+	result.warmup_frames = settings.warmup_frames;
+	result.threads = job_system.get_thread_count();
+	result.object_count = object_manager_system.get_game_objects().size();
+	result.culling = gpu_culling_system != nullptr || settings.culling == CullingMode::software
+		? settings.culling
+		: CullingMode::none;
+	result.sort_draws = settings.sort_draws;
+	result.gpu_timestamps = renderer.has_gpu_timestamps();
+	result.pipelines = device.get_pipeline_cache().get_statistics();
+	result.pipeline_states = device.get_pipeline_state_cache().get_statistics();
+	result.frames.reserve(settings.frames);
+
+	int frame_index = 0;
+	GlobalUbo ubo{};
+	SecondaryRecordingInfo recording_info{};
+	std::vector<VkCommandBuffer> secondary_command_buffers;
+	std::vector<VkCommandBuffer> late_command_buffers;
+
+	// Same systems as the engine loop, minus the debug UI
+	SystemScheduler scheduler{job_system};
+	scheduler.add_system("point_lights", PointLightSystem::update_access(), [&]
+	{
+		point_light_system.update(object_manager_system.get_point_lights(), ubo, FIXED_TIMESTEP);
+		uniform_buffers[frame_index]->write_to_buffer(&ubo);
+		uniform_buffers[frame_index]->flush();
+	});
+	scheduler.add_system("record_game_objects", RenderSystem::record_access(), [&]
+	{
+		render_system.record_game_objects(
+			job_system,
+			command_pools,
+			frame_index,
+			recording_info,
+			renderer.get_frame_descriptor_allocator(),
+			object_manager_system.get_game_objects(),
+			camera,
+			global_descriptor_sets[frame_index],
+			joint_descriptor_sets[frame_index],
+			texture_manager_system.get_material_descriptor()->get_descriptor_set(),
+			false,
+			secondary_command_buffers,
+			late_command_buffers
+		);
+	});
+
+	uint32_t total_frames = settings.warmup_frames + settings.frames;
+	for (uint32_t frame = 0; frame < total_frames; frame++)
+	{
+		auto frame_start = std::chrono::high_resolution_clock::now();
+
+		// Scripted camera: one slow orbit around the model, independent of how fast frames are produced
+		float angle = frame * FIXED_TIMESTEP * 0.5f;
+		glm::vec3 eye{8.f * glm::sin(angle), -3.f, -8.f * glm::cos(angle)};
+		camera.set_view_target(eye, glm::vec3(0.f, -1.f, 0.f));
+
+		auto command_buffer = renderer.begin_frame();
+		frame_index = renderer.get_frame_index();
+
+		bool measured = frame >= settings.warmup_frames;
+		if (measured && settings.capture_frames.contains(frame - settings.warmup_frames))
+		{
+			renderer.request_capture();
+		}
+
+		ubo = GlobalUbo{};
+		ubo.projection = camera.get_projection_matrix();
+		ubo.view = camera.get_view_matrix();
+		ubo.inverse_view = camera.get_inverse_view_matrix();
+
+		command_pools.reset(frame_index);
+		recording_info = SecondaryRecordingInfo{
+			renderer.get_render_pass(),
+			renderer.get_current_framebuffer(),
+			renderer.get_extent()
+		};
+		secondary_command_buffers.clear();
+		late_command_buffers.clear();
+
+		// Only the main thread touches the object manager's change tracking
+		if (gpu_culling_system != nullptr)
+		{
+			gpu_culling_system->take_scene_changes(object_manager_system);
+		}
+
+		scheduler.run();
+
+		VkCommandBuffer light_command_buffer = command_pools.begin_secondary(
+			frame_index, job_system.get_worker_index(), recording_info);
+		point_light_system.render(light_command_buffer, object_manager_system.get_point_lights(),
+		                          camera, global_descriptor_sets[frame_index]);
+		if (vkEndCommandBuffer(light_command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record light command buffer");
+		}
+		late_command_buffers.push_back(light_command_buffer);
+
+		if (gpu_culling_system != nullptr)
+		{
+			gpu_culling_system->cull(command_buffer, frame_index, camera);
+		}
+
+		renderer.begin_render_pass(command_buffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(
+			command_buffer,
+			static_cast<uint32_t>(secondary_command_buffers.size()),
+			secondary_command_buffers.data()
+		);
+
+		if (gpu_culling_system != nullptr && gpu_culling_system->needs_occlusion_pass(frame_index))
+		{
+			renderer.end_render_pass(command_buffer);
+			depth_pyramid->build(
+				command_buffer,
+				frame_index,
+				renderer.get_current_depth_image(),
+				renderer.get_current_depth_image_view()
+			);
+			gpu_culling_system->cull_occluded(command_buffer, frame_index, camera);
+			renderer.continue_render_pass(command_buffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		}
+
+		vkCmdExecuteCommands(
+			command_buffer,
+			static_cast<uint32_t>(late_command_buffers.size()),
+			late_command_buffers.data()
+		);
+		renderer.end_render_pass(command_buffer);
+		renderer.end_frame();
+
+		double frame_ms = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - frame_start).count();
+
+		if (measured)
+		{
+			BenchmarkFrame benchmark_frame{};
+			benchmark_frame.index = frame - settings.warmup_frames;
+			benchmark_frame.frame_ms = frame_ms;
+			benchmark_frame.cpu_ms = frame_ms - renderer.get_last_fence_wait_ms();
+			benchmark_frame.gpu_ms = -1.0;
+			result.frames.push_back(benchmark_frame);
+		}
+	}
+
+	renderer.wait_idle();
+
+	const auto& gpu_frame_times = renderer.get_gpu_frame_times();
+	for (auto& benchmark_frame : result.frames)
+	{
+		size_t frame_number = benchmark_frame.index + settings.warmup_frames;
+		if (frame_number < gpu_frame_times.size())
+		{
+			benchmark_frame.gpu_ms = gpu_frame_times[frame_number];
+		}
+	}
+
+	for (auto& captured : renderer.get_captured_frames())
+	{
+		captured.frame_number -= settings.warmup_frames;
+		result.captures.push_back(std::move(captured));
+	}
+	renderer.get_captured_frames().clear();
+
+	vkDeviceWaitIdle(device.get_logical_device());
+
+	result.memory = device.get_memory_allocator().get_statistics();
+	result.render_statistics = render_system.get_render_statistics();
+	if (gpu_culling_system != nullptr)
+	{
+		result.culling_statistics = gpu_culling_system->get_statistics();
+	}
+
+	return result;
+}
+
+void game_engine::Benchmark::add_extra_objects()
+{
+	if (settings.extra_objects == 0)
+	{
+		return;
+	}
+
+	std::shared_ptr<GltfModel> model;
+	auto& game_objects = object_manager_system.get_game_objects();
+	std::span<const std::string> names = game_objects.get<std::string>();
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i] == "animated_model")
+		{
+			model = game_objects.get<RenderComponent>()[i].gltf_model;
+			break;
+		}
+	}
+	assert(model != nullptr && "Default scene has no animated model to copy");
+
+	// Copies share the model's vertex and index buffers, only the transform differs
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(settings.extra_objects))));
+	float spacing = 2.f;
+	for (uint32_t i = 0; i < settings.extra_objects; i++)
+	{
+		glm::vec3 translation{
+			(static_cast<float>(i % side) - side * 0.5f) * spacing,
+			0.f,
+			(static_cast<float>(i / side) - side * 0.5f) * spacing
+		};
+
+		auto game_object = GameObject(
+			model,
+			glm::vec3(0.0f),
+			translation,
+			1.0f,
+			glm::vec3(0.0f),
+			"bench_object_" + std::to_string(i)
+		);
+		object_manager_system.add_game_object(game_object);
+	}
+}
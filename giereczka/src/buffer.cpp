@@ -19,30 +19,33 @@ game_engine::Buffer::Buffer(Device& device, VkDeviceSize instance_size, uint32_t
 {
 	alignment_size = get_alignment(instance_size, min_offset_alignment);
 	buffer_size = alignment_size * instance_count;
-	device.create_buffer(buffer_size, usage_flags, memory_property_flags, buffer, buffer_memory);
+	device.create_buffer(buffer_size, usage_flags, memory_property_flags, buffer, allocation);
 }
 
 game_engine::Buffer::~Buffer()
 {
 	unmap();
 	vkDestroyBuffer(device.get_logical_device(), buffer, nullptr);
-	vkFreeMemory(device.get_logical_device(), buffer_memory, nullptr);
+	device.get_memory_allocator().free(allocation);
 }
 
 VkResult game_engine::Buffer::map(VkDeviceSize size, VkDeviceSize offset)
 {
-	assert(buffer && buffer_memory && "Cannot map memory before buffer has been created");
+	assert(buffer && allocation.is_valid() && "Cannot map memory before buffer has been created");
 
-	return vkMapMemory(device.get_logical_device(), buffer_memory, offset, size, 0, &mapped_memory);
+	// Host visible blocks stay mapped, mapping only hands out the pointer
+	if (!allocation.mapped)
+	{
+		return VK_ERROR_MEMORY_MAP_FAILED;
+	}
+
+	mapped_memory = static_cast<char*>(allocation.mapped) + offset;
+	return VK_SUCCESS;
 }
 
 void game_engine::Buffer::unmap()
 {
-	if (mapped_memory)
-	{
-		vkUnmapMemory(device.get_logical_device(), buffer_memory);
-		mapped_memory = nullptr;
-	}
+	mapped_memory = nullptr;
 }
 
 void game_engine::Buffer::write_to_buffer(void* data, VkDeviceSize size, VkDeviceSize offset)
@@ -63,12 +66,7 @@ void game_engine::Buffer::write_to_buffer(void* data, VkDeviceSize size, VkDevic
 
 VkResult game_engine::Buffer::flush(VkDeviceSize size, VkDeviceSize offset)
 {
-	VkMappedMemoryRange mapped_range = {};
-	mapped_range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mapped_range.memory = buffer_memory;
-	mapped_range.offset = offset;
-	mapped_range.size = size;
-	return vkFlushMappedMemoryRanges(device.get_logical_device(), 1, &mapped_range);
+	return device.get_memory_allocator().flush(allocation, offset, size);
 }
 
 VkDescriptorBufferInfo game_engine::Buffer::descriptor_info(VkDeviceSize size, VkDeviceSize offset) const
@@ -82,12 +80,7 @@ VkDescriptorBufferInfo game_engine::Buffer::descriptor_info(VkDeviceSize size, V
 
 VkResult game_engine::Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
 {
-	VkMappedMemoryRange mapped_range = {};
-	mapped_range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mapped_range.memory = buffer_memory;
-	mapped_range.offset = offset;
-	mapped_range.size = size;
-	return vkInvalidateMappedMemoryRanges(device.get_logical_device(), 1, &mapped_range);
+	return device.get_memory_allocator().invalidate(allocation, offset, size);
 }
 
 void game_engine::Buffer::write_to_index(void* data, int index)
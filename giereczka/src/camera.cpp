@@ -103,3 +103,29 @@ void game_engine::Camera::set_view_YXZ(const glm::vec3 position, const glm::vec3
 	inverse_view_matrix[3][1] = position.y;
 	inverse_view_matrix[3][2] = position.z;
 }
+
+std::array<glm::vec4, 6> game_engine::Camera::get_frustum_planes() const
+{
+	// Rows of the view projection matrix (Gribb and Hartmann), depth is in [0, 1]
+	const glm::mat4 view_projection = projection_matrix * view_matrix;
+	const glm::vec4 row0{ view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0] };
+	const glm::vec4 row1{ view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1] };
+	const glm::vec4 row2{ view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2] };
+	const glm::vec4 row3{ view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3] };
+
+	std::array<glm::vec4, 6> planes{
+		row3 + row0,
+		row3 - row0,
+		row3 + row1,
+		row3 - row1,
+		row2,
+		row3 - row2
+	};
+
+	for (auto& plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return planes;
+}
@@ -25,20 +25,11 @@ void game_engine::DebugUI::init_debug_ui(VkRenderPass render_pass, uint32_t imag
 
 void game_engine::DebugUI::init_imgui(VkRenderPass render_pass, uint32_t image_count)
 {
+	// The backend only allocates combined image samplers: one for the font atlas, one per AddTexture call
 	imgui_descriptor_pool = DescriptorPool::Builder{ device }
-		.add_pool_size(VK_DESCRIPTOR_TYPE_SAMPLER, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000)
-		.add_pool_size(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000)
+		.add_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE)
         .set_pool_flags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
-		.set_max_sets(1000)
+		.set_max_sets(IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE)
 		.build();
 
     ImGui::CreateContext();
@@ -73,7 +64,9 @@ void game_engine::DebugUI::draw(
     VkCommandBuffer command_buffer,
     ObjectManagerSystem& object_manager_system,
     PlayerController& player_controller,
-    PerformanceCounter& performance_counter
+    PerformanceCounter& performance_counter,
+    const OcclusionCullingStatistics& occlusion_statistics,
+    const RenderStatistics& render_statistics
 )
 {
     ImGui_ImplVulkan_NewFrame();
@@ -85,11 +78,15 @@ void game_engine::DebugUI::draw(
     auto &game_objects = object_manager_system.get_game_objects();
     auto &point_lights = object_manager_system.get_point_lights();
 
-	std::vector<std::pair<ObjectManagerSystem::id_t, GameObject>> game_objects_vector(game_objects.begin(), game_objects.end());
-	std::vector<std::pair<ObjectManagerSystem::id_t, game_engine::PointLightObject>> point_lights_vector(point_lights.begin(), point_lights.end());
+	// Rows index the tables' dense arrays, which removals reorder
+	std::span<const ObjectManagerSystem::id_t> game_object_handles = game_objects.get_handles();
+	std::span<const transform_component> transforms = game_objects.get<transform_component>();
+	std::span<const std::string> names = game_objects.get<std::string>();
+	std::span<const ObjectManagerSystem::id_t> point_light_handles = point_lights.get_handles();
+	std::span<const PointLightObject> lights = point_lights.get<PointLightObject>();
 
-	int game_object_count = game_objects_vector.size();
-	int point_light_count = point_lights_vector.size();
+	int game_object_count = static_cast<int>(game_objects.size());
+	int point_light_count = static_cast<int>(point_lights.size());
 
     if (ImGui::BeginTabBar("DebugTabBar"))
     {
@@ -113,7 +110,7 @@ void game_engine::DebugUI::draw(
 
                     ImGui::TableSetColumnIndex(0);
                     if (
-                        ImGui::Selectable(std::to_string(game_objects_vector[row].first).c_str(),
+                        ImGui::Selectable(std::to_string(game_object_handles[row].index).c_str(),
                         selected_object == row,
                         ImGuiSelectableFlags_SpanAllColumns
                         ))
@@ -122,14 +119,14 @@ void game_engine::DebugUI::draw(
                     }
 
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%s", game_objects_vector[row].second.name.c_str());
+                    ImGui::Text("%s", names[row].c_str());
 
                     ImGui::TableSetColumnIndex(2);
-                    ImGui::Text("%f", game_objects_vector[row].second.transform.translation.x);
+                    ImGui::Text("%f", transforms[row].translation.x);
                     ImGui::TableSetColumnIndex(3);
-                    ImGui::Text("%f", game_objects_vector[row].second.transform.translation.y);
+                    ImGui::Text("%f", transforms[row].translation.y);
                     ImGui::TableSetColumnIndex(4);
-                    ImGui::Text("%f", game_objects_vector[row].second.transform.translation.z);
+                    ImGui::Text("%f", transforms[row].translation.z);
                 }
 
 				for (int row = game_object_count; row < point_light_count + game_object_count; row++)
@@ -137,7 +134,7 @@ void game_engine::DebugUI::draw(
 					ImGui::TableNextRow();
 					ImGui::TableSetColumnIndex(0);
 					if (
-						ImGui::Selectable(std::to_string(point_lights_vector[row - game_object_count].first).c_str(),
+						ImGui::Selectable(std::to_string(point_light_handles[row - game_object_count].index).c_str(),
 							selected_object == row,
 							ImGuiSelectableFlags_SpanAllColumns
 						))
@@ -147,57 +144,68 @@ void game_engine::DebugUI::draw(
 					ImGui::TableSetColumnIndex(1);
 					ImGui::Text("Point light");
 					ImGui::TableSetColumnIndex(2);
-					ImGui::Text("%f", point_lights_vector[row - game_object_count].second.position.x);
+					ImGui::Text("%f", lights[row - game_object_count].position.x);
 					ImGui::TableSetColumnIndex(3);
-					ImGui::Text("%f", point_lights_vector[row - game_object_count].second.position.y);
+					ImGui::Text("%f", lights[row - game_object_count].position.y);
 					ImGui::TableSetColumnIndex(4);
-					ImGui::Text("%f", point_lights_vector[row - game_object_count].second.position.z);
+					ImGui::Text("%f", lights[row - game_object_count].position.z);
 				}
 				ImGui::EndTable();
 			}
 
             if (selected_object != -1 && selected_object < game_object_count)
             {
-				glm::vec3 translation = game_objects_vector[selected_object].second.transform.translation;
-				float scale = game_objects_vector[selected_object].second.transform.scale;
-				glm::vec3 rotation = game_objects_vector[selected_object].second.transform.rotation;
-				ImGui::DragFloat3("Translation", &translation.x, 0.01f);
-				ImGui::DragFloat("Scale", &scale, 0.01f);
-				ImGui::DragFloat3("Rotation", &rotation.x, 0.01f);
-
-				object_manager_system.move_game_object(game_objects_vector[selected_object].first, translation);
-				object_manager_system.scale_game_object(game_objects_vector[selected_object].first, scale);
-				object_manager_system.rotate_game_object(game_objects_vector[selected_object].first, rotation);
-
-				if (previous_selected_object != selected_object)
+				ObjectManagerSystem::id_t handle = game_object_handles[selected_object];
+				glm::vec3 translation = transforms[selected_object].translation;
+				float scale = transforms[selected_object].scale;
+				glm::vec3 rotation = transforms[selected_object].rotation;
+				// Every set marks the object changed, so only edits are passed on
+				if (ImGui::DragFloat3("Translation", &translation.x, 0.01f))
 				{
-					if (previous_selected_object != -1)
-					{
-						object_manager_system.set_model_color(game_objects_vector[previous_selected_object].first, glm::vec3(0.0f, 0.0f, 0.0f));
-					}
-					object_manager_system.set_model_color(game_objects_vector[selected_object].first, glm::vec3(0.f, 1.f, 0.f));
-					debug_object_id = game_objects_vector[selected_object].first;
+					object_manager_system.move_game_object(handle, translation);
+				}
+				if (ImGui::DragFloat("Scale", &scale, 0.01f))
+				{
+					object_manager_system.scale_game_object(handle, scale);
+				}
+				if (ImGui::DragFloat3("Rotation", &rotation.x, 0.01f))
+				{
+					object_manager_system.rotate_game_object(handle, rotation);
 				}
 
-				previous_selected_object = selected_object;
+				if (debug_object_id != handle)
+				{
+					// Ignored when the previous object was removed since
+					object_manager_system.set_model_color(debug_object_id, glm::vec3(0.0f, 0.0f, 0.0f));
+					object_manager_system.set_model_color(handle, glm::vec3(0.f, 1.f, 0.f));
+					debug_object_id = handle;
+				}
             }
 			else if (selected_object != -1 && selected_object < point_light_count+game_object_count && selected_object >= game_object_count)
 			{
 				const int object_id = selected_object - game_object_count;
+				ObjectManagerSystem::id_t handle = point_light_handles[object_id];
 
-				glm::vec3 translation = point_lights_vector[object_id].second.position;
-				float scale = point_lights_vector[object_id].second.light_radius;
-				glm::vec3 color = point_lights_vector[object_id].second.light_color;
-				float intensity = point_lights_vector[object_id].second.light_intensity;
-				ImGui::DragFloat3("Translation", &translation.x, 0.01f);
-				ImGui::DragFloat("Scale", &scale, 0.01f);
-				ImGui::ColorEdit3("Color", &color.x);
-				ImGui::DragFloat("Intensity", &intensity, 0.01f);
-
-				object_manager_system.set_point_light_position(point_lights_vector[object_id].first, translation);
-				object_manager_system.set_point_light_radius(point_lights_vector[object_id].first, scale);
-				object_manager_system.set_point_light_color(point_lights_vector[object_id].first, color);
-				object_manager_system.set_point_light_intensity(point_lights_vector[object_id].first, intensity);
+				glm::vec3 translation = lights[object_id].position;
+				float scale = lights[object_id].light_radius;
+				glm::vec3 color = lights[object_id].light_color;
+				float intensity = lights[object_id].light_intensity;
+				if (ImGui::DragFloat3("Translation", &translation.x, 0.01f))
+				{
+					object_manager_system.set_point_light_position(handle, translation);
+				}
+				if (ImGui::DragFloat("Scale", &scale, 0.01f))
+				{
+					object_manager_system.set_point_light_radius(handle, scale);
+				}
+				if (ImGui::ColorEdit3("Color", &color.x))
+				{
+					object_manager_system.set_point_light_color(handle, color);
+				}
+				if (ImGui::DragFloat("Intensity", &intensity, 0.01f))
+				{
+					object_manager_system.set_point_light_intensity(handle, intensity);
+				}
 			}
             ImGui::EndTabItem();
         }
@@ -232,6 +240,27 @@ void game_engine::DebugUI::draw(
 			ImGui::Text("Frame time: %f", performance_counter.get_delta_time());
 			ImGui::Text("FPS: %f", performance_counter.get_fps());
 			ImGui::Text("Vertex count: %d", object_manager_system.get_vertex_count());
+
+			// Only the CPU recording path runs it, indirect draws are culled on the GPU
+			if (ImGui::CollapsingHeader("Software occlusion culling", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				ImGui::Text("Rasterizer: %s", MaskedOcclusionCuller::get_simd_name());
+				ImGui::Text("Occluders: %u (%u triangles)", occlusion_statistics.occluders, occlusion_statistics.occluder_triangles);
+				ImGui::Text("Occluded: %u of %u", occlusion_statistics.occluded, occlusion_statistics.tested);
+				ImGui::Text("Rasterize: %.3f ms", occlusion_statistics.rasterize_ms);
+				ImGui::Text("Test: %.3f ms", occlusion_statistics.test_ms);
+			}
+
+			// Zero while the GPU culling draws indirectly
+			if (ImGui::CollapsingHeader("Draw recording", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				ImGui::Text("Draws: %u (%u instances)", render_statistics.draws, render_statistics.instances);
+				ImGui::Text("Pipeline binds: %u", render_statistics.pipeline_binds);
+				ImGui::Text("Descriptor set binds: %u", render_statistics.descriptor_set_binds);
+				ImGui::Text("Index buffer binds: %u", render_statistics.index_buffer_binds);
+				ImGui::Text("Push constant updates: %u", render_statistics.push_constant_updates);
+				ImGui::Text("Sort: %.3f ms", render_statistics.sort_ms);
+			}
 			ImGui::EndTabItem();
 		}
 
@@ -239,6 +268,8 @@ void game_engine::DebugUI::draw(
         {
             ImGui::Checkbox("Wireframe", &render_wireframe);
         	ImGui::Checkbox("Raytracing", &render_raytracing);
+			ImGui::Checkbox("Software occlusion culling", &software_occlusion_culling);
+			ImGui::Checkbox("Sort draws", &draw_sorting);
 			ImGui::EndTabItem();
         }
 
@@ -0,0 +1,369 @@
+#include "depth_pyramid.h"
+
+namespace {
+	uint32_t previous_power_of_two(uint32_t value)
+	{
+		uint32_t result = 1;
+		while (result * 2 <= value)
+		{
+			result *= 2;
+		}
+		return result;
+	}
+
+	bool has_stencil_component(VkFormat format)
+	{
+		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+	}
+}
+
+game_engine::DepthPyramid::DepthPyramid(Device& device, VkExtent2D depth_extent, VkFormat depth_format, int frames_in_flight)
+	: device(device), depth_extent(depth_extent), depth_format(depth_format), push_descriptors(device.has_push_descriptors())
+{
+	set_layout = DescriptorSetLayout::Builder{device}
+	             .add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+	             .add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+	             .set_flags(push_descriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0)
+	             .build();
+
+	// One set per level and per frame in flight, the first pool fits a 4k depth attachment
+	if (!push_descriptors)
+	{
+		descriptor_allocator = std::make_unique<DescriptorAllocator>(
+			device,
+			16 + static_cast<uint32_t>(frames_in_flight),
+			std::vector<DescriptorAllocator::PoolSizeRatio>{
+				{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.f},
+				{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f}
+			}
+		);
+		depth_sets.resize(frames_in_flight, VK_NULL_HANDLE);
+	}
+
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_NEAREST;
+	sampler_info.minFilter = VK_FILTER_NEAREST;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.minLod = 0.f;
+	sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(device.get_logical_device(), &sampler_info, nullptr, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid sampler");
+	}
+
+	create_pyramid();
+	create_pipeline_layout();
+
+	pipeline_config_info pipeline_config{};
+	Pipeline::default_pipeline_config_info(pipeline_config);
+	pipeline_config.pipeline_layout = pipeline_layout;
+	pipeline = std::make_unique<CullingPipeline>(
+		device,
+		"compiled_shaders/depth_pyramid.comp.spv",
+		pipeline_config
+	);
+}
+
+game_engine::DepthPyramid::~DepthPyramid()
+{
+	destroy_pyramid();
+	vkDestroySampler(device.get_logical_device(), sampler, nullptr);
+	vkDestroyPipelineLayout(device.get_logical_device(), pipeline_layout, nullptr);
+}
+
+void game_engine::DepthPyramid::resize(VkExtent2D depth_extent)
+{
+	this->depth_extent = depth_extent;
+
+	destroy_pyramid();
+	if (descriptor_allocator != nullptr)
+	{
+		descriptor_allocator->reset();
+	}
+	std::fill(depth_sets.begin(), depth_sets.end(), VK_NULL_HANDLE);
+	create_pyramid();
+}
+
+VkDescriptorImageInfo game_engine::DepthPyramid::descriptor_info() const
+{
+	VkDescriptorImageInfo image_info{};
+	image_info.sampler = sampler;
+	image_info.imageView = view;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	return image_info;
+}
+
+void game_engine::DepthPyramid::build(VkCommandBuffer command_buffer, int frame_index, VkImage depth_image,
+                                      VkImageView depth_image_view)
+{
+	VkDescriptorImageInfo depth_info{};
+	depth_info.sampler = sampler;
+	depth_info.imageView = depth_image_view;
+	depth_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	// The depth attachment changes with the swapchain image, the frame's earlier submissions are
+	// complete so its set can be rewritten in place
+	if (!push_descriptors)
+	{
+		VkDescriptorImageInfo level_info{};
+		level_info.imageView = levels[0].view;
+		level_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		DescriptorWriter(*set_layout, *descriptor_allocator)
+			.write_image(0, &depth_info)
+			.write_image(1, &level_info)
+			.overwrite(depth_sets[frame_index]);
+	}
+
+	std::array<VkImageMemoryBarrier, 2> barriers{};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = depth_image;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (has_stencil_component(depth_format))
+	{
+		barriers[0].subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.layerCount = 1;
+
+	// Last frame's culling may still be reading the pyramid, its contents are rebuilt anyway
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = image;
+	barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[1].subresourceRange.levelCount = get_level_count();
+	barriers[1].subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data()
+	);
+
+	pipeline->bind(command_buffer);
+
+	VkExtent2D source_extent = depth_extent;
+	for (uint32_t level = 0; level < get_level_count(); level++)
+	{
+		// Every dispatch reads and writes a different pair of images, pushed they need no set each
+		if (push_descriptors)
+		{
+			VkDescriptorImageInfo source_info = depth_info;
+			if (level > 0)
+			{
+				source_info.imageView = levels[level - 1].view;
+				source_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			}
+			VkDescriptorImageInfo destination_info{};
+			destination_info.imageView = levels[level].view;
+			destination_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			DescriptorWriter(*set_layout)
+				.write_image(0, &source_info)
+				.write_image(1, &destination_info)
+				.push(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0);
+		}
+		else
+		{
+			VkDescriptorSet descriptor_set = level == 0 ? depth_sets[frame_index] : levels[level].descriptor_set;
+			vkCmdBindDescriptorSets(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				pipeline_layout,
+				0,
+				1,
+				&descriptor_set,
+				0,
+				nullptr
+			);
+		}
+
+		const VkExtent2D& level_extent = levels[level].extent;
+		ReducePushConstants push{};
+		push.source_size = glm::ivec2(source_extent.width, source_extent.height);
+		push.destination_size = glm::ivec2(level_extent.width, level_extent.height);
+		vkCmdPushConstants(
+			command_buffer,
+			pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(ReducePushConstants),
+			&push
+		);
+
+		vkCmdDispatch(
+			command_buffer,
+			(level_extent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+			(level_extent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+			1
+		);
+
+		// The next level reads this one, after the last one the culling pass reads all of them
+		VkMemoryBarrier level_barrier{};
+		level_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		level_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		level_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &level_barrier,
+			0, nullptr,
+			0, nullptr
+		);
+
+		source_extent = level_extent;
+	}
+}
+
+void game_engine::DepthPyramid::create_pyramid()
+{
+	extent.width = previous_power_of_two(depth_extent.width);
+	extent.height = previous_power_of_two(depth_extent.height);
+
+	uint32_t level_count = 1;
+	while ((std::max(extent.width, extent.height) >> level_count) > 0)
+	{
+		level_count++;
+	}
+
+	VkImageCreateInfo image_info{};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.extent.width = extent.width;
+	image_info.extent.height = extent.height;
+	image_info.extent.depth = 1;
+	image_info.mipLevels = level_count;
+	image_info.arrayLayers = 1;
+	image_info.format = VK_FORMAT_R32_SFLOAT;
+	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	device.create_image_with_info(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, image_memory);
+
+	VkImageViewCreateInfo view_info{};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = image;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format = VK_FORMAT_R32_SFLOAT;
+	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_info.subresourceRange.baseMipLevel = 0;
+	view_info.subresourceRange.levelCount = level_count;
+	view_info.subresourceRange.baseArrayLayer = 0;
+	view_info.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(device.get_logical_device(), &view_info, nullptr, &view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid view");
+	}
+
+	levels.resize(level_count);
+	for (uint32_t i = 0; i < level_count; i++)
+	{
+		Level& level = levels[i];
+		level.extent.width = std::max(extent.width >> i, 1u);
+		level.extent.height = std::max(extent.height >> i, 1u);
+
+		view_info.subresourceRange.baseMipLevel = i;
+		view_info.subresourceRange.levelCount = 1;
+		if (vkCreateImageView(device.get_logical_device(), &view_info, nullptr, &level.view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth pyramid level view");
+		}
+	}
+
+	// Pushed by build() instead
+	if (push_descriptors)
+	{
+		return;
+	}
+
+	for (uint32_t i = 1; i < level_count; i++)
+	{
+		VkDescriptorImageInfo source_info{};
+		source_info.sampler = sampler;
+		source_info.imageView = levels[i - 1].view;
+		source_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		VkDescriptorImageInfo destination_info{};
+		destination_info.imageView = levels[i].view;
+		destination_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		if (!DescriptorWriter(*set_layout, *descriptor_allocator)
+		     .write_image(0, &source_info)
+		     .write_image(1, &destination_info)
+		     .build(levels[i].descriptor_set))
+		{
+			throw std::runtime_error("Failed to build depth pyramid descriptor set");
+		}
+	}
+
+	for (VkDescriptorSet& depth_set : depth_sets)
+	{
+		if (!descriptor_allocator->allocate_descriptor(set_layout->get_descriptor_set_layout(), depth_set))
+		{
+			throw std::runtime_error("Failed to allocate depth pyramid descriptor set");
+		}
+	}
+}
+
+void game_engine::DepthPyramid::destroy_pyramid()
+{
+	for (const Level& level : levels)
+	{
+		vkDestroyImageView(device.get_logical_device(), level.view, nullptr);
+	}
+	levels.clear();
+
+	vkDestroyImageView(device.get_logical_device(), view, nullptr);
+	vkDestroyImage(device.get_logical_device(), image, nullptr);
+	device.get_memory_allocator().free(image_memory);
+}
+
+void game_engine::DepthPyramid::create_pipeline_layout()
+{
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(ReducePushConstants);
+
+	VkDescriptorSetLayout descriptor_set_layout = set_layout->get_descriptor_set_layout();
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &descriptor_set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	if (vkCreatePipelineLayout(
+		device.get_logical_device(),
+		&pipeline_layout_info,
+		nullptr,
+		&pipeline_layout
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid pipeline layout");
+	}
+}
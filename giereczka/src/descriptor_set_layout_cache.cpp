@@ -0,0 +1,110 @@
+#include "descriptor_set_layout_cache.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+	void hash_combine(size_t& seed, size_t value)
+	{
+		seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+	}
+}
+
+game_engine::DescriptorSetLayoutCache::DescriptorSetLayoutCache(VkDevice device) : device(device)
+{
+}
+
+game_engine::DescriptorSetLayoutCache::~DescriptorSetLayoutCache()
+{
+	for (auto& [key, layout] : layouts)
+	{
+		vkDestroyDescriptorSetLayout(device, layout, nullptr);
+	}
+}
+
+VkDescriptorSetLayout game_engine::DescriptorSetLayoutCache::get_layout(const VkDescriptorSetLayoutCreateInfo& create_info)
+{
+	const VkDescriptorBindingFlags* binding_flags = nullptr;
+	if (create_info.pNext != nullptr)
+	{
+		auto* flags_info = static_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(create_info.pNext);
+		assert(flags_info->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO &&
+			flags_info->pNext == nullptr && "Unsupported descriptor set layout pNext chain");
+		assert(flags_info->bindingCount == create_info.bindingCount && "Binding flag count must match binding count");
+		binding_flags = flags_info->pBindingFlags;
+	}
+
+	LayoutKey key;
+	key.flags = create_info.flags;
+	key.bindings.reserve(create_info.bindingCount);
+	for (uint32_t i = 0; i < create_info.bindingCount; i++)
+	{
+		key.bindings.push_back({create_info.pBindings[i], binding_flags != nullptr ? binding_flags[i] : 0});
+	}
+	std::sort(key.bindings.begin(), key.bindings.end(), [](const LayoutBinding& a, const LayoutBinding& b)
+	{
+		return a.binding.binding < b.binding.binding;
+	});
+
+	std::lock_guard lock(mutex);
+	if (auto it = layouts.find(key); it != layouts.end())
+	{
+		return it->second;
+	}
+
+	VkDescriptorSetLayout layout;
+	if (vkCreateDescriptorSetLayout(device, &create_info, nullptr, &layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create descriptor set layout");
+	}
+
+	layouts.emplace(std::move(key), layout);
+	return layout;
+}
+
+size_t game_engine::DescriptorSetLayoutCache::get_layout_count() const
+{
+	std::lock_guard lock(mutex);
+	return layouts.size();
+}
+
+bool game_engine::DescriptorSetLayoutCache::LayoutKey::operator==(const LayoutKey& other) const
+{
+	if (flags != other.flags || bindings.size() != other.bindings.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < bindings.size(); i++)
+	{
+		const auto& a = bindings[i];
+		const auto& b = other.bindings[i];
+		if (a.binding.binding != b.binding.binding ||
+			a.binding.descriptorType != b.binding.descriptorType ||
+			a.binding.descriptorCount != b.binding.descriptorCount ||
+			a.binding.stageFlags != b.binding.stageFlags ||
+			a.binding.pImmutableSamplers != b.binding.pImmutableSamplers ||
+			a.flags != b.flags)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t game_engine::DescriptorSetLayoutCache::LayoutKeyHash::operator()(const LayoutKey& key) const
+{
+	size_t seed = std::hash<uint32_t>{}(key.flags);
+	for (const auto& entry : key.bindings)
+	{
+		// Binding number, type, count and stages packed into one value
+		uint64_t packed = static_cast<uint64_t>(entry.binding.binding) |
+			static_cast<uint64_t>(entry.binding.descriptorType) << 8 |
+			static_cast<uint64_t>(entry.binding.descriptorCount) << 16 |
+			static_cast<uint64_t>(entry.binding.stageFlags) << 40;
+		hash_combine(seed, std::hash<uint64_t>{}(packed));
+		hash_combine(seed, std::hash<uint32_t>{}(entry.flags));
+	}
+	return seed;
+}
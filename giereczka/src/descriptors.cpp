@@ -1,5 +1,7 @@
 #include "descriptors.h"
 
+#include <algorithm>
+
 game_engine::DescriptorPool::Builder& game_engine::DescriptorPool::Builder::add_pool_size(VkDescriptorType type, uint32_t count)
 {
 	pool_sizes.push_back({ type, count });
@@ -37,12 +39,22 @@ game_engine::DescriptorSetLayout::Builder& game_engine::DescriptorSetLayout::Bui
 	return *this;
 }
 
+game_engine::DescriptorSetLayout::Builder& game_engine::DescriptorSetLayout::Builder::set_flags(VkDescriptorSetLayoutCreateFlags flags)
+{
+	this->flags = flags;
+	return *this;
+}
+
 std::unique_ptr<game_engine::DescriptorSetLayout> game_engine::DescriptorSetLayout::Builder::build() const
 {
-	return std::make_unique<DescriptorSetLayout>(device, bindings);
+	return std::make_unique<DescriptorSetLayout>(device, bindings, flags);
 }
 
-game_engine::DescriptorSetLayout::DescriptorSetLayout(Device& device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings) : device{ device }, bindings{ bindings }
+game_engine::DescriptorSetLayout::DescriptorSetLayout(
+	Device& device,
+	std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+	VkDescriptorSetLayoutCreateFlags flags
+	) : device{ device }, bindings{ bindings }
 {
 	std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings{};
 	for (auto kv : bindings)
@@ -54,27 +66,15 @@ game_engine::DescriptorSetLayout::DescriptorSetLayout(Device& device, std::unord
 	descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(set_layout_bindings.size());
 	descriptor_set_layout_create_info.pBindings = set_layout_bindings.data();
+	descriptor_set_layout_create_info.flags = flags;
 
-	if (vkCreateDescriptorSetLayout(
-		device.get_logical_device(),
-		&descriptor_set_layout_create_info,
-		nullptr,
-		&descriptor_set_layout
-	) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create descriptor set layout");
-	}
+	descriptor_set_layout = device.get_descriptor_set_layout_cache().get_layout(descriptor_set_layout_create_info);
 }
 
 std::unique_ptr<game_engine::DescriptorPool> game_engine::DescriptorPool::Builder::build() const {
 	return std::make_unique<DescriptorPool>(device, max_sets, pool_flags, pool_sizes);
 }
 
-game_engine::DescriptorSetLayout::~DescriptorSetLayout()
-{
-	vkDestroyDescriptorSetLayout(device.get_logical_device(), descriptor_set_layout, nullptr);
-}
-
 game_engine::DescriptorPool::DescriptorPool(Device& device, uint32_t max_sets, VkDescriptorPoolCreateFlags pool_flags, const std::vector<VkDescriptorPoolSize>& pool_sizes) : device{device}
 {
 	VkDescriptorPoolCreateInfo descriptor_pool_create_info{};
@@ -130,7 +130,131 @@ void game_engine::DescriptorPool::reset_pool()
 	vkResetDescriptorPool(device.get_logical_device(), descriptor_pool, 0);
 }
 
-game_engine::DescriptorWriter::DescriptorWriter(DescriptorSetLayout& set_layout, DescriptorPool& pool) : set_layout{ set_layout }, pool{ pool }
+game_engine::DescriptorAllocator::DescriptorAllocator(
+	Device& device,
+	uint32_t initial_sets,
+	std::vector<PoolSizeRatio> pool_ratios,
+	VkDescriptorPoolCreateFlags pool_flags
+	) : device{ device }, pool_ratios{ std::move(pool_ratios) }, pool_flags{ pool_flags }, sets_per_pool{ std::max(initial_sets, 1u) }
+{
+	ready_pools.push_back(create_pool(sets_per_pool));
+}
+
+game_engine::DescriptorAllocator::~DescriptorAllocator()
+{
+	for (VkDescriptorPool pool : ready_pools)
+	{
+		vkDestroyDescriptorPool(device.get_logical_device(), pool, nullptr);
+	}
+	for (VkDescriptorPool pool : full_pools)
+	{
+		vkDestroyDescriptorPool(device.get_logical_device(), pool, nullptr);
+	}
+}
+
+bool game_engine::DescriptorAllocator::allocate_descriptor(VkDescriptorSetLayout layout, VkDescriptorSet& descriptor)
+{
+	std::lock_guard lock(mutex);
+
+	VkDescriptorSetAllocateInfo descriptor_set_allocate_info{};
+	descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptor_set_allocate_info.descriptorSetCount = 1;
+	descriptor_set_allocate_info.pSetLayouts = &layout;
+
+	// A pool may be out of sets or of descriptors of one type, move on until a brand new pool fails too
+	while (true)
+	{
+		bool new_pool = ready_pools.empty();
+		VkDescriptorPool pool = get_pool();
+		descriptor_set_allocate_info.descriptorPool = pool;
+
+		VkResult result = vkAllocateDescriptorSets(device.get_logical_device(), &descriptor_set_allocate_info, &descriptor);
+		if (result == VK_SUCCESS)
+		{
+			ready_pools.push_back(pool);
+			return true;
+		}
+
+		full_pools.push_back(pool);
+		if (new_pool || (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL))
+		{
+			return false;
+		}
+	}
+}
+
+void game_engine::DescriptorAllocator::reset()
+{
+	std::lock_guard lock(mutex);
+
+	for (VkDescriptorPool pool : ready_pools)
+	{
+		vkResetDescriptorPool(device.get_logical_device(), pool, 0);
+	}
+	for (VkDescriptorPool pool : full_pools)
+	{
+		vkResetDescriptorPool(device.get_logical_device(), pool, 0);
+		ready_pools.push_back(pool);
+	}
+	full_pools.clear();
+}
+
+size_t game_engine::DescriptorAllocator::get_pool_count() const
+{
+	std::lock_guard lock(mutex);
+	return ready_pools.size() + full_pools.size();
+}
+
+VkDescriptorPool game_engine::DescriptorAllocator::get_pool()
+{
+	if (!ready_pools.empty())
+	{
+		VkDescriptorPool pool = ready_pools.back();
+		ready_pools.pop_back();
+		return pool;
+	}
+
+	VkDescriptorPool pool = create_pool(sets_per_pool);
+	sets_per_pool = std::min(sets_per_pool + sets_per_pool / 2 + 1, MAX_SETS_PER_POOL);
+	return pool;
+}
+
+VkDescriptorPool game_engine::DescriptorAllocator::create_pool(uint32_t set_count) const
+{
+	std::vector<VkDescriptorPoolSize> pool_sizes;
+	pool_sizes.reserve(pool_ratios.size());
+	for (const PoolSizeRatio& ratio : pool_ratios)
+	{
+		uint32_t count = static_cast<uint32_t>(std::ceil(ratio.ratio * static_cast<float>(set_count)));
+		pool_sizes.push_back({ ratio.type, std::max(count, 1u) });
+	}
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info{};
+	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	descriptor_pool_create_info.pPoolSizes = pool_sizes.data();
+	descriptor_pool_create_info.maxSets = set_count;
+	descriptor_pool_create_info.flags = pool_flags;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(
+		device.get_logical_device(),
+		&descriptor_pool_create_info,
+		nullptr,
+		&pool
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create descriptor pool");
+	}
+
+	return pool;
+}
+
+game_engine::DescriptorWriter::DescriptorWriter(DescriptorSetLayout& set_layout, DescriptorAllocator& allocator) : set_layout{ set_layout }, allocator{ &allocator }
+{
+}
+
+game_engine::DescriptorWriter::DescriptorWriter(DescriptorSetLayout& set_layout) : set_layout{ set_layout }, allocator{ nullptr }
 {
 }
 
@@ -181,9 +305,11 @@ game_engine::DescriptorWriter& game_engine::DescriptorWriter::write_image(uint32
 
 bool game_engine::DescriptorWriter::build(VkDescriptorSet& set)
 {
+	assert(allocator != nullptr && "Push only writer cannot build descriptor sets");
+
 	if (set == VK_NULL_HANDLE)
 	{
-		bool success = pool.allocate_descriptor(set_layout.descriptor_set_layout, set);
+		bool success = allocator->allocate_descriptor(set_layout.descriptor_set_layout, set);
 		if (!success)
 		{
 			return false;
@@ -202,10 +328,30 @@ void game_engine::DescriptorWriter::overwrite(VkDescriptorSet set)
 	}
 
 	vkUpdateDescriptorSets(
-		pool.device.get_logical_device(),
+		set_layout.device.get_logical_device(),
 		static_cast<uint32_t>(writes.size()),
 		writes.data(),
 		0,
 		nullptr
 	);
 }
+
+void game_engine::DescriptorWriter::push(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set)
+{
+	PFN_vkCmdPushDescriptorSetKHR cmd_push_descriptor_set = set_layout.device.get_cmd_push_descriptor_set();
+	assert(cmd_push_descriptor_set != nullptr && "Device does not support push descriptors");
+
+	for (auto& write : writes)
+	{
+		write.dstSet = VK_NULL_HANDLE;
+	}
+
+	cmd_push_descriptor_set(
+		command_buffer,
+		bind_point,
+		pipeline_layout,
+		set,
+		static_cast<uint32_t>(writes.size()),
+		writes.data()
+	);
+}
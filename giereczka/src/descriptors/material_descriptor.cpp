@@ -1,6 +1,6 @@
 #include "descriptors/material_descriptor.h"
 
-game_engine::MaterialDescriptor::MaterialDescriptor(Device& device, std::unique_ptr<DescriptorPool>& descriptor_pool) : device{device}
+game_engine::MaterialDescriptor::MaterialDescriptor(Device& device, DescriptorAllocator& descriptor_allocator) : device{device}
 {
     textures_binding.binding = 0;
     textures_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -24,17 +24,9 @@ game_engine::MaterialDescriptor::MaterialDescriptor(Device& device, std::unique_
     layout_info.pNext = nullptr;
     layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
 
-    if (vkCreateDescriptorSetLayout(device.get_logical_device(), &layout_info, nullptr, &descriptor_set_layout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create descriptor set layout");
-    }
-
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = descriptor_pool->get_descriptor_pool();
-    alloc_info.descriptorSetCount = 1;
-    alloc_info.pSetLayouts = &descriptor_set_layout;
+    descriptor_set_layout = device.get_descriptor_set_layout_cache().get_layout(layout_info);
 
-    if (vkAllocateDescriptorSets(device.get_logical_device(), &alloc_info, &descriptor_set) != VK_SUCCESS) {
+    if (!descriptor_allocator.allocate_descriptor(descriptor_set_layout, descriptor_set)) {
         throw std::runtime_error("Failed to allocate descriptor set");
     }
 }
@@ -1,4 +1,7 @@
 #include "device.h"
+#include "upload_batcher.h"
+#include "geometry_pool.h"
+#include "pipelines/pipeline_state_cache.h"
 
 namespace game_engine {
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback
@@ -48,18 +51,49 @@ namespace game_engine {
         }
     }
 
-	Device::Device(Window& window) : window(window)
+	Device::Device(Window& window) : window(&window)
 	{
 		create_instance();
 		setup_debug_messenger();
 		create_surface();
 		pick_physical_device();
 		create_logical_device();
+		memory_allocator = std::make_unique<MemoryAllocator>(physical_device, device_, properties.limits);
+		pipeline_cache = std::make_unique<PipelineCache>(device_, properties);
+		pipeline_state_cache = std::make_unique<PipelineStateCache>(*this);
+		descriptor_set_layout_cache = std::make_unique<DescriptorSetLayoutCache>(device_);
 		create_command_pool();
+		upload_batcher = std::make_unique<UploadBatcher>(*this);
+		geometry_pool = std::make_unique<GeometryPool>(*this);
+	}
+
+	Device::Device()
+	{
+		std::erase_if(device_extensions, [](const char* extension) {
+			return strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0;
+		});
+
+		create_instance();
+		setup_debug_messenger();
+		pick_physical_device();
+		create_logical_device();
+		memory_allocator = std::make_unique<MemoryAllocator>(physical_device, device_, properties.limits);
+		pipeline_cache = std::make_unique<PipelineCache>(device_, properties);
+		pipeline_state_cache = std::make_unique<PipelineStateCache>(*this);
+		descriptor_set_layout_cache = std::make_unique<DescriptorSetLayoutCache>(device_);
+		create_command_pool();
+		upload_batcher = std::make_unique<UploadBatcher>(*this);
+		geometry_pool = std::make_unique<GeometryPool>(*this);
 	}
 
     Device::~Device()
     {
+		geometry_pool.reset();
+		upload_batcher.reset();
+		pipeline_state_cache.reset();
+		descriptor_set_layout_cache.reset();
+		pipeline_cache.reset();
+		memory_allocator.reset();
 		vkDestroyCommandPool(device_, command_pool, nullptr);
 		vkDestroyDevice(device_, nullptr);
 
@@ -68,7 +102,10 @@ namespace game_engine {
 			DestroyDebugUtilsMessengerEX(instance, debug_messenger, nullptr);
 		}
 
-		vkDestroySurfaceKHR(instance, surface_, nullptr);
+		if (surface_ != VK_NULL_HANDLE)
+		{
+			vkDestroySurfaceKHR(instance, surface_, nullptr);
+		}
 		vkDestroyInstance(instance, nullptr);
     }
 
@@ -147,7 +184,7 @@ namespace game_engine {
 		throw std::runtime_error("failed to find supported format");
     }
 
-    void Device::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+    void Device::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& buffer_allocation)
     {
 		VkBufferCreateInfo buffer_info{};
 		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -160,19 +197,7 @@ namespace game_engine {
 			throw std::runtime_error("failed to create buffer");
         }
 
-		VkMemoryRequirements mem_requirements;
-		vkGetBufferMemoryRequirements(device_, buffer, &mem_requirements);
-
-		VkMemoryAllocateInfo alloc_info{};
-		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		alloc_info.allocationSize = mem_requirements.size;
-		alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
-        if (vkAllocateMemory(device_, &alloc_info, nullptr, &bufferMemory) != VK_SUCCESS)
-        {
-			throw std::runtime_error("failed to allocate buffer memory");
-        }
-
-		vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+		buffer_allocation = memory_allocator->allocate_buffer(buffer, properties);
     }
 
     VkCommandBuffer Device::begin_single_time_commands()
@@ -209,71 +234,14 @@ namespace game_engine {
 		vkFreeCommandBuffers(device_, command_pool, 1, &command_buffer);
     }
 
-    void Device::copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size)
-    {
-		VkCommandBuffer command_buffer = begin_single_time_commands();
-
-		VkBufferCopy copy_region{};
-		copy_region.srcOffset = 0;
-		copy_region.dstOffset = 0;
-		copy_region.size = size;
-
-		vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
-
-		end_single_time_commands(command_buffer);
-    }
-
-    void Device::copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layer_count)
-    {
-		VkCommandBuffer command_buffer = begin_single_time_commands();
-
-		VkBufferImageCopy region{};
-		region.bufferOffset = 0;
-		region.bufferRowLength = 0;
-		region.bufferImageHeight = 0;
-
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.mipLevel = 0;
-		region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = layer_count;
-
-		region.imageOffset = { 0, 0, 0 };
-		region.imageExtent = { width, height, 1 };
-
-		vkCmdCopyBufferToImage(
-            command_buffer,
-            buffer,
-            image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &region
-        );
-		end_single_time_commands(command_buffer);
-    }
-
-    void Device::create_image_with_info(const VkImageCreateInfo& image_info, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory)
+    void Device::create_image_with_info(const VkImageCreateInfo& image_info, VkMemoryPropertyFlags properties, VkImage& image, Allocation& image_allocation)
     {
         if (vkCreateImage(device_, &image_info, nullptr, &image) != VK_SUCCESS)
         {
 			throw std::runtime_error("failed to create image");
         }
 
-		VkMemoryRequirements mem_requirements;
-		vkGetImageMemoryRequirements(device_, image, &mem_requirements);
-
-		VkMemoryAllocateInfo alloc_info{};
-		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		alloc_info.allocationSize = mem_requirements.size;
-		alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
-        if (vkAllocateMemory(device_, &alloc_info, nullptr, &image_memory) != VK_SUCCESS)
-        {
-			throw std::runtime_error("failed to allocate image memory");
-        }
-
-        if (vkBindImageMemory(device_, image, image_memory, 0) != VK_SUCCESS)
-        {
-			throw std::runtime_error("failed to bind image memory");
-        }
+		image_allocation = memory_allocator->allocate_image(image, image_info.tiling, properties);
     }
 
     void Device::create_instance()
@@ -339,7 +307,7 @@ namespace game_engine {
 
     void Device::create_surface()
     {
-		window.create_window_surface(instance, &surface_);
+		window->create_window_surface(instance, &surface_);
     }
 
     void Device::pick_physical_device()
@@ -363,6 +331,14 @@ namespace game_engine {
 				break;
             }
         }
+
+        if (physical_device == VK_NULL_HANDLE)
+        {
+			throw std::runtime_error("failed to find a suitable GPU");
+        }
+
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+		std::cout << "Physical device: " << properties.deviceName << std::endl;
     }
 
     void Device::create_logical_device()
@@ -371,6 +347,10 @@ namespace game_engine {
 
 		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 		std::set<uint32_t> unique_queue_families = { indices.graphics_family, indices.present_family };
+		if (indices.transfer_family_has_value)
+		{
+			unique_queue_families.insert(indices.transfer_family);
+		}
 
 		float queue_priority = 1.0f;
         for (uint32_t queue_family : unique_queue_families)
@@ -394,6 +374,105 @@ namespace game_engine {
     	indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
     	indexing_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 
+		// Extended dynamic state is optional, pipelines bake the state in when it is missing
+		uint32_t extension_count;
+		vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, available_extensions.data());
+
+		std::set<std::string> available;
+		for (const auto& extension : available_extensions)
+		{
+			available.insert(extension.extensionName);
+		}
+
+		VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_state_features{};
+		dynamic_state_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+		VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamic_state2_features{};
+		dynamic_state2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+		VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamic_state3_features{};
+		dynamic_state3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+		// Query only the structures whose extension is present
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		void** query_next = &features2.pNext;
+		if (available.contains(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME))
+		{
+			*query_next = &dynamic_state_features;
+			query_next = &dynamic_state_features.pNext;
+		}
+		if (available.contains(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME))
+		{
+			*query_next = &dynamic_state2_features;
+			query_next = &dynamic_state2_features.pNext;
+		}
+		if (available.contains(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME))
+		{
+			*query_next = &dynamic_state3_features;
+			query_next = &dynamic_state3_features.pNext;
+		}
+		vkGetPhysicalDeviceFeatures2(physical_device, &features2);
+
+		extended_dynamic_state = ExtendedDynamicState{};
+		extended_dynamic_state.basic = dynamic_state_features.extendedDynamicState == VK_TRUE;
+		// The later extensions are only used on top of the first one
+		extended_dynamic_state.state2 = extended_dynamic_state.basic &&
+			dynamic_state2_features.extendedDynamicState2 == VK_TRUE;
+		extended_dynamic_state.polygon_mode = extended_dynamic_state.basic &&
+			dynamic_state3_features.extendedDynamicState3PolygonMode == VK_TRUE;
+
+		std::vector<const char*> enabled_extensions = device_extensions;
+		void** enable_next = &indexing_features.pNext;
+		if (extended_dynamic_state.basic)
+		{
+			enabled_extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+			dynamic_state_features.pNext = nullptr;
+			*enable_next = &dynamic_state_features;
+			enable_next = &dynamic_state_features.pNext;
+		}
+		if (extended_dynamic_state.state2)
+		{
+			enabled_extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+			// The logic op and patch control point features stay off
+			dynamic_state2_features = VkPhysicalDeviceExtendedDynamicState2FeaturesEXT{};
+			dynamic_state2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+			dynamic_state2_features.extendedDynamicState2 = VK_TRUE;
+			*enable_next = &dynamic_state2_features;
+			enable_next = &dynamic_state2_features.pNext;
+		}
+		if (extended_dynamic_state.polygon_mode)
+		{
+			enabled_extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+			dynamic_state3_features = VkPhysicalDeviceExtendedDynamicState3FeaturesEXT{};
+			dynamic_state3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+			dynamic_state3_features.extendedDynamicState3PolygonMode = VK_TRUE;
+			*enable_next = &dynamic_state3_features;
+			enable_next = &dynamic_state3_features.pNext;
+		}
+
+		// GPU-driven drawing needs many draws per indirect call with their own firstInstance, the count
+		// variant is optional as the draw buffer can be zero-filled instead
+		multi_draw_indirect = features2.features.multiDrawIndirect == VK_TRUE &&
+			features2.features.drawIndirectFirstInstance == VK_TRUE;
+		if (multi_draw_indirect)
+		{
+			device_features.multiDrawIndirect = VK_TRUE;
+			device_features.drawIndirectFirstInstance = VK_TRUE;
+		}
+		bool draw_indirect_count = multi_draw_indirect && available.contains(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		if (draw_indirect_count)
+		{
+			enabled_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+
+		// Lets per-draw descriptors be recorded straight into command buffers, optional
+		bool push_descriptors = available.contains(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+		if (push_descriptors)
+		{
+			enabled_extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+		}
+
 		VkDeviceCreateInfo create_info{};
 		create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -402,8 +481,8 @@ namespace game_engine {
     	create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     	create_info.pQueueCreateInfos = queue_create_infos.data();
     	create_info.pEnabledFeatures = &device_features;
-    	create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-    	create_info.ppEnabledExtensionNames = device_extensions.data();
+    	create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions.size());
+    	create_info.ppEnabledExtensionNames = enabled_extensions.data();
 
         if (enable_validation_layers)
         {
@@ -422,6 +501,28 @@ namespace game_engine {
 
 		vkGetDeviceQueue(device_, indices.graphics_family, 0, &graphics_queue);
 		vkGetDeviceQueue(device_, indices.present_family, 0, &present_queue);
+
+		transfer_queue = graphics_queue;
+		if (indices.transfer_family_has_value)
+		{
+			vkGetDeviceQueue(device_, indices.transfer_family, 0, &transfer_queue);
+		}
+
+		load_extended_dynamic_state();
+
+		cmd_draw_indexed_indirect_count = nullptr;
+		if (draw_indirect_count)
+		{
+			cmd_draw_indexed_indirect_count = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+				vkGetDeviceProcAddr(device_, "vkCmdDrawIndexedIndirectCountKHR"));
+		}
+
+		cmd_push_descriptor_set = nullptr;
+		if (push_descriptors)
+		{
+			cmd_push_descriptor_set = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(
+				vkGetDeviceProcAddr(device_, "vkCmdPushDescriptorSetKHR"));
+		}
     }
 
     void Device::create_command_pool()
@@ -445,8 +546,8 @@ namespace game_engine {
 
 		bool extensions_supported = check_device_extension_support(device);
 
-		bool swap_chain_adequate = false;
-        if (extensions_supported)
+		bool swap_chain_adequate = is_headless();
+        if (extensions_supported && !is_headless())
         {
 			SwapChainSupportDetails swap_chain_support = query_swap_chain_support(device);
 			swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
@@ -466,12 +567,16 @@ namespace game_engine {
 
     std::vector<const char*> Device::get_required_extensions()
     {
-		uint32_t glfw_extension_count = 0;
-		const char** glfw_extensions;
+		std::vector<const char*> extensions;
+        if (!is_headless())
+        {
+			uint32_t glfw_extension_count = 0;
+			const char** glfw_extensions;
 
-		glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+			glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
 
-		std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+			extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+        }
 
         if (enable_validation_layers)
         {
@@ -533,7 +638,16 @@ namespace game_engine {
             }
 
 			VkBool32 present_support = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &present_support);
+            if (surface_ != VK_NULL_HANDLE)
+            {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &present_support);
+            }
+            else
+            {
+				// Nothing is presented in headless mode, the graphics queue stands in for the present queue
+				present_support = queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+            }
+
             if (queue_family.queueCount > 0 && present_support)
             {
 				indices.present_family = i;
@@ -548,6 +662,34 @@ namespace game_engine {
 			i++;
         }
 
+		// Prefer a pure transfer family (the DMA engines) over an async compute one, which can also copy
+		int best_transfer_score = 0;
+		for (uint32_t family = 0; family < queue_family_count; family++)
+		{
+			VkQueueFlags flags = queue_families[family].queueFlags;
+			if (queue_families[family].queueCount == 0 || (flags & VK_QUEUE_GRAPHICS_BIT))
+			{
+				continue;
+			}
+
+			int score = 0;
+			if (flags & VK_QUEUE_COMPUTE_BIT)
+			{
+				score = 1;
+			}
+			else if (flags & VK_QUEUE_TRANSFER_BIT)
+			{
+				score = 2;
+			}
+
+			if (score > best_transfer_score)
+			{
+				best_transfer_score = score;
+				indices.transfer_family = family;
+				indices.transfer_family_has_value = true;
+			}
+		}
+
 		return indices;
     }
 
@@ -679,4 +821,38 @@ bool game_engine::Device::check_descriptor_indexing_support(VkPhysicalDevice dev
 	return indexing_features.descriptorBindingPartiallyBound &&
 		   indexing_features.runtimeDescriptorArray &&
 		   indexing_features.descriptorBindingVariableDescriptorCount;
-}
\ No newline at end of file
+}
+
+void game_engine::Device::load_extended_dynamic_state()
+{
+	auto load = [this](auto& function, const char* name)
+	{
+		function = reinterpret_cast<std::remove_reference_t<decltype(function)>>(vkGetDeviceProcAddr(device_, name));
+		return function != nullptr;
+	};
+
+	ExtendedDynamicState& state = extended_dynamic_state;
+	if (state.basic)
+	{
+		state.basic = load(state.cmd_set_cull_mode, "vkCmdSetCullModeEXT") &&
+			load(state.cmd_set_front_face, "vkCmdSetFrontFaceEXT") &&
+			load(state.cmd_set_primitive_topology, "vkCmdSetPrimitiveTopologyEXT") &&
+			load(state.cmd_set_depth_test_enable, "vkCmdSetDepthTestEnableEXT") &&
+			load(state.cmd_set_depth_write_enable, "vkCmdSetDepthWriteEnableEXT") &&
+			load(state.cmd_set_depth_compare_op, "vkCmdSetDepthCompareOpEXT");
+	}
+	if (state.state2)
+	{
+		state.state2 = state.basic &&
+			load(state.cmd_set_depth_bias_enable, "vkCmdSetDepthBiasEnableEXT") &&
+			load(state.cmd_set_primitive_restart_enable, "vkCmdSetPrimitiveRestartEnableEXT");
+	}
+	if (state.polygon_mode)
+	{
+		state.polygon_mode = state.basic && load(state.cmd_set_polygon_mode, "vkCmdSetPolygonModeEXT");
+	}
+
+	std::cout << "Extended dynamic state: " << (state.basic ? "yes" : "no")
+		<< ", state 2: " << (state.state2 ? "yes" : "no")
+		<< ", polygon mode: " << (state.polygon_mode ? "yes" : "no") << std::endl;
+}
@@ -1,5 +1,8 @@
 #include "engine.h"
 
+#include "pipelines/pipeline_state_cache.h"
+#include "geometry_pool.h"
+
 game_engine::Engine::Engine()
 {
 }
@@ -10,14 +13,25 @@ game_engine::Engine::~Engine()
 
 void game_engine::Engine::run()
 {
-	global_descriptor_pool = DescriptorPool::Builder{device}
-	                         .set_max_sets(SwapChain::MAX_FRAMES_IN_FLIGHT * 4)
-	                         .add_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT * 2)
-	                         .add_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-	                                        SwapChain::MAX_FRAMES_IN_FLIGHT * 1024)
-	                         .add_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT * 4)
-	                         .set_pool_flags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT)
-	                         .build();
+	// Per-frame uniform buffer sets, the allocator adds pools if systems ask for more
+	global_descriptor_allocator = std::make_unique<DescriptorAllocator>(
+		device,
+		SwapChain::MAX_FRAMES_IN_FLIGHT * 2,
+		std::vector<DescriptorAllocator::PoolSizeRatio>{
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.f},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.f}
+		}
+	);
+
+	// The bindless texture array is updated after bind, so it needs its own pool flags
+	materials_descriptor_allocator = std::make_unique<DescriptorAllocator>(
+		device,
+		1,
+		std::vector<DescriptorAllocator::PoolSizeRatio>{
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<float>(MAX_TEXTURES)}
+		},
+		VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT
+	);
 
 	global_descriptor_set_layout = DescriptorSetLayout::Builder{device}
 	                               .add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
@@ -32,7 +46,7 @@ void game_engine::Engine::run()
 	                              .build();
 
 	auto materials_descriptor = std::make_unique<
-		MaterialDescriptor>(MaterialDescriptor(device, global_descriptor_pool));
+		MaterialDescriptor>(MaterialDescriptor(device, *materials_descriptor_allocator));
 	std::vector<std::unique_ptr<Buffer>> uniform_buffers{SwapChain::MAX_FRAMES_IN_FLIGHT};
 	std::vector<std::unique_ptr<Buffer>> joint_buffers{SwapChain::MAX_FRAMES_IN_FLIGHT};
 	for (int i = 0; i < uniform_buffers.size(); i++)
@@ -48,6 +62,7 @@ void game_engine::Engine::run()
 		uniform_buffers[i]->map();
 	}
 
+	// Never written while skeletal animation is disabled, vert_shader.vert does not skin yet
 	for (int i = 0; i < joint_buffers.size(); i++)
 	{
 		joint_buffers[i] = std::make_unique<Buffer>(
@@ -70,7 +85,7 @@ void game_engine::Engine::run()
 	for (int i = 0; i < global_descriptor_sets.size(); i++)
 	{
 		auto buffer_info = uniform_buffers[i]->descriptor_info();
-		bool result = DescriptorWriter(*global_descriptor_set_layout, *global_descriptor_pool)
+		bool result = DescriptorWriter(*global_descriptor_set_layout, *global_descriptor_allocator)
 		              .write_buffer(0, &buffer_info)
 		              .build(global_descriptor_sets[i]);
 		assert(result && "Failed to build global descriptor set");
@@ -79,22 +94,35 @@ void game_engine::Engine::run()
 	for (int i = 0; i < joint_descriptor_sets.size(); i++)
 	{
 		auto buffer_info = joint_buffers[i]->descriptor_info();
-		bool result = DescriptorWriter(*joint_descriptor_set_layout, *global_descriptor_pool)
+		bool result = DescriptorWriter(*joint_descriptor_set_layout, *global_descriptor_allocator)
 		              .write_buffer(0, &buffer_info)
 		              .build(joint_descriptor_sets[i]);
 		assert(result && "Failed to build joint descriptor set");
 	}
 
+	// Without multiDrawIndirect objects keep being culled and recorded one by one on the CPU
+	std::unique_ptr<DepthPyramid> depth_pyramid;
+	std::unique_ptr<GpuCullingSystem> gpu_culling_system;
+	if (GpuCullingSystem::is_supported(device))
+	{
+		depth_pyramid = std::make_unique<DepthPyramid>(
+			device, renderer.get_swap_chain_extent(), renderer.get_depth_format(), SwapChain::MAX_FRAMES_IN_FLIGHT);
+		gpu_culling_system = std::make_unique<GpuCullingSystem>(device, SwapChain::MAX_FRAMES_IN_FLIGHT, depth_pyramid.get());
+	}
+
 	RenderSystem render_system{
 		device,
+		job_system,
 		renderer.get_swap_chain_render_pass(),
 		global_descriptor_set_layout->get_descriptor_set_layout(),
 		joint_descriptor_set_layout->get_descriptor_set_layout(),
-		materials_descriptor->get_descriptor_set_layout()
+		materials_descriptor->get_descriptor_set_layout(),
+		SwapChain::MAX_FRAMES_IN_FLIGHT,
+		gpu_culling_system.get()
 	};
 
 	PointLightSystem point_light_system{
-		device, renderer.get_swap_chain_render_pass(), global_descriptor_set_layout->get_descriptor_set_layout()
+		device, job_system, renderer.get_swap_chain_render_pass(), global_descriptor_set_layout->get_descriptor_set_layout()
 	};
 
 	PlayerController player_controller;
@@ -108,6 +136,42 @@ void game_engine::Engine::run()
 
 	debug_ui.init_debug_ui(renderer.get_swap_chain_render_pass(), SwapChain::MAX_FRAMES_IN_FLIGHT);
 
+	// Frame state the systems below share, the main thread fills it in before every scheduler run
+	int frame_index = 0;
+	float frame_time = 0.f;
+	GlobalUbo ubo{};
+	SecondaryRecordingInfo recording_info{};
+	std::vector<VkCommandBuffer> secondary_command_buffers;
+	std::vector<VkCommandBuffer> late_command_buffers;
+
+	SystemScheduler scheduler{job_system};
+	scheduler.add_system("point_lights", PointLightSystem::update_access(), [&]
+	{
+		point_light_system.update(object_manager_system.get_point_lights(), ubo, frame_time);
+		uniform_buffers[frame_index]->write_to_buffer(&ubo);
+		uniform_buffers[frame_index]->flush();
+	});
+	scheduler.add_system("record_game_objects", RenderSystem::record_access(), [&]
+	{
+		render_system.set_software_occlusion_culling(debug_ui.is_software_occlusion_culling());
+		render_system.set_draw_sorting(debug_ui.is_draw_sorting());
+		render_system.record_game_objects(
+			job_system,
+			command_pools,
+			frame_index,
+			recording_info,
+			renderer.get_frame_descriptor_allocator(),
+			object_manager_system.get_game_objects(),
+			player_controller.get_camera(),
+			global_descriptor_sets[frame_index],
+			joint_descriptor_sets[frame_index],
+			texture_manager_system.get_material_descriptor()->get_descriptor_set(),
+			debug_ui.is_render_wireframe(),
+			secondary_command_buffers,
+			late_command_buffers
+		);
+	});
+
 	auto current_time = std::chrono::high_resolution_clock::now();
 
 	performance_counter.start();
@@ -117,8 +181,7 @@ void game_engine::Engine::run()
 
 		auto new_time = std::chrono::high_resolution_clock::now();
 		auto duration = std::chrono::duration<float>(new_time - current_time);
-		float frame_time = duration.count();
-		Timestep timestep(duration);
+		frame_time = duration.count();
 		current_time = new_time;
 
 		performance_counter.run(frame_time);
@@ -130,65 +193,49 @@ void game_engine::Engine::run()
 
 		if (auto command_buffer = renderer.begin_frame())
 		{
-			int frame_index = renderer.get_frame_index();
-			// update
-			GlobalUbo ubo{};
-			JointUbo joint_ubo{};
+			frame_index = renderer.get_frame_index();
 
 			auto& camera = player_controller.get_camera();
+			ubo = GlobalUbo{};
 			ubo.projection = camera.get_projection_matrix();
 			ubo.view = camera.get_view_matrix();
 			ubo.inverse_view = camera.get_inverse_view_matrix();
 
-			//gltf_model.animations->update(timestep, *gltf_model.skeleton, 7);
-			//gltf_model.skeleton->Update();
-
-			//for (int i = 0; i < gltf_model.skeleton->shader_data.final_joint_matrices.size(); i++)
-			//{
-			//	joint_ubo.joint_matrices[i] = gltf_model.skeleton->shader_data.final_joint_matrices[i];
-			//}
-			//joint_ubo.num_joints = gltf_model.skeleton->joints.size();
-
-			point_light_system.update(object_manager_system.get_point_lights(), ubo, frame_time);
-
-			uniform_buffers[frame_index]->write_to_buffer(&ubo);
-			uniform_buffers[frame_index]->flush();
-
-			//joint_buffers[frame_index]->write_to_buffer(&joint_ubo);
-			//joint_buffers[frame_index]->flush();
-
-			// render
-			renderer.begin_swap_chain_render_pass(command_buffer);
-
-			if (debug_ui.is_render_wireframe())
+			command_pools.reset(frame_index);
+			recording_info = SecondaryRecordingInfo{
+				renderer.get_swap_chain_render_pass(),
+				renderer.get_current_framebuffer(),
+				renderer.get_swap_chain_extent()
+			};
+			secondary_command_buffers.clear();
+			late_command_buffers.clear();
+
+			// Only the main thread touches the object manager's change tracking
+			if (gpu_culling_system != nullptr)
 			{
-				render_system.render_wireframe_game_objects(command_buffer, object_manager_system.get_game_objects(),
-				                                            player_controller.get_camera(),
-				                                            global_descriptor_sets[frame_index],
-				                                            joint_descriptor_sets[frame_index]);
-			}
-			else
-			{
-				render_system.render_game_objects(
-					command_buffer,
-					object_manager_system.get_game_objects(),
-					player_controller.get_camera(),
-					global_descriptor_sets[frame_index],
-					joint_descriptor_sets[frame_index],
-					texture_manager_system.get_material_descriptor()->get_descriptor_set()
-				);
+				gpu_culling_system->take_scene_changes(object_manager_system);
 			}
 
-			point_light_system.render(command_buffer, object_manager_system.get_point_lights(),
+			// Light and UBO updates, animation and draw recording overlap on the job system
+			scheduler.run();
+
+			// Lights and the debug UI are cheap, and ImGui is not thread safe, so the main thread records them
+			// once the systems are done
+			VkCommandBuffer overlay_command_buffer = command_pools.begin_secondary(
+				frame_index, job_system.get_worker_index(), recording_info);
+
+			point_light_system.render(overlay_command_buffer, object_manager_system.get_point_lights(),
 			                          player_controller.get_camera(), global_descriptor_sets[frame_index]);
 
 			if (input_system.get_is_menu_open())
 			{
 				debug_ui.draw(
-					command_buffer,
+					overlay_command_buffer,
 					object_manager_system,
 					player_controller,
-					performance_counter
+					performance_counter,
+					render_system.get_occlusion_statistics(),
+					render_system.get_render_statistics()
 				);
 			}
 			else
@@ -196,6 +243,54 @@ void game_engine::Engine::run()
 				object_manager_system.set_model_color(debug_ui.get_debug_object_id(), glm::vec3(0.0f, 0.0f, 0.0f));
 			}
 
+			if (vkEndCommandBuffer(overlay_command_buffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to record overlay command buffer");
+			}
+			// Drawn last, over whatever the occlusion culling pass adds
+			late_command_buffers.push_back(overlay_command_buffer);
+
+			// Dispatches cannot be recorded inside the render pass, the indirect draws wait on it there
+			if (gpu_culling_system != nullptr)
+			{
+				VkExtent2D extent = renderer.get_swap_chain_extent();
+				VkExtent2D pyramid_depth_extent = depth_pyramid->get_depth_extent();
+				if (extent.width != pyramid_depth_extent.width || extent.height != pyramid_depth_extent.height)
+				{
+					// Only after the swapchain was recreated, frames still in flight may read the old pyramid
+					vkDeviceWaitIdle(device.get_logical_device());
+					depth_pyramid->resize(extent);
+				}
+
+				gpu_culling_system->cull(command_buffer, frame_index, camera);
+			}
+
+			renderer.begin_swap_chain_render_pass(command_buffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			vkCmdExecuteCommands(
+				command_buffer,
+				static_cast<uint32_t>(secondary_command_buffers.size()),
+				secondary_command_buffers.data()
+			);
+
+			// What was visible last frame is drawn, its depth decides what else is worth drawing
+			if (gpu_culling_system != nullptr && gpu_culling_system->needs_occlusion_pass(frame_index))
+			{
+				renderer.end_swap_chain_render_pass(command_buffer);
+				depth_pyramid->build(
+					command_buffer,
+					frame_index,
+					renderer.get_current_depth_image(),
+					renderer.get_current_depth_image_view()
+				);
+				gpu_culling_system->cull_occluded(command_buffer, frame_index, camera);
+				renderer.continue_swap_chain_render_pass(command_buffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			}
+
+			vkCmdExecuteCommands(
+				command_buffer,
+				static_cast<uint32_t>(late_command_buffers.size()),
+				late_command_buffers.data()
+			);
 			renderer.end_swap_chain_render_pass(command_buffer);
 			renderer.end_frame();
 		}
@@ -203,59 +298,19 @@ void game_engine::Engine::run()
 	performance_counter.stop();
 
 	vkDeviceWaitIdle(device.get_logical_device());
-}
 
-void game_engine::Engine::load_game_objects(TextureManagerSystem& texture_manager_system)
-{
-	for (int i = 0; i < 10; i++)
+	// Pipelines compile in the background while the first frames render, so creation is reported on exit.
+	// Compare against a run with pipeline_cache.bin deleted for the cold start.
+	device.get_pipeline_cache().print_statistics(std::cout);
+	device.get_pipeline_state_cache().print_statistics(std::cout);
+	device.get_geometry_pool().print_statistics(std::cout);
+	if (gpu_culling_system != nullptr)
 	{
-		auto rotate_light = glm::rotate(
-			glm::mat4(1.f),
-			(i * glm::two_pi<float>()) / 10.f,
-			glm::vec3(0.f, -1.f, 0.f)
-		);
-		auto position = glm::vec3(rotate_light * glm::vec4(-5.f, -5.f, -5.f, 1.f));
-
-		float hue = (i / static_cast<float>(10)) * glm::two_pi<float>();
-		float r = 0.5f * (1.0f + cos(hue));
-		float g = 0.5f * (1.0f + cos(hue + glm::two_pi<float>() / 3.0f));
-		float b = 0.5f * (1.0f + cos(hue + 2.0f * glm::two_pi<float>() / 3.0f));
-		auto color = glm::vec3(
-			r, g, b
-		);
-
-		auto point_light = PointLightObject(
-			1.0f,
-			0.05f,
-			color,
-			position
-		);
-		object_manager_system.add_point_light(point_light);
+		gpu_culling_system->print_statistics(std::cout);
 	}
+}
 
-	auto gltf_model = std::make_shared<GltfModel>(device, "models/animated_model.gltf");
-	auto game_object = GameObject(
-		gltf_model,
-		glm::vec3(0.0f),
-		glm::vec3(0.0f),
-		1.0f,
-		glm::vec3(0.0f),
-		"animated_model"
-	);
-
-	game_object.gltf_model->texture_id = texture_manager_system.load_texture(game_object.gltf_model->textures[0]);
-
-	object_manager_system.add_game_object(game_object);
-
-	auto gltf_model2 = std::make_shared<GltfModel>(device, "models/plane.gltf");
-	auto game_object2 = GameObject(
-		gltf_model2,
-		glm::vec3(0.0f),
-		glm::vec3(0.0f),
-		1.0f,
-		glm::vec3(0.0f),
-		"plane"
-	);
-	game_object2.gltf_model->texture_id = texture_manager_system.load_texture(game_object2.gltf_model->textures[1]);
-	object_manager_system.add_game_object(game_object2);
+void game_engine::Engine::load_game_objects(TextureManagerSystem& texture_manager_system)
+{
+	load_default_scene(device, object_manager_system, texture_manager_system);
 }
@@ -0,0 +1,279 @@
+#include "frustum_culling.h"
+
+#include <bit>
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define GAME_ENGINE_CULL_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GAME_ENGINE_CULL_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define GAME_ENGINE_CULL_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+	// Bit i of mask is set when box base + i is visible, bits past the last box are padding
+	void append_visible(uint32_t mask, size_t base, size_t count, std::vector<uint32_t>& visible)
+	{
+		if (count - base < game_engine::FrustumCuller::BATCH_SIZE)
+		{
+			mask &= (1u << (count - base)) - 1;
+		}
+
+		while (mask != 0)
+		{
+			visible.push_back(static_cast<uint32_t>(base) + std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+}
+
+void game_engine::FrustumCuller::clear()
+{
+	count = 0;
+	center_x.clear();
+	center_y.clear();
+	center_z.clear();
+	extent_x.clear();
+	extent_y.clear();
+	extent_z.clear();
+}
+
+void game_engine::FrustumCuller::reserve(size_t count)
+{
+	size_t padded = (count + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+	for (auto* values : {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z})
+	{
+		values->reserve(padded);
+	}
+}
+
+uint32_t game_engine::FrustumCuller::add(const BoundingBox& world_box)
+{
+	// Grow by a whole batch at a time so the kernels never read past the end
+	if (count % BATCH_SIZE == 0)
+	{
+		for (auto* values : {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z})
+		{
+			values->resize(count + BATCH_SIZE, 0.f);
+		}
+	}
+
+	glm::vec3 center = world_box.get_center();
+	glm::vec3 extent = world_box.get_extent();
+	center_x[count] = center.x;
+	center_y[count] = center.y;
+	center_z[count] = center.z;
+	extent_x[count] = extent.x;
+	extent_y[count] = extent.y;
+	extent_z[count] = extent.z;
+
+	return static_cast<uint32_t>(count++);
+}
+
+void game_engine::FrustumCuller::cull(
+	const std::array<glm::vec4, 6>& planes,
+	std::vector<uint32_t>& visible,
+	CullingKernel kernel
+) const
+{
+	if (kernel == CullingKernel::simd)
+	{
+		cull_simd(planes, visible);
+	}
+	else
+	{
+		cull_scalar(planes, visible);
+	}
+}
+
+const char* game_engine::FrustumCuller::get_simd_name()
+{
+#if defined(GAME_ENGINE_CULL_AVX2)
+	return "AVX2";
+#elif defined(GAME_ENGINE_CULL_SSE2)
+	return "SSE2";
+#elif defined(GAME_ENGINE_CULL_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+// A box is outside when it lies entirely behind one plane: the signed distance of its center plus its
+// extent projected on the plane normal is negative
+void game_engine::FrustumCuller::cull_scalar(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible) const
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		bool inside = true;
+		for (const glm::vec4& plane : planes)
+		{
+			float distance = plane.x * center_x[i] + plane.y * center_y[i] + plane.z * center_z[i] + plane.w;
+			float radius = std::abs(plane.x) * extent_x[i] + std::abs(plane.y) * extent_y[i] + std::abs(plane.z) * extent_z[i];
+			if (distance + radius < 0.f)
+			{
+				inside = false;
+				break;
+			}
+		}
+
+		if (inside)
+		{
+			visible.push_back(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+#if defined(GAME_ENGINE_CULL_AVX2)
+
+void game_engine::FrustumCuller::cull_simd(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible) const
+{
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (size_t base = 0; base < count; base += BATCH_SIZE)
+	{
+		const __m256 cx = _mm256_loadu_ps(center_x.data() + base);
+		const __m256 cy = _mm256_loadu_ps(center_y.data() + base);
+		const __m256 cz = _mm256_loadu_ps(center_z.data() + base);
+		const __m256 ex = _mm256_loadu_ps(extent_x.data() + base);
+		const __m256 ey = _mm256_loadu_ps(extent_y.data() + base);
+		const __m256 ez = _mm256_loadu_ps(extent_z.data() + base);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const glm::vec4& plane : planes)
+		{
+			__m256 distance = _mm256_fmadd_ps(_mm256_set1_ps(plane.x), cx, _mm256_set1_ps(plane.w));
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(plane.y), cy, distance);
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(plane.z), cz, distance);
+
+			__m256 radius = _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex);
+			radius = _mm256_fmadd_ps(_mm256_set1_ps(std::abs(plane.y)), ey, radius);
+			radius = _mm256_fmadd_ps(_mm256_set1_ps(std::abs(plane.z)), ez, radius);
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+		}
+
+		append_visible(static_cast<uint32_t>(_mm256_movemask_ps(inside)), base, count, visible);
+	}
+}
+
+#elif defined(GAME_ENGINE_CULL_SSE2)
+
+namespace {
+	// Four boxes starting at offset, returns their visibility in the low four bits
+	uint32_t cull_sse2_half(
+		const std::array<glm::vec4, 6>& planes,
+		const float* cx_data, const float* cy_data, const float* cz_data,
+		const float* ex_data, const float* ey_data, const float* ez_data
+	)
+	{
+		const __m128 cx = _mm_loadu_ps(cx_data);
+		const __m128 cy = _mm_loadu_ps(cy_data);
+		const __m128 cz = _mm_loadu_ps(cz_data);
+		const __m128 ex = _mm_loadu_ps(ex_data);
+		const __m128 ey = _mm_loadu_ps(ey_data);
+		const __m128 ez = _mm_loadu_ps(ez_data);
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const glm::vec4& plane : planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_set1_ps(plane.w));
+			distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.y), cy), distance);
+			distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), distance);
+
+			__m128 radius = _mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex);
+			radius = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey), radius);
+			radius = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez), radius);
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		return static_cast<uint32_t>(_mm_movemask_ps(inside));
+	}
+}
+
+void game_engine::FrustumCuller::cull_simd(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible) const
+{
+	for (size_t base = 0; base < count; base += BATCH_SIZE)
+	{
+		uint32_t low = cull_sse2_half(
+			planes,
+			center_x.data() + base, center_y.data() + base, center_z.data() + base,
+			extent_x.data() + base, extent_y.data() + base, extent_z.data() + base
+		);
+		uint32_t high = cull_sse2_half(
+			planes,
+			center_x.data() + base + 4, center_y.data() + base + 4, center_z.data() + base + 4,
+			extent_x.data() + base + 4, extent_y.data() + base + 4, extent_z.data() + base + 4
+		);
+		append_visible(low | (high << 4), base, count, visible);
+	}
+}
+
+#elif defined(GAME_ENGINE_CULL_NEON)
+
+namespace {
+	uint32_t cull_neon_half(
+		const std::array<glm::vec4, 6>& planes,
+		const float* cx_data, const float* cy_data, const float* cz_data,
+		const float* ex_data, const float* ey_data, const float* ez_data
+	)
+	{
+		const float32x4_t cx = vld1q_f32(cx_data);
+		const float32x4_t cy = vld1q_f32(cy_data);
+		const float32x4_t cz = vld1q_f32(cz_data);
+		const float32x4_t ex = vld1q_f32(ex_data);
+		const float32x4_t ey = vld1q_f32(ey_data);
+		const float32x4_t ez = vld1q_f32(ez_data);
+		const float32x4_t zero = vdupq_n_f32(0.f);
+
+		uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+		for (const glm::vec4& plane : planes)
+		{
+			float32x4_t distance = vfmaq_n_f32(vdupq_n_f32(plane.w), cx, plane.x);
+			distance = vfmaq_n_f32(distance, cy, plane.y);
+			distance = vfmaq_n_f32(distance, cz, plane.z);
+
+			float32x4_t radius = vmulq_n_f32(ex, std::abs(plane.x));
+			radius = vfmaq_n_f32(radius, ey, std::abs(plane.y));
+			radius = vfmaq_n_f32(radius, ez, std::abs(plane.z));
+
+			inside = vandq_u32(inside, vcgeq_f32(vaddq_f32(distance, radius), zero));
+		}
+
+		// No movemask on NEON, weight the lanes and add them up
+		const uint32_t lane_bits[4] = {1, 2, 4, 8};
+		return vaddvq_u32(vandq_u32(inside, vld1q_u32(lane_bits)));
+	}
+}
+
+void game_engine::FrustumCuller::cull_simd(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible) const
+{
+	for (size_t base = 0; base < count; base += BATCH_SIZE)
+	{
+		uint32_t low = cull_neon_half(
+			planes,
+			center_x.data() + base, center_y.data() + base, center_z.data() + base,
+			extent_x.data() + base, extent_y.data() + base, extent_z.data() + base
+		);
+		uint32_t high = cull_neon_half(
+			planes,
+			center_x.data() + base + 4, center_y.data() + base + 4, center_z.data() + base + 4,
+			extent_x.data() + base + 4, extent_y.data() + base + 4, extent_z.data() + base + 4
+		);
+		append_visible(low | (high << 4), base, count, visible);
+	}
+}
+
+#else
+
+void game_engine::FrustumCuller::cull_simd(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible) const
+{
+	cull_scalar(planes, visible);
+}
+
+#endif
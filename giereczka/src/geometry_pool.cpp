@@ -0,0 +1,329 @@
+#include "geometry_pool.h"
+
+#include "upload_batcher.h"
+
+#include <algorithm>
+#include <cassert>
+
+game_engine::GeometryPool::GeometryPool(
+	Device& device,
+	VkDeviceSize vertex_capacity,
+	VkDeviceSize index16_capacity,
+	VkDeviceSize index32_capacity,
+	VkDeviceSize meshlet_capacity
+)
+	: device(device),
+	  vertex_allocator(vertex_capacity),
+	  index16_allocator(index16_capacity),
+	  index32_allocator(index32_capacity),
+	  meshlet_allocator(meshlet_capacity)
+{
+	auto& upload_batcher = device.get_upload_batcher();
+
+	vertex_buffer = std::make_unique<Buffer>(
+		device,
+		sizeof(uint32_t),
+		static_cast<uint32_t>(vertex_capacity / sizeof(uint32_t)),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		upload_batcher.get_static_buffer_properties()
+	);
+
+	index16_buffer = std::make_unique<Buffer>(
+		device,
+		sizeof(uint16_t),
+		static_cast<uint32_t>(index16_capacity),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		upload_batcher.get_static_buffer_properties()
+	);
+
+	index32_buffer = std::make_unique<Buffer>(
+		device,
+		sizeof(uint32_t),
+		static_cast<uint32_t>(index32_capacity),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		upload_batcher.get_static_buffer_properties()
+	);
+
+	meshlet_buffer = std::make_unique<Buffer>(
+		device,
+		sizeof(GpuMeshlet),
+		static_cast<uint32_t>(meshlet_capacity),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		upload_batcher.get_static_buffer_properties()
+	);
+
+	descriptor_set_layout = DescriptorSetLayout::Builder{device}
+	                        .add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+	                        .build();
+
+	descriptor_allocator = std::make_unique<DescriptorAllocator>(
+		device,
+		1,
+		std::vector<DescriptorAllocator::PoolSizeRatio>{
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.f}
+		}
+	);
+
+	auto buffer_info = vertex_buffer->descriptor_info();
+	if (!DescriptorWriter(*descriptor_set_layout, *descriptor_allocator)
+	     .write_buffer(0, &buffer_info)
+	     .build(descriptor_set))
+	{
+		throw std::runtime_error("Failed to build geometry pool descriptor set");
+	}
+}
+
+game_engine::GeometryPool::~GeometryPool()
+{
+}
+
+game_engine::GeometryAllocation game_engine::GeometryPool::allocate(
+	const void* vertices,
+	uint32_t vertex_count,
+	uint32_t vertex_stride,
+	const uint32_t* indices,
+	uint32_t index_count
+)
+{
+	assert(vertex_count > 0 && "Cannot allocate an empty mesh");
+	assert(vertex_stride > 0 && vertex_stride % sizeof(uint32_t) == 0 && "Vertex stride must be a multiple of 4 bytes");
+
+	GeometryAllocation allocation{};
+	allocation.vertex_count = vertex_count;
+	allocation.vertex_stride = vertex_stride;
+	allocation.index_count = index_count;
+	allocation.index_type = vertex_count <= UINT16_MAX ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	TlsfAllocator& index_allocator = allocation.index_type == VK_INDEX_TYPE_UINT16 ? index16_allocator : index32_allocator;
+
+	VkDeviceSize vertex_bytes = static_cast<VkDeviceSize>(vertex_count) * vertex_stride;
+
+	std::lock_guard lock(mutex);
+
+	// TLSF only aligns to powers of two, other strides get room to round the start up themselves
+	bool power_of_two = (vertex_stride & (vertex_stride - 1)) == 0;
+	VkDeviceSize vertex_offset;
+	auto allocate_vertices = [&]
+	{
+		return power_of_two
+			? vertex_allocator.allocate(vertex_bytes, vertex_stride, vertex_offset)
+			: vertex_allocator.allocate(vertex_bytes + vertex_stride - sizeof(uint32_t), sizeof(uint32_t), vertex_offset);
+	};
+	allocation.vertex_handle = allocate_vertices();
+	if (allocation.vertex_handle == TlsfAllocator::INVALID_HANDLE)
+	{
+		grow(vertex_buffer, vertex_allocator, 1, vertex_bytes + vertex_stride);
+		allocation.vertex_handle = allocate_vertices();
+	}
+	assert(allocation.vertex_handle != TlsfAllocator::INVALID_HANDLE && "Grown vertex buffer is still too small");
+	allocation.vertex_offset = static_cast<int32_t>((vertex_offset + vertex_stride - 1) / vertex_stride);
+
+	std::unique_ptr<Buffer>& index_buffer = allocation.index_type == VK_INDEX_TYPE_UINT16 ? index16_buffer : index32_buffer;
+	if (index_count > 0)
+	{
+		VkDeviceSize first_index;
+		allocation.index_handle = index_allocator.allocate(index_count, 1, first_index);
+		if (allocation.index_handle == TlsfAllocator::INVALID_HANDLE)
+		{
+			grow(index_buffer, index_allocator, index_buffer->get_instance_size(), index_count);
+			allocation.index_handle = index_allocator.allocate(index_count, 1, first_index);
+		}
+		assert(allocation.index_handle != TlsfAllocator::INVALID_HANDLE && "Grown index buffer is still too small");
+		allocation.first_index = static_cast<uint32_t>(first_index);
+	}
+
+	// The ranges were free, so the GPU cannot be reading them while they are written. Still under the
+	// lock, so a growing pool cannot swap the buffers in between.
+	auto& upload_batcher = device.get_upload_batcher();
+	upload_batcher.upload_buffer(
+		*vertex_buffer,
+		vertices,
+		vertex_bytes,
+		static_cast<VkDeviceSize>(allocation.vertex_offset) * vertex_stride
+	);
+	if (index_count > 0 && allocation.index_type == VK_INDEX_TYPE_UINT16)
+	{
+		std::vector<uint16_t> narrow_indices(indices, indices + index_count);
+		upload_batcher.upload_buffer(
+			*index_buffer,
+			narrow_indices.data(),
+			index_count * sizeof(uint16_t),
+			allocation.first_index * sizeof(uint16_t)
+		);
+	}
+	else if (index_count > 0)
+	{
+		upload_batcher.upload_buffer(
+			*index_buffer,
+			indices,
+			index_count * sizeof(uint32_t),
+			allocation.first_index * sizeof(uint32_t)
+		);
+	}
+
+	return allocation;
+}
+
+void game_engine::GeometryPool::allocate_meshlets(GeometryAllocation& allocation, std::span<const GpuMeshlet> meshlets)
+{
+	assert(allocation.is_valid() && allocation.meshlet_count == 0 && "Meshlets belong to a mesh without any yet");
+	if (meshlets.empty())
+	{
+		return;
+	}
+
+	std::lock_guard lock(mutex);
+
+	VkDeviceSize first_meshlet;
+	allocation.meshlet_handle = meshlet_allocator.allocate(meshlets.size(), 1, first_meshlet);
+	if (allocation.meshlet_handle == TlsfAllocator::INVALID_HANDLE)
+	{
+		grow(meshlet_buffer, meshlet_allocator, sizeof(GpuMeshlet), meshlets.size());
+		allocation.meshlet_handle = meshlet_allocator.allocate(meshlets.size(), 1, first_meshlet);
+	}
+	assert(allocation.meshlet_handle != TlsfAllocator::INVALID_HANDLE && "Grown meshlet buffer is still too small");
+	allocation.first_meshlet = static_cast<uint32_t>(first_meshlet);
+	allocation.meshlet_count = static_cast<uint32_t>(meshlets.size());
+
+	device.get_upload_batcher().upload_buffer(
+		*meshlet_buffer,
+		meshlets.data(),
+		meshlets.size_bytes(),
+		allocation.first_meshlet * sizeof(GpuMeshlet)
+	);
+}
+
+void game_engine::GeometryPool::free(GeometryAllocation& allocation)
+{
+	if (!allocation.is_valid())
+	{
+		return;
+	}
+
+	std::lock_guard lock(mutex);
+
+	vertex_allocator.free(allocation.vertex_handle);
+	if (allocation.index_handle != TlsfAllocator::INVALID_HANDLE)
+	{
+		TlsfAllocator& index_allocator = allocation.index_type == VK_INDEX_TYPE_UINT16 ? index16_allocator : index32_allocator;
+		index_allocator.free(allocation.index_handle);
+	}
+	if (allocation.meshlet_handle != TlsfAllocator::INVALID_HANDLE)
+	{
+		meshlet_allocator.free(allocation.meshlet_handle);
+	}
+	allocation = GeometryAllocation{};
+}
+
+void game_engine::GeometryPool::grow(
+	std::unique_ptr<Buffer>& buffer,
+	TlsfAllocator& allocator,
+	VkDeviceSize unit_size,
+	VkDeviceSize required
+)
+{
+	VkDeviceSize capacity = std::max(allocator.get_size() * 2, allocator.get_size() + required);
+
+	auto grown = std::make_unique<Buffer>(
+		device,
+		buffer->get_instance_size(),
+		static_cast<uint32_t>(capacity * unit_size / buffer->get_instance_size()),
+		buffer->get_usage_flags(),
+		buffer->get_memory_property_flags()
+	);
+
+	// Uploads still in flight write the old buffer and recorded frames read it, afterwards nothing
+	// refers to it and the sets can be rewritten
+	device.get_upload_batcher().wait_idle();
+	vkDeviceWaitIdle(device.get_logical_device());
+
+	VkCommandBuffer command_buffer = device.begin_single_time_commands();
+
+	VkBufferCopy copy_region{};
+	copy_region.size = buffer->get_buffer_size();
+	vkCmdCopyBuffer(command_buffer, buffer->get_buffer(), grown->get_buffer(), 1, &copy_region);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		1, &barrier,
+		0, nullptr,
+		0, nullptr
+	);
+
+	device.end_single_time_commands(command_buffer);
+
+	allocator.grow(capacity);
+	buffer = std::move(grown);
+
+	if (&buffer == &vertex_buffer)
+	{
+		auto buffer_info = vertex_buffer->descriptor_info();
+		DescriptorWriter(*descriptor_set_layout, *descriptor_allocator)
+			.write_buffer(0, &buffer_info)
+			.overwrite(descriptor_set);
+	}
+	generation++;
+}
+
+VkBuffer game_engine::GeometryPool::get_index_buffer(VkIndexType index_type) const
+{
+	return index_type == VK_INDEX_TYPE_UINT16 ? index16_buffer->get_buffer() : index32_buffer->get_buffer();
+}
+
+VkDescriptorBufferInfo game_engine::GeometryPool::get_index_buffer_info(VkIndexType index_type) const
+{
+	return index_type == VK_INDEX_TYPE_UINT16 ? index16_buffer->descriptor_info() : index32_buffer->descriptor_info();
+}
+
+void game_engine::GeometryPool::bind(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t set) const
+{
+	bind_index_buffer(command_buffer, VK_INDEX_TYPE_UINT16);
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		pipeline_layout,
+		set,
+		1,
+		&descriptor_set,
+		0,
+		nullptr
+	);
+}
+
+void game_engine::GeometryPool::bind_index_buffer(VkCommandBuffer command_buffer, VkIndexType index_type) const
+{
+	vkCmdBindIndexBuffer(command_buffer, get_index_buffer(index_type), 0, index_type);
+}
+
+game_engine::GeometryPoolStatistics game_engine::GeometryPool::get_statistics() const
+{
+	std::lock_guard lock(mutex);
+
+	GeometryPoolStatistics statistics{};
+	statistics.vertex_capacity = vertex_allocator.get_size();
+	statistics.vertex_bytes_used = vertex_allocator.get_used_size();
+	statistics.index16_capacity = index16_allocator.get_size();
+	statistics.index16_used = index16_allocator.get_used_size();
+	statistics.index32_capacity = index32_allocator.get_size();
+	statistics.index32_used = index32_allocator.get_used_size();
+	statistics.meshlet_capacity = meshlet_allocator.get_size();
+	statistics.meshlets_used = meshlet_allocator.get_used_size();
+	statistics.allocation_count = vertex_allocator.get_allocation_count();
+	return statistics;
+}
+
+void game_engine::GeometryPool::print_statistics(std::ostream& out) const
+{
+	GeometryPoolStatistics statistics = get_statistics();
+	out << "Geometry pool: " << statistics.allocation_count << " meshes, " << statistics.vertex_bytes_used << " / "
+		<< statistics.vertex_capacity << " vertex bytes, " << statistics.index16_used << " / " << statistics.index16_capacity
+		<< " 16-bit indices, " << statistics.index32_used << " / " << statistics.index32_capacity << " 32-bit indices, "
+		<< statistics.meshlets_used << " / " << statistics.meshlet_capacity << " meshlets" << std::endl;
+}
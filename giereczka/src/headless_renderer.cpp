@@ -0,0 +1,612 @@
+#include "headless_renderer.h"
+#include "upload_batcher.h"
+#include "pipelines/pipeline_state_cache.h"
+
+game_engine::HeadlessRenderer::HeadlessRenderer(Device& device, VkExtent2D extent) : device(device), extent(extent)
+{
+	depth_format = find_depth_format();
+
+	create_render_pass();
+	create_frame_targets();
+	create_command_buffers();
+	create_frame_descriptor_allocators();
+	create_query_pool();
+}
+
+game_engine::HeadlessRenderer::~HeadlessRenderer()
+{
+	VkDevice logical_device = device.get_logical_device();
+	vkDeviceWaitIdle(logical_device);
+
+	for (auto& target : frame_targets)
+	{
+		vkDestroyFramebuffer(logical_device, target.framebuffer, nullptr);
+		vkDestroyImageView(logical_device, target.color_image_view, nullptr);
+		vkDestroyImage(logical_device, target.color_image, nullptr);
+		device.get_memory_allocator().free(target.color_image_memory);
+		vkDestroyImageView(logical_device, target.depth_image_view, nullptr);
+		vkDestroyImage(logical_device, target.depth_image, nullptr);
+		device.get_memory_allocator().free(target.depth_image_memory);
+
+		vkDestroyBuffer(logical_device, target.readback_buffer, nullptr);
+		device.get_memory_allocator().free(target.readback_buffer_memory);
+
+		vkDestroyFence(logical_device, target.in_flight_fence, nullptr);
+	}
+
+	if (query_pool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(logical_device, query_pool, nullptr);
+	}
+
+	vkFreeCommandBuffers(
+		logical_device,
+		device.get_command_pool(),
+		static_cast<uint32_t>(command_buffers.size()),
+		command_buffers.data()
+	);
+
+	device.get_pipeline_state_cache().unregister_render_pass(render_pass);
+	vkDestroyRenderPass(logical_device, render_pass, nullptr);
+	device.get_pipeline_state_cache().unregister_render_pass(load_render_pass);
+	vkDestroyRenderPass(logical_device, load_render_pass, nullptr);
+}
+
+float game_engine::HeadlessRenderer::get_aspect_ratio() const
+{
+	return static_cast<float>(extent.width) / static_cast<float>(extent.height);
+}
+
+bool game_engine::HeadlessRenderer::is_frame_in_progress() const
+{
+	return is_frame_started;
+}
+
+VkCommandBuffer game_engine::HeadlessRenderer::get_current_command_buffer() const
+{
+	assert(is_frame_started && "Cannot get command buffer when frame is not in progress");
+	return command_buffers[current_frame_index];
+}
+
+VkFramebuffer game_engine::HeadlessRenderer::get_current_framebuffer() const
+{
+	assert(is_frame_started && "Cannot get framebuffer when frame is not in progress");
+	return frame_targets[current_frame_index].framebuffer;
+}
+
+int game_engine::HeadlessRenderer::get_frame_index() const
+{
+	assert(is_frame_in_progress() && "Cannot get frame index when frame is not in progress");
+	return current_frame_index;
+}
+
+VkCommandBuffer game_engine::HeadlessRenderer::begin_frame()
+{
+	assert(!is_frame_in_progress() && "Cannot start new frame while another is still in progress");
+
+	auto& target = frame_targets[current_frame_index];
+
+	auto wait_start = std::chrono::high_resolution_clock::now();
+	vkWaitForFences(device.get_logical_device(), 1, &target.in_flight_fence, VK_TRUE, UINT64_MAX);
+	last_fence_wait_ms = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - wait_start).count();
+
+	collect_frame(target);
+	vkResetFences(device.get_logical_device(), 1, &target.in_flight_fence);
+	frame_descriptor_allocators[current_frame_index]->reset();
+
+	is_frame_started = true;
+
+	auto command_buffer = get_current_command_buffer();
+
+	VkCommandBufferBeginInfo begin_info{};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to begin recording command buffer");
+	}
+
+	if (timestamps_supported)
+	{
+		uint32_t first_query = current_frame_index * 2;
+		vkCmdResetQueryPool(command_buffer, query_pool, first_query, 2);
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, first_query);
+	}
+
+	return command_buffer;
+}
+
+void game_engine::HeadlessRenderer::end_frame()
+{
+	assert(is_frame_in_progress() && "Cannot end frame when none is in progress");
+
+	auto command_buffer = get_current_command_buffer();
+	auto& target = frame_targets[current_frame_index];
+
+	if (target.capture)
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+
+		// The render pass leaves the color target in TRANSFER_SRC_OPTIMAL
+		vkCmdCopyImageToBuffer(
+			command_buffer,
+			target.color_image,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			target.readback_buffer,
+			1,
+			&region
+		);
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = target.readback_buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_HOST_BIT,
+			0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr
+		);
+	}
+
+	if (timestamps_supported)
+	{
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, current_frame_index * 2 + 1);
+	}
+
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to record command buffer");
+	}
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+
+	// Uploads recorded since the last frame must reach the queue ahead of the draws using them
+	device.get_upload_batcher().flush();
+
+	if (vkQueueSubmit(device.get_graphics_queue(), 1, &submit_info, target.in_flight_fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit command buffers");
+	}
+
+	target.pending = true;
+	target.submitted_frame = frame_number;
+
+	is_frame_started = false;
+	frame_number++;
+	current_frame_index = (current_frame_index + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+void game_engine::HeadlessRenderer::begin_render_pass(VkCommandBuffer command_buffer, VkSubpassContents contents)
+{
+	begin_render_pass(command_buffer, render_pass, contents);
+}
+
+void game_engine::HeadlessRenderer::continue_render_pass(VkCommandBuffer command_buffer, VkSubpassContents contents)
+{
+	begin_render_pass(command_buffer, load_render_pass, contents);
+}
+
+VkImage game_engine::HeadlessRenderer::get_current_depth_image() const
+{
+	assert(is_frame_started && "Cannot get depth image when frame is not in progress");
+	return frame_targets[current_frame_index].depth_image;
+}
+
+VkImageView game_engine::HeadlessRenderer::get_current_depth_image_view() const
+{
+	assert(is_frame_started && "Cannot get depth image view when frame is not in progress");
+	return frame_targets[current_frame_index].depth_image_view;
+}
+
+void game_engine::HeadlessRenderer::begin_render_pass(VkCommandBuffer command_buffer, VkRenderPass pass, VkSubpassContents contents)
+{
+	assert(is_frame_in_progress() && "Cannot begin render pass when frame is not in progress");
+	assert(command_buffer == get_current_command_buffer() && "Can only begin render pass for command buffer of current frame");
+
+	VkRenderPassBeginInfo render_pass_info{};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_info.renderPass = pass;
+	render_pass_info.framebuffer = frame_targets[current_frame_index].framebuffer;
+
+	render_pass_info.renderArea.offset = { 0, 0 };
+	render_pass_info.renderArea.extent = extent;
+
+	std::array<VkClearValue, 2> clear_values{};
+	clear_values[0].color = { 0.005f, 0.005f, 0.005f, 1.0f };
+	clear_values[1].depthStencil = { 1.0f, 0 };
+	render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+	render_pass_info.pClearValues = clear_values.data();
+
+	vkCmdBeginRenderPass(
+		command_buffer,
+		&render_pass_info,
+		contents
+	);
+
+	if (contents != VK_SUBPASS_CONTENTS_INLINE)
+	{
+		return;
+	}
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor{ {0, 0}, extent };
+	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+}
+
+void game_engine::HeadlessRenderer::end_render_pass(VkCommandBuffer command_buffer)
+{
+	assert(is_frame_in_progress() && "Cannot end render pass when frame is not in progress");
+	assert(command_buffer == get_current_command_buffer() && "Can only end render pass for command buffer of current frame");
+
+	vkCmdEndRenderPass(command_buffer);
+}
+
+void game_engine::HeadlessRenderer::request_capture()
+{
+	assert(is_frame_in_progress() && "Can only capture a frame that is being recorded");
+	frame_targets[current_frame_index].capture = true;
+}
+
+void game_engine::HeadlessRenderer::wait_idle()
+{
+	assert(!is_frame_in_progress() && "Cannot wait for idle while a frame is being recorded");
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		// Collect in submission order so captures come out sorted by frame number
+		auto& target = frame_targets[(current_frame_index + i) % MAX_FRAMES_IN_FLIGHT];
+		vkWaitForFences(device.get_logical_device(), 1, &target.in_flight_fence, VK_TRUE, UINT64_MAX);
+		collect_frame(target);
+	}
+}
+
+void game_engine::HeadlessRenderer::collect_frame(FrameTarget& target)
+{
+	if (!target.pending)
+	{
+		return;
+	}
+
+	if (gpu_frame_times.size() <= target.submitted_frame)
+	{
+		gpu_frame_times.resize(target.submitted_frame + 1, -1.0);
+	}
+
+	if (timestamps_supported)
+	{
+		uint32_t slot = static_cast<uint32_t>(&target - frame_targets.data());
+		std::array<uint64_t, 2> timestamps{};
+		if (vkGetQueryPoolResults(
+			device.get_logical_device(),
+			query_pool,
+			slot * 2,
+			2,
+			sizeof(timestamps),
+			timestamps.data(),
+			sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT
+		) == VK_SUCCESS)
+		{
+			uint64_t ticks = ((timestamps[1] & timestamp_mask) - (timestamps[0] & timestamp_mask)) & timestamp_mask;
+			gpu_frame_times[target.submitted_frame] = ticks * device.properties.limits.timestampPeriod / 1e6;
+		}
+	}
+
+	if (target.capture)
+	{
+		CapturedFrame captured{};
+		captured.frame_number = target.submitted_frame;
+		captured.width = extent.width;
+		captured.height = extent.height;
+
+		auto* pixels = static_cast<const uint8_t*>(target.readback_mapped);
+		captured.rgba.assign(pixels, pixels + static_cast<size_t>(extent.width) * extent.height * 4);
+		captured_frames.push_back(std::move(captured));
+
+		target.capture = false;
+	}
+
+	target.pending = false;
+}
+
+VkFormat game_engine::HeadlessRenderer::find_depth_format()
+{
+	return device.find_supported_format(
+		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+	);
+}
+
+void game_engine::HeadlessRenderer::create_render_pass()
+{
+	VkAttachmentDescription depth_attachment{};
+	depth_attachment.format = depth_format;
+	depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depth_attachment_ref{};
+	depth_attachment_ref.attachment = 1;
+	depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	// Same formats and sample counts as the swapchain pass would use, so every pipeline built
+	// against this render pass is identical to the windowed one
+	VkAttachmentDescription color_attachment{};
+	color_attachment.format = COLOR_FORMAT;
+	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	color_attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	VkAttachmentReference color_attachment_ref{};
+	color_attachment_ref.attachment = 0;
+	color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &color_attachment_ref;
+	subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+	std::array<VkSubpassDependency, 2> dependencies{};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	std::array<VkAttachmentDescription, 2> attachments = { color_attachment, depth_attachment };
+
+	VkRenderPassCreateInfo render_pass_info{};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+	render_pass_info.pAttachments = attachments.data();
+	render_pass_info.subpassCount = 1;
+	render_pass_info.pSubpasses = &subpass;
+	render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	render_pass_info.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(
+		device.get_logical_device(),
+		&render_pass_info,
+		nullptr,
+		&render_pass
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create render pass");
+	}
+
+	device.get_pipeline_state_cache().register_render_pass(render_pass, render_pass_info);
+
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	if (vkCreateRenderPass(
+		device.get_logical_device(),
+		&render_pass_info,
+		nullptr,
+		&load_render_pass
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create load render pass");
+	}
+
+	device.get_pipeline_state_cache().register_render_pass(load_render_pass, render_pass_info);
+}
+
+void game_engine::HeadlessRenderer::create_frame_targets()
+{
+	VkFenceCreateInfo fence_info{};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (auto& target : frame_targets)
+	{
+		VkImageCreateInfo image_info{};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.extent.width = extent.width;
+		image_info.extent.height = extent.height;
+		image_info.extent.depth = 1;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.flags = 0;
+
+		image_info.format = COLOR_FORMAT;
+		image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		device.create_image_with_info(
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			target.color_image,
+			target.color_image_memory
+		);
+
+		image_info.format = depth_format;
+		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		device.create_image_with_info(
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			target.depth_image,
+			target.depth_image_memory
+		);
+
+		VkImageViewCreateInfo view_info{};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.subresourceRange.baseMipLevel = 0;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = 1;
+
+		view_info.image = target.color_image;
+		view_info.format = COLOR_FORMAT;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		if (vkCreateImageView(device.get_logical_device(), &view_info, nullptr, &target.color_image_view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create color image view");
+		}
+
+		view_info.image = target.depth_image;
+		view_info.format = depth_format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (vkCreateImageView(device.get_logical_device(), &view_info, nullptr, &target.depth_image_view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth image view");
+		}
+
+		std::array<VkImageView, 2> attachments = { target.color_image_view, target.depth_image_view };
+
+		VkFramebufferCreateInfo framebuffer_info{};
+		framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebuffer_info.renderPass = render_pass;
+		framebuffer_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebuffer_info.pAttachments = attachments.data();
+		framebuffer_info.width = extent.width;
+		framebuffer_info.height = extent.height;
+		framebuffer_info.layers = 1;
+
+		if (vkCreateFramebuffer(device.get_logical_device(), &framebuffer_info, nullptr, &target.framebuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create framebuffer");
+		}
+
+		device.create_buffer(
+			static_cast<VkDeviceSize>(extent.width) * extent.height * 4,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			target.readback_buffer,
+			target.readback_buffer_memory
+		);
+		target.readback_mapped = target.readback_buffer_memory.mapped;
+
+		if (vkCreateFence(device.get_logical_device(), &fence_info, nullptr, &target.in_flight_fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create synchronization objects for a frame");
+		}
+	}
+}
+
+void game_engine::HeadlessRenderer::create_frame_descriptor_allocators()
+{
+	// Transient sets for a single frame, dropped all at once when the frame slot comes around again
+	std::vector<DescriptorAllocator::PoolSizeRatio> pool_ratios{
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f}
+	};
+
+	frame_descriptor_allocators.resize(MAX_FRAMES_IN_FLIGHT);
+	for (auto& allocator : frame_descriptor_allocators)
+	{
+		allocator = std::make_unique<DescriptorAllocator>(device, FRAME_DESCRIPTOR_SETS, pool_ratios);
+	}
+}
+
+void game_engine::HeadlessRenderer::create_command_buffers()
+{
+	command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+	VkCommandBufferAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandPool = device.get_command_pool();
+	allocate_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
+
+	if (vkAllocateCommandBuffers(
+		device.get_logical_device(),
+		&allocate_info,
+		command_buffers.data()
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate command buffers");
+	}
+}
+
+void game_engine::HeadlessRenderer::create_query_pool()
+{
+	uint32_t queue_family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device.get_physical_device(), &queue_family_count, nullptr);
+	std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(device.get_physical_device(), &queue_family_count, queue_families.data());
+
+	uint32_t valid_bits = queue_families[device.find_physical_queue_families().graphics_family].timestampValidBits;
+	if (valid_bits == 0 || device.properties.limits.timestampPeriod <= 0.0f)
+	{
+		std::cout << "GPU timestamps are not supported, GPU frame times will not be reported" << std::endl;
+		return;
+	}
+	timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+	VkQueryPoolCreateInfo query_pool_info{};
+	query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_info.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+	if (vkCreateQueryPool(device.get_logical_device(), &query_pool_info, nullptr, &query_pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timestamp query pool");
+	}
+
+	timestamps_supported = true;
+}
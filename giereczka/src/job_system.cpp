@@ -0,0 +1,338 @@
+#include "job_system.h"
+
+namespace {
+	thread_local const game_engine::JobSystem* current_job_system = nullptr;
+	thread_local uint32_t current_worker_index = 0;
+}
+
+game_engine::JobSystem::JobSystem(uint32_t thread_count) : thread_count(std::max(1u, thread_count))
+{
+	for (uint32_t i = 0; i < this->thread_count; i++)
+	{
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	for (uint32_t i = 1; i < this->thread_count; i++)
+	{
+		workers.emplace_back(&JobSystem::worker_loop, this, i);
+	}
+}
+
+game_engine::JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard lock(sleep_mutex);
+		stopping = true;
+	}
+	work_available.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+uint32_t game_engine::JobSystem::get_worker_index() const
+{
+	return current_job_system == this ? current_worker_index : 0;
+}
+
+game_engine::JobHandle game_engine::JobSystem::schedule(JobFunction function, std::span<const JobHandle> dependencies)
+{
+	auto job = std::make_shared<Job>();
+	job->function = std::move(function);
+
+	for (const auto& dependency : dependencies)
+	{
+		if (dependency == nullptr)
+		{
+			continue;
+		}
+
+		// finish() flips the flag under the same lock, so the dependency either sees this job in its
+		// dependents or is already done
+		std::scoped_lock lock(dependency->mutex, job->mutex);
+		if (dependency->finished.load())
+		{
+			inherit_exception(*job, dependency->exception);
+			continue;
+		}
+		job->pending_dependencies++;
+		dependency->dependents.push_back(job);
+	}
+
+	release(get_worker_index(), job);
+	return job;
+}
+
+game_engine::JobHandle game_engine::JobSystem::schedule_background(JobFunction function)
+{
+	auto job = std::make_shared<Job>();
+	job->function = std::move(function);
+	job->pending_dependencies = 0;
+
+	if (workers.empty())
+	{
+		execute(get_worker_index(), job);
+		return job;
+	}
+
+	queued_background_jobs++;
+	{
+		std::lock_guard lock(background_queue.mutex);
+		background_queue.jobs.push_back(job);
+	}
+
+	{
+		std::lock_guard lock(sleep_mutex);
+	}
+	work_available.notify_one();
+	return job;
+}
+
+game_engine::JobHandle game_engine::JobSystem::schedule_parallel_for(
+	size_t count,
+	size_t grain_size,
+	RangeFunction function,
+	std::span<const JobHandle> dependencies
+)
+{
+	grain_size = std::max<size_t>(1, grain_size);
+
+	// Chunks share one copy of the function instead of each capturing their own
+	auto shared_function = std::make_shared<RangeFunction>(std::move(function));
+
+	std::vector<JobHandle> chunks;
+	chunks.reserve((count + grain_size - 1) / grain_size);
+	for (size_t begin = 0; begin < count; begin += grain_size)
+	{
+		size_t end = std::min(count, begin + grain_size);
+		chunks.push_back(schedule([shared_function, begin, end](uint32_t worker_index)
+		{
+			(*shared_function)(worker_index, begin, end);
+		}, dependencies));
+	}
+
+	return schedule([](uint32_t) {}, chunks);
+}
+
+void game_engine::JobSystem::wait(const JobHandle& job)
+{
+	uint32_t worker_index = get_worker_index();
+	while (!job->is_finished())
+	{
+		if (JobHandle next = find_job(worker_index))
+		{
+			execute(worker_index, next);
+			continue;
+		}
+
+		// Nothing to help with, the job is running on another worker or waiting on one
+		std::unique_lock lock(sleep_mutex);
+		waiting_threads++;
+		job_finished.wait(lock, [&] { return job->is_finished() || queued_jobs.load() > 0; });
+		waiting_threads--;
+	}
+
+	if (job->exception)
+	{
+		std::rethrow_exception(job->exception);
+	}
+}
+
+void game_engine::JobSystem::parallel_for(size_t count, size_t grain_size, const RangeFunction& function)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (thread_count == 1 || count <= grain_size)
+	{
+		function(get_worker_index(), 0, count);
+		return;
+	}
+
+	wait(schedule_parallel_for(count, grain_size, function));
+}
+
+void game_engine::JobSystem::parallel_for(size_t count, const RangeFunction& function)
+{
+	parallel_for(count, default_grain_size(count), function);
+}
+
+size_t game_engine::JobSystem::default_grain_size(size_t count) const
+{
+	size_t chunk_count = static_cast<size_t>(thread_count) * 4;
+	return std::max<size_t>(1, (count + chunk_count - 1) / chunk_count);
+}
+
+void game_engine::JobSystem::worker_loop(uint32_t worker_index)
+{
+	current_job_system = this;
+	current_worker_index = worker_index;
+
+	while (true)
+	{
+		if (JobHandle job = find_job(worker_index))
+		{
+			execute(worker_index, job);
+			continue;
+		}
+
+		if (JobHandle job = find_background_job())
+		{
+			execute(worker_index, job);
+			continue;
+		}
+
+		std::unique_lock lock(sleep_mutex);
+		work_available.wait(lock, [this]
+		{
+			return stopping || queued_jobs.load() > 0 || queued_background_jobs.load() > 0;
+		});
+		// Background jobs are drained too, they may reference objects that wait for them on destruction
+		if (stopping && queued_jobs.load() == 0 && queued_background_jobs.load() == 0)
+		{
+			return;
+		}
+	}
+}
+
+game_engine::JobHandle game_engine::JobSystem::find_job(uint32_t worker_index)
+{
+	if (queued_jobs.load() == 0)
+	{
+		return nullptr;
+	}
+
+	{
+		auto& own = *queues[worker_index];
+		std::lock_guard lock(own.mutex);
+		if (!own.jobs.empty())
+		{
+			JobHandle job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			queued_jobs--;
+			return job;
+		}
+	}
+
+	for (uint32_t offset = 1; offset < thread_count; offset++)
+	{
+		auto& victim = *queues[(worker_index + offset) % thread_count];
+		std::lock_guard lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			JobHandle job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			queued_jobs--;
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+game_engine::JobHandle game_engine::JobSystem::find_background_job()
+{
+	if (queued_background_jobs.load() == 0)
+	{
+		return nullptr;
+	}
+
+	std::lock_guard lock(background_queue.mutex);
+	if (background_queue.jobs.empty())
+	{
+		return nullptr;
+	}
+
+	JobHandle job = std::move(background_queue.jobs.front());
+	background_queue.jobs.pop_front();
+	queued_background_jobs--;
+	return job;
+}
+
+void game_engine::JobSystem::push(uint32_t worker_index, JobHandle job)
+{
+	// Counted before it becomes visible, so find_job() can never take the counter below zero
+	queued_jobs++;
+	{
+		auto& queue = *queues[worker_index];
+		std::lock_guard lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+	}
+
+	// Taking the lock orders the counter update with a worker that is about to sleep
+	{
+		std::lock_guard lock(sleep_mutex);
+	}
+	work_available.notify_one();
+	if (waiting_threads.load() > 0)
+	{
+		job_finished.notify_all();
+	}
+}
+
+void game_engine::JobSystem::release(uint32_t worker_index, JobHandle job)
+{
+	if (job->pending_dependencies.fetch_sub(1) == 1)
+	{
+		push(worker_index, std::move(job));
+	}
+}
+
+void game_engine::JobSystem::execute(uint32_t worker_index, const JobHandle& job)
+{
+	if (!job->exception)
+	{
+		try
+		{
+			job->function(worker_index);
+		}
+		catch (...)
+		{
+			job->exception = std::current_exception();
+		}
+	}
+
+	finish(worker_index, job);
+}
+
+void game_engine::JobSystem::finish(uint32_t worker_index, const JobHandle& job)
+{
+	std::vector<JobHandle> dependents;
+	{
+		std::lock_guard lock(job->mutex);
+		job->finished.store(true);
+		dependents.swap(job->dependents);
+		// Drop captured state now rather than whenever the last handle goes away
+		job->function = nullptr;
+	}
+
+	for (auto& dependent : dependents)
+	{
+		if (job->exception)
+		{
+			std::lock_guard lock(dependent->mutex);
+			inherit_exception(*dependent, job->exception);
+		}
+		release(worker_index, std::move(dependent));
+	}
+
+	if (waiting_threads.load() > 0)
+	{
+		{
+			std::lock_guard lock(sleep_mutex);
+		}
+		job_finished.notify_all();
+	}
+}
+
+void game_engine::JobSystem::inherit_exception(Job& job, const std::exception_ptr& exception)
+{
+	if (exception && !job.exception)
+	{
+		job.exception = exception;
+	}
+}
@@ -0,0 +1,454 @@
+#include "masked_occlusion_culling.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define GAME_ENGINE_RASTER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GAME_ENGINE_RASTER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define GAME_ENGINE_RASTER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+	constexpr uint64_t FULL_MASK = ~0ull;
+}
+
+game_engine::MaskedOcclusionCuller::MaskedOcclusionCuller(uint32_t width, uint32_t height)
+	: width(width), height(height), tiles_x(width / TILE_SIZE), tiles_y(height / TILE_SIZE)
+{
+	assert(width % TILE_SIZE == 0 && height % TILE_SIZE == 0 && "Occlusion buffer size must be a multiple of the tile size");
+	assert(width > 0 && height > 0 && "Occlusion buffer cannot be empty");
+	tiles.resize(static_cast<size_t>(tiles_x) * tiles_y);
+}
+
+void game_engine::MaskedOcclusionCuller::begin_frame(const glm::mat4& view_projection)
+{
+	this->view_projection = view_projection;
+	std::fill(tiles.begin(), tiles.end(), Tile{0, 1.f, 0.f});
+	occluders.clear();
+	occluder_triangle_count = 0;
+}
+
+void game_engine::MaskedOcclusionCuller::add_occluder(const Model& model, const glm::mat4& model_matrix)
+{
+	const auto& indices = model.get_indices();
+	size_t triangle_count = indices.empty() ? model.get_vertices().size() / 3 : indices.size() / 3;
+	if (triangle_count == 0)
+	{
+		return;
+	}
+
+	occluders.push_back(Occluder{&model, view_projection * model_matrix, occluder_triangle_count});
+	occluder_triangle_count += static_cast<uint32_t>(triangle_count);
+}
+
+void game_engine::MaskedOcclusionCuller::render_occluders(JobSystem& job_system)
+{
+	triangles.resize(occluder_triangle_count);
+
+	job_system.parallel_for(occluders.size(), 1, [&](uint32_t, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			setup_triangles(occluders[i]);
+		}
+	});
+
+	uint32_t band_count = (tiles_y + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	job_system.parallel_for(band_count, 1, [&](uint32_t, size_t begin, size_t end)
+	{
+		for (size_t band = begin; band < end; band++)
+		{
+			uint32_t first_tile_row = static_cast<uint32_t>(band) * BAND_HEIGHT;
+			rasterize_band(first_tile_row, std::min(tiles_y, first_tile_row + BAND_HEIGHT));
+		}
+	});
+}
+
+bool game_engine::MaskedOcclusionCuller::is_visible(const BoundingBox& world_box) const
+{
+	float min_x = std::numeric_limits<float>::max();
+	float min_y = std::numeric_limits<float>::max();
+	float max_x = std::numeric_limits<float>::lowest();
+	float max_y = std::numeric_limits<float>::lowest();
+	float nearest_depth = std::numeric_limits<float>::max();
+
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner{
+			(i & 1) != 0 ? world_box.max.x : world_box.min.x,
+			(i & 2) != 0 ? world_box.max.y : world_box.min.y,
+			(i & 4) != 0 ? world_box.max.z : world_box.min.z
+		};
+		glm::vec4 clip = view_projection * glm::vec4(corner, 1.f);
+		if (clip.z < 0.f || clip.w <= 0.f)
+		{
+			return true;
+		}
+
+		float inverse_w = 1.f / clip.w;
+		float x = (clip.x * inverse_w * 0.5f + 0.5f) * static_cast<float>(width);
+		float y = (clip.y * inverse_w * 0.5f + 0.5f) * static_cast<float>(height);
+		min_x = std::min(min_x, x);
+		min_y = std::min(min_y, y);
+		max_x = std::max(max_x, x);
+		max_y = std::max(max_y, y);
+		nearest_depth = std::min(nearest_depth, clip.z * inverse_w);
+	}
+
+	// Every pixel the rectangle touches, occluders only cover the pixels whose centers they contain
+	int x0 = std::max(0, static_cast<int>(std::floor(min_x)));
+	int y0 = std::max(0, static_cast<int>(std::floor(min_y)));
+	int x1 = std::min(static_cast<int>(width) - 1, static_cast<int>(std::ceil(max_x)) - 1);
+	int y1 = std::min(static_cast<int>(height) - 1, static_cast<int>(std::ceil(max_y)) - 1);
+	if (x0 > x1 || y0 > y1)
+	{
+		return true;
+	}
+
+	const int tile_size = static_cast<int>(TILE_SIZE);
+	for (int tile_y = y0 / tile_size; tile_y <= y1 / tile_size; tile_y++)
+	{
+		int first_row = std::max(y0, tile_y * tile_size) - tile_y * tile_size;
+		int last_row = std::min(y1, tile_y * tile_size + tile_size - 1) - tile_y * tile_size;
+
+		for (int tile_x = x0 / tile_size; tile_x <= x1 / tile_size; tile_x++)
+		{
+			int first_column = std::max(x0, tile_x * tile_size) - tile_x * tile_size;
+			int last_column = std::min(x1, tile_x * tile_size + tile_size - 1) - tile_x * tile_size;
+
+			uint64_t row_bits = ((2ull << last_column) - 1) & ~((1ull << first_column) - 1);
+			uint64_t rectangle = 0;
+			for (int row = first_row; row <= last_row; row++)
+			{
+				rectangle |= row_bits << (row * tile_size);
+			}
+
+			// The working layer is tighter, but only bounds the pixels under its mask
+			const Tile& tile = tiles[static_cast<size_t>(tile_y) * tiles_x + tile_x];
+			float occluder_depth = tile.z_max0;
+			if ((tile.mask & rectangle) == rectangle)
+			{
+				occluder_depth = std::min(occluder_depth, tile.z_max1);
+			}
+
+			if (nearest_depth <= occluder_depth)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void game_engine::MaskedOcclusionCuller::setup_triangles(const Occluder& occluder)
+{
+	const auto& vertices = occluder.model->get_vertices();
+	const auto& indices = occluder.model->get_indices();
+	size_t triangle_count = indices.empty() ? vertices.size() / 3 : indices.size() / 3;
+
+	for (size_t i = 0; i < triangle_count; i++)
+	{
+		Triangle& triangle = triangles[occluder.first_triangle + i];
+		// Dropped until proven otherwise
+		triangle.min_tile_x = 1;
+		triangle.max_tile_x = 0;
+		triangle.min_tile_y = 1;
+		triangle.max_tile_y = 0;
+
+		std::array<glm::vec3, 3> screen;
+		bool dropped = false;
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			size_t index = indices.empty() ? i * 3 + corner : indices[i * 3 + corner];
+			glm::vec4 clip = occluder.model_view_projection * glm::vec4(vertices[index].position, 1.f);
+			// Not clipped against the near plane, triangles crossing it are left out
+			if (clip.z < 0.f || clip.w <= 0.f)
+			{
+				dropped = true;
+				break;
+			}
+
+			float inverse_w = 1.f / clip.w;
+			screen[corner] = glm::vec3(
+				(clip.x * inverse_w * 0.5f + 0.5f) * static_cast<float>(width),
+				(clip.y * inverse_w * 0.5f + 0.5f) * static_cast<float>(height),
+				clip.z * inverse_w
+			);
+			if (std::abs(screen[corner].x) > GUARD_BAND || std::abs(screen[corner].y) > GUARD_BAND)
+			{
+				dropped = true;
+				break;
+			}
+		}
+		if (dropped)
+		{
+			continue;
+		}
+
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y)
+			- (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+		if (std::abs(area) < 1e-6f)
+		{
+			continue;
+		}
+		// Both faces are rasterized, back faces of closed meshes are hidden behind their front faces anyway
+		if (area < 0.f)
+		{
+			std::swap(screen[1], screen[2]);
+			area = -area;
+		}
+
+		float min_x = std::min({screen[0].x, screen[1].x, screen[2].x});
+		float min_y = std::min({screen[0].y, screen[1].y, screen[2].y});
+		float max_x = std::max({screen[0].x, screen[1].x, screen[2].x});
+		float max_y = std::max({screen[0].y, screen[1].y, screen[2].y});
+		if (max_x < 0.f || max_y < 0.f || min_x >= static_cast<float>(width) || min_y >= static_cast<float>(height))
+		{
+			continue;
+		}
+
+		for (size_t edge = 0; edge < 3; edge++)
+		{
+			const glm::vec3& from = screen[edge];
+			const glm::vec3& to = screen[(edge + 1) % 3];
+			triangle.edges[edge] = glm::vec3(
+				from.y - to.y,
+				to.x - from.x,
+				(to.y - from.y) * from.x - (to.x - from.x) * from.y
+			);
+		}
+
+		glm::vec3 d1 = screen[1] - screen[0];
+		glm::vec3 d2 = screen[2] - screen[0];
+		float slope_x = (d1.z * d2.y - d2.z * d1.y) / area;
+		float slope_y = (d2.z * d1.x - d1.z * d2.x) / area;
+		triangle.depth_plane = glm::vec3(screen[0].z - slope_x * screen[0].x - slope_y * screen[0].y, slope_x, slope_y);
+		triangle.min_depth = std::min({screen[0].z, screen[1].z, screen[2].z});
+		triangle.max_depth = std::max({screen[0].z, screen[1].z, screen[2].z});
+
+		const int tile_size = static_cast<int>(TILE_SIZE);
+		triangle.min_tile_x = std::max(0, static_cast<int>(min_x)) / tile_size;
+		triangle.min_tile_y = std::max(0, static_cast<int>(min_y)) / tile_size;
+		triangle.max_tile_x = std::min(static_cast<int>(width) - 1, static_cast<int>(max_x)) / tile_size;
+		triangle.max_tile_y = std::min(static_cast<int>(height) - 1, static_cast<int>(max_y)) / tile_size;
+	}
+}
+
+void game_engine::MaskedOcclusionCuller::rasterize_band(uint32_t first_tile_row, uint32_t end_tile_row)
+{
+	const int first_row = static_cast<int>(first_tile_row);
+	const int last_row = static_cast<int>(end_tile_row) - 1;
+	const float tile_span = static_cast<float>(TILE_SIZE - 1);
+
+	// Triangles go in the order they were queued, so the result does not depend on the thread count
+	for (const Triangle& triangle : triangles)
+	{
+		if (triangle.min_tile_x > triangle.max_tile_x || triangle.max_tile_y < first_row || triangle.min_tile_y > last_row)
+		{
+			continue;
+		}
+
+		for (int tile_y = std::max(first_row, triangle.min_tile_y); tile_y <= std::min(last_row, triangle.max_tile_y); tile_y++)
+		{
+			for (int tile_x = triangle.min_tile_x; tile_x <= triangle.max_tile_x; tile_x++)
+			{
+				Tile& tile = tiles[static_cast<size_t>(tile_y) * tiles_x + tile_x];
+
+				// Depth range of the triangle's plane over the tile's pixel centers
+				float x = static_cast<float>(tile_x * TILE_SIZE);
+				float y = static_cast<float>(tile_y * TILE_SIZE);
+				float corner_depth = triangle.depth_plane.x
+					+ triangle.depth_plane.y * (x + 0.5f) + triangle.depth_plane.z * (y + 0.5f);
+				float step_x = triangle.depth_plane.y * tile_span;
+				float step_y = triangle.depth_plane.z * tile_span;
+				float tile_min_depth = std::max(
+					triangle.min_depth, corner_depth + std::min(step_x, 0.f) + std::min(step_y, 0.f));
+				float tile_max_depth = std::min(
+					triangle.max_depth, corner_depth + std::max(step_x, 0.f) + std::max(step_y, 0.f));
+
+				// Behind everything the tile already has
+				if (tile_min_depth > tile.z_max0)
+				{
+					continue;
+				}
+
+				uint64_t coverage = compute_coverage(triangle, x, y);
+				if (coverage != 0)
+				{
+					update_tile(tile, coverage, tile_max_depth);
+				}
+			}
+		}
+	}
+}
+
+void game_engine::MaskedOcclusionCuller::update_tile(Tile& tile, uint64_t coverage, float depth)
+{
+	// Covered pixels keep whichever is nearer, the triangle or what the reference layer bounds
+	depth = std::min(depth, tile.z_max0);
+
+	// A triangle much nearer than the working layer starts a new one, merging would push it back to the
+	// working layer's depth
+	if (tile.z_max1 - depth > tile.z_max0 - tile.z_max1)
+	{
+		tile.mask = 0;
+		tile.z_max1 = 0.f;
+	}
+
+	tile.z_max1 = std::max(tile.z_max1, depth);
+	tile.mask |= coverage;
+
+	// z_max1 never exceeds z_max0, so a full working layer is the tighter reference
+	if (tile.mask == FULL_MASK)
+	{
+		tile.z_max0 = tile.z_max1;
+		tile.mask = 0;
+		tile.z_max1 = 0.f;
+	}
+}
+
+const char* game_engine::MaskedOcclusionCuller::get_simd_name()
+{
+#if defined(GAME_ENGINE_RASTER_AVX2)
+	return "AVX2";
+#elif defined(GAME_ENGINE_RASTER_SSE2)
+	return "SSE2";
+#elif defined(GAME_ENGINE_RASTER_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+// One row of eight pixel centers per step, bit x of each row byte is set when pixel x is inside all three
+// edges
+
+#if defined(GAME_ENGINE_RASTER_AVX2)
+
+uint64_t game_engine::MaskedOcclusionCuller::compute_coverage(const Triangle& triangle, float tile_x, float tile_y)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 x = _mm256_add_ps(
+		_mm256_set1_ps(tile_x + 0.5f),
+		_mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f)
+	);
+
+	const std::array<glm::vec3, 3>& edges = triangle.edges;
+	uint64_t mask = 0;
+	for (uint32_t row = 0; row < TILE_SIZE; row++)
+	{
+		float y = tile_y + static_cast<float>(row) + 0.5f;
+
+		__m256 inside = _mm256_cmp_ps(
+			_mm256_fmadd_ps(_mm256_set1_ps(edges[0].x), x, _mm256_set1_ps(edges[0].y * y + edges[0].z)), zero, _CMP_GE_OQ);
+		inside = _mm256_and_ps(inside, _mm256_cmp_ps(
+			_mm256_fmadd_ps(_mm256_set1_ps(edges[1].x), x, _mm256_set1_ps(edges[1].y * y + edges[1].z)), zero, _CMP_GE_OQ));
+		inside = _mm256_and_ps(inside, _mm256_cmp_ps(
+			_mm256_fmadd_ps(_mm256_set1_ps(edges[2].x), x, _mm256_set1_ps(edges[2].y * y + edges[2].z)), zero, _CMP_GE_OQ));
+
+		mask |= static_cast<uint64_t>(_mm256_movemask_ps(inside)) << (row * TILE_SIZE);
+	}
+	return mask;
+}
+
+#elif defined(GAME_ENGINE_RASTER_SSE2)
+
+namespace {
+	// Four pixels starting at x, returns their coverage in the low four bits
+	uint32_t cover_sse2_half(const std::array<glm::vec3, 3>& edges, __m128 x, float y)
+	{
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const glm::vec3& edge : edges)
+		{
+			__m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge.x), x), _mm_set1_ps(edge.y * y + edge.z));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(value, zero));
+		}
+		return static_cast<uint32_t>(_mm_movemask_ps(inside));
+	}
+}
+
+uint64_t game_engine::MaskedOcclusionCuller::compute_coverage(const Triangle& triangle, float tile_x, float tile_y)
+{
+	const __m128 low_x = _mm_add_ps(_mm_set1_ps(tile_x + 0.5f), _mm_setr_ps(0.f, 1.f, 2.f, 3.f));
+	const __m128 high_x = _mm_add_ps(low_x, _mm_set1_ps(4.f));
+
+	uint64_t mask = 0;
+	for (uint32_t row = 0; row < TILE_SIZE; row++)
+	{
+		float y = tile_y + static_cast<float>(row) + 0.5f;
+		uint32_t bits = cover_sse2_half(triangle.edges, low_x, y) | (cover_sse2_half(triangle.edges, high_x, y) << 4);
+		mask |= static_cast<uint64_t>(bits) << (row * TILE_SIZE);
+	}
+	return mask;
+}
+
+#elif defined(GAME_ENGINE_RASTER_NEON)
+
+namespace {
+	uint32_t cover_neon_half(const std::array<glm::vec3, 3>& edges, float32x4_t x, float y)
+	{
+		const float32x4_t zero = vdupq_n_f32(0.f);
+
+		uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+		for (const glm::vec3& edge : edges)
+		{
+			float32x4_t value = vfmaq_n_f32(vdupq_n_f32(edge.y * y + edge.z), x, edge.x);
+			inside = vandq_u32(inside, vcgeq_f32(value, zero));
+		}
+
+		// No movemask on NEON, weight the lanes and add them up
+		const uint32_t lane_bits[4] = {1, 2, 4, 8};
+		return vaddvq_u32(vandq_u32(inside, vld1q_u32(lane_bits)));
+	}
+}
+
+uint64_t game_engine::MaskedOcclusionCuller::compute_coverage(const Triangle& triangle, float tile_x, float tile_y)
+{
+	const float lane_offsets[4] = {0.5f, 1.5f, 2.5f, 3.5f};
+	const float32x4_t low_x = vaddq_f32(vdupq_n_f32(tile_x), vld1q_f32(lane_offsets));
+	const float32x4_t high_x = vaddq_f32(low_x, vdupq_n_f32(4.f));
+
+	uint64_t mask = 0;
+	for (uint32_t row = 0; row < TILE_SIZE; row++)
+	{
+		float y = tile_y + static_cast<float>(row) + 0.5f;
+		uint32_t bits = cover_neon_half(triangle.edges, low_x, y) | (cover_neon_half(triangle.edges, high_x, y) << 4);
+		mask |= static_cast<uint64_t>(bits) << (row * TILE_SIZE);
+	}
+	return mask;
+}
+
+#else
+
+uint64_t game_engine::MaskedOcclusionCuller::compute_coverage(const Triangle& triangle, float tile_x, float tile_y)
+{
+	uint64_t mask = 0;
+	for (uint32_t row = 0; row < TILE_SIZE; row++)
+	{
+		float y = tile_y + static_cast<float>(row) + 0.5f;
+		for (uint32_t column = 0; column < TILE_SIZE; column++)
+		{
+			float x = tile_x + static_cast<float>(column) + 0.5f;
+			bool inside = true;
+			for (const glm::vec3& edge : triangle.edges)
+			{
+				inside = inside && edge.x * x + edge.y * y + edge.z >= 0.f;
+			}
+			if (inside)
+			{
+				mask |= 1ull << (row * TILE_SIZE + column);
+			}
+		}
+	}
+	return mask;
+}
+
+#endif
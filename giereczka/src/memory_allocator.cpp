@@ -0,0 +1,467 @@
+#include "memory_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace game_engine {
+	class MemoryBlock {
+	public:
+		MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void* mapped, uint32_t memory_type, MemoryResourceKind kind)
+			: memory(memory), mapped(mapped), memory_type(memory_type), kind(kind), allocator(size)
+		{
+		}
+
+		VkDeviceMemory memory;
+		void* mapped;
+		uint32_t memory_type;
+		MemoryResourceKind kind;
+		TlsfAllocator allocator;
+	};
+}
+
+namespace {
+	VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	constexpr size_t KIND_COUNT = static_cast<size_t>(game_engine::MemoryResourceKind::count);
+}
+
+game_engine::MemoryAllocator::MemoryAllocator(
+	VkPhysicalDevice physical_device,
+	VkDevice device,
+	const VkPhysicalDeviceLimits& limits
+) : device(device),
+    non_coherent_atom_size(std::max<VkDeviceSize>(1, limits.nonCoherentAtomSize)),
+    max_memory_allocation_count(limits.maxMemoryAllocationCount)
+{
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+	pools.resize(memory_properties.memoryTypeCount * KIND_COUNT);
+	dedicated_counts.resize(memory_properties.memoryTypeCount);
+	dedicated_bytes.resize(memory_properties.memoryTypeCount);
+}
+
+game_engine::MemoryAllocator::~MemoryAllocator()
+{
+	uint32_t leaked = 0;
+	for (auto& pool : pools)
+	{
+		for (auto& block : pool)
+		{
+			leaked += block->allocator.get_allocation_count();
+			// Freeing a mapped block unmaps it implicitly
+			vkFreeMemory(device, block->memory, nullptr);
+		}
+	}
+
+	for (uint32_t count : dedicated_counts)
+	{
+		leaked += count;
+	}
+
+	if (leaked > 0)
+	{
+		std::cerr << "Memory allocator destroyed with " << leaked << " live allocations" << std::endl;
+	}
+}
+
+game_engine::Allocation game_engine::MemoryAllocator::allocate_buffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+{
+	VkBufferMemoryRequirementsInfo2 requirements_info{};
+	requirements_info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirements_info.buffer = buffer;
+
+	VkMemoryDedicatedRequirements dedicated_requirements{};
+	dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicated_requirements;
+	vkGetBufferMemoryRequirements2(device, &requirements_info, &requirements);
+
+	bool dedicated = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+
+	Allocation allocation = allocate(
+		requirements.memoryRequirements,
+		properties,
+		MemoryResourceKind::linear,
+		dedicated,
+		buffer,
+		VK_NULL_HANDLE
+	);
+
+	if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+	{
+		free(allocation);
+		throw std::runtime_error("failed to bind buffer memory");
+	}
+
+	return allocation;
+}
+
+game_engine::Allocation game_engine::MemoryAllocator::allocate_image(
+	VkImage image,
+	VkImageTiling tiling,
+	VkMemoryPropertyFlags properties
+)
+{
+	VkImageMemoryRequirementsInfo2 requirements_info{};
+	requirements_info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirements_info.image = image;
+
+	VkMemoryDedicatedRequirements dedicated_requirements{};
+	dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicated_requirements;
+	vkGetImageMemoryRequirements2(device, &requirements_info, &requirements);
+
+	bool dedicated = dedicated_requirements.prefersDedicatedAllocation ||
+		dedicated_requirements.requiresDedicatedAllocation ||
+		requirements.memoryRequirements.size >= DEDICATED_IMAGE_SIZE;
+
+	Allocation allocation = allocate(
+		requirements.memoryRequirements,
+		properties,
+		tiling == VK_IMAGE_TILING_OPTIMAL ? MemoryResourceKind::optimal_image : MemoryResourceKind::linear,
+		dedicated,
+		VK_NULL_HANDLE,
+		image
+	);
+
+	if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+	{
+		free(allocation);
+		throw std::runtime_error("failed to bind image memory");
+	}
+
+	return allocation;
+}
+
+void game_engine::MemoryAllocator::free(Allocation& allocation)
+{
+	if (!allocation.is_valid())
+	{
+		return;
+	}
+
+	std::lock_guard lock(mutex);
+
+	if (allocation.is_dedicated())
+	{
+		vkFreeMemory(device, allocation.memory, nullptr);
+		dedicated_counts[allocation.memory_type]--;
+		dedicated_bytes[allocation.memory_type] -= allocation.size;
+		allocation = Allocation{};
+		return;
+	}
+
+	MemoryBlock* block = allocation.block;
+	block->allocator.free(allocation.handle);
+	allocation = Allocation{};
+
+	if (!block->allocator.is_empty())
+	{
+		return;
+	}
+
+	// Keep one empty block per pool around so a load/unload cycle does not hit vkAllocateMemory every time
+	auto& pool = pools[block->memory_type * KIND_COUNT + static_cast<size_t>(block->kind)];
+	size_t empty_blocks = std::count_if(pool.begin(), pool.end(), [](const auto& candidate)
+	{
+		return candidate->allocator.is_empty();
+	});
+	if (empty_blocks <= 1)
+	{
+		return;
+	}
+
+	vkFreeMemory(device, block->memory, nullptr);
+	std::erase_if(pool, [block](const auto& candidate) { return candidate.get() == block; });
+}
+
+VkResult game_engine::MemoryAllocator::flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (!allocation.is_valid() || !is_non_coherent(allocation.memory_type))
+	{
+		return VK_SUCCESS;
+	}
+
+	VkMappedMemoryRange range = mapped_range(allocation, offset, size);
+	return vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+VkResult game_engine::MemoryAllocator::invalidate(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (!allocation.is_valid() || !is_non_coherent(allocation.memory_type))
+	{
+		return VK_SUCCESS;
+	}
+
+	VkMappedMemoryRange range = mapped_range(allocation, offset, size);
+	return vkInvalidateMappedMemoryRanges(device, 1, &range);
+}
+
+uint32_t game_engine::MemoryAllocator::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+	{
+		if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type");
+}
+
+game_engine::MemoryStatistics game_engine::MemoryAllocator::get_statistics() const
+{
+	std::lock_guard lock(mutex);
+
+	MemoryStatistics statistics{};
+	statistics.max_memory_allocation_count = max_memory_allocation_count;
+	statistics.total_device_allocations = total_device_allocations;
+
+	for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++)
+	{
+		MemoryTypeStatistics type_statistics{};
+		type_statistics.memory_type = type;
+		type_statistics.property_flags = memory_properties.memoryTypes[type].propertyFlags;
+		type_statistics.dedicated_count = dedicated_counts[type];
+		type_statistics.dedicated_bytes = dedicated_bytes[type];
+
+		for (size_t kind = 0; kind < KIND_COUNT; kind++)
+		{
+			for (const auto& block : pools[type * KIND_COUNT + kind])
+			{
+				type_statistics.block_count++;
+				type_statistics.block_bytes += block->allocator.get_size();
+				type_statistics.allocation_count += block->allocator.get_allocation_count();
+				type_statistics.allocated_bytes += block->allocator.get_used_size();
+			}
+		}
+
+		if (type_statistics.block_count == 0 && type_statistics.dedicated_count == 0)
+		{
+			continue;
+		}
+
+		statistics.block_count += type_statistics.block_count;
+		statistics.block_bytes += type_statistics.block_bytes;
+		statistics.allocation_count += type_statistics.allocation_count;
+		statistics.allocated_bytes += type_statistics.allocated_bytes;
+		statistics.dedicated_count += type_statistics.dedicated_count;
+		statistics.dedicated_bytes += type_statistics.dedicated_bytes;
+		statistics.memory_types.push_back(type_statistics);
+	}
+
+	statistics.device_memory_count = statistics.block_count + statistics.dedicated_count;
+	return statistics;
+}
+
+void game_engine::MemoryAllocator::print_statistics(std::ostream& out) const
+{
+	constexpr double MIB = 1024.0 * 1024.0;
+	MemoryStatistics statistics = get_statistics();
+
+	out << "Device memory: " << statistics.device_memory_count << " / " << statistics.max_memory_allocation_count
+		<< " VkDeviceMemory objects, " << statistics.total_device_allocations << " vkAllocateMemory calls" << std::endl;
+	for (const auto& type : statistics.memory_types)
+	{
+		out << "  type " << type.memory_type << " (flags 0x" << std::hex << type.property_flags << std::dec << "): "
+			<< type.allocation_count << " allocations using " << type.allocated_bytes / MIB << " of "
+			<< type.block_bytes / MIB << " MiB in " << type.block_count << " blocks, "
+			<< type.dedicated_count << " dedicated (" << type.dedicated_bytes / MIB << " MiB)" << std::endl;
+	}
+}
+
+game_engine::Allocation game_engine::MemoryAllocator::allocate(
+	const VkMemoryRequirements& requirements,
+	VkMemoryPropertyFlags properties,
+	MemoryResourceKind kind,
+	bool dedicated,
+	VkBuffer dedicated_buffer,
+	VkImage dedicated_image
+)
+{
+	uint32_t memory_type = find_memory_type(requirements.memoryTypeBits, properties);
+
+	// Anything over half a block would leave the rest of it mostly unusable
+	if (dedicated || requirements.size > preferred_block_size(memory_type) / 2)
+	{
+		return allocate_dedicated(requirements, memory_type, dedicated_buffer, dedicated_image);
+	}
+
+	VkDeviceSize size = requirements.size;
+	VkDeviceSize alignment = std::max<VkDeviceSize>(1, requirements.alignment);
+	if (is_non_coherent(memory_type))
+	{
+		// Flushes are widened to whole atoms, they must not reach into a neighbouring allocation
+		alignment = std::max(alignment, non_coherent_atom_size);
+		size = align_up(size, non_coherent_atom_size);
+	}
+
+	std::lock_guard lock(mutex);
+
+	auto& pool = pools[memory_type * KIND_COUNT + static_cast<size_t>(kind)];
+	MemoryBlock* block = nullptr;
+	VkDeviceSize offset = 0;
+	uint32_t handle = TlsfAllocator::INVALID_HANDLE;
+	for (auto& candidate : pool)
+	{
+		handle = candidate->allocator.allocate(size, alignment, offset);
+		if (handle != TlsfAllocator::INVALID_HANDLE)
+		{
+			block = candidate.get();
+			break;
+		}
+	}
+
+	if (block == nullptr)
+	{
+		block = create_block(memory_type, kind, size);
+		handle = block->allocator.allocate(size, alignment, offset);
+		assert(handle != TlsfAllocator::INVALID_HANDLE && "A fresh block must fit the allocation it was created for");
+	}
+
+	Allocation allocation{};
+	allocation.memory = block->memory;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+	allocation.memory_type = memory_type;
+	allocation.block = block;
+	allocation.handle = handle;
+	return allocation;
+}
+
+game_engine::Allocation game_engine::MemoryAllocator::allocate_dedicated(
+	const VkMemoryRequirements& requirements,
+	uint32_t memory_type,
+	VkBuffer dedicated_buffer,
+	VkImage dedicated_image
+)
+{
+	VkMemoryDedicatedAllocateInfo dedicated_info{};
+	dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicated_info.buffer = dedicated_buffer;
+	dedicated_info.image = dedicated_image;
+
+	VkMemoryAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.pNext = &dedicated_info;
+	alloc_info.allocationSize = requirements.size;
+	alloc_info.memoryTypeIndex = memory_type;
+
+	Allocation allocation{};
+	if (vkAllocateMemory(device, &alloc_info, nullptr, &allocation.memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate dedicated device memory");
+	}
+
+	allocation.size = requirements.size;
+	allocation.memory_type = memory_type;
+	if (is_host_visible(memory_type) &&
+		vkMapMemory(device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped) != VK_SUCCESS)
+	{
+		vkFreeMemory(device, allocation.memory, nullptr);
+		throw std::runtime_error("failed to map dedicated device memory");
+	}
+
+	std::lock_guard lock(mutex);
+	dedicated_counts[memory_type]++;
+	dedicated_bytes[memory_type] += allocation.size;
+	total_device_allocations++;
+	return allocation;
+}
+
+game_engine::MemoryBlock* game_engine::MemoryAllocator::create_block(
+	uint32_t memory_type,
+	MemoryResourceKind kind,
+	VkDeviceSize minimum_size
+)
+{
+	auto& pool = pools[memory_type * KIND_COUNT + static_cast<size_t>(kind)];
+
+	// The first blocks of a pool start at 1/8 of the preferred size and double, so a handful of
+	// small resources does not claim a whole block
+	VkDeviceSize preferred = preferred_block_size(memory_type);
+	VkDeviceSize block_size = std::max(preferred >> (3 - std::min<size_t>(3, pool.size())), minimum_size);
+
+	VkMemoryAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = block_size;
+	alloc_info.memoryTypeIndex = memory_type;
+
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(device, &alloc_info, nullptr, &memory);
+	if (result != VK_SUCCESS && block_size > minimum_size)
+	{
+		// Heap nearly full, settle for a block that only fits this allocation
+		block_size = minimum_size;
+		alloc_info.allocationSize = block_size;
+		result = vkAllocateMemory(device, &alloc_info, nullptr, &memory);
+	}
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate device memory block");
+	}
+
+	void* mapped = nullptr;
+	if (is_host_visible(memory_type) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+	{
+		vkFreeMemory(device, memory, nullptr);
+		throw std::runtime_error("failed to map device memory block");
+	}
+
+	total_device_allocations++;
+	pool.push_back(std::make_unique<MemoryBlock>(memory, block_size, mapped, memory_type, kind));
+	return pool.back().get();
+}
+
+VkDeviceSize game_engine::MemoryAllocator::preferred_block_size(uint32_t memory_type) const
+{
+	uint32_t heap_index = memory_properties.memoryTypes[memory_type].heapIndex;
+	VkDeviceSize heap_size = memory_properties.memoryHeaps[heap_index].size;
+	// Small heaps (e.g. the 256 MiB BAR window) are shared by many pools, do not let one block take it all
+	return heap_size <= 1024ull * 1024 * 1024 ? heap_size / 8 : MAX_BLOCK_SIZE;
+}
+
+bool game_engine::MemoryAllocator::is_host_visible(uint32_t memory_type) const
+{
+	return memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+bool game_engine::MemoryAllocator::is_non_coherent(uint32_t memory_type) const
+{
+	VkMemoryPropertyFlags flags = memory_properties.memoryTypes[memory_type].propertyFlags;
+	return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+VkMappedMemoryRange game_engine::MemoryAllocator::mapped_range(
+	const Allocation& allocation,
+	VkDeviceSize offset,
+	VkDeviceSize size
+) const
+{
+	VkDeviceSize begin = allocation.offset + offset;
+	VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+
+	VkMappedMemoryRange range{};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = begin / non_coherent_atom_size * non_coherent_atom_size;
+	range.size = align_up(end, non_coherent_atom_size) - range.offset;
+
+	// The memory object's size need not be a multiple of the atom, its end is only reachable as VK_WHOLE_SIZE
+	VkDeviceSize memory_size = allocation.is_dedicated() ? allocation.size : allocation.block->allocator.get_size();
+	if (range.offset + range.size > memory_size)
+	{
+		range.size = VK_WHOLE_SIZE;
+	}
+	return range;
+}
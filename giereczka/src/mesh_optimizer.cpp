@@ -0,0 +1,413 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+	constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+	// Size of the LRU cache Forsyth's scores simulate, larger than the hardware cache on purpose
+	constexpr int FORSYTH_CACHE_SIZE = 32;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float VALENCE_BOOST_SCALE = 2.f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+	float forsyth_vertex_score(int cache_position, uint32_t remaining_triangles)
+	{
+		if (remaining_triangles == 0)
+		{
+			return -1.f;
+		}
+
+		float score = 0.f;
+		if (cache_position >= 0)
+		{
+			// The last triangle's vertices score the same whatever their order, reusing them right away
+			// is no better than a bit later
+			if (cache_position < 3)
+			{
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				float scale = 1.f / (FORSYTH_CACHE_SIZE - 3);
+				score = std::pow(1.f - (cache_position - 3) * scale, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Finishing off vertices with few triangles left avoids leaving lone triangles behind
+		score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangles), -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	// Misses of every triangle under a FIFO cache that starts empty
+	class FifoCache {
+	public:
+		FifoCache(size_t vertex_count, uint32_t cache_size) : timestamps(vertex_count, 0), cache_size(cache_size)
+		{
+		}
+
+		void reset()
+		{
+			// Everything inserted so far is now older than the cache is long
+			time += cache_size;
+		}
+
+		uint32_t access(uint32_t vertex)
+		{
+			if (timestamps[vertex] != 0 && time - timestamps[vertex] < cache_size)
+			{
+				return 0;
+			}
+			timestamps[vertex] = ++time;
+			return 1;
+		}
+
+		uint32_t access_triangle(const uint32_t* corners)
+		{
+			return access(corners[0]) + access(corners[1]) + access(corners[2]);
+		}
+
+	private:
+		std::vector<uint32_t> timestamps;
+		uint32_t cache_size;
+		// Starts at 1 so a timestamp of 0 can mean never inserted
+		uint32_t time = 1;
+	};
+}
+
+game_engine::VertexCacheStatistics game_engine::analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertex_count, uint32_t cache_size)
+{
+	assert(indices.size() % 3 == 0 && "Cache analysis needs a triangle list");
+
+	VertexCacheStatistics statistics{};
+	if (indices.empty())
+	{
+		return statistics;
+	}
+
+	FifoCache cache(vertex_count, cache_size);
+	std::vector<uint8_t> referenced(vertex_count);
+	size_t misses = 0;
+	size_t referenced_count = 0;
+	for (uint32_t vertex : indices)
+	{
+		misses += cache.access(vertex);
+		referenced_count += referenced[vertex] == 0;
+		referenced[vertex] = 1;
+	}
+
+	statistics.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+	statistics.atvr = static_cast<float>(misses) / static_cast<float>(referenced_count);
+	return statistics;
+}
+
+std::vector<uint32_t> game_engine::optimize_vertex_cache(std::span<const uint32_t> indices, size_t vertex_count)
+{
+	assert(indices.size() % 3 == 0 && "Cache optimization needs a triangle list");
+
+	const size_t triangle_count = indices.size() / 3;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	if (triangle_count == 0)
+	{
+		return result;
+	}
+
+	// Triangles around every vertex, the first remaining[vertex] of them not emitted yet
+	std::vector<uint32_t> remaining(vertex_count, 0);
+	for (uint32_t vertex : indices)
+	{
+		remaining[vertex]++;
+	}
+	std::vector<uint32_t> triangle_offsets(vertex_count + 1, 0);
+	for (size_t vertex = 0; vertex < vertex_count; vertex++)
+	{
+		triangle_offsets[vertex + 1] = triangle_offsets[vertex] + remaining[vertex];
+	}
+	std::vector<uint32_t> vertex_triangles(indices.size());
+	{
+		std::vector<uint32_t> fill(triangle_offsets.begin(), triangle_offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			vertex_triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<float> vertex_scores(vertex_count);
+	for (size_t vertex = 0; vertex < vertex_count; vertex++)
+	{
+		vertex_scores[vertex] = forsyth_vertex_score(-1, remaining[vertex]);
+	}
+
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	uint32_t best_triangle = 0;
+	float best_score = -std::numeric_limits<float>::max();
+	for (size_t triangle = 0; triangle < triangle_count; triangle++)
+	{
+		const uint32_t* corners = &indices[triangle * 3];
+		float score = vertex_scores[corners[0]] + vertex_scores[corners[1]] + vertex_scores[corners[2]];
+		if (score > best_score)
+		{
+			best_score = score;
+			best_triangle = static_cast<uint32_t>(triangle);
+		}
+	}
+
+	// Most recently used first, the extra three slots hold what the last triangle pushed out
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> next_cache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	size_t fallback_cursor = 0;
+
+	for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+	{
+		// Nothing in the cache has triangles left, restart from the next triangle in input order
+		if (best_triangle == INVALID_INDEX)
+		{
+			while (emitted[fallback_cursor]) fallback_cursor++;
+			best_triangle = static_cast<uint32_t>(fallback_cursor);
+		}
+
+		const uint32_t* corners = &indices[best_triangle * 3];
+		result.insert(result.end(), corners, corners + 3);
+		emitted[best_triangle] = 1;
+
+		next_cache.clear();
+		for (int corner = 0; corner < 3; corner++)
+		{
+			uint32_t vertex = corners[corner];
+			if (std::find(next_cache.begin(), next_cache.end(), vertex) == next_cache.end())
+			{
+				next_cache.push_back(vertex);
+			}
+
+			// Swap the emitted triangle out of the vertex's remaining ones
+			uint32_t* triangles = &vertex_triangles[triangle_offsets[vertex]];
+			uint32_t* last = triangles + remaining[vertex] - 1;
+			*std::find(triangles, last + 1, best_triangle) = *last;
+			remaining[vertex]--;
+		}
+		for (uint32_t vertex : cache)
+		{
+			if (std::find(next_cache.begin(), next_cache.end(), vertex) == next_cache.end())
+			{
+				next_cache.push_back(vertex);
+			}
+		}
+		std::swap(cache, next_cache);
+
+		// Rescore everything that moved in or out of the cache and the triangles using it
+		for (int position = 0; position < static_cast<int>(cache.size()); position++)
+		{
+			uint32_t vertex = cache[position];
+			vertex_scores[vertex] = forsyth_vertex_score(position < FORSYTH_CACHE_SIZE ? position : -1, remaining[vertex]);
+		}
+
+		best_triangle = INVALID_INDEX;
+		best_score = -std::numeric_limits<float>::max();
+		for (uint32_t vertex : cache)
+		{
+			for (uint32_t i = 0; i < remaining[vertex]; i++)
+			{
+				uint32_t triangle = vertex_triangles[triangle_offsets[vertex] + i];
+				const uint32_t* triangle_corners = &indices[triangle * 3];
+				float score = vertex_scores[triangle_corners[0]] + vertex_scores[triangle_corners[1]] + vertex_scores[triangle_corners[2]];
+				if (score > best_score)
+				{
+					best_score = score;
+					best_triangle = triangle;
+				}
+			}
+		}
+
+		if (cache.size() > FORSYTH_CACHE_SIZE)
+		{
+			cache.resize(FORSYTH_CACHE_SIZE);
+		}
+	}
+
+	return result;
+}
+
+std::vector<uint32_t> game_engine::optimize_overdraw(std::span<const uint32_t> indices, std::span<const glm::vec3> positions, float threshold)
+{
+	assert(indices.size() % 3 == 0 && "Overdraw optimization needs a triangle list");
+
+	const size_t triangle_count = indices.size() / 3;
+	if (triangle_count < 2)
+	{
+		return std::vector<uint32_t>(indices.begin(), indices.end());
+	}
+
+	const float mesh_acmr = analyze_vertex_cache(indices, positions.size()).acmr;
+
+	// Hard boundaries, the cache would miss on every vertex of the triangle anyway
+	std::vector<uint32_t> cluster_starts;
+	{
+		FifoCache cache(positions.size(), DEFAULT_VERTEX_CACHE_SIZE);
+		for (size_t triangle = 0; triangle < triangle_count; triangle++)
+		{
+			if (cache.access_triangle(&indices[triangle * 3]) == 3)
+			{
+				cluster_starts.push_back(static_cast<uint32_t>(triangle));
+			}
+		}
+	}
+	cluster_starts.push_back(static_cast<uint32_t>(triangle_count));
+
+	// Soft boundaries, wherever the cluster so far would keep its ACMR starting from a cold cache
+	std::vector<uint32_t> clusters;
+	{
+		FifoCache cache(positions.size(), DEFAULT_VERTEX_CACHE_SIZE);
+		for (size_t hard = 0; hard + 1 < cluster_starts.size(); hard++)
+		{
+			uint32_t misses = 0;
+			uint32_t cluster_size = 0;
+			cache.reset();
+			clusters.push_back(cluster_starts[hard]);
+			for (uint32_t triangle = cluster_starts[hard]; triangle < cluster_starts[hard + 1]; triangle++)
+			{
+				misses += cache.access_triangle(&indices[triangle * 3]);
+				cluster_size++;
+
+				bool last = triangle + 1 == cluster_starts[hard + 1];
+				if (!last && static_cast<float>(misses) / cluster_size <= threshold * mesh_acmr)
+				{
+					clusters.push_back(triangle + 1);
+					misses = 0;
+					cluster_size = 0;
+					cache.reset();
+				}
+			}
+		}
+	}
+	clusters.push_back(static_cast<uint32_t>(triangle_count));
+
+	// Area weighted centroids and normals
+	glm::vec3 mesh_centroid{0.f};
+	float mesh_area = 0.f;
+	std::vector<glm::vec3> cluster_centroids(clusters.size() - 1, glm::vec3{0.f});
+	std::vector<glm::vec3> cluster_normals(clusters.size() - 1, glm::vec3{0.f});
+	for (size_t cluster = 0; cluster + 1 < clusters.size(); cluster++)
+	{
+		float cluster_area = 0.f;
+		for (uint32_t triangle = clusters[cluster]; triangle < clusters[cluster + 1]; triangle++)
+		{
+			const glm::vec3& a = positions[indices[triangle * 3]];
+			const glm::vec3& b = positions[indices[triangle * 3 + 1]];
+			const glm::vec3& c = positions[indices[triangle * 3 + 2]];
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float area = glm::length(normal);
+
+			cluster_centroids[cluster] += (a + b + c) * (area / 3.f);
+			cluster_normals[cluster] += normal;
+			cluster_area += area;
+		}
+
+		mesh_centroid += cluster_centroids[cluster];
+		mesh_area += cluster_area;
+		cluster_centroids[cluster] /= cluster_area > 0.f ? cluster_area : 1.f;
+	}
+	mesh_centroid /= mesh_area > 0.f ? mesh_area : 1.f;
+
+	std::vector<float> sort_keys(clusters.size() - 1);
+	std::vector<uint32_t> order(clusters.size() - 1);
+	for (size_t cluster = 0; cluster < order.size(); cluster++)
+	{
+		float normal_length = glm::length(cluster_normals[cluster]);
+		glm::vec3 normal = normal_length > 0.f ? cluster_normals[cluster] / normal_length : glm::vec3{0.f};
+		sort_keys[cluster] = glm::dot(cluster_centroids[cluster] - mesh_centroid, normal);
+		order[cluster] = static_cast<uint32_t>(cluster);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (uint32_t cluster : order)
+	{
+		result.insert(result.end(), indices.begin() + clusters[cluster] * 3, indices.begin() + clusters[cluster + 1] * 3);
+	}
+	return result;
+}
+
+std::vector<uint32_t> game_engine::weld_vertices_remap(const void* vertices, size_t vertex_count, size_t vertex_size, size_t& unique_count)
+{
+	assert(vertex_size % sizeof(uint32_t) == 0 && "Welding hashes vertices by words");
+
+	const auto* bytes = static_cast<const uint8_t*>(vertices);
+	auto vertex_bytes = [&](uint32_t vertex) { return bytes + static_cast<size_t>(vertex) * vertex_size; };
+
+	// MurmurHash2 over the vertex's words
+	auto hash = [&](uint32_t vertex) {
+		constexpr uint32_t m = 0x5bd1e995;
+		const uint8_t* data = vertex_bytes(vertex);
+		uint32_t h = 0;
+		for (size_t offset = 0; offset < vertex_size; offset += sizeof(uint32_t))
+		{
+			uint32_t k;
+			std::memcpy(&k, data + offset, sizeof(k));
+			k *= m;
+			k ^= k >> 24;
+			k *= m;
+			h = h * m ^ k;
+		}
+		h ^= h >> 13;
+		h *= m;
+		return h ^ h >> 15;
+	};
+
+	// Power of two at least twice the vertex count keeps probe sequences short
+	size_t table_size = 1;
+	while (table_size < vertex_count * 2) table_size *= 2;
+	std::vector<uint32_t> table(table_size, INVALID_INDEX);
+
+	std::vector<uint32_t> remap(vertex_count);
+	unique_count = 0;
+	for (uint32_t vertex = 0; vertex < vertex_count; vertex++)
+	{
+		size_t slot = hash(vertex) & (table_size - 1);
+		while (table[slot] != INVALID_INDEX && std::memcmp(vertex_bytes(table[slot]), vertex_bytes(vertex), vertex_size) != 0)
+		{
+			slot = (slot + 1) & (table_size - 1);
+		}
+
+		if (table[slot] == INVALID_INDEX)
+		{
+			table[slot] = vertex;
+			remap[vertex] = static_cast<uint32_t>(unique_count++);
+		}
+		else
+		{
+			remap[vertex] = remap[table[slot]];
+		}
+	}
+	return remap;
+}
+
+std::vector<uint32_t> game_engine::optimize_vertex_fetch_remap(std::span<uint32_t> indices, size_t vertex_count)
+{
+	std::vector<uint32_t> remap(vertex_count, INVALID_INDEX);
+	uint32_t next_vertex = 0;
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == INVALID_INDEX)
+		{
+			remap[index] = next_vertex++;
+		}
+		index = remap[index];
+	}
+
+	for (uint32_t& position : remap)
+	{
+		if (position == INVALID_INDEX)
+		{
+			position = next_vertex++;
+		}
+	}
+	return remap;
+}
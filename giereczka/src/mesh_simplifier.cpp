@@ -0,0 +1,250 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+
+namespace {
+	// Sum of squared distances to a set of planes, weighted by the area of the triangles they came from
+	struct Quadric {
+		double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+		double b2 = 0.0, bc = 0.0, bd = 0.0;
+		double c2 = 0.0, cd = 0.0;
+		double d2 = 0.0;
+		double weight = 0.0;
+
+		void add_plane(const glm::dvec3& normal, double distance, double plane_weight)
+		{
+			a2 += normal.x * normal.x * plane_weight;
+			ab += normal.x * normal.y * plane_weight;
+			ac += normal.x * normal.z * plane_weight;
+			ad += normal.x * distance * plane_weight;
+			b2 += normal.y * normal.y * plane_weight;
+			bc += normal.y * normal.z * plane_weight;
+			bd += normal.y * distance * plane_weight;
+			c2 += normal.z * normal.z * plane_weight;
+			cd += normal.z * distance * plane_weight;
+			d2 += distance * distance * plane_weight;
+			weight += plane_weight;
+		}
+
+		Quadric operator+(const Quadric& other) const
+		{
+			Quadric sum = *this;
+			sum.a2 += other.a2; sum.ab += other.ab; sum.ac += other.ac; sum.ad += other.ad;
+			sum.b2 += other.b2; sum.bc += other.bc; sum.bd += other.bd;
+			sum.c2 += other.c2; sum.cd += other.cd;
+			sum.d2 += other.d2;
+			sum.weight += other.weight;
+			return sum;
+		}
+
+		// Mean squared distance of point to the planes
+		double evaluate(const glm::dvec3& point) const
+		{
+			if (weight <= 0.0) return 0.0;
+
+			const double x = point.x, y = point.y, z = point.z;
+			double error = a2 * x * x + b2 * y * y + c2 * z * z + d2
+				+ 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+			return std::max(error, 0.0) / weight;
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	uint64_t edge_key(uint32_t a, uint32_t b)
+	{
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	glm::dvec3 triangle_normal(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c)
+	{
+		return glm::cross(b - a, c - a);
+	}
+}
+
+std::vector<uint32_t> game_engine::simplify_mesh(
+	std::span<const glm::vec3> positions,
+	std::span<const uint32_t> indices,
+	size_t target_index_count,
+	float target_error,
+	float* error
+)
+{
+	assert(indices.size() % 3 == 0 && "Simplification needs a triangle list");
+
+	std::vector<uint32_t> result(indices.begin(), indices.end());
+	const size_t vertex_count = positions.size();
+	const double error_limit = static_cast<double>(target_error) * target_error;
+	double max_error = 0.0;
+
+	std::vector<Quadric> quadrics(vertex_count);
+	std::vector<uint8_t> locked(vertex_count);
+	std::vector<uint8_t> touched(vertex_count);
+	std::vector<uint32_t> remap(vertex_count);
+	std::vector<uint32_t> triangle_offsets(vertex_count + 1);
+	std::vector<uint32_t> vertex_triangles;
+	std::vector<uint64_t> edges;
+	std::vector<Collapse> collapses;
+
+	auto position = [&](uint32_t vertex) { return glm::dvec3(positions[vertex]); };
+
+	// Every pass collapses a batch of independent edges in order of cost, then rebuilds everything
+	while (result.size() > target_index_count)
+	{
+		const size_t triangle_count = result.size() / 3;
+
+		std::fill(quadrics.begin(), quadrics.end(), Quadric{});
+		for (size_t triangle = 0; triangle < triangle_count; triangle++)
+		{
+			const uint32_t* corners = &result[triangle * 3];
+			glm::dvec3 normal = triangle_normal(position(corners[0]), position(corners[1]), position(corners[2]));
+			double length = glm::length(normal);
+			if (length <= 0.0) continue;
+
+			normal /= length;
+			double distance = -glm::dot(normal, position(corners[0]));
+			for (int corner = 0; corner < 3; corner++)
+			{
+				quadrics[corners[corner]].add_plane(normal, distance, length * 0.5);
+			}
+		}
+
+		// Edges used by anything but exactly two triangles are borders, seams or non-manifold
+		edges.clear();
+		for (size_t triangle = 0; triangle < triangle_count; triangle++)
+		{
+			const uint32_t* corners = &result[triangle * 3];
+			for (int corner = 0; corner < 3; corner++)
+			{
+				edges.push_back(edge_key(corners[corner], corners[(corner + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		std::fill(locked.begin(), locked.end(), 0);
+		for (size_t begin = 0; begin < edges.size();)
+		{
+			size_t end = begin + 1;
+			while (end < edges.size() && edges[end] == edges[begin]) end++;
+			if (end - begin != 2)
+			{
+				locked[static_cast<uint32_t>(edges[begin] >> 32)] = 1;
+				locked[static_cast<uint32_t>(edges[begin])] = 1;
+			}
+			begin = end;
+		}
+
+		// Triangles around every vertex, for the flip test
+		std::fill(triangle_offsets.begin(), triangle_offsets.end(), 0);
+		for (uint32_t vertex : result)
+		{
+			triangle_offsets[vertex + 1]++;
+		}
+		for (size_t vertex = 0; vertex < vertex_count; vertex++)
+		{
+			triangle_offsets[vertex + 1] += triangle_offsets[vertex];
+		}
+		vertex_triangles.resize(result.size());
+		{
+			std::vector<uint32_t> fill = triangle_offsets;
+			for (size_t i = 0; i < result.size(); i++)
+			{
+				vertex_triangles[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		// Interior edges show up once in each direction, a < b keeps one of them
+		collapses.clear();
+		for (size_t triangle = 0; triangle < triangle_count; triangle++)
+		{
+			const uint32_t* corners = &result[triangle * 3];
+			for (int corner = 0; corner < 3; corner++)
+			{
+				uint32_t a = corners[corner];
+				uint32_t b = corners[(corner + 1) % 3];
+				if (a >= b) continue;
+
+				Quadric quadric = quadrics[a] + quadrics[b];
+				if (!locked[a]) collapses.push_back({a, b, quadric.evaluate(position(b))});
+				if (!locked[b]) collapses.push_back({b, a, quadric.evaluate(position(a))});
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		for (size_t vertex = 0; vertex < vertex_count; vertex++)
+		{
+			remap[vertex] = static_cast<uint32_t>(vertex);
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+
+		// Every collapse removes about two triangles
+		size_t collapse_budget = (result.size() - target_index_count) / 6 + 1;
+		size_t collapse_count = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.cost > error_limit || collapse_count == collapse_budget) break;
+			if (touched[collapse.from] || touched[collapse.to]) continue;
+
+			// Moving from onto to must not turn any of its remaining triangles over
+			glm::dvec3 target = position(collapse.to);
+			bool flips = false;
+			for (uint32_t i = triangle_offsets[collapse.from]; i < triangle_offsets[collapse.from + 1] && !flips; i++)
+			{
+				const uint32_t* corners = &result[vertex_triangles[i] * 3];
+				if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) continue;
+
+				std::array<glm::dvec3, 3> before{position(corners[0]), position(corners[1]), position(corners[2])};
+				std::array<glm::dvec3, 3> after = before;
+				for (int corner = 0; corner < 3; corner++)
+				{
+					if (corners[corner] == collapse.from) after[corner] = target;
+				}
+				flips = glm::dot(
+					triangle_normal(before[0], before[1], before[2]),
+					triangle_normal(after[0], after[1], after[2])
+				) <= 0.0;
+			}
+			if (flips) continue;
+
+			// Neighbours stay put for the rest of the pass, so the flip tests above see final positions
+			for (uint32_t i = triangle_offsets[collapse.from]; i < triangle_offsets[collapse.from + 1]; i++)
+			{
+				const uint32_t* corners = &result[vertex_triangles[i] * 3];
+				touched[corners[0]] = touched[corners[1]] = touched[corners[2]] = 1;
+			}
+			touched[collapse.to] = 1;
+
+			remap[collapse.from] = collapse.to;
+			max_error = std::max(max_error, collapse.cost);
+			collapse_count++;
+		}
+
+		if (collapse_count == 0)
+		{
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t triangle = 0; triangle < triangle_count; triangle++)
+		{
+			uint32_t a = remap[result[triangle * 3]];
+			uint32_t b = remap[result[triangle * 3 + 1]];
+			uint32_t c = remap[result[triangle * 3 + 2]];
+			if (a == b || b == c || c == a) continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (error != nullptr)
+	{
+		*error = static_cast<float>(std::sqrt(max_error));
+	}
+	return result;
+}
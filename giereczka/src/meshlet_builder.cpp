@@ -0,0 +1,116 @@
+#include "meshlet_builder.h"
+
+#include "bounds.h"
+
+#include <algorithm>
+
+namespace {
+	void compute_meshlet_bounds(
+		game_engine::Meshlet& meshlet,
+		std::span<const uint32_t> indices,
+		std::span<const glm::vec3> positions
+	)
+	{
+		auto triangle_indices = indices.subspan(meshlet.first_index, meshlet.triangle_count * 3);
+
+		game_engine::BoundingBox box{};
+		for (uint32_t index : triangle_indices)
+		{
+			box.expand(positions[index]);
+		}
+		meshlet.bounding_sphere = game_engine::compute_bounding_sphere(
+			box,
+			triangle_indices,
+			[&](uint32_t index) { return positions[index]; }
+		);
+
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.triangle_count);
+		glm::vec3 normal_sum{0.f};
+		for (size_t i = 0; i < triangle_indices.size(); i += 3)
+		{
+			const glm::vec3& a = positions[triangle_indices[i]];
+			glm::vec3 normal = glm::cross(positions[triangle_indices[i + 1]] - a, positions[triangle_indices[i + 2]] - a);
+			float length = glm::length(normal);
+			// Degenerate triangles are never rasterized and say nothing about facing
+			if (length <= 0.f) continue;
+
+			normals.push_back(normal / length);
+			normal_sum += normal / length;
+		}
+
+		float axis_length = glm::length(normal_sum);
+		if (normals.empty() || axis_length <= 0.f)
+		{
+			return;
+		}
+
+		meshlet.cone_axis = normal_sum / axis_length;
+		float min_dot = 1.f;
+		for (const glm::vec3& normal : normals)
+		{
+			min_dot = std::min(min_dot, glm::dot(normal, meshlet.cone_axis));
+		}
+		// Cones wider than about 84 degrees would hardly ever cull, keep them out of the test
+		meshlet.cone_cutoff = min_dot <= 0.1f ? 1.f : std::sqrt(1.f - min_dot * min_dot);
+	}
+}
+
+std::vector<game_engine::Meshlet> game_engine::build_meshlets(
+	std::span<const uint32_t> indices,
+	std::span<const glm::vec3> positions
+)
+{
+	assert(indices.size() % 3 == 0 && "Meshlets need a triangle list");
+
+	std::vector<Meshlet> meshlets;
+	// Meshlet a vertex was last added to, offset by one so zero means none
+	std::vector<uint32_t> vertex_meshlet(positions.size(), 0);
+
+	Meshlet current{};
+	for (uint32_t first = 0; first < indices.size(); first += 3)
+	{
+		uint32_t stamp = static_cast<uint32_t>(meshlets.size()) + 1;
+		uint32_t new_vertices = 0;
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			uint32_t index = indices[first + corner];
+			if (vertex_meshlet[index] == stamp) continue;
+
+			// Repeated corners of degenerate triangles count once
+			bool repeated = false;
+			for (uint32_t previous = 0; previous < corner; previous++)
+			{
+				repeated = repeated || indices[first + previous] == index;
+			}
+			if (!repeated) new_vertices++;
+		}
+
+		if (current.triangle_count == MESHLET_MAX_TRIANGLES || current.vertex_count + new_vertices > MESHLET_MAX_VERTICES)
+		{
+			compute_meshlet_bounds(current, indices, positions);
+			meshlets.push_back(current);
+			current = Meshlet{};
+			current.first_index = first;
+			stamp++;
+		}
+
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			uint32_t index = indices[first + corner];
+			if (vertex_meshlet[index] != stamp)
+			{
+				vertex_meshlet[index] = stamp;
+				current.vertex_count++;
+			}
+		}
+		current.triangle_count++;
+	}
+
+	if (current.triangle_count > 0)
+	{
+		compute_meshlet_bounds(current, indices, positions);
+		meshlets.push_back(current);
+	}
+	return meshlets;
+}
@@ -1,5 +1,14 @@
 #include "model.h"
 
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlet_builder.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <atomic>
+#include <cstring>
+
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
@@ -14,167 +23,211 @@ namespace std {
 	};
 }
 
-std::vector<VkVertexInputBindingDescription> game_engine::Model::Vertex::get_binding_descriptions()
-{
-	std::vector<VkVertexInputBindingDescription> binding_descriptions(1);
-	binding_descriptions[0].binding = 0;
-	binding_descriptions[0].stride = sizeof(Vertex);
-	binding_descriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-	return binding_descriptions;
+namespace {
+	// Models can be created from any thread
+	std::atomic<uint32_t> next_id{0};
 }
 
-std::vector<VkVertexInputAttributeDescription> game_engine::Model::Vertex::get_attribute_descriptions()
+game_engine::Model::Model(Device& device, std::vector<Vertex> vertices, std::vector<uint32_t> indices) : device(device), id(next_id++), file_path(file_path)
 {
-	std::vector<VkVertexInputAttributeDescription> attribute_descriptions(7);
-
-	attribute_descriptions[0].binding = 0;
-	attribute_descriptions[0].location = 0;
-	attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attribute_descriptions[0].offset = offsetof(Vertex, position);
-
-	attribute_descriptions[1].binding = 0;
-	attribute_descriptions[1].location = 1;
-	attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attribute_descriptions[1].offset = offsetof(Vertex, color);
-
-	attribute_descriptions[2].binding = 0;
-	attribute_descriptions[2].location = 2;
-	attribute_descriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attribute_descriptions[2].offset = offsetof(Vertex, normal);
-
-	attribute_descriptions[3].binding = 0;
-	attribute_descriptions[3].location = 3;
-	attribute_descriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-	attribute_descriptions[3].offset = offsetof(Vertex, uv);
-
-	attribute_descriptions[4].binding = 0;
-	attribute_descriptions[4].location = 4;
-	attribute_descriptions[4].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attribute_descriptions[4].offset = offsetof(Vertex, tangent);
-
-	attribute_descriptions[5].binding = 0;
-	attribute_descriptions[5].location = 5;
-	attribute_descriptions[5].format = VK_FORMAT_R32G32B32A32_SINT;
-	attribute_descriptions[5].offset = offsetof(Vertex, joint_ids);
-
-	attribute_descriptions[6].binding = 0;
-	attribute_descriptions[6].location = 6;
-	attribute_descriptions[6].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	attribute_descriptions[6].offset = offsetof(Vertex, joint_weights);
-
-	return attribute_descriptions;
-}
+	assert(vertices.size() >= 3 && "Vertex count must be at least 3");
 
-game_engine::Model::Model(Device& device, std::vector<Vertex> vertices, std::vector<uint32_t> indices) : device(device), file_path(file_path)
-{
-	create_vertex_buffers(vertices);
-	create_index_buffers(indices);
-}
+	this->vertices = std::move(vertices);
+	this->indices = std::move(indices);
 
-game_engine::Model::~Model()
-{
-}
+	for (const Vertex& vertex : this->vertices)
+	{
+		bounding_box.expand(vertex.position);
+	}
+	bounding_sphere = compute_bounding_sphere(bounding_box, this->vertices, [](const Vertex& vertex) { return vertex.position; });
+
+	quantization = PositionQuantization::from_bounds(bounding_box);
+	dequantization_matrix = quantization.dequantization_matrix();
+	bool skinned = std::any_of(this->vertices.begin(), this->vertices.end(), [](const Vertex& vertex) {
+		return vertex.joint_weights != glm::vec4{0.f};
+	});
+	vertex_layout = skinned ? VertexLayout::skinned : VertexLayout::static_mesh;
+
+	// Ranges are relative to the allocation until it exists
+	std::vector<uint32_t> pool_indices = this->indices;
+	lods.push_back(Lod{0, static_cast<uint32_t>(this->indices.size()), 0.f});
+	if (this->indices.size() / 3 >= MIN_LOD_TRIANGLES)
+	{
+		generate_lods(pool_indices);
+	}
 
-std::vector<game_engine::Model::Vertex>& game_engine::Model::get_vertices()
-{
-	return vertices;
-}
+	std::vector<uint8_t> packed_vertices = pack_vertices();
+	geometry = device.get_geometry_pool().allocate(
+		packed_vertices.data(),
+		static_cast<uint32_t>(this->vertices.size()),
+		get_vertex_stride(vertex_layout),
+		pool_indices.data(),
+		static_cast<uint32_t>(pool_indices.size())
+	);
 
-std::vector<uint32_t>& game_engine::Model::get_indices()
-{
-	return indices;
+	for (Lod& lod : lods)
+	{
+		lod.first_index += geometry.first_index;
+	}
+
+	if (this->indices.size() / 3 >= MIN_MESHLET_TRIANGLES && vertex_layout == VertexLayout::static_mesh)
+	{
+		allocate_meshlets();
+	}
 }
 
-void game_engine::Model::bind(VkCommandBuffer command_buffer)
+void game_engine::Model::generate_lods(std::vector<uint32_t>& pool_indices)
 {
-	VkBuffer buffers[] = { vertex_buffer->get_buffer()};
-	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(command_buffer, 0, 1, buffers, offsets);
+	std::vector<glm::vec3> positions = get_positions();
 
-	if (has_index_buffer)
+	const float max_error = MAX_LOD_ERROR * glm::length(bounding_box.max - bounding_box.min);
+
+	// Each level simplifies the one before, which is cheaper and keeps the chain nested
+	std::vector<uint32_t> previous = indices;
+	while (lods.size() < MAX_LOD_COUNT)
 	{
-		vkCmdBindIndexBuffer(command_buffer, index_buffer->get_buffer(), 0, VK_INDEX_TYPE_UINT32);
+		float error = 0.f;
+		std::vector<uint32_t> simplified = simplify_mesh(positions, previous, previous.size() / 6 * 3, max_error, &error);
+
+		// Not worth the index memory once simplification stalls
+		if (simplified.empty() || simplified.size() > previous.size() * 3 / 4)
+		{
+			break;
+		}
+
+		// Simplification keeps the input order, which no longer suits the vertex cache
+		simplified = optimize_vertex_cache(simplified, vertices.size());
+
+		lods.push_back(Lod{
+			static_cast<uint32_t>(pool_indices.size()),
+			static_cast<uint32_t>(simplified.size()),
+			std::max(error, lods.back().error)
+		});
+		pool_indices.insert(pool_indices.end(), simplified.begin(), simplified.end());
+		previous = std::move(simplified);
 	}
 }
 
-void game_engine::Model::draw(VkCommandBuffer command_buffer)
+void game_engine::Model::allocate_meshlets()
 {
-	if (has_index_buffer)
+	std::vector<Meshlet> meshlets = build_meshlets(indices, get_positions());
+
+	// Quantization moves every position by up to half a step on each axis
+	const float rounding_radius = 0.5f * std::sqrt(3.f) / 65535.f;
+
+	std::vector<GpuMeshlet> gpu_meshlets;
+	gpu_meshlets.reserve(meshlets.size());
+	for (const Meshlet& meshlet : meshlets)
 	{
-		vkCmdDrawIndexed(command_buffer, index_count, 1, 0, 0, 0);
+		GpuMeshlet& gpu_meshlet = gpu_meshlets.emplace_back();
+		gpu_meshlet.bounding_sphere = glm::vec4{
+			(glm::vec3{meshlet.bounding_sphere} - quantization.offset) / quantization.scale,
+			meshlet.bounding_sphere.w / quantization.scale + rounding_radius
+		};
+		gpu_meshlet.cone = glm::vec4{meshlet.cone_axis, meshlet.cone_cutoff};
+		gpu_meshlet.first_index = geometry.first_index + meshlet.first_index;
+		gpu_meshlet.triangle_count = meshlet.triangle_count;
 	}
-	else
+
+	device.get_geometry_pool().allocate_meshlets(geometry, gpu_meshlets);
+}
+
+std::vector<glm::vec3> game_engine::Model::get_positions() const
+{
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertices.size());
+	for (const Vertex& vertex : vertices)
 	{
-		vkCmdDraw(command_buffer, vertex_count, 1, 0, 0);
+		positions.push_back(vertex.position);
 	}
+	return positions;
 }
 
-void game_engine::Model::create_vertex_buffers(const std::vector<Vertex>& vertices)
+std::vector<uint8_t> game_engine::Model::pack_vertices() const
 {
-	this->vertices = vertices;
-	vertex_count = static_cast<uint32_t>(vertices.size());
+	const uint32_t stride = get_vertex_stride(vertex_layout);
+	std::vector<uint8_t> packed(vertices.size() * stride);
 
-	assert(vertex_count >= 3 && "Vertex count must be at least 3");
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vertex& vertex = vertices[i];
+
+		PackedSkinnedVertex packed_vertex{};
+		std::array<uint16_t, 3> position = quantization.quantize(vertex.position);
+		std::array<int8_t, 2> normal = encode_octahedral(vertex.normal);
+		std::array<int8_t, 2> tangent = encode_octahedral(vertex.tangent);
+		std::copy(position.begin(), position.end(), packed_vertex.base.position);
+		std::copy(normal.begin(), normal.end(), packed_vertex.base.normal);
+		std::copy(tangent.begin(), tangent.end(), packed_vertex.base.tangent);
+		packed_vertex.base.uv[0] = glm::packHalf1x16(vertex.uv.x);
+		packed_vertex.base.uv[1] = glm::packHalf1x16(vertex.uv.y);
+		packed_vertex.base.color = pack_rgb565(vertex.color);
+
+		if (vertex_layout == VertexLayout::skinned)
+		{
+			float weight_sum = vertex.joint_weights.x + vertex.joint_weights.y + vertex.joint_weights.z + vertex.joint_weights.w;
+			glm::vec4 weights = weight_sum > 0.f ? vertex.joint_weights / weight_sum : glm::vec4{0.f};
+
+			int rounded_sum = 0;
+			int heaviest = 0;
+			for (int joint = 0; joint < 4; joint++)
+			{
+				// Skins with more joints would need a wider joint index than the packed layout has
+				if (vertex.joint_ids[joint] < 0 || vertex.joint_ids[joint] > UINT8_MAX)
+				{
+					throw std::runtime_error("Joint index " + std::to_string(vertex.joint_ids[joint]) + " does not fit the skinned vertex layout");
+				}
+				packed_vertex.joint_ids[joint] = static_cast<uint8_t>(vertex.joint_ids[joint]);
+				packed_vertex.joint_weights[joint] = static_cast<uint8_t>(std::round(weights[joint] * 255.f));
+				rounded_sum += packed_vertex.joint_weights[joint];
+				if (weights[joint] > weights[heaviest]) heaviest = joint;
+			}
+			// Rounding must not make the mesh shrink or grow between joints
+			if (weight_sum > 0.f)
+			{
+				packed_vertex.joint_weights[heaviest] = static_cast<uint8_t>(packed_vertex.joint_weights[heaviest] + 255 - rounded_sum);
+			}
+		}
 
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertex_count;
+		std::memcpy(packed.data() + i * stride, &packed_vertex, stride);
+	}
 
-	uint32_t vertex_size = sizeof(vertices[0]);
+	return packed;
+}
 
-	Buffer staging_buffer{
-		device,
-		vertex_size,
-		vertex_count,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+glm::vec4 game_engine::Model::get_quantized_bounding_sphere() const
+{
+	return glm::vec4{
+		(glm::vec3{bounding_sphere} - quantization.offset) / quantization.scale,
+		bounding_sphere.w / quantization.scale
 	};
+}
 
-	staging_buffer.map();
-	staging_buffer.write_to_buffer((void*)vertices.data());
-
-	vertex_buffer = std::make_unique<Buffer>(
-		device,
-		vertex_size,
-		vertex_count,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
+game_engine::Model::~Model()
+{
+	device.get_geometry_pool().free(geometry);
+}
 
-	device.copy_buffer(staging_buffer.get_buffer(), vertex_buffer->get_buffer(), bufferSize);
+std::vector<game_engine::Model::Vertex>& game_engine::Model::get_vertices()
+{
+	return vertices;
 }
 
-void game_engine::Model::create_index_buffers(const std::vector<uint32_t>& indices)
+std::vector<uint32_t>& game_engine::Model::get_indices()
 {
-	this->indices = indices;
-	index_count = static_cast<uint32_t>(indices.size());
-	has_index_buffer = index_count > 0;
+	return indices;
+}
 
-	if (!has_index_buffer)
+void game_engine::Model::draw(VkCommandBuffer command_buffer, uint32_t lod, uint32_t instance_count, uint32_t first_instance)
+{
+	if (geometry.index_count > 0)
 	{
-		return;
+		const Lod& range = get_lod(lod);
+		vkCmdDrawIndexed(command_buffer, range.index_count, instance_count, range.first_index, geometry.vertex_offset, first_instance);
 	}
-
-	VkDeviceSize bufferSize = sizeof(indices[0]) * index_count;
-
-	uint32_t index_size = sizeof(indices[0]);
-
-	Buffer staging_buffer{
-		device,
-		index_size,
-		index_count,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	};
-
-	staging_buffer.map();
-	staging_buffer.write_to_buffer((void*)indices.data());
-
-	index_buffer = std::make_unique<Buffer>(
-		device,
-		index_size,
-		index_count,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
-
-	device.copy_buffer(staging_buffer.get_buffer(), index_buffer->get_buffer(), bufferSize);
-}
\ No newline at end of file
+	else
+	{
+		// gl_VertexIndex includes firstVertex, so the shaders index the pool the same way either way
+		vkCmdDraw(command_buffer, geometry.vertex_count, instance_count, static_cast<uint32_t>(geometry.vertex_offset), first_instance);
+	}
+}
@@ -0,0 +1,157 @@
+#include "pipeline_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+game_engine::PipelineCache::PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, std::string path)
+	: device(device), properties(properties), path(std::move(path))
+{
+	std::vector<char> data = load();
+	if (!data.empty() && !is_compatible(data))
+	{
+		std::cout << "Pipeline cache " << this->path << " was written by another device or driver, starting cold" << std::endl;
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo cache_info{};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cache_info.initialDataSize = data.size();
+	cache_info.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &cache_info, nullptr, &pipeline_cache) != VK_SUCCESS)
+	{
+		// The driver may still reject data whose header checked out, an empty cache always works
+		cache_info.initialDataSize = 0;
+		cache_info.pInitialData = nullptr;
+		data.clear();
+
+		if (vkCreatePipelineCache(device, &cache_info, nullptr, &pipeline_cache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create pipeline cache");
+		}
+	}
+
+	statistics.warm_start = !data.empty();
+	statistics.loaded_bytes = data.size();
+}
+
+game_engine::PipelineCache::~PipelineCache()
+{
+	try
+	{
+		save();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Failed to save pipeline cache: " << e.what() << std::endl;
+	}
+
+	vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+}
+
+VkResult game_engine::PipelineCache::create_graphics_pipeline(const VkGraphicsPipelineCreateInfo& pipeline_info, VkPipeline* pipeline)
+{
+	auto start = std::chrono::steady_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, pipeline);
+	record_creation(std::chrono::steady_clock::now() - start);
+	return result;
+}
+
+VkResult game_engine::PipelineCache::create_compute_pipeline(const VkComputePipelineCreateInfo& pipeline_info, VkPipeline* pipeline)
+{
+	auto start = std::chrono::steady_clock::now();
+	VkResult result = vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, pipeline);
+	record_creation(std::chrono::steady_clock::now() - start);
+	return result;
+}
+
+void game_engine::PipelineCache::save() const
+{
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, pipeline_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+	{
+		return;
+	}
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(device, pipeline_cache, &size, data.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to read pipeline cache data");
+	}
+	data.resize(size);
+
+	// Write next to the target and rename, so a crash mid-write never leaves a truncated cache behind
+	std::string temporary_path = path + ".tmp";
+	{
+		std::ofstream file{temporary_path, std::ios::binary | std::ios::trunc};
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open file: " + temporary_path);
+		}
+		file.write(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!file)
+		{
+			throw std::runtime_error("Failed to write file: " + temporary_path);
+		}
+	}
+
+	std::filesystem::rename(temporary_path, path);
+}
+
+game_engine::PipelineCacheStatistics game_engine::PipelineCache::get_statistics() const
+{
+	std::lock_guard lock(statistics_mutex);
+	return statistics;
+}
+
+void game_engine::PipelineCache::print_statistics(std::ostream& out) const
+{
+	PipelineCacheStatistics current = get_statistics();
+	out << "Pipelines (" << (current.warm_start ? "warm" : "cold") << " start, " << current.loaded_bytes
+		<< " cache bytes loaded): " << current.pipeline_count << " created in " << current.creation_ms << " ms" << std::endl;
+}
+
+std::vector<char> game_engine::PipelineCache::load() const
+{
+	std::ifstream file{path, std::ios::ate | std::ios::binary};
+	if (!file.is_open())
+	{
+		return {};
+	}
+
+	std::vector<char> data(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(data.data(), static_cast<std::streamsize>(data.size()));
+	if (!file)
+	{
+		return {};
+	}
+
+	return data;
+}
+
+bool game_engine::PipelineCache::is_compatible(const std::vector<char>& data) const
+{
+	VkPipelineCacheHeaderVersionOne header{};
+	if (data.size() < sizeof(header))
+	{
+		return false;
+	}
+
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	return header.headerSize >= sizeof(header) &&
+		header.headerSize <= data.size() &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == properties.vendorID &&
+		header.deviceID == properties.deviceID &&
+		std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void game_engine::PipelineCache::record_creation(std::chrono::steady_clock::duration duration)
+{
+	std::lock_guard lock(statistics_mutex);
+	statistics.pipeline_count++;
+	statistics.creation_ms += std::chrono::duration<double, std::milli>(duration).count();
+}
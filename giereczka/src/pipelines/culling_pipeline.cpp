@@ -0,0 +1,8 @@
+#include "pipelines/culling_pipeline.h"
+
+game_engine::CullingPipeline::CullingPipeline(Device& device, const std::string& compute_shader_file_path,
+                                              const pipeline_config_info& config_info,
+                                              JobSystem* job_system, PipelineCompileMode compile_mode) : Pipeline(device, job_system, compile_mode)
+{
+	create_compute_pipeline(compute_shader_file_path, config_info);
+}
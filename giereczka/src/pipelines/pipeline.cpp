@@ -1,21 +1,158 @@
 #include "pipelines/pipeline.h"
+#include "pipelines/pipeline_state_cache.h"
 
-game_engine::Pipeline::Pipeline(Device& device) : device(device)
+game_engine::DynamicPipelineState game_engine::DynamicPipelineState::from_config(const pipeline_config_info& config_info)
 {
+	DynamicPipelineState state{};
+	state.cull_mode = config_info.rasterization_info.cullMode;
+	state.front_face = config_info.rasterization_info.frontFace;
+	state.topology = config_info.input_assembly_info.topology;
+	state.primitive_restart_enable = config_info.input_assembly_info.primitiveRestartEnable;
+	state.depth_test_enable = config_info.depth_stencil_info.depthTestEnable;
+	state.depth_write_enable = config_info.depth_stencil_info.depthWriteEnable;
+	state.depth_compare_op = config_info.depth_stencil_info.depthCompareOp;
+	state.depth_bias_enable = config_info.rasterization_info.depthBiasEnable;
+	state.polygon_mode = config_info.rasterization_info.polygonMode;
+	return state;
+}
+
+game_engine::Pipeline::Pipeline(Device& device, JobSystem* job_system, PipelineCompileMode compile_mode)
+	: device(device), job_system(job_system), compile_mode(compile_mode)
+{
+	assert((compile_mode == PipelineCompileMode::immediate || job_system != nullptr) &&
+		"Background pipeline compilation needs a job system");
 }
 
 game_engine::Pipeline::~Pipeline()
 {
-	vkDestroyPipeline(device.get_logical_device(), graphics_pipeline, nullptr);
+	JobHandle job;
+	{
+		std::lock_guard lock(compile_mutex);
+		job = compile_job;
+	}
+
+	if (job != nullptr)
+	{
+		try
+		{
+			job_system->wait(job);
+		}
+		catch (const std::exception&)
+		{
+			// Already reported by the compile job
+		}
+	}
+}
+
+bool game_engine::Pipeline::bind(VkCommandBuffer command_buffer)
+{
+	VkPipeline pipeline = graphics_pipeline.load(std::memory_order_acquire);
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		request();
+		return fallback != nullptr && fallback->bind(command_buffer);
+	}
+
+	vkCmdBindPipeline(command_buffer, bind_point, pipeline);
+
+	if (bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS)
+	{
+		device.get_pipeline_state_cache().set_dynamic_state(command_buffer, dynamic_state);
+	}
+	return true;
+}
+
+void game_engine::Pipeline::request()
+{
+	std::lock_guard lock(compile_mutex);
+	if (compile_job != nullptr || !pending_compile)
+	{
+		return;
+	}
+
+	compile_job = job_system->schedule_background([this, compile_function = std::move(pending_compile)](uint32_t)
+	{
+		try
+		{
+			graphics_pipeline.store(compile_function(), std::memory_order_release);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Background pipeline compilation failed: " << e.what() << std::endl;
+			throw;
+		}
+	});
+	pending_compile = nullptr;
+}
+
+void game_engine::Pipeline::wait()
+{
+	request();
+
+	JobHandle job;
+	{
+		std::lock_guard lock(compile_mutex);
+		job = compile_job;
+	}
+
+	if (job != nullptr)
+	{
+		job_system->wait(job);
+	}
+}
+
+void game_engine::Pipeline::create_graphics_pipeline(const std::vector<ShaderStage>& stages,
+                                                     const pipeline_config_info& config_info)
+{
+	assert(config_info.pipeline_layout != nullptr && "Cannot create graphics pipeline: no pipeline layout specified");
+	assert(config_info.render_pass != nullptr && "Cannot create graphics pipeline: no render pass specified");
+
+	bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	dynamic_state = DynamicPipelineState::from_config(config_info);
+
+	// The caller's config is gone by the time a background compile runs
+	auto config = std::make_shared<pipeline_config_info>();
+	copy_pipeline_config_info(config_info, *config);
+
+	PipelineStateCache& cache = device.get_pipeline_state_cache();
+	compile([&cache, stages, config]
+	{
+		return cache.get_graphics_pipeline(stages, *config);
+	});
 }
 
-void game_engine::Pipeline::bind(VkCommandBuffer command_buffer)
+void game_engine::Pipeline::create_compute_pipeline(const std::string& compute_shader_file_path,
+                                                    const pipeline_config_info& config_info)
 {
-	if(graphics_pipeline == nullptr)
+	assert(config_info.pipeline_layout != nullptr && "Cannot create compute pipeline: no pipeline layout specified");
+
+	bind_point = VK_PIPELINE_BIND_POINT_COMPUTE;
+
+	PipelineStateCache& cache = device.get_pipeline_state_cache();
+	VkPipelineLayout pipeline_layout = config_info.pipeline_layout;
+	compile([&cache, compute_shader_file_path, pipeline_layout]
 	{
-		throw std::runtime_error("Graphics pipeline is nullptr");
+		return cache.get_compute_pipeline(compute_shader_file_path, pipeline_layout);
+	});
+}
+
+void game_engine::Pipeline::compile(std::function<VkPipeline()> compile_function)
+{
+	if (compile_mode == PipelineCompileMode::immediate)
+	{
+		graphics_pipeline.store(compile_function(), std::memory_order_release);
+		return;
+	}
+
+	{
+		std::lock_guard lock(compile_mutex);
+		pending_compile = std::move(compile_function);
+	}
+
+	if (compile_mode == PipelineCompileMode::background)
+	{
+		request();
 	}
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
 }
 
 void game_engine::Pipeline::default_pipeline_config_info(pipeline_config_info& config_info)
@@ -87,44 +224,32 @@ void game_engine::Pipeline::default_pipeline_config_info(pipeline_config_info& c
 	config_info.dynamic_state_info.pDynamicStates = config_info.dynamic_state_enables.data();
 	config_info.dynamic_state_info.flags = 0;
 
-	config_info.vertex_attribute_descriptions = Model::Vertex::get_attribute_descriptions();
-	config_info.vertex_binding_descriptions = Model::Vertex::get_binding_descriptions();
-}
-
-std::vector<char> game_engine::Pipeline::read_file(const std::string& file_path)
-{
-	if (file_path == "none")
-	{
-		return std::vector<char>();
-	}
-	std::ifstream file{ file_path, std::ios::ate | std::ios::binary };
-
-	if (!file.is_open())
-	{
-		throw std::runtime_error("Failed to open file: " + file_path);
-	}
-
-	size_t file_size = static_cast<size_t>(file.tellg());
-
-	std::vector<char> buffer(file_size);
-
-	file.seekg(0);
-	file.read(buffer.data(), file_size);
-
-	file.close();
-
-	return buffer;
+	// No vertex input, every pipeline pulls vertices from the geometry pool
+	config_info.vertex_attribute_descriptions.clear();
+	config_info.vertex_binding_descriptions.clear();
 }
 
-void game_engine::Pipeline::create_shader_module(const std::vector<char>& code, VkShaderModule* shader_module)
+void game_engine::Pipeline::copy_pipeline_config_info(const pipeline_config_info& source, pipeline_config_info& destination)
 {
-	VkShaderModuleCreateInfo create_info{};
-	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	create_info.codeSize = code.size();
-	create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-	if (vkCreateShaderModule(device.get_logical_device(), &create_info, nullptr, shader_module) != VK_SUCCESS)
+	destination.vertex_binding_descriptions = source.vertex_binding_descriptions;
+	destination.vertex_attribute_descriptions = source.vertex_attribute_descriptions;
+	destination.viewport_info = source.viewport_info;
+	destination.input_assembly_info = source.input_assembly_info;
+	destination.rasterization_info = source.rasterization_info;
+	destination.multisample_info = source.multisample_info;
+	destination.color_blend_attachment = source.color_blend_attachment;
+	destination.color_blend_info = source.color_blend_info;
+	destination.depth_stencil_info = source.depth_stencil_info;
+	destination.dynamic_state_enables = source.dynamic_state_enables;
+	destination.dynamic_state_info = source.dynamic_state_info;
+	destination.pipeline_layout = source.pipeline_layout;
+	destination.render_pass = source.render_pass;
+	destination.subpass = source.subpass;
+
+	if (source.color_blend_info.pAttachments == &source.color_blend_attachment)
 	{
-		throw std::runtime_error("Failed to create shader module");
+		destination.color_blend_info.pAttachments = &destination.color_blend_attachment;
 	}
+	destination.dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(destination.dynamic_state_enables.size());
+	destination.dynamic_state_info.pDynamicStates = destination.dynamic_state_enables.data();
 }
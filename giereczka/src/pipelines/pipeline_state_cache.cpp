@@ -0,0 +1,450 @@
+#include "pipelines/pipeline_state_cache.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+	// Appends the raw bytes of plain Vulkan values, used only for structures without padding
+	template <typename T>
+	void append(std::string& key, const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void append(std::string& key, const std::string& value)
+	{
+		append(key, value.size());
+		key.append(value);
+	}
+
+	// Topologies that may replace each other through vkCmdSetPrimitiveTopologyEXT
+	VkPrimitiveTopology topology_class(VkPrimitiveTopology topology)
+	{
+		switch (topology)
+		{
+		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+			return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+			return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+		case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+			return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+		default:
+			return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		}
+	}
+
+	void append_attachment_references(std::string& key, uint32_t count, const VkAttachmentReference* references)
+	{
+		append(key, count);
+		for (uint32_t i = 0; references != nullptr && i < count; i++)
+		{
+			// Layouts do not affect compatibility
+			append(key, references[i].attachment);
+		}
+	}
+}
+
+game_engine::PipelineStateCache::PipelineStateCache(Device& device)
+	: device(device), extended_dynamic_state(device.get_extended_dynamic_state())
+{
+}
+
+game_engine::PipelineStateCache::~PipelineStateCache()
+{
+	VkDevice logical_device = device.get_logical_device();
+	for (auto& [key, pipeline] : pipelines)
+	{
+		vkDestroyPipeline(logical_device, pipeline, nullptr);
+	}
+	for (auto& [path, shader_module] : shader_modules)
+	{
+		vkDestroyShaderModule(logical_device, shader_module, nullptr);
+	}
+}
+
+void game_engine::PipelineStateCache::register_render_pass(VkRenderPass render_pass, const VkRenderPassCreateInfo& create_info)
+{
+	std::string key;
+	append(key, create_info.attachmentCount);
+	for (uint32_t i = 0; i < create_info.attachmentCount; i++)
+	{
+		append(key, create_info.pAttachments[i].format);
+		append(key, create_info.pAttachments[i].samples);
+	}
+
+	append(key, create_info.subpassCount);
+	for (uint32_t i = 0; i < create_info.subpassCount; i++)
+	{
+		const VkSubpassDescription& subpass = create_info.pSubpasses[i];
+		append_attachment_references(key, subpass.inputAttachmentCount, subpass.pInputAttachments);
+		append_attachment_references(key, subpass.colorAttachmentCount, subpass.pColorAttachments);
+		append_attachment_references(key, subpass.pResolveAttachments != nullptr ? subpass.colorAttachmentCount : 0,
+		                             subpass.pResolveAttachments);
+		append_attachment_references(key, subpass.pDepthStencilAttachment != nullptr ? 1 : 0,
+		                             subpass.pDepthStencilAttachment);
+	}
+
+	std::lock_guard lock(mutex);
+	render_pass_keys[render_pass] = std::move(key);
+}
+
+void game_engine::PipelineStateCache::unregister_render_pass(VkRenderPass render_pass)
+{
+	// The handle value may be reused by a later, incompatible render pass
+	std::lock_guard lock(mutex);
+	render_pass_keys.erase(render_pass);
+}
+
+VkPipeline game_engine::PipelineStateCache::get_graphics_pipeline(const std::vector<ShaderStage>& stages,
+                                                                  const pipeline_config_info& config_info)
+{
+	std::string key = make_graphics_key(stages, config_info);
+	{
+		std::lock_guard lock(mutex);
+		requests++;
+		if (auto it = pipelines.find(key); it != pipelines.end())
+		{
+			return it->second;
+		}
+	}
+
+	std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
+	shader_stages.reserve(stages.size());
+	for (const auto& stage : stages)
+	{
+		VkPipelineShaderStageCreateInfo shader_stage{};
+		shader_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shader_stage.stage = stage.stage;
+		shader_stage.module = get_shader_module(stage.file_path);
+		shader_stage.pName = "main";
+		shader_stages.push_back(shader_stage);
+	}
+
+	auto& binding_descriptions = config_info.vertex_binding_descriptions;
+	auto& attribute_descriptions = config_info.vertex_attribute_descriptions;
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(binding_descriptions.size());
+	vertex_input_info.pVertexBindingDescriptions = binding_descriptions.data();
+	vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
+	vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
+
+	std::vector<VkDynamicState> dynamic_states = get_dynamic_states(config_info);
+	VkPipelineDynamicStateCreateInfo dynamic_state_info = config_info.dynamic_state_info;
+	dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+	dynamic_state_info.pDynamicStates = dynamic_states.data();
+
+	VkGraphicsPipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.stageCount = static_cast<uint32_t>(shader_stages.size());
+	pipeline_info.pStages = shader_stages.data();
+	pipeline_info.pVertexInputState = &vertex_input_info;
+	pipeline_info.pInputAssemblyState = &config_info.input_assembly_info;
+	pipeline_info.pViewportState = &config_info.viewport_info;
+	pipeline_info.pRasterizationState = &config_info.rasterization_info;
+	pipeline_info.pMultisampleState = &config_info.multisample_info;
+	pipeline_info.pColorBlendState = &config_info.color_blend_info;
+	pipeline_info.pDepthStencilState = &config_info.depth_stencil_info;
+	pipeline_info.pDynamicState = &dynamic_state_info;
+
+	pipeline_info.layout = config_info.pipeline_layout;
+	pipeline_info.renderPass = config_info.render_pass;
+	pipeline_info.subpass = config_info.subpass;
+
+	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+	pipeline_info.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	if (device.get_pipeline_cache().create_graphics_pipeline(pipeline_info, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create graphics pipeline");
+	}
+
+	return insert_pipeline(key, pipeline);
+}
+
+VkPipeline game_engine::PipelineStateCache::get_compute_pipeline(const std::string& compute_shader_file_path,
+                                                                 VkPipelineLayout pipeline_layout)
+{
+	std::string key;
+	append(key, VK_PIPELINE_BIND_POINT_COMPUTE);
+	append(key, compute_shader_file_path);
+	append(key, pipeline_layout);
+	{
+		std::lock_guard lock(mutex);
+		requests++;
+		if (auto it = pipelines.find(key); it != pipelines.end())
+		{
+			return it->second;
+		}
+	}
+
+	VkPipelineShaderStageCreateInfo compute_stage{};
+	compute_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compute_stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compute_stage.module = get_shader_module(compute_shader_file_path);
+	compute_stage.pName = "main";
+
+	VkComputePipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage = compute_stage;
+	pipeline_info.layout = pipeline_layout;
+
+	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+	pipeline_info.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	if (device.get_pipeline_cache().create_compute_pipeline(pipeline_info, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create compute pipeline");
+	}
+
+	return insert_pipeline(key, pipeline);
+}
+
+VkShaderModule game_engine::PipelineStateCache::get_shader_module(const std::string& file_path)
+{
+	{
+		std::lock_guard lock(mutex);
+		if (auto it = shader_modules.find(file_path); it != shader_modules.end())
+		{
+			return it->second;
+		}
+	}
+
+	auto code = read_file(file_path);
+	if (code.empty())
+	{
+		throw std::runtime_error("Shader code is empty: " + file_path);
+	}
+
+	VkShaderModuleCreateInfo create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	create_info.codeSize = code.size();
+	create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shader_module;
+	if (vkCreateShaderModule(device.get_logical_device(), &create_info, nullptr, &shader_module) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shader module");
+	}
+
+	std::lock_guard lock(mutex);
+	auto [it, inserted] = shader_modules.emplace(file_path, shader_module);
+	if (!inserted)
+	{
+		vkDestroyShaderModule(device.get_logical_device(), shader_module, nullptr);
+	}
+	return it->second;
+}
+
+void game_engine::PipelineStateCache::set_dynamic_state(VkCommandBuffer command_buffer, const DynamicPipelineState& state) const
+{
+	const ExtendedDynamicState& functions = extended_dynamic_state;
+	if (functions.basic)
+	{
+		functions.cmd_set_cull_mode(command_buffer, state.cull_mode);
+		functions.cmd_set_front_face(command_buffer, state.front_face);
+		functions.cmd_set_primitive_topology(command_buffer, state.topology);
+		functions.cmd_set_depth_test_enable(command_buffer, state.depth_test_enable);
+		functions.cmd_set_depth_write_enable(command_buffer, state.depth_write_enable);
+		functions.cmd_set_depth_compare_op(command_buffer, state.depth_compare_op);
+	}
+	if (functions.state2)
+	{
+		functions.cmd_set_depth_bias_enable(command_buffer, state.depth_bias_enable);
+		functions.cmd_set_primitive_restart_enable(command_buffer, state.primitive_restart_enable);
+	}
+	if (functions.polygon_mode)
+	{
+		functions.cmd_set_polygon_mode(command_buffer, state.polygon_mode);
+	}
+}
+
+game_engine::PipelineStateStatistics game_engine::PipelineStateCache::get_statistics() const
+{
+	std::lock_guard lock(mutex);
+
+	PipelineStateStatistics statistics{};
+	statistics.requests = requests;
+	statistics.pipelines = static_cast<uint32_t>(pipelines.size());
+	statistics.shader_modules = static_cast<uint32_t>(shader_modules.size());
+	return statistics;
+}
+
+void game_engine::PipelineStateCache::print_statistics(std::ostream& out) const
+{
+	PipelineStateStatistics current = get_statistics();
+	out << "Pipeline states: " << current.requests << " requests resolved to " << current.pipelines
+		<< " pipelines and " << current.shader_modules << " shader modules" << std::endl;
+}
+
+std::vector<char> game_engine::PipelineStateCache::read_file(const std::string& file_path)
+{
+	if (file_path == "none")
+	{
+		return std::vector<char>();
+	}
+	std::ifstream file{ file_path, std::ios::ate | std::ios::binary };
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open file: " + file_path);
+	}
+
+	size_t file_size = static_cast<size_t>(file.tellg());
+
+	std::vector<char> buffer(file_size);
+
+	file.seekg(0);
+	file.read(buffer.data(), file_size);
+
+	file.close();
+
+	return buffer;
+}
+
+std::string game_engine::PipelineStateCache::make_graphics_key(const std::vector<ShaderStage>& stages,
+                                                               const pipeline_config_info& config_info) const
+{
+	const ExtendedDynamicState& dynamic = extended_dynamic_state;
+	std::string key;
+	key.reserve(512);
+
+	append(key, VK_PIPELINE_BIND_POINT_GRAPHICS);
+	append(key, stages.size());
+	for (const auto& stage : stages)
+	{
+		append(key, stage.stage);
+		append(key, stage.file_path);
+	}
+
+	append(key, config_info.vertex_binding_descriptions.size());
+	for (const auto& binding : config_info.vertex_binding_descriptions)
+	{
+		append(key, binding);
+	}
+	append(key, config_info.vertex_attribute_descriptions.size());
+	for (const auto& attribute : config_info.vertex_attribute_descriptions)
+	{
+		append(key, attribute);
+	}
+
+	const auto& input_assembly = config_info.input_assembly_info;
+	append(key, dynamic.basic ? topology_class(input_assembly.topology) : input_assembly.topology);
+	append(key, dynamic.state2 ? VK_FALSE : input_assembly.primitiveRestartEnable);
+
+	append(key, config_info.viewport_info.viewportCount);
+	append(key, config_info.viewport_info.scissorCount);
+
+	const auto& rasterization = config_info.rasterization_info;
+	append(key, rasterization.depthClampEnable);
+	append(key, rasterization.rasterizerDiscardEnable);
+	append(key, dynamic.polygon_mode ? VK_POLYGON_MODE_FILL : rasterization.polygonMode);
+	append(key, dynamic.basic ? VK_CULL_MODE_NONE : rasterization.cullMode);
+	append(key, dynamic.basic ? VK_FRONT_FACE_CLOCKWISE : rasterization.frontFace);
+	append(key, dynamic.state2 ? VK_FALSE : rasterization.depthBiasEnable);
+	append(key, rasterization.depthBiasConstantFactor);
+	append(key, rasterization.depthBiasClamp);
+	append(key, rasterization.depthBiasSlopeFactor);
+	append(key, rasterization.lineWidth);
+
+	const auto& multisample = config_info.multisample_info;
+	append(key, multisample.rasterizationSamples);
+	append(key, multisample.sampleShadingEnable);
+	append(key, multisample.minSampleShading);
+	append(key, multisample.alphaToCoverageEnable);
+	append(key, multisample.alphaToOneEnable);
+
+	const auto& color_blend = config_info.color_blend_info;
+	append(key, color_blend.logicOpEnable);
+	append(key, color_blend.logicOp);
+	append(key, color_blend.attachmentCount);
+	for (uint32_t i = 0; i < color_blend.attachmentCount; i++)
+	{
+		append(key, color_blend.pAttachments[i]);
+	}
+	append(key, color_blend.blendConstants);
+
+	const auto& depth_stencil = config_info.depth_stencil_info;
+	append(key, dynamic.basic ? VK_FALSE : depth_stencil.depthTestEnable);
+	append(key, dynamic.basic ? VK_FALSE : depth_stencil.depthWriteEnable);
+	append(key, dynamic.basic ? VK_COMPARE_OP_NEVER : depth_stencil.depthCompareOp);
+	append(key, depth_stencil.depthBoundsTestEnable);
+	append(key, depth_stencil.stencilTestEnable);
+	append(key, depth_stencil.front);
+	append(key, depth_stencil.back);
+	append(key, depth_stencil.minDepthBounds);
+	append(key, depth_stencil.maxDepthBounds);
+
+	for (VkDynamicState state : get_dynamic_states(config_info))
+	{
+		append(key, state);
+	}
+
+	append(key, config_info.pipeline_layout);
+	append(key, config_info.subpass);
+	{
+		std::lock_guard lock(mutex);
+		if (auto it = render_pass_keys.find(config_info.render_pass); it != render_pass_keys.end())
+		{
+			append(key, it->second);
+		}
+		else
+		{
+			append(key, config_info.render_pass);
+		}
+	}
+
+	return key;
+}
+
+std::vector<VkDynamicState> game_engine::PipelineStateCache::get_dynamic_states(const pipeline_config_info& config_info) const
+{
+	std::vector<VkDynamicState> states = config_info.dynamic_state_enables;
+
+	auto add = [&states](VkDynamicState state)
+	{
+		if (std::find(states.begin(), states.end(), state) == states.end())
+		{
+			states.push_back(state);
+		}
+	};
+
+	if (extended_dynamic_state.basic)
+	{
+		add(VK_DYNAMIC_STATE_CULL_MODE_EXT);
+		add(VK_DYNAMIC_STATE_FRONT_FACE_EXT);
+		add(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT);
+		add(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT);
+		add(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT);
+		add(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT);
+	}
+	if (extended_dynamic_state.state2)
+	{
+		add(VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT);
+		add(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT);
+	}
+	if (extended_dynamic_state.polygon_mode)
+	{
+		add(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+	}
+
+	return states;
+}
+
+VkPipeline game_engine::PipelineStateCache::insert_pipeline(const std::string& key, VkPipeline pipeline)
+{
+	std::lock_guard lock(mutex);
+	auto [it, inserted] = pipelines.emplace(key, pipeline);
+	if (!inserted)
+	{
+		vkDestroyPipeline(device.get_logical_device(), pipeline, nullptr);
+	}
+	return it->second;
+}
@@ -0,0 +1,139 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <bit>
+
+uint64_t game_engine::make_draw_key(
+	DrawPipeline pipeline,
+	VertexLayout vertex_layout,
+	VkIndexType index_type,
+	uint32_t mesh_id,
+	uint32_t lod,
+	float depth
+)
+{
+	// Non-negative floats order like their bit patterns, the top 16 bits keep the exponent and 7 bits
+	// of mantissa, under 1% apart at any distance
+	uint64_t quantized_depth = std::bit_cast<uint32_t>(std::max(depth, 0.f)) >> 16;
+
+	return static_cast<uint64_t>(static_cast<uint32_t>(pipeline) & 0x3) << 62
+		| static_cast<uint64_t>(static_cast<uint32_t>(vertex_layout) & 0x1) << 61
+		| static_cast<uint64_t>(index_type == VK_INDEX_TYPE_UINT32 ? 1 : 0) << 60
+		| static_cast<uint64_t>(mesh_id & 0x3FFFFFF) << 34
+		| static_cast<uint64_t>(std::min(lod, 3u)) << 32
+		| quantized_depth << 16;
+}
+
+game_engine::RenderStatistics& game_engine::RenderStatistics::operator+=(const RenderStatistics& other)
+{
+	draws += other.draws;
+	instances += other.instances;
+	pipeline_binds += other.pipeline_binds;
+	descriptor_set_binds += other.descriptor_set_binds;
+	index_buffer_binds += other.index_buffer_binds;
+	push_constant_updates += other.push_constant_updates;
+	sort_ms += other.sort_ms;
+	return *this;
+}
+
+void game_engine::RenderQueue::clear()
+{
+	keys.clear();
+	values.clear();
+}
+
+void game_engine::RenderQueue::reserve(size_t count)
+{
+	keys.reserve(count);
+	values.reserve(count);
+}
+
+void game_engine::RenderQueue::push(uint64_t key, uint32_t value)
+{
+	keys.push_back(key);
+	values.push_back(value);
+}
+
+void game_engine::RenderQueue::sort(JobSystem* job_system)
+{
+	const size_t count = keys.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	scratch_keys.resize(count);
+	scratch_values.resize(count);
+
+	const size_t chunk_size = job_system != nullptr
+		? std::max(MIN_CHUNK_SIZE, job_system->default_grain_size(count))
+		: count;
+	const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+	histograms.resize(chunk_count * RADIX_SIZE);
+
+	auto for_each_chunk = [&](auto&& body)
+	{
+		if (job_system == nullptr || chunk_count == 1)
+		{
+			for (size_t chunk = 0; chunk < chunk_count; chunk++)
+			{
+				body(chunk, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+			}
+			return;
+		}
+
+		job_system->parallel_for(chunk_count, 1, [&](uint32_t, size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				body(chunk, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+			}
+		});
+	};
+
+	for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS)
+	{
+		std::fill(histograms.begin(), histograms.end(), 0);
+		for_each_chunk([&](size_t chunk, size_t begin, size_t end)
+		{
+			uint32_t* histogram = &histograms[chunk * RADIX_SIZE];
+			for (size_t i = begin; i < end; i++)
+			{
+				histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+			}
+		});
+
+		bool single_digit = false;
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < RADIX_SIZE; digit++)
+		{
+			uint32_t digit_count = 0;
+			for (size_t chunk = 0; chunk < chunk_count; chunk++)
+			{
+				uint32_t& counter = histograms[chunk * RADIX_SIZE + digit];
+				uint32_t chunk_digit_count = counter;
+				counter = offset;
+				offset += chunk_digit_count;
+				digit_count += chunk_digit_count;
+			}
+			single_digit = single_digit || digit_count == count;
+		}
+		if (single_digit)
+		{
+			continue;
+		}
+
+		for_each_chunk([&](size_t chunk, size_t begin, size_t end)
+		{
+			uint32_t* offsets = &histograms[chunk * RADIX_SIZE];
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t destination = offsets[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+				scratch_keys[destination] = keys[i];
+				scratch_values[destination] = values[i];
+			}
+		});
+		keys.swap(scratch_keys);
+		values.swap(scratch_values);
+	}
+}
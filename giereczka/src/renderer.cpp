@@ -21,6 +21,17 @@ VkCommandBuffer game_engine::Renderer::get_current_command_buffer() const
 	return command_buffers[current_frame_index];
 }
 
+VkFramebuffer game_engine::Renderer::get_current_framebuffer() const
+{
+	assert(is_frame_started && "Cannot get framebuffer when frame is not in progress");
+	return swap_chain->get_framebuffer(current_image_index);
+}
+
+VkExtent2D game_engine::Renderer::get_swap_chain_extent() const
+{
+	return swap_chain->get_swap_chain_extent();
+}
+
 int game_engine::Renderer::get_frame_index() const
 {
 	assert(is_frame_in_progress() && "Cannot get frame index when frame is not in progress");
@@ -46,6 +57,9 @@ VkCommandBuffer game_engine::Renderer::begin_frame()
 
 	is_frame_started = true;
 
+	// Acquiring waited for this frame's fence, nothing in flight uses its descriptor sets anymore
+	frame_descriptor_allocators[current_frame_index]->reset();
+
 	auto command_buffer = get_current_command_buffer();
 
 	VkCommandBufferBeginInfo begin_info{};
@@ -87,14 +101,41 @@ void game_engine::Renderer::end_frame()
 	current_frame_index = (current_frame_index + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
 }
 
-void game_engine::Renderer::begin_swap_chain_render_pass(VkCommandBuffer command_buffer)
+void game_engine::Renderer::begin_swap_chain_render_pass(VkCommandBuffer command_buffer, VkSubpassContents contents)
+{
+	begin_render_pass(command_buffer, swap_chain->get_render_pass(), contents);
+}
+
+void game_engine::Renderer::continue_swap_chain_render_pass(VkCommandBuffer command_buffer, VkSubpassContents contents)
+{
+	begin_render_pass(command_buffer, swap_chain->get_load_render_pass(), contents);
+}
+
+VkFormat game_engine::Renderer::get_depth_format() const
+{
+	return swap_chain->get_swap_chain_depth_format();
+}
+
+VkImage game_engine::Renderer::get_current_depth_image() const
+{
+	assert(is_frame_started && "Cannot get depth image when frame is not in progress");
+	return swap_chain->get_depth_image(current_image_index);
+}
+
+VkImageView game_engine::Renderer::get_current_depth_image_view() const
+{
+	assert(is_frame_started && "Cannot get depth image view when frame is not in progress");
+	return swap_chain->get_depth_image_view(current_image_index);
+}
+
+void game_engine::Renderer::begin_render_pass(VkCommandBuffer command_buffer, VkRenderPass render_pass, VkSubpassContents contents)
 {
 	assert(is_frame_in_progress() && "Cannot begin render pass when frame is not in progress");
 	assert(command_buffer == get_current_command_buffer() && "Can only begin render pass for command buffer of current frame");
 
 	VkRenderPassBeginInfo render_pass_info{};
 	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	render_pass_info.renderPass = swap_chain->get_render_pass();
+	render_pass_info.renderPass = render_pass;
 	render_pass_info.framebuffer = swap_chain->get_framebuffer(current_image_index);
 
 	render_pass_info.renderArea.offset = { 0, 0 };
@@ -109,9 +150,14 @@ void game_engine::Renderer::begin_swap_chain_render_pass(VkCommandBuffer command
 	vkCmdBeginRenderPass(
 		command_buffer,
 		&render_pass_info,
-		VK_SUBPASS_CONTENTS_INLINE
+		contents
 	);
 
+	if (contents != VK_SUBPASS_CONTENTS_INLINE)
+	{
+		return;
+	}
+
 	VkViewport viewport{};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
@@ -136,6 +182,7 @@ game_engine::Renderer::Renderer(Window& window, Device& device) : window(window)
 {
 	recreate_swap_chain();
 	create_command_buffers();
+	create_frame_descriptor_allocators();
 }
 
 game_engine::Renderer::~Renderer()
@@ -143,6 +190,22 @@ game_engine::Renderer::~Renderer()
 	free_command_buffers();
 }
 
+void game_engine::Renderer::create_frame_descriptor_allocators()
+{
+	// Transient sets for a single frame, dropped all at once when the frame slot comes around again
+	std::vector<DescriptorAllocator::PoolSizeRatio> pool_ratios{
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f}
+	};
+
+	frame_descriptor_allocators.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+	for (auto& allocator : frame_descriptor_allocators)
+	{
+		allocator = std::make_unique<DescriptorAllocator>(device, FRAME_DESCRIPTOR_SETS, pool_ratios);
+	}
+}
+
 void game_engine::Renderer::create_command_buffers()
 {
 	command_buffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
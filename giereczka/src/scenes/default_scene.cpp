@@ -0,0 +1,60 @@
+#include "scenes/default_scene.h"
+
+void game_engine::load_default_scene(
+	Device& device,
+	ObjectManagerSystem& object_manager_system,
+	TextureManagerSystem& texture_manager_system
+)
+{
+	for (int i = 0; i < 10; i++)
+	{
+		auto rotate_light = glm::rotate(
+			glm::mat4(1.f),
+			(i * glm::two_pi<float>()) / 10.f,
+			glm::vec3(0.f, -1.f, 0.f)
+		);
+		auto position = glm::vec3(rotate_light * glm::vec4(-5.f, -5.f, -5.f, 1.f));
+
+		float hue = (i / static_cast<float>(10)) * glm::two_pi<float>();
+		float r = 0.5f * (1.0f + cos(hue));
+		float g = 0.5f * (1.0f + cos(hue + glm::two_pi<float>() / 3.0f));
+		float b = 0.5f * (1.0f + cos(hue + 2.0f * glm::two_pi<float>() / 3.0f));
+		auto color = glm::vec3(
+			r, g, b
+		);
+
+		auto point_light = PointLightObject(
+			1.0f,
+			0.05f,
+			color,
+			position
+		);
+		object_manager_system.add_point_light(point_light);
+	}
+
+	auto gltf_model = std::make_shared<GltfModel>(device, "models/animated_model.gltf");
+	auto game_object = GameObject(
+		gltf_model,
+		glm::vec3(0.0f),
+		glm::vec3(0.0f),
+		1.0f,
+		glm::vec3(0.0f),
+		"animated_model"
+	);
+
+	game_object.gltf_model->texture_id = texture_manager_system.load_texture(game_object.gltf_model->textures[0]);
+
+	object_manager_system.add_game_object(game_object);
+
+	auto gltf_model2 = std::make_shared<GltfModel>(device, "models/plane.gltf");
+	auto game_object2 = GameObject(
+		gltf_model2,
+		glm::vec3(0.0f),
+		glm::vec3(0.0f),
+		1.0f,
+		glm::vec3(0.0f),
+		"plane"
+	);
+	game_object2.gltf_model->texture_id = texture_manager_system.load_texture(game_object2.gltf_model->textures[1]);
+	object_manager_system.add_game_object(game_object2);
+}
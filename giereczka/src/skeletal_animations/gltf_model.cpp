@@ -5,6 +5,10 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <tiny_gltf.h>
 
+#include "mesh_optimizer.h"
+
+#include <span>
+
 tinygltf::TinyGLTF loader;
 
 game_engine::GltfModel::GltfModel(Device& device, const std::string& file_path) : device{ device }
@@ -21,6 +25,7 @@ game_engine::GltfModel::GltfModel(Device& device, const std::string& file_path)
 		load_vertex_data(mesh_index);
 
 		auto model = std::make_shared<Model>(device, vertices, indices);
+		bounding_box.expand(model->get_bounding_box());
 		models.push_back(model);
 	}
 }
@@ -608,7 +613,66 @@ void game_engine::GltfModel::load_vertex_data(uint32_t const mesh_index)
 
 		submesh.index_count = index_count;
 		submesh.vertex_count = vertex_count;
+		optimize_submesh(submesh);
+
+		auto submesh_vertices = std::span(vertices).subspan(submesh.first_vertex, submesh.vertex_count);
+		for (const Model::Vertex& vertex : submesh_vertices)
+		{
+			submesh.bounding_box.expand(vertex.position);
+		}
+		submesh.bounding_sphere = compute_bounding_sphere(
+			submesh.bounding_box,
+			submesh_vertices,
+			[](const Model::Vertex& vertex) { return vertex.position; }
+		);
+	}
+}
+
+void game_engine::GltfModel::optimize_submesh(Model::Submesh& submesh)
+{
+	// Other modes than triangle lists have no index_count divisible by 3 to go by
+	if (submesh.index_count == 0 || submesh.index_count % 3 != 0)
+	{
+		return;
+	}
+
+	// glTF indices are relative to the primitive's own vertices
+	auto submesh_indices = std::span(indices).subspan(submesh.first_index, submesh.index_count);
+	auto submesh_vertices = std::span(vertices).subspan(submesh.first_vertex, submesh.vertex_count);
+
+	// Exporters split vertices per face more often than needed. The submesh is the last one loaded, so
+	// dropping its duplicates only shrinks the end of vertices.
+	size_t unique_count = 0;
+	std::vector<uint32_t> weld_remap = weld_vertices_remap(
+		submesh_vertices.data(),
+		submesh_vertices.size(),
+		sizeof(Model::Vertex),
+		unique_count
+	);
+	if (unique_count < submesh_vertices.size())
+	{
+		for (uint32_t& index : submesh_indices)
+		{
+			index = weld_remap[index];
+		}
+		remap_vertices(submesh_vertices, std::span<const uint32_t>(weld_remap));
+		submesh.vertex_count = static_cast<uint32_t>(unique_count);
+		vertices.resize(submesh.first_vertex + unique_count);
+		submesh_vertices = std::span(vertices).subspan(submesh.first_vertex, submesh.vertex_count);
 	}
+
+	std::vector<glm::vec3> positions;
+	positions.reserve(submesh_vertices.size());
+	for (const Model::Vertex& vertex : submesh_vertices)
+	{
+		positions.push_back(vertex.position);
+	}
+
+	std::vector<uint32_t> optimized = optimize_vertex_cache(submesh_indices, positions.size());
+	optimized = optimize_overdraw(optimized, positions);
+	std::vector<uint32_t> remap = optimize_vertex_fetch_remap(optimized, positions.size());
+	remap_vertices(submesh_vertices, std::span<const uint32_t>(remap));
+	std::copy(optimized.begin(), optimized.end(), submesh_indices.begin());
 }
 
 void game_engine::GltfModel::calculate_tangents()
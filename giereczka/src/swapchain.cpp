@@ -1,4 +1,6 @@
 #include "swapchain.h"
+#include "upload_batcher.h"
+#include "pipelines/pipeline_state_cache.h"
 
 game_engine::SwapChain::SwapChain(Device& device, VkExtent2D window_extent) : device(device), window_extent(window_extent)
 {
@@ -31,7 +33,7 @@ game_engine::SwapChain::~SwapChain()
 	{
 		vkDestroyImageView(device.get_logical_device(), depth_image_views[i], nullptr);
 		vkDestroyImage(device.get_logical_device(), depth_images[i], nullptr);
-		vkFreeMemory(device.get_logical_device(), depth_image_memories[i], nullptr);
+		device.get_memory_allocator().free(depth_image_memories[i]);
 	}
 
 	for (size_t i = 0; i < swap_chain_framebuffers.size(); i++)
@@ -39,7 +41,10 @@ game_engine::SwapChain::~SwapChain()
 		vkDestroyFramebuffer(device.get_logical_device(), swap_chain_framebuffers[i], nullptr);
 	}
 
+	device.get_pipeline_state_cache().unregister_render_pass(render_pass);
 	vkDestroyRenderPass(device.get_logical_device(), render_pass, nullptr);
+	device.get_pipeline_state_cache().unregister_render_pass(load_render_pass);
+	vkDestroyRenderPass(device.get_logical_device(), load_render_pass, nullptr);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
@@ -59,11 +64,26 @@ VkRenderPass game_engine::SwapChain::get_render_pass()
 	return render_pass;
 }
 
+VkRenderPass game_engine::SwapChain::get_load_render_pass()
+{
+	return load_render_pass;
+}
+
 VkImageView game_engine::SwapChain::get_image_view(size_t index)
 {
 	return swap_chain_image_views[index];
 }
 
+VkImage game_engine::SwapChain::get_depth_image(size_t index)
+{
+	return depth_images[index];
+}
+
+VkImageView game_engine::SwapChain::get_depth_image_view(size_t index)
+{
+	return depth_image_views[index];
+}
+
 size_t game_engine::SwapChain::image_count()
 {
 	return swap_chain_images.size();
@@ -74,6 +94,11 @@ VkFormat game_engine::SwapChain::get_swap_chain_image_format()
 	return swap_chain_image_format;
 }
 
+VkFormat game_engine::SwapChain::get_swap_chain_depth_format()
+{
+	return swap_chain_depth_format;
+}
+
 VkExtent2D game_engine::SwapChain::get_swap_chain_extent()
 {
 	return swap_chain_extent;
@@ -99,7 +124,7 @@ VkFormat game_engine::SwapChain::find_depth_format()
 	return device.find_supported_format(
 		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
 	);
 }
 
@@ -156,6 +181,9 @@ VkResult game_engine::SwapChain::submit_command_buffers(const VkCommandBuffer* b
 	submit_info.signalSemaphoreCount = 1;
 	submit_info.pSignalSemaphores = signal_semaphores;
 
+	// Uploads recorded since the last frame must reach the queue ahead of the draws using them
+	device.get_upload_batcher().flush();
+
 	vkResetFences(device.get_logical_device(), 1, &in_flight_fences[current_frame]);
 	if (vkQueueSubmit(
 		device.get_graphics_queue(),
@@ -309,7 +337,7 @@ void game_engine::SwapChain::create_render_pass()
 	depth_attachment.format = find_depth_format();
 	depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -367,6 +395,38 @@ void game_engine::SwapChain::create_render_pass()
 	{
 		throw std::runtime_error("Failed to create render pass");
 	}
+
+	device.get_pipeline_state_cache().register_render_pass(render_pass, render_pass_info);
+
+	// Picks up where the first pass left off, after the depth pyramid was built from its depth
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	VkSubpassDependency load_dependency{};
+	load_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	load_dependency.dstSubpass = 0;
+	load_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	load_dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	load_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	load_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	render_pass_info.pDependencies = &load_dependency;
+
+	if (vkCreateRenderPass(
+		device.get_logical_device(),
+		&render_pass_info,
+		nullptr,
+		&load_render_pass
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create load render pass");
+	}
+
+	device.get_pipeline_state_cache().register_render_pass(load_render_pass, render_pass_info);
 }
 
 void game_engine::SwapChain::create_depth_resources()
@@ -393,7 +453,7 @@ void game_engine::SwapChain::create_depth_resources()
 		image_info.format = depth_format;
 		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
 		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
 		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		image_info.flags = 0;
@@ -0,0 +1,73 @@
+#include "system_scheduler.h"
+
+game_engine::SystemScheduler::SystemScheduler(JobSystem& job_system) : job_system(job_system)
+{
+}
+
+void game_engine::SystemScheduler::add_system(
+	std::string name,
+	const SystemAccess& access,
+	std::function<void()> update
+)
+{
+	size_t index = systems.size();
+	std::vector<size_t> dependencies;
+
+	for (FrameResource resource : access.reads)
+	{
+		auto& state = resources[static_cast<size_t>(resource)];
+		if (state.last_writer)
+		{
+			dependencies.push_back(*state.last_writer);
+		}
+	}
+
+	for (FrameResource resource : access.writes)
+	{
+		auto& state = resources[static_cast<size_t>(resource)];
+		if (state.last_writer)
+		{
+			dependencies.push_back(*state.last_writer);
+		}
+		dependencies.insert(dependencies.end(), state.readers.begin(), state.readers.end());
+	}
+
+	// Update the resource state only after every dependency is known, a system that reads and writes
+	// the same resource must not end up depending on itself
+	for (FrameResource resource : access.reads)
+	{
+		resources[static_cast<size_t>(resource)].readers.push_back(index);
+	}
+
+	for (FrameResource resource : access.writes)
+	{
+		auto& state = resources[static_cast<size_t>(resource)];
+		state.last_writer = index;
+		state.readers.clear();
+	}
+
+	std::sort(dependencies.begin(), dependencies.end());
+	dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+	std::erase(dependencies, index);
+
+	systems.push_back(System{std::move(name), std::move(update), std::move(dependencies)});
+}
+
+void game_engine::SystemScheduler::run()
+{
+	handles.clear();
+	for (auto& system : systems)
+	{
+		dependency_handles.clear();
+		for (size_t dependency : system.dependencies)
+		{
+			dependency_handles.push_back(handles[dependency]);
+		}
+
+		handles.push_back(job_system.schedule([&system](uint32_t) { system.update(); }, dependency_handles));
+	}
+
+	// Joining on everything keeps systems from outliving the frame state they capture, even when one throws
+	JobHandle frame_done = job_system.schedule([](uint32_t) {}, handles);
+	job_system.wait(frame_done);
+}
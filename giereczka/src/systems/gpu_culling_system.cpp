@@ -0,0 +1,1106 @@
+#include "systems/gpu_culling_system.h"
+
+#include "geometry_pool.h"
+
+#include <cstring>
+
+game_engine::GpuCullingSystem::GpuCullingSystem(Device& device, int frames_in_flight, DepthPyramid* depth_pyramid)
+	: device(device), depth_pyramid(depth_pyramid), frames_in_flight(frames_in_flight)
+{
+	assert(is_supported(device) && "GPU culling needs multiDrawIndirect and drawIndirectFirstInstance");
+
+	max_draw_count = device.properties.limits.maxDrawIndirectCount;
+
+	instance_set_layout = DescriptorSetLayout::Builder{device}
+	                      .add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+	                      .add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                      .add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                      .add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                      .build();
+
+	meshlet_set_layout = DescriptorSetLayout::Builder{device}
+	                     .add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                     .add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                     .add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                     .add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                     .build();
+
+	scatter_set_layout = DescriptorSetLayout::Builder{device}
+	                     .add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                     .add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+	                     .build();
+
+	if (depth_pyramid != nullptr)
+	{
+		occlusion_set_layout = DescriptorSetLayout::Builder{device}
+		                       .add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		                       .add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		                       .add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		                       .build();
+	}
+
+	// An instance set, a meshlet set, a scatter set and, with occlusion culling, an occlusion set per frame
+	descriptor_allocator = std::make_unique<DescriptorAllocator>(
+		device,
+		static_cast<uint32_t>(frames_in_flight) * 4,
+		std::vector<DescriptorAllocator::PoolSizeRatio>{
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.f},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.f}
+		}
+	);
+
+	create_scene_buffer(INITIAL_CAPACITY);
+
+	frames.resize(frames_in_flight);
+	for (auto& frame : frames)
+	{
+		create_frame_buffers(frame, std::min(INITIAL_CAPACITY, max_draw_count));
+		create_update_buffer(frame, INITIAL_CAPACITY);
+		write_frame_sets(frame);
+
+		// Written once the frame has meshlet instances, see create_compacted_indices
+		if (!descriptor_allocator->allocate_descriptor(meshlet_set_layout->get_descriptor_set_layout(), frame.meshlet_set))
+		{
+			throw std::runtime_error("Failed to allocate meshlet descriptor set");
+		}
+
+		if (depth_pyramid != nullptr &&
+		    !descriptor_allocator->allocate_descriptor(occlusion_set_layout->get_descriptor_set_layout(), frame.occlusion_set))
+		{
+			throw std::runtime_error("Failed to allocate occlusion descriptor set");
+		}
+	}
+
+	create_pipeline_layout();
+	create_pipeline();
+	if (depth_pyramid != nullptr)
+	{
+		create_occlusion_pipeline();
+	}
+	create_meshlet_pipeline();
+	create_scatter_pipeline();
+}
+
+game_engine::GpuCullingSystem::~GpuCullingSystem()
+{
+	vkDestroyPipelineLayout(device.get_logical_device(), pipeline_layout, nullptr);
+	vkDestroyPipelineLayout(device.get_logical_device(), meshlet_pipeline_layout, nullptr);
+	vkDestroyPipelineLayout(device.get_logical_device(), scatter_pipeline_layout, nullptr);
+	if (occlusion_pipeline_layout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(device.get_logical_device(), occlusion_pipeline_layout, nullptr);
+	}
+}
+
+void game_engine::GpuCullingSystem::take_scene_changes(ObjectManagerSystem& object_manager_system)
+{
+	object_manager_system.take_scene_changes(changed_objects, removed_objects);
+}
+
+void game_engine::GpuCullingSystem::write_instances(
+	int frame_index,
+	const ObjectManagerSystem::GameObjectTable& game_objects,
+	const LodSelector& select_lod
+)
+{
+	FrameBuffers& frame = frames[frame_index];
+	assert(frame.update_count == 0 && "cull() was not recorded after the last write_instances");
+
+	// The frame's fence has signaled, so its counters are complete
+	if (frame.counters_pending)
+	{
+		frame.counters_readback->invalidate();
+		const auto* counters = static_cast<const Counters*>(frame.counters_readback->get_mapped_memory());
+		counted_frames++;
+		total_drawn += counters->drawn;
+		total_frustum_culled += counters->frustum_culled;
+		total_occlusion_culled += counters->occlusion_culled;
+		total_meshlets_drawn += counters->meshlets_drawn;
+		total_meshlets_culled += counters->meshlets_culled;
+		frame.counters_pending = false;
+	}
+
+	std::erase_if(retired_buffers, [](RetiredBuffer& retired) { return --retired.frames_left <= 0; });
+
+	for (ObjectManagerSystem::id_t id : removed_objects)
+	{
+		auto scene_object = scene_objects.find(id);
+		if (scene_object != scene_objects.end())
+		{
+			free_slots(scene_object->second);
+			scene_objects.erase(scene_object);
+		}
+	}
+
+	// Transforms and world boxes are only computed again for the objects that changed
+	for (ObjectManagerSystem::id_t id : changed_objects)
+	{
+		uint32_t dense = game_objects.find(id);
+		if (dense == ObjectManagerSystem::GameObjectTable::NOT_FOUND)
+		{
+			continue;
+		}
+
+		const RenderComponent& render = game_objects.get<RenderComponent>()[dense];
+		if (render.gltf_model == nullptr)
+		{
+			auto scene_object = scene_objects.find(id);
+			if (scene_object != scene_objects.end())
+			{
+				free_slots(scene_object->second);
+				scene_objects.erase(scene_object);
+			}
+			continue;
+		}
+
+		SceneObject& scene_object = scene_objects[id];
+		scene_object.model_matrix = game_objects.get<transform_component>()[dense].matrix();
+		scene_object.world_box = render.gltf_model->get_bounding_box().transformed(scene_object.model_matrix);
+
+		size_t model_count = render.gltf_model->models.size();
+		free_slots(scene_object, std::min(model_count, scene_object.slots.size()));
+		while (scene_object.slots.size() < model_count)
+		{
+			scene_object.slots.push_back(allocate_slot());
+		}
+		scene_object.lod = UINT32_MAX;
+	}
+	changed_objects.clear();
+	removed_objects.clear();
+
+	// Levels of detail follow the camera, the slots of unchanged objects are only staged when theirs does
+	for (auto& [id, scene_object] : scene_objects)
+	{
+		uint32_t lod = select_lod(id, scene_object.world_box);
+		if (lod != scene_object.lod)
+		{
+			write_scene_object(scene_object, game_objects.get<RenderComponent>(id), lod);
+		}
+	}
+
+	if (scene_instances.size() > scene_capacity)
+	{
+		uint32_t capacity = scene_capacity;
+		while (capacity < scene_instances.size())
+		{
+			capacity *= 2;
+		}
+		create_scene_buffer(capacity);
+	}
+
+	// Past the device limit the remaining instances are not drawn
+	uint32_t instance_count = std::min(static_cast<uint32_t>(scene_instances.size()), max_draw_count);
+	if (instance_count > frame.capacity)
+	{
+		uint32_t capacity = frame.capacity;
+		while (capacity < instance_count)
+		{
+			capacity = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(capacity) * 2, max_draw_count));
+		}
+
+		// The next frame's first phase may still be reading the visibility it wrote last time round
+		if (frame.visibility != nullptr)
+		{
+			retired_buffers.push_back({std::move(frame.visibility), frames_in_flight});
+			if (visibility_frame == frame_index)
+			{
+				visibility_frame = -1;
+			}
+		}
+		create_frame_buffers(frame, capacity);
+	}
+
+	if (scene_compacted_index_count > frame.compacted_capacity)
+	{
+		create_compacted_indices(frame, std::max(scene_compacted_index_count, frame.compacted_capacity * 2));
+	}
+	else if (frame.compacted_indices != nullptr && frame.geometry_generation != device.get_geometry_pool().get_generation())
+	{
+		write_meshlet_set(frame);
+	}
+
+	if (pending_slots.size() > frame.update_capacity)
+	{
+		uint32_t capacity = frame.update_capacity;
+		while (capacity < pending_slots.size())
+		{
+			capacity *= 2;
+		}
+		create_update_buffer(frame, capacity);
+	}
+
+	if (frame.bound_scene_buffer != scene_buffer.get())
+	{
+		write_frame_sets(frame);
+	}
+
+	auto* updates = static_cast<GpuInstanceUpdate*>(frame.updates->get_mapped_memory());
+	for (size_t i = 0; i < pending_slots.size(); i++)
+	{
+		uint32_t slot = pending_slots[i];
+		updates[i].slot = slot;
+		updates[i].instance = scene_instances[slot];
+		slot_pending[slot] = 0;
+	}
+	if (!pending_slots.empty())
+	{
+		frame.updates->flush();
+	}
+	frame.update_count = static_cast<uint32_t>(pending_slots.size());
+	pending_slots.clear();
+
+	upload_frames++;
+	total_uploaded_instances += frame.update_count;
+	total_scene_instances += scene_instances.size() - free_scene_slots.size();
+
+	for (uint32_t stream = 0; stream < DRAW_STREAM_COUNT; stream++)
+	{
+		frame.stream_counts[stream] = std::min(scene_stream_counts[stream], instance_count);
+	}
+	frame.instance_count = instance_count;
+}
+
+void game_engine::GpuCullingSystem::write_scene_object(SceneObject& scene_object, const RenderComponent& render, uint32_t lod)
+{
+	const auto& models = render.gltf_model->models;
+	assert(models.size() == scene_object.slots.size() && "Models changed without the object being marked changed");
+
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		GpuInstance instance{};
+		if (models[i] != nullptr)
+		{
+			const Model& model = *models[i];
+			const GeometryAllocation& geometry = model.get_geometry();
+			const Model::Lod& model_lod = model.get_lod(lod);
+
+			instance.model_matrix = scene_object.model_matrix * model.get_dequantization_matrix();
+			instance.bounding_sphere = model.get_quantized_bounding_sphere();
+			instance.color = render.color;
+			instance.texture_index = render.gltf_model->texture_id;
+			instance.index_count = model_lod.index_count;
+			instance.first_index = model_lod.first_index;
+			instance.vertex_offset = geometry.vertex_offset;
+			instance.vertex_layout = model.get_vertex_layout();
+			instance.index_type = geometry.index_type;
+
+			// Meshlets cover the full mesh only
+			if (model.get_meshlet_count() > 0 && lod == 0)
+			{
+				instance.first_meshlet = geometry.first_meshlet;
+				instance.meshlet_count = geometry.meshlet_count;
+			}
+		}
+		set_slot(scene_object.slots[i], instance);
+	}
+	scene_object.lod = lod;
+}
+
+uint32_t game_engine::GpuCullingSystem::allocate_slot()
+{
+	if (!free_scene_slots.empty())
+	{
+		uint32_t slot = free_scene_slots.back();
+		free_scene_slots.pop_back();
+		return slot;
+	}
+
+	scene_instances.emplace_back();
+	slot_pending.push_back(0);
+	return static_cast<uint32_t>(scene_instances.size() - 1);
+}
+
+void game_engine::GpuCullingSystem::set_slot(uint32_t slot, const GpuInstance& instance)
+{
+	GpuInstance& current = scene_instances[slot];
+	if (std::memcmp(&current, &instance, sizeof(GpuInstance)) == 0)
+	{
+		return;
+	}
+
+	// DRAW_STREAM_COUNT for the empty and non-indexed instances the culling skips
+	auto get_stream = [](const GpuInstance& slot_instance) -> uint32_t
+	{
+		if (slot_instance.meshlet_count > 0) return MESHLET_STREAM;
+		if (slot_instance.index_count > 0) return static_cast<uint32_t>(slot_instance.index_type);
+		return DRAW_STREAM_COUNT;
+	};
+
+	uint32_t stream = get_stream(current);
+	if (stream < DRAW_STREAM_COUNT)
+	{
+		scene_stream_counts[stream]--;
+	}
+	if (stream == MESHLET_STREAM)
+	{
+		scene_compacted_index_count -= current.index_count;
+	}
+
+	stream = get_stream(instance);
+	if (stream < DRAW_STREAM_COUNT)
+	{
+		scene_stream_counts[stream]++;
+	}
+	if (stream == MESHLET_STREAM)
+	{
+		scene_compacted_index_count += instance.index_count;
+	}
+
+	current = instance;
+	stage_slot(slot);
+}
+
+void game_engine::GpuCullingSystem::stage_slot(uint32_t slot)
+{
+	if (slot_pending[slot] == 0)
+	{
+		slot_pending[slot] = 1;
+		pending_slots.push_back(slot);
+	}
+}
+
+void game_engine::GpuCullingSystem::free_slots(SceneObject& scene_object, size_t first)
+{
+	for (size_t i = first; i < scene_object.slots.size(); i++)
+	{
+		set_slot(scene_object.slots[i], GpuInstance{});
+		free_scene_slots.push_back(scene_object.slots[i]);
+	}
+	scene_object.slots.resize(first);
+}
+
+void game_engine::GpuCullingSystem::upload_instances(VkCommandBuffer command_buffer, FrameBuffers& frame)
+{
+	if (frame.update_count == 0)
+	{
+		return;
+	}
+
+	// Earlier frames' culling and draws may still read the slots about to be overwritten
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		0, nullptr
+	);
+
+	scatter_pipeline->bind(command_buffer);
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		scatter_pipeline_layout,
+		0,
+		1,
+		&frame.scatter_set,
+		0,
+		nullptr
+	);
+
+	ScatterPushConstants push{};
+	push.update_count = frame.update_count;
+	vkCmdPushConstants(
+		command_buffer,
+		scatter_pipeline_layout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0,
+		sizeof(ScatterPushConstants),
+		&push
+	);
+
+	vkCmdDispatch(command_buffer, (frame.update_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	VkMemoryBarrier scatter_barrier{};
+	scatter_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	scatter_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	scatter_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		0,
+		1, &scatter_barrier,
+		0, nullptr,
+		0, nullptr
+	);
+
+	frame.update_count = 0;
+}
+
+void game_engine::GpuCullingSystem::cull(VkCommandBuffer command_buffer, int frame_index, const Camera& camera)
+{
+	FrameBuffers& frame = frames[frame_index];
+	upload_instances(command_buffer, frame);
+	if (frame.instance_count == 0)
+	{
+		// Nothing to carry over to the next frame
+		visibility_frame = -1;
+		return;
+	}
+
+	reset_draws(command_buffer, frame, true);
+
+	if (depth_pyramid != nullptr)
+	{
+		// Rewritten every frame, the previous frame's buffer and the pyramid may have been recreated
+		const FrameBuffers& previous_frame = visibility_frame >= 0 ? frames[visibility_frame] : frame;
+		auto previous_visibility_info = previous_frame.visibility->descriptor_info();
+		auto visibility_info = frame.visibility->descriptor_info();
+		auto depth_pyramid_info = depth_pyramid->descriptor_info();
+		DescriptorWriter(*occlusion_set_layout, *descriptor_allocator)
+			.write_buffer(0, &previous_visibility_info)
+			.write_buffer(1, &visibility_info)
+			.write_image(2, &depth_pyramid_info)
+			.overwrite(frame.occlusion_set);
+
+		dispatch_occlusion(command_buffer, frame, camera, false);
+		dispatch_meshlets(command_buffer, frame, camera);
+		finish_draws(command_buffer, frame, false);
+		return;
+	}
+
+	pipeline->bind(command_buffer);
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		pipeline_layout,
+		0,
+		1,
+		&frame.descriptor_set,
+		0,
+		nullptr
+	);
+
+	CullPushConstants push{};
+	push.frustum_planes = camera.get_frustum_planes();
+	push.instance_count = frame.instance_count;
+	vkCmdPushConstants(
+		command_buffer,
+		pipeline_layout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0,
+		sizeof(CullPushConstants),
+		&push
+	);
+
+	vkCmdDispatch(command_buffer, (frame.instance_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	dispatch_meshlets(command_buffer, frame, camera);
+	finish_draws(command_buffer, frame, true);
+	frame.instance_count = 0;
+}
+
+bool game_engine::GpuCullingSystem::needs_occlusion_pass(int frame_index) const
+{
+	return depth_pyramid != nullptr && frames[frame_index].instance_count > 0;
+}
+
+void game_engine::GpuCullingSystem::cull_occluded(VkCommandBuffer command_buffer, int frame_index, const Camera& camera)
+{
+	assert(needs_occlusion_pass(frame_index) && "No first phase to follow up on");
+
+	FrameBuffers& frame = frames[frame_index];
+
+	// The first phase's draws read the buffers that are about to be cleared and rewritten
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		0, nullptr
+	);
+
+	reset_draws(command_buffer, frame, false);
+	dispatch_occlusion(command_buffer, frame, camera, true);
+	dispatch_meshlets(command_buffer, frame, camera);
+	finish_draws(command_buffer, frame, true);
+
+	visibility_frame = frame_index;
+	visibility_count = frame.instance_count;
+	frame.instance_count = 0;
+}
+
+void game_engine::GpuCullingSystem::draw(VkCommandBuffer command_buffer, int frame_index) const
+{
+	const FrameBuffers& frame = frames[frame_index];
+	if (frame.instance_count == 0)
+	{
+		return;
+	}
+
+	for (uint32_t stream = 0; stream < DRAW_STREAM_COUNT; stream++)
+	{
+		uint32_t draw_count = frame.stream_counts[stream];
+		if (draw_count == 0)
+		{
+			continue;
+		}
+
+		if (stream == MESHLET_STREAM)
+		{
+			vkCmdBindIndexBuffer(command_buffer, frame.compacted_indices->get_buffer(), 0, VK_INDEX_TYPE_UINT32);
+		}
+		else
+		{
+			device.get_geometry_pool().bind_index_buffer(command_buffer, static_cast<VkIndexType>(stream));
+		}
+		VkDeviceSize draw_offset = stream * frame.instance_count * sizeof(VkDrawIndexedIndirectCommand);
+		if (auto cmd_draw_indexed_indirect_count = device.get_cmd_draw_indexed_indirect_count())
+		{
+			cmd_draw_indexed_indirect_count(
+				command_buffer,
+				frame.draw_commands->get_buffer(),
+				draw_offset,
+				frame.counters->get_buffer(),
+				offsetof(Counters, draw_counts) + stream * sizeof(uint32_t),
+				draw_count,
+				sizeof(VkDrawIndexedIndirectCommand)
+			);
+		}
+		else
+		{
+			vkCmdDrawIndexedIndirect(
+				command_buffer,
+				frame.draw_commands->get_buffer(),
+				draw_offset,
+				draw_count,
+				sizeof(VkDrawIndexedIndirectCommand)
+			);
+		}
+	}
+}
+
+void game_engine::GpuCullingSystem::create_frame_buffers(FrameBuffers& frame, uint32_t capacity)
+{
+	frame.capacity = capacity;
+	// The sets still point at the buffers about to be replaced
+	frame.bound_scene_buffer = nullptr;
+
+	// One stream per index type and the meshlet stream
+	frame.draw_commands = std::make_unique<Buffer>(
+		device,
+		sizeof(VkDrawIndexedIndirectCommand),
+		capacity * DRAW_STREAM_COUNT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	// The header and an instance, draw slot pair per instance
+	frame.meshlet_work = std::make_unique<Buffer>(
+		device,
+		sizeof(uint32_t) * 2,
+		capacity + sizeof(MeshletWork) / (sizeof(uint32_t) * 2),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	if (frame.counters == nullptr)
+	{
+		frame.counters = std::make_unique<Buffer>(
+			device,
+			sizeof(Counters),
+			1,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+
+		frame.counters_readback = std::make_unique<Buffer>(
+			device,
+			sizeof(Counters),
+			1,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		);
+		frame.counters_readback->map();
+	}
+
+	if (depth_pyramid != nullptr)
+	{
+		frame.visibility = std::make_unique<Buffer>(
+			device,
+			sizeof(uint32_t),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+	}
+
+}
+
+void game_engine::GpuCullingSystem::create_update_buffer(FrameBuffers& frame, uint32_t capacity)
+{
+	frame.update_capacity = capacity;
+	frame.bound_scene_buffer = nullptr;
+
+	frame.updates = std::make_unique<Buffer>(
+		device,
+		sizeof(GpuInstanceUpdate),
+		capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+	);
+	frame.updates->map();
+}
+
+void game_engine::GpuCullingSystem::create_scene_buffer(uint32_t capacity)
+{
+	// Frames in flight keep drawing from the old one until their sets are rewritten
+	if (scene_buffer != nullptr)
+	{
+		retired_buffers.push_back({std::move(scene_buffer), frames_in_flight});
+	}
+
+	scene_capacity = capacity;
+	scene_buffer = std::make_unique<Buffer>(
+		device,
+		sizeof(GpuInstance),
+		capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	for (uint32_t slot = 0; slot < scene_instances.size(); slot++)
+	{
+		stage_slot(slot);
+	}
+}
+
+void game_engine::GpuCullingSystem::write_frame_sets(FrameBuffers& frame)
+{
+	// The frame's earlier submissions are complete, so its sets can be rewritten in place
+	auto scene_info = scene_buffer->descriptor_info();
+	auto draw_commands_info = frame.draw_commands->descriptor_info();
+	auto counters_info = frame.counters->descriptor_info();
+	auto meshlet_work_info = frame.meshlet_work->descriptor_info();
+	DescriptorWriter writer(*instance_set_layout, *descriptor_allocator);
+	writer.write_buffer(0, &scene_info)
+	      .write_buffer(1, &draw_commands_info)
+	      .write_buffer(2, &counters_info)
+	      .write_buffer(3, &meshlet_work_info);
+	if (frame.descriptor_set != VK_NULL_HANDLE)
+	{
+		writer.overwrite(frame.descriptor_set);
+	}
+	else if (!writer.build(frame.descriptor_set))
+	{
+		throw std::runtime_error("Failed to build instance descriptor set");
+	}
+
+	auto updates_info = frame.updates->descriptor_info();
+	DescriptorWriter scatter_writer(*scatter_set_layout, *descriptor_allocator);
+	scatter_writer.write_buffer(0, &scene_info)
+	              .write_buffer(1, &updates_info);
+	if (frame.scatter_set != VK_NULL_HANDLE)
+	{
+		scatter_writer.overwrite(frame.scatter_set);
+	}
+	else if (!scatter_writer.build(frame.scatter_set))
+	{
+		throw std::runtime_error("Failed to build scatter descriptor set");
+	}
+
+	frame.bound_scene_buffer = scene_buffer.get();
+}
+
+void game_engine::GpuCullingSystem::create_compacted_indices(FrameBuffers& frame, uint32_t capacity)
+{
+	frame.compacted_capacity = capacity;
+
+	// Only this frame's submissions draw from it, and they are complete
+	frame.compacted_indices = std::make_unique<Buffer>(
+		device,
+		sizeof(uint32_t),
+		capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	write_meshlet_set(frame);
+}
+
+void game_engine::GpuCullingSystem::write_meshlet_set(FrameBuffers& frame)
+{
+	const GeometryPool& geometry_pool = device.get_geometry_pool();
+	auto meshlets_info = geometry_pool.get_meshlet_buffer_info();
+	auto indices16_info = geometry_pool.get_index_buffer_info(VK_INDEX_TYPE_UINT16);
+	auto indices32_info = geometry_pool.get_index_buffer_info(VK_INDEX_TYPE_UINT32);
+	auto compacted_info = frame.compacted_indices->descriptor_info();
+	DescriptorWriter(*meshlet_set_layout, *descriptor_allocator)
+		.write_buffer(0, &meshlets_info)
+		.write_buffer(1, &indices16_info)
+		.write_buffer(2, &indices32_info)
+		.write_buffer(3, &compacted_info)
+		.overwrite(frame.meshlet_set);
+	frame.geometry_generation = geometry_pool.get_generation();
+}
+
+void game_engine::GpuCullingSystem::create_pipeline_layout()
+{
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(CullPushConstants);
+
+	VkDescriptorSetLayout set_layout = instance_set_layout->get_descriptor_set_layout();
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	if (vkCreatePipelineLayout(
+		device.get_logical_device(),
+		&pipeline_layout_info,
+		nullptr,
+		&pipeline_layout
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling pipeline layout");
+	}
+}
+
+void game_engine::GpuCullingSystem::create_pipeline()
+{
+	pipeline_config_info pipeline_config{};
+	Pipeline::default_pipeline_config_info(pipeline_config);
+	pipeline_config.pipeline_layout = pipeline_layout;
+
+	// Small enough that startup does not notice, and nothing can be drawn without it
+	pipeline = std::make_unique<CullingPipeline>(
+		device,
+		"compiled_shaders/cull_instances.comp.spv",
+		pipeline_config
+	);
+}
+
+void game_engine::GpuCullingSystem::create_occlusion_pipeline()
+{
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(OcclusionPushConstants);
+
+	std::array<VkDescriptorSetLayout, 2> set_layouts{
+		instance_set_layout->get_descriptor_set_layout(),
+		occlusion_set_layout->get_descriptor_set_layout()
+	};
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+	pipeline_layout_info.pSetLayouts = set_layouts.data();
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	if (vkCreatePipelineLayout(
+		device.get_logical_device(),
+		&pipeline_layout_info,
+		nullptr,
+		&occlusion_pipeline_layout
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create occlusion culling pipeline layout");
+	}
+
+	pipeline_config_info pipeline_config{};
+	Pipeline::default_pipeline_config_info(pipeline_config);
+	pipeline_config.pipeline_layout = occlusion_pipeline_layout;
+
+	occlusion_pipeline = std::make_unique<CullingPipeline>(
+		device,
+		"compiled_shaders/cull_occlusion.comp.spv",
+		pipeline_config
+	);
+}
+
+void game_engine::GpuCullingSystem::create_meshlet_pipeline()
+{
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(MeshletPushConstants);
+
+	std::array<VkDescriptorSetLayout, 2> set_layouts{
+		instance_set_layout->get_descriptor_set_layout(),
+		meshlet_set_layout->get_descriptor_set_layout()
+	};
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+	pipeline_layout_info.pSetLayouts = set_layouts.data();
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	if (vkCreatePipelineLayout(
+		device.get_logical_device(),
+		&pipeline_layout_info,
+		nullptr,
+		&meshlet_pipeline_layout
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet culling pipeline layout");
+	}
+
+	pipeline_config_info pipeline_config{};
+	Pipeline::default_pipeline_config_info(pipeline_config);
+	pipeline_config.pipeline_layout = meshlet_pipeline_layout;
+
+	meshlet_pipeline = std::make_unique<CullingPipeline>(
+		device,
+		"compiled_shaders/cull_meshlets.comp.spv",
+		pipeline_config
+	);
+}
+
+void game_engine::GpuCullingSystem::create_scatter_pipeline()
+{
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(ScatterPushConstants);
+
+	VkDescriptorSetLayout set_layout = scatter_set_layout->get_descriptor_set_layout();
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	if (vkCreatePipelineLayout(
+		device.get_logical_device(),
+		&pipeline_layout_info,
+		nullptr,
+		&scatter_pipeline_layout
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create scatter pipeline layout");
+	}
+
+	pipeline_config_info pipeline_config{};
+	Pipeline::default_pipeline_config_info(pipeline_config);
+	pipeline_config.pipeline_layout = scatter_pipeline_layout;
+
+	scatter_pipeline = std::make_unique<CullingPipeline>(
+		device,
+		"compiled_shaders/scatter_instances.comp.spv",
+		pipeline_config
+	);
+}
+
+void game_engine::GpuCullingSystem::reset_draws(VkCommandBuffer command_buffer, FrameBuffers& frame, bool reset_statistics)
+{
+	vkCmdFillBuffer(
+		command_buffer,
+		frame.counters->get_buffer(),
+		0,
+		reset_statistics ? VK_WHOLE_SIZE : offsetof(Counters, drawn),
+		0
+	);
+	if (device.get_cmd_draw_indexed_indirect_count() == nullptr)
+	{
+		// Every slot is drawn, the ones past the visible count must be empty draws
+		vkCmdFillBuffer(command_buffer, frame.draw_commands->get_buffer(), 0, VK_WHOLE_SIZE, 0);
+	}
+	// Each instance pass queues its own meshlet work
+	MeshletWork meshlet_work{{0, 1, 1}, 0};
+	vkCmdUpdateBuffer(command_buffer, frame.meshlet_work->get_buffer(), 0, sizeof(MeshletWork), &meshlet_work);
+
+	// Also orders the previous frame's visibility writes before this frame reads them
+	VkMemoryBarrier clear_barrier{};
+	clear_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		1, &clear_barrier,
+		0, nullptr,
+		0, nullptr
+	);
+}
+
+void game_engine::GpuCullingSystem::finish_draws(VkCommandBuffer command_buffer, FrameBuffers& frame, bool read_back_counters)
+{
+	VkMemoryBarrier draw_barrier{};
+	draw_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	draw_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	draw_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &draw_barrier,
+		0, nullptr,
+		0, nullptr
+	);
+
+	if (!read_back_counters)
+	{
+		return;
+	}
+
+	VkBufferCopy copy{};
+	copy.size = sizeof(Counters);
+	vkCmdCopyBuffer(command_buffer, frame.counters->get_buffer(), frame.counters_readback->get_buffer(), 1, &copy);
+
+	VkMemoryBarrier readback_barrier{};
+	readback_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	readback_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	readback_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0,
+		1, &readback_barrier,
+		0, nullptr,
+		0, nullptr
+	);
+
+	frame.counters_pending = true;
+}
+
+void game_engine::GpuCullingSystem::dispatch_occlusion(VkCommandBuffer command_buffer, FrameBuffers& frame,
+                                                       const Camera& camera, bool late)
+{
+	occlusion_pipeline->bind(command_buffer);
+
+	std::array<VkDescriptorSet, 2> descriptor_sets{frame.descriptor_set, frame.occlusion_set};
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		occlusion_pipeline_layout,
+		0,
+		static_cast<uint32_t>(descriptor_sets.size()),
+		descriptor_sets.data(),
+		0,
+		nullptr
+	);
+
+	// Symmetric perspective projection with depth going from 0 at the near plane to 1 at the far one, see
+	// Camera::set_perspective_projection
+	const glm::mat4& projection = camera.get_projection_matrix();
+	glm::vec2 frustum_x = glm::normalize(glm::vec2(projection[0][0], 1.f));
+	glm::vec2 frustum_y = glm::normalize(glm::vec2(projection[1][1], 1.f));
+	VkExtent2D pyramid_extent = depth_pyramid->get_extent();
+
+	OcclusionPushConstants push{};
+	push.view = camera.get_view_matrix();
+	push.frustum = glm::vec4(frustum_x, frustum_y);
+	push.projection = glm::vec4(projection[0][0], projection[1][1], projection[2][2], projection[3][2]);
+	push.z_near = -projection[3][2] / projection[2][2];
+	push.z_far = projection[3][2] / (1.f - projection[2][2]);
+	push.pyramid_size = glm::vec2(pyramid_extent.width, pyramid_extent.height);
+	push.instance_count = frame.instance_count;
+	push.visibility_count = visibility_frame >= 0 ? visibility_count : 0;
+	push.late = late ? 1 : 0;
+	vkCmdPushConstants(
+		command_buffer,
+		occlusion_pipeline_layout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0,
+		sizeof(OcclusionPushConstants),
+		&push
+	);
+
+	vkCmdDispatch(command_buffer, (frame.instance_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+}
+
+void game_engine::GpuCullingSystem::dispatch_meshlets(VkCommandBuffer command_buffer, FrameBuffers& frame,
+                                                      const Camera& camera)
+{
+	if (frame.stream_counts[MESHLET_STREAM] == 0)
+	{
+		return;
+	}
+
+	// The instance pass queued the work and wrote the draws the meshlets add their triangles to
+	VkMemoryBarrier work_barrier{};
+	work_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	work_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	work_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0,
+		1, &work_barrier,
+		0, nullptr,
+		0, nullptr
+	);
+
+	meshlet_pipeline->bind(command_buffer);
+
+	std::array<VkDescriptorSet, 2> descriptor_sets{frame.descriptor_set, frame.meshlet_set};
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		meshlet_pipeline_layout,
+		0,
+		static_cast<uint32_t>(descriptor_sets.size()),
+		descriptor_sets.data(),
+		0,
+		nullptr
+	);
+
+	MeshletPushConstants push{};
+	push.frustum_planes = camera.get_frustum_planes();
+	push.camera_position = camera.get_inverse_view_matrix()[3];
+	push.draw_offset = MESHLET_STREAM * frame.instance_count;
+	vkCmdPushConstants(
+		command_buffer,
+		meshlet_pipeline_layout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0,
+		sizeof(MeshletPushConstants),
+		&push
+	);
+
+	vkCmdDispatchIndirect(command_buffer, frame.meshlet_work->get_buffer(), 0);
+}
+
+game_engine::CullingStatistics game_engine::GpuCullingSystem::get_statistics() const
+{
+	CullingStatistics statistics{};
+	if (upload_frames > 0)
+	{
+		statistics.uploaded_instances = static_cast<double>(total_uploaded_instances) / static_cast<double>(upload_frames);
+		statistics.scene_instances = static_cast<double>(total_scene_instances) / static_cast<double>(upload_frames);
+	}
+	if (counted_frames == 0)
+	{
+		return statistics;
+	}
+
+	double frames = static_cast<double>(counted_frames);
+	statistics.drawn = static_cast<double>(total_drawn) / frames;
+	statistics.frustum_culled = static_cast<double>(total_frustum_culled) / frames;
+	statistics.occlusion_culled = static_cast<double>(total_occlusion_culled) / frames;
+	statistics.meshlets_drawn = static_cast<double>(total_meshlets_drawn) / frames;
+	statistics.meshlets_culled = static_cast<double>(total_meshlets_culled) / frames;
+	return statistics;
+}
+
+void game_engine::GpuCullingSystem::print_statistics(std::ostream& out) const
+{
+	CullingStatistics statistics = get_statistics();
+	out << "GPU culling" << (depth_pyramid != nullptr ? " with occlusion" : "") << ": " << statistics.drawn
+		<< " drawn, " << statistics.frustum_culled << " frustum culled, " << statistics.occlusion_culled
+		<< " occlusion culled, " << statistics.meshlets_drawn << " / "
+		<< statistics.meshlets_drawn + statistics.meshlets_culled << " meshlets drawn, " << statistics.uploaded_instances
+		<< " / " << statistics.scene_instances << " instances uploaded per frame over " << counted_frames
+		<< " frames" << std::endl;
+}
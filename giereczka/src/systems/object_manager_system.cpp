@@ -8,63 +8,140 @@ game_engine::ObjectManagerSystem::~ObjectManagerSystem()
 {
 }
 
-void game_engine::ObjectManagerSystem::add_game_object(GameObject& game_object)
+game_engine::ObjectManagerSystem::id_t game_engine::ObjectManagerSystem::add_game_object(GameObject& game_object)
 {
-	for (auto& model : game_object.gltf_model->models) vertex_count += model->get_vertex_count();
-	id_t id = assign_id();
-	game_objects.emplace(id, std::move(game_object));
+	if (game_object.gltf_model != nullptr)
+	{
+		for (auto& model : game_object.gltf_model->models) vertex_count += model->get_vertex_count();
+	}
+
+	RenderComponent render{std::move(game_object.gltf_model), game_object.color};
+	BoundingBox box = get_world_bounding_box(game_object.transform, render);
+	id_t id = game_objects.insert(game_object.transform, std::move(render), SpatialProxy{}, std::move(game_object.name));
+	if (!box.is_empty())
+	{
+		game_objects.get<SpatialProxy>(id).proxy = spatial_index.create_proxy(box, id.index);
+	}
+
+	mark_changed(id);
+	return id;
 }
 
-void game_engine::ObjectManagerSystem::add_point_light(PointLightObject& point_light)
+game_engine::ObjectManagerSystem::id_t game_engine::ObjectManagerSystem::add_point_light(PointLightObject& point_light)
 {
-	id_t id = assign_id();
-	point_lights.emplace(id, std::move(point_light));
+	return point_lights.insert(std::move(point_light));
 }
 
 void game_engine::ObjectManagerSystem::move_game_object(id_t id, const glm::vec3& translation)
 {
-	game_objects[id].transform.translation = translation;
+	uint32_t dense = game_objects.find(id);
+	if (dense == GameObjectTable::NOT_FOUND) return;
+
+	auto& transform = game_objects.get<transform_component>()[dense];
+	// Like set_model_color, unchanged values would stage the object for upload again
+	if (transform.translation == translation) return;
+
+	glm::vec3 displacement = translation - transform.translation;
+	transform.translation = translation;
+	mark_changed(id);
+	update_proxy(dense, displacement);
 }
 
 void game_engine::ObjectManagerSystem::scale_game_object(id_t id, float scale)
 {
-	game_objects[id].transform.scale = scale;
+	uint32_t dense = game_objects.find(id);
+	if (dense == GameObjectTable::NOT_FOUND) return;
+
+	auto& transform = game_objects.get<transform_component>()[dense];
+	if (transform.scale == scale) return;
+
+	transform.scale = scale;
+	mark_changed(id);
+	update_proxy(dense);
 }
 
 void game_engine::ObjectManagerSystem::rotate_game_object(id_t id, const glm::vec3& rotation)
 {
-	game_objects[id].transform.rotation = rotation;
+	uint32_t dense = game_objects.find(id);
+	if (dense == GameObjectTable::NOT_FOUND) return;
+
+	auto& transform = game_objects.get<transform_component>()[dense];
+	if (transform.rotation == rotation) return;
+
+	transform.rotation = rotation;
+	mark_changed(id);
+	update_proxy(dense);
+}
+
+void game_engine::ObjectManagerSystem::update_bounds(id_t id)
+{
+	uint32_t dense = game_objects.find(id);
+	if (dense == GameObjectTable::NOT_FOUND) return;
+
+	mark_changed(id);
+	update_proxy(dense);
 }
 
 void game_engine::ObjectManagerSystem::set_model_color(id_t id, const glm::vec3& color)
 {
-	if (game_objects.find(id) == game_objects.end()) return;
-	game_objects[id].color = color;
+	uint32_t dense = game_objects.find(id);
+	if (dense == GameObjectTable::NOT_FOUND) return;
+
+	// Set every frame for the debug highlight, mostly to the color it already has
+	RenderComponent& render = game_objects.get<RenderComponent>()[dense];
+	if (render.color == color) return;
+
+	render.color = color;
+	mark_changed(id);
+}
+
+void game_engine::ObjectManagerSystem::take_scene_changes(std::vector<id_t>& changed, std::vector<id_t>& removed)
+{
+	changed.insert(changed.end(), changed_objects.begin(), changed_objects.end());
+	removed.insert(removed.end(), removed_objects.begin(), removed_objects.end());
+	changed_objects.clear();
+	removed_objects.clear();
 }
 
 void game_engine::ObjectManagerSystem::set_point_light_position(id_t id, const glm::vec3& position)
 {
-	point_lights[id].position = position;
+	if (point_lights.contains(id)) point_lights.get<PointLightObject>(id).position = position;
 }
 
 void game_engine::ObjectManagerSystem::set_point_light_intensity(id_t id, float intensity)
 {
-	point_lights[id].light_intensity = intensity;
+	if (point_lights.contains(id)) point_lights.get<PointLightObject>(id).light_intensity = intensity;
 }
 
 void game_engine::ObjectManagerSystem::set_point_light_radius(id_t id, float radius)
 {
-	point_lights[id].light_radius = radius;
+	if (point_lights.contains(id)) point_lights.get<PointLightObject>(id).light_radius = radius;
 }
 
 void game_engine::ObjectManagerSystem::set_point_light_color(id_t id, const glm::vec3& color)
 {
-	point_lights[id].light_color = color;
+	if (point_lights.contains(id)) point_lights.get<PointLightObject>(id).light_color = color;
 }
 
 void game_engine::ObjectManagerSystem::remove_game_object(id_t id)
 {
-	point_lights.erase(id);
+	uint32_t dense = game_objects.find(id);
+	if (dense == GameObjectTable::NOT_FOUND) return;
+
+	uint32_t proxy = game_objects.get<SpatialProxy>()[dense].proxy;
+	if (proxy != AabbTree::INVALID_NODE)
+	{
+		spatial_index.destroy_proxy(proxy);
+	}
+
+	const RenderComponent& render = game_objects.get<RenderComponent>()[dense];
+	if (render.gltf_model != nullptr)
+	{
+		for (auto& model : render.gltf_model->models) vertex_count -= model->get_vertex_count();
+	}
+
+	game_objects.erase(id);
+	removed_objects.push_back(id);
 }
 
 void game_engine::ObjectManagerSystem::remove_point_light(id_t id)
@@ -72,7 +149,81 @@ void game_engine::ObjectManagerSystem::remove_point_light(id_t id)
 	point_lights.erase(id);
 }
 
-game_engine::ObjectManagerSystem::id_t game_engine::ObjectManagerSystem::assign_id()
+void game_engine::ObjectManagerSystem::query_frustum(const std::array<glm::vec4, 6>& planes, std::vector<id_t>& ids) const
+{
+	spatial_index.query(planes, [&](uint32_t index)
+	{
+		ids.push_back(game_objects.get_handle(index));
+		return true;
+	});
+}
+
+void game_engine::ObjectManagerSystem::query_sphere(const glm::vec3& center, float radius, std::vector<id_t>& ids) const
+{
+	spatial_index.query(center, radius, [&](uint32_t index)
+	{
+		ids.push_back(game_objects.get_handle(index));
+		return true;
+	});
+}
+
+void game_engine::ObjectManagerSystem::query_box(const BoundingBox& box, std::vector<id_t>& ids) const
+{
+	spatial_index.query(box, [&](uint32_t index)
+	{
+		ids.push_back(game_objects.get_handle(index));
+		return true;
+	});
+}
+
+std::optional<game_engine::ObjectManagerSystem::id_t> game_engine::ObjectManagerSystem::ray_cast(
+	const glm::vec3& origin,
+	const glm::vec3& direction,
+	float max_distance,
+	float* distance
+) const
+{
+	std::optional<id_t> closest;
+	float closest_distance = max_distance;
+	spatial_index.ray_cast(origin, direction, max_distance, [&](uint32_t index, float hit_distance)
+	{
+		if (hit_distance < closest_distance || !closest)
+		{
+			closest = game_objects.get_handle(index);
+			closest_distance = hit_distance;
+		}
+		// Only closer boxes from here on
+		return closest_distance;
+	});
+
+	if (closest && distance != nullptr)
+	{
+		*distance = closest_distance;
+	}
+	return closest;
+}
+
+game_engine::BoundingBox game_engine::ObjectManagerSystem::get_world_bounding_box(
+	const transform_component& transform,
+	const RenderComponent& render
+) const
+{
+	if (render.gltf_model == nullptr)
+	{
+		return BoundingBox{};
+	}
+	return render.gltf_model->get_bounding_box().transformed(transform.matrix());
+}
+
+void game_engine::ObjectManagerSystem::update_proxy(uint32_t dense, const glm::vec3& displacement)
 {
-	return current_id++;
+	uint32_t proxy = game_objects.get<SpatialProxy>()[dense].proxy;
+	if (proxy != AabbTree::INVALID_NODE)
+	{
+		BoundingBox box = get_world_bounding_box(
+			game_objects.get<transform_component>()[dense],
+			game_objects.get<RenderComponent>()[dense]
+		);
+		spatial_index.move_proxy(proxy, box, displacement);
+	}
 }
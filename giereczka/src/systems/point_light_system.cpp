@@ -2,12 +2,13 @@
 
 game_engine::PointLightSystem::PointLightSystem(
 	Device& device,
+	JobSystem& job_system,
 	VkRenderPass render_pass,
 	VkDescriptorSetLayout global_set_layout
 ) : device(device)
 {
 	create_pipeline_layout(global_set_layout);
-	create_pipeline(render_pass);
+	create_pipeline(job_system, render_pass);
 }
 
 game_engine::PointLightSystem::~PointLightSystem()
@@ -15,6 +16,11 @@ game_engine::PointLightSystem::~PointLightSystem()
 	vkDestroyPipelineLayout(device.get_logical_device(), pipeline_layout, nullptr);
 }
 
+void game_engine::PointLightSystem::wait_for_pipelines()
+{
+	pipeline->wait();
+}
+
 void game_engine::PointLightSystem::create_pipeline_layout(VkDescriptorSetLayout global_set_layout)
 {
 	VkPushConstantRange push_constant_range{};
@@ -41,13 +47,11 @@ void game_engine::PointLightSystem::create_pipeline_layout(VkDescriptorSetLayout
 	}
 }
 
-void game_engine::PointLightSystem::create_pipeline(VkRenderPass render_pass)
+void game_engine::PointLightSystem::create_pipeline(JobSystem& job_system, VkRenderPass render_pass)
 {
 	assert(pipeline_layout != nullptr && "Cannot create pipeline before pipeline layout");
 	pipeline_config_info pipeline_config{};
 	Pipeline::default_pipeline_config_info(pipeline_config);
-	pipeline_config.vertex_attribute_descriptions.clear();
-	pipeline_config.vertex_binding_descriptions.clear();
 
 	pipeline_config.render_pass = render_pass;
 	pipeline_config.pipeline_layout = pipeline_layout;
@@ -55,11 +59,13 @@ void game_engine::PointLightSystem::create_pipeline(VkRenderPass render_pass)
 		device,
 		"compiled_shaders/point_light.vert.spv",
 		"compiled_shaders/point_light.frag.spv",
-		pipeline_config
+		pipeline_config,
+		&job_system,
+		PipelineCompileMode::background
 	);
 }
 
-void game_engine::PointLightSystem::update(ObjectManagerSystem::PointLightMap& point_lights, game_engine::GlobalUbo& global_ubo, float dt)
+void game_engine::PointLightSystem::update(const ObjectManagerSystem::PointLightTable& point_lights, game_engine::GlobalUbo& global_ubo, float dt)
 {
 	int light_index = 0;
 	
@@ -68,9 +74,8 @@ void game_engine::PointLightSystem::update(ObjectManagerSystem::PointLightMap& p
 	float wave_speed = 1.0f;
 	float wave_amplitude = 0.5f;
 
-	for (auto& point_light : point_lights)
+	for (const PointLightObject& obj : point_lights.get<PointLightObject>())
 	{
-		auto obj = point_light.second;
 		global_ubo.point_lights[light_index].position = glm::vec4(obj.position, 1.f);
 		global_ubo.point_lights[light_index].color = glm::vec4(obj.light_color, obj.light_intensity);
 
@@ -82,12 +87,15 @@ void game_engine::PointLightSystem::update(ObjectManagerSystem::PointLightMap& p
 
 void game_engine::PointLightSystem::render(
 	VkCommandBuffer command_buffer,
-	game_engine::ObjectManagerSystem::PointLightMap& point_lights,
+	const game_engine::ObjectManagerSystem::PointLightTable& point_lights,
 	const Camera& camera,
 	const VkDescriptorSet global_descriptor_set
 )
 {
-	pipeline->bind(command_buffer);
+	if (!pipeline->bind(command_buffer))
+	{
+		return;
+	}
 
 	vkCmdBindDescriptorSets(
 		command_buffer,
@@ -100,9 +108,8 @@ void game_engine::PointLightSystem::render(
 		nullptr
 	);
 
-	for (auto& point_light : point_lights)
+	for (const PointLightObject& obj : point_lights.get<PointLightObject>())
 	{
-		auto& obj = point_light.second;
 		PointLightPushConstants push_constants{};
 		push_constants.light_position = glm::vec4(obj.position, 1.f);
 		push_constants.light_color = glm::vec4(obj.light_color, obj.light_intensity);
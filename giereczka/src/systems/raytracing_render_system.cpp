@@ -5,6 +5,7 @@
 
 game_engine::RaytracingRenderSystem::RaytracingRenderSystem(
     Device &device,
+    JobSystem &job_system,
     VkRenderPass render_pass,
     VkDescriptorSetLayout global_set_layout,
     VkDescriptorSetLayout joint_set_layout,
@@ -13,7 +14,7 @@ game_engine::RaytracingRenderSystem::RaytracingRenderSystem(
 ) : device(device)
 {
     create_raytracing_pipeline_layout(global_set_layout, joint_set_layout, materials_set_layout, mesh_data_set_layout);
-    create_raytracing_pipeline(render_pass);
+    create_raytracing_pipeline(job_system, render_pass);
 }
 
 game_engine::RaytracingRenderSystem::~RaytracingRenderSystem()
@@ -23,7 +24,7 @@ game_engine::RaytracingRenderSystem::~RaytracingRenderSystem()
 
 void game_engine::RaytracingRenderSystem::render_raytraced_scene(
     VkCommandBuffer command_buffer,
-    game_engine::ObjectManagerSystem::ObjectMap &
+    game_engine::ObjectManagerSystem::GameObjectTable &
     game_objects, const Camera &camera,
     const VkDescriptorSet global_descriptor_set,
     const VkDescriptorSet joint_descriptor_set,
@@ -33,6 +34,13 @@ void game_engine::RaytracingRenderSystem::render_raytraced_scene(
     uint32_t height
 )
 {
+    // Starts the compile on the first call, frames are skipped until it is done
+    if (!raytracing_pipeline->is_ready())
+    {
+        raytracing_pipeline->request();
+        return;
+    }
+
     VkImage output_image{};
 
     // Transition the output image to general layout
@@ -138,7 +146,7 @@ void game_engine::RaytracingRenderSystem::create_raytracing_pipeline_layout(
     }
 }
 
-void game_engine::RaytracingRenderSystem::create_raytracing_pipeline(VkRenderPass render_pass)
+void game_engine::RaytracingRenderSystem::create_raytracing_pipeline(JobSystem &job_system, VkRenderPass render_pass)
 {
     assert(raytracing_pipeline_layout != nullptr && "Cannot create pipeline before pipeline layout");
     pipeline_config_info pipeline_config{};
@@ -149,21 +157,23 @@ void game_engine::RaytracingRenderSystem::create_raytracing_pipeline(VkRenderPas
     raytracing_pipeline = std::make_unique<RaytracingPipeline>(
         device,
         "compiled_shaders/raytracing_compute_shader.comp.spv",
-        pipeline_config
+        pipeline_config,
+        &job_system,
+        PipelineCompileMode::on_first_use
     );
 }
 
 void game_engine::RaytracingRenderSystem::create_mesh_storage_buffers(
-    game_engine::ObjectManagerSystem::ObjectMap &game_objects)
+    game_engine::ObjectManagerSystem::GameObjectTable &game_objects)
 {
     std::vector<Model::Vertex> all_vertices;
     std::vector<uint32_t> all_indices;
 
     // Collect all vertex and index data from game objects
-    for (auto& obj : game_objects) {
-        if (obj.second.gltf_model == nullptr) continue;
+    for (const RenderComponent& render : game_objects.get<RenderComponent>()) {
+        if (render.gltf_model == nullptr) continue;
 
-        for (auto& model : obj.second.gltf_model->models) {
+        for (auto& model : render.gltf_model->models) {
             if (model == nullptr) continue;
 
             // You'll need to add methods to get vertices and indices from your Model class
@@ -1,26 +1,62 @@
 #include "render_system.h"
 
 #include "pipelines/wireframe_pipeline.h"
+#include "geometry_pool.h"
+
+#include <algorithm>
+#include <chrono>
 
 game_engine::RenderSystem::RenderSystem(
 	Device& device,
+	JobSystem& job_system,
 	VkRenderPass render_pass,
 	VkDescriptorSetLayout global_set_layout,
 	VkDescriptorSetLayout joint_set_layout,
-	VkDescriptorSetLayout materials_set_layout
-) : device(device)
+	VkDescriptorSetLayout materials_set_layout,
+	int frames_in_flight,
+	GpuCullingSystem* gpu_culling_system
+) : device(device), gpu_culling_system(gpu_culling_system)
 {
+	instance_set_layout = DescriptorSetLayout::Builder{device}
+	                      .add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+	                      .build();
+
+	frame_instances.resize(frames_in_flight);
+	for (FrameInstances& frame : frame_instances)
+	{
+		create_instance_buffer(frame, INITIAL_INSTANCE_CAPACITY);
+	}
+
 	create_main_pipeline_layout(global_set_layout, joint_set_layout, materials_set_layout);
-	create_main_pipeline(render_pass);
+	create_main_pipeline(job_system, render_pass);
 
 	create_wireframe_pipeline_layout(global_set_layout, joint_set_layout, materials_set_layout);
-	create_wireframe_pipeline(render_pass);
+	create_wireframe_pipeline(job_system, render_pass);
+
+	if (gpu_culling_system != nullptr)
+	{
+		create_indirect_pipeline_layout(global_set_layout, joint_set_layout, materials_set_layout);
+		create_indirect_pipeline(job_system, render_pass);
+	}
 }
 
 game_engine::RenderSystem::~RenderSystem()
 {
 	vkDestroyPipelineLayout(device.get_logical_device(), pipeline_layout, nullptr);
 	vkDestroyPipelineLayout(device.get_logical_device(), wireframe_pipeline_layout, nullptr);
+	if (indirect_pipeline_layout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(device.get_logical_device(), indirect_pipeline_layout, nullptr);
+	}
+}
+
+void game_engine::RenderSystem::wait_for_pipelines()
+{
+	pipeline->wait();
+	if (indirect_pipeline != nullptr)
+	{
+		indirect_pipeline->wait();
+	}
 }
 
 void game_engine::RenderSystem::create_main_pipeline_layout(
@@ -29,12 +65,19 @@ void game_engine::RenderSystem::create_main_pipeline_layout(
 	VkDescriptorSetLayout materials_set_layout
 )
 {
+	// Everything per object comes from the instance buffer
 	VkPushConstantRange push_constant_range{};
-	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	push_constant_range.offset = 0;
-	push_constant_range.size = sizeof(PushConstantData);
+	push_constant_range.size = sizeof(InstancedPushConstantData);
 
-	std::vector<VkDescriptorSetLayout> descriptor_set_layouts{ global_set_layout, joint_set_layout, materials_set_layout };
+	std::vector<VkDescriptorSetLayout> descriptor_set_layouts{
+		global_set_layout,
+		joint_set_layout,
+		materials_set_layout,
+		device.get_geometry_pool().get_descriptor_set_layout(),
+		instance_set_layout->get_descriptor_set_layout()
+	};
 
 	VkPipelineLayoutCreateInfo pipeline_layout_info{};
 	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -53,7 +96,7 @@ void game_engine::RenderSystem::create_main_pipeline_layout(
 	}
 }
 
-void game_engine::RenderSystem::create_main_pipeline(VkRenderPass render_pass)
+void game_engine::RenderSystem::create_main_pipeline(JobSystem& job_system, VkRenderPass render_pass)
 {
 	assert(pipeline_layout != nullptr && "Cannot create pipeline before pipeline layout");
 	pipeline_config_info pipeline_config{};
@@ -61,12 +104,24 @@ void game_engine::RenderSystem::create_main_pipeline(VkRenderPass render_pass)
 
 	pipeline_config.render_pass = render_pass;
 	pipeline_config.pipeline_layout = pipeline_layout;
+
+	// Unlit and cheap to compile, so it is the only pipeline startup waits for
+	fallback_pipeline = std::make_unique<MainPipeline>(
+		device,
+		"compiled_shaders/vert_shader.vert.spv",
+		"compiled_shaders/fallback_shader.frag.spv",
+		pipeline_config
+	);
+
 	pipeline = std::make_unique<MainPipeline>(
 		device,
 		"compiled_shaders/vert_shader.vert.spv",
 		"compiled_shaders/frag_shader.frag.spv",
-		pipeline_config
+		pipeline_config,
+		&job_system,
+		PipelineCompileMode::background
 	);
+	pipeline->set_fallback(fallback_pipeline.get());
 }
 
 void game_engine::RenderSystem::create_wireframe_pipeline_layout(
@@ -80,7 +135,12 @@ void game_engine::RenderSystem::create_wireframe_pipeline_layout(
 	push_constant_range.offset = 0;
 	push_constant_range.size = sizeof(PushConstantData);
 
-	std::vector<VkDescriptorSetLayout> descriptor_set_layouts{ global_set_layout, joint_set_layout, materials_set_layout };
+	std::vector<VkDescriptorSetLayout> descriptor_set_layouts{
+		global_set_layout,
+		joint_set_layout,
+		materials_set_layout,
+		device.get_geometry_pool().get_descriptor_set_layout()
+	};
 
 	VkPipelineLayoutCreateInfo pipeline_layout_info{};
 	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -99,7 +159,7 @@ void game_engine::RenderSystem::create_wireframe_pipeline_layout(
 	}
 }
 
-void game_engine::RenderSystem::create_wireframe_pipeline(VkRenderPass render_pass)
+void game_engine::RenderSystem::create_wireframe_pipeline(JobSystem& job_system, VkRenderPass render_pass)
 {
 	assert(wireframe_pipeline_layout != nullptr && "Cannot create pipeline before pipeline layout");
 	pipeline_config_info pipeline_config{};
@@ -112,22 +172,401 @@ void game_engine::RenderSystem::create_wireframe_pipeline(VkRenderPass render_pa
 		"compiled_shaders/wireframe_vert_shader.vert.spv",
 		"compiled_shaders/wireframe_geom_shader.geom.spv",
 		"compiled_shaders/wireframe_frag_shader.frag.spv",
-		pipeline_config
+		pipeline_config,
+		&job_system,
+		PipelineCompileMode::on_first_use
 	);
 }
 
-void game_engine::RenderSystem::render_game_objects(
-	VkCommandBuffer command_buffer,
-	game_engine::ObjectManagerSystem::ObjectMap& game_objects,
+void game_engine::RenderSystem::create_indirect_pipeline_layout(
+	VkDescriptorSetLayout global_set_layout,
+	VkDescriptorSetLayout joint_set_layout,
+	VkDescriptorSetLayout materials_set_layout
+)
+{
+	// Everything per object comes from the instance buffer, so there are no push constants
+	std::vector<VkDescriptorSetLayout> descriptor_set_layouts{
+		global_set_layout,
+		joint_set_layout,
+		materials_set_layout,
+		device.get_geometry_pool().get_descriptor_set_layout(),
+		gpu_culling_system->get_instance_set_layout()
+	};
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(descriptor_set_layouts.size());
+	pipeline_layout_info.pSetLayouts = descriptor_set_layouts.data();
+	pipeline_layout_info.pushConstantRangeCount = 0;
+	pipeline_layout_info.pPushConstantRanges = nullptr;
+	if (vkCreatePipelineLayout(
+		device.get_logical_device(),
+		&pipeline_layout_info,
+		nullptr,
+		&indirect_pipeline_layout
+	) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create pipeline layout");
+	}
+}
+
+void game_engine::RenderSystem::create_indirect_pipeline(JobSystem& job_system, VkRenderPass render_pass)
+{
+	assert(indirect_pipeline_layout != nullptr && "Cannot create pipeline before pipeline layout");
+	pipeline_config_info pipeline_config{};
+	Pipeline::default_pipeline_config_info(pipeline_config);
+
+	pipeline_config.render_pass = render_pass;
+	pipeline_config.pipeline_layout = indirect_pipeline_layout;
+
+	// Until it is ready objects are drawn one by one with the main pipeline or its fallback
+	indirect_pipeline = std::make_unique<MainPipeline>(
+		device,
+		"compiled_shaders/indirect_vert_shader.vert.spv",
+		"compiled_shaders/frag_shader.frag.spv",
+		pipeline_config,
+		&job_system,
+		PipelineCompileMode::background
+	);
+}
+
+void game_engine::RenderSystem::record_game_objects(
+	JobSystem& job_system,
+	ThreadCommandPools& command_pools,
+	int frame_index,
+	const SecondaryRecordingInfo& recording_info,
+	DescriptorAllocator& frame_descriptor_allocator,
+	const ObjectManagerSystem::GameObjectTable& game_objects,
 	const Camera& camera,
 	const VkDescriptorSet global_descriptor_set,
 	const VkDescriptorSet joint_descriptor_set,
-	const VkDescriptorSet texture_descriptor_set
+	const VkDescriptorSet texture_descriptor_set,
+	bool wireframe,
+	std::vector<VkCommandBuffer>& secondary_command_buffers,
+	std::vector<VkCommandBuffer>& late_command_buffers
 )
 {
-	pipeline->bind(command_buffer);
+	assert(command_pools.get_thread_count() >= job_system.get_thread_count() && "Every worker needs its own command pool");
+	occlusion_statistics = {};
+	render_statistics = {};
+
+	if (gpu_culling_system != nullptr && !wireframe && indirect_pipeline->is_ready())
+	{
+		record_indirect_game_objects(
+			job_system,
+			command_pools,
+			frame_index,
+			recording_info,
+			game_objects,
+			camera,
+			global_descriptor_set,
+			joint_descriptor_set,
+			texture_descriptor_set,
+			secondary_command_buffers,
+			late_command_buffers
+		);
+		return;
+	}
+
+	// The world boxes come from the bind pose, animations moving vertices far outside it can pop at the
+	// edges
+	collect_game_objects(game_objects);
+	frustum_culler.clear();
+	frustum_culler.reserve(world_boxes.size());
+	for (const BoundingBox& world_box : world_boxes)
+	{
+		frustum_culler.add(world_box);
+	}
 
-	std::vector<VkDescriptorSet> descriptor_sets{ global_descriptor_set, joint_descriptor_set, texture_descriptor_set };
+	// Visible indices are ascending, so the list can be compacted in place
+	visible_objects.clear();
+	frustum_culler.cull(camera.get_frustum_planes(), visible_objects);
+	for (size_t i = 0; i < visible_objects.size(); i++)
+	{
+		draw_list[i] = draw_list[visible_objects[i]];
+		world_boxes[i] = world_boxes[visible_objects[i]];
+	}
+	draw_list.resize(visible_objects.size());
+	world_boxes.resize(visible_objects.size());
+
+	if (software_occlusion_culling)
+	{
+		cull_occluded_objects(job_system, camera);
+	}
+
+	// The wireframe pipeline compiles on first use, keep drawing shaded until it is ready
+	if (wireframe && !wireframe_pipeline->is_ready())
+	{
+		wireframe_pipeline->request();
+		wireframe = false;
+	}
+
+	// Shaded chunks take instance groups, wireframe ones queue entries
+	build_render_queue(&job_system, camera, wireframe ? DrawPipeline::wireframe : DrawPipeline::main);
+	size_t draw_count = render_queue.size();
+	if (!wireframe)
+	{
+		write_instance_groups(&job_system, frame_index, frame_descriptor_allocator);
+		draw_count = instance_groups.size();
+	}
+
+	// Fewer, larger chunks than the default, every chunk pays for a command buffer begin and pipeline bind
+	size_t chunk_count = static_cast<size_t>(job_system.get_thread_count()) * 2;
+	size_t grain_size = std::max<size_t>(64, (draw_count + chunk_count - 1) / chunk_count);
+	chunk_command_buffers.assign((draw_count + grain_size - 1) / grain_size, VK_NULL_HANDLE);
+	chunk_statistics.assign(chunk_command_buffers.size(), {});
+
+	job_system.parallel_for(draw_count, grain_size, [&](uint32_t worker_index, size_t begin, size_t end)
+	{
+		VkCommandBuffer command_buffer = command_pools.begin_secondary(frame_index, worker_index, recording_info);
+
+		// With nothing ready to draw with yet the chunk is submitted empty
+		RecordingState state{};
+		if (wireframe && bind_wireframe_pipeline(command_buffer, global_descriptor_set, joint_descriptor_set, state))
+		{
+			draw_wireframe_entries(command_buffer, begin, end, state);
+		}
+		else if (!wireframe && bind_main_pipeline(command_buffer, global_descriptor_set, joint_descriptor_set, texture_descriptor_set, state))
+		{
+			draw_instance_groups(command_buffer, begin, end, state);
+		}
+
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record secondary command buffer");
+		}
+
+		chunk_command_buffers[begin / grain_size] = command_buffer;
+		chunk_statistics[begin / grain_size] = state.statistics;
+	});
+
+	for (VkCommandBuffer command_buffer : chunk_command_buffers)
+	{
+		if (command_buffer != VK_NULL_HANDLE)
+		{
+			secondary_command_buffers.push_back(command_buffer);
+		}
+	}
+	for (const RenderStatistics& statistics : chunk_statistics)
+	{
+		render_statistics += statistics;
+	}
+}
+
+void game_engine::RenderSystem::collect_game_objects(const ObjectManagerSystem::GameObjectTable& game_objects)
+{
+	handles = game_objects.get_handles();
+	transforms = game_objects.get<transform_component>();
+	renders = game_objects.get<RenderComponent>();
+	// Reused slots start from their previous object's level, which only matters within the hysteresis band
+	object_lods.resize(game_objects.get_slot_count(), 0);
+
+	draw_list.clear();
+	world_boxes.clear();
+	for (uint32_t i = 0; i < renders.size(); i++)
+	{
+		if (renders[i].gltf_model != nullptr)
+		{
+			draw_list.push_back(i);
+			world_boxes.push_back(renders[i].gltf_model->get_bounding_box().transformed(transforms[i].matrix()));
+		}
+	}
+}
+
+uint32_t game_engine::RenderSystem::select_lod(ObjectHandle handle, const BoundingBox& world_box, const Camera& camera)
+{
+	// Height of the bounding sphere over the screen height, P[1][1] is the cotangent of half the vertical
+	// field of view
+	glm::vec3 camera_position = camera.get_inverse_view_matrix()[3];
+	float radius = glm::length(world_box.get_extent());
+	float distance = std::max(glm::length(world_box.get_center() - camera_position), radius);
+	float size = radius * std::abs(camera.get_projection_matrix()[1][1]) / std::max(distance, 1e-6f);
+
+	uint32_t lod = std::min(object_lods[handle.index], Model::MAX_LOD_COUNT - 1);
+	while (lod + 1 < Model::MAX_LOD_COUNT && size < LOD_SCREEN_SIZE / static_cast<float>(1u << lod) * (1.f - LOD_HYSTERESIS))
+	{
+		lod++;
+	}
+	while (lod > 0 && size > LOD_SCREEN_SIZE / static_cast<float>(1u << (lod - 1)) * (1.f + LOD_HYSTERESIS))
+	{
+		lod--;
+	}
+	object_lods[handle.index] = lod;
+	return lod;
+}
+
+void game_engine::RenderSystem::cull_occluded_objects(JobSystem& job_system, const Camera& camera)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	occlusion_culler.begin_frame(camera.get_projection_matrix() * camera.get_view_matrix());
+
+	// Skinned meshes are rasterized in their bind pose, which is not where they are drawn
+	glm::vec3 camera_position = camera.get_inverse_view_matrix()[3];
+	occluder_candidates.clear();
+	for (uint32_t i = 0; i < draw_list.size(); i++)
+	{
+		const GltfModel& model = *renders[draw_list[i]].gltf_model;
+		if (model.animations != nullptr && model.skeleton != nullptr)
+		{
+			continue;
+		}
+
+		float radius = glm::length(world_boxes[i].get_extent());
+		float distance = glm::length(world_boxes[i].get_center() - camera_position);
+		float size = radius / std::max(distance, 1e-3f);
+		if (size >= MIN_OCCLUDER_SIZE)
+		{
+			occluder_candidates.emplace_back(size, i);
+		}
+	}
+
+	size_t occluder_count = std::min<size_t>(occluder_candidates.size(), MAX_OCCLUDERS);
+	std::partial_sort(
+		occluder_candidates.begin(),
+		occluder_candidates.begin() + occluder_count,
+		occluder_candidates.end(),
+		[](const auto& a, const auto& b) { return a.first > b.first; }
+	);
+
+	for (size_t i = 0; i < occluder_count; i++)
+	{
+		uint32_t object = draw_list[occluder_candidates[i].second];
+		glm::mat4 model_matrix = transforms[object].matrix();
+		for (const auto& model : renders[object].gltf_model->models)
+		{
+			if (model == nullptr) continue;
+
+			size_t triangle_count = model->get_indices().empty()
+				? model->get_vertices().size() / 3
+				: model->get_indices().size() / 3;
+			if (occlusion_culler.get_occluder_triangle_count() + triangle_count > MAX_OCCLUDER_TRIANGLES)
+			{
+				continue;
+			}
+			occlusion_culler.add_occluder(*model, model_matrix);
+		}
+	}
+
+	occlusion_culler.render_occluders(job_system);
+	auto rasterized = std::chrono::high_resolution_clock::now();
+
+	object_visibility.assign(draw_list.size(), 1);
+	job_system.parallel_for(draw_list.size(), [&](uint32_t, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			object_visibility[i] = occlusion_culler.is_visible(world_boxes[i]) ? 1 : 0;
+		}
+	});
+
+	size_t visible_count = 0;
+	for (size_t i = 0; i < draw_list.size(); i++)
+	{
+		if (object_visibility[i] != 0)
+		{
+			draw_list[visible_count] = draw_list[i];
+			world_boxes[visible_count] = world_boxes[i];
+			visible_count++;
+		}
+	}
+
+	occlusion_statistics.occluders = occlusion_culler.get_occluder_count();
+	occlusion_statistics.occluder_triangles = occlusion_culler.get_occluder_triangle_count();
+	occlusion_statistics.tested = static_cast<uint32_t>(draw_list.size());
+	occlusion_statistics.occluded = static_cast<uint32_t>(draw_list.size() - visible_count);
+	occlusion_statistics.rasterize_ms = std::chrono::duration<double, std::milli>(rasterized - start).count();
+	occlusion_statistics.test_ms = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - rasterized).count();
+
+	draw_list.resize(visible_count);
+	world_boxes.resize(visible_count);
+}
+
+void game_engine::RenderSystem::record_indirect_game_objects(
+	JobSystem& job_system,
+	ThreadCommandPools& command_pools,
+	int frame_index,
+	const SecondaryRecordingInfo& recording_info,
+	const ObjectManagerSystem::GameObjectTable& game_objects,
+	const Camera& camera,
+	const VkDescriptorSet global_descriptor_set,
+	const VkDescriptorSet joint_descriptor_set,
+	const VkDescriptorSet texture_descriptor_set,
+	std::vector<VkCommandBuffer>& secondary_command_buffers,
+	std::vector<VkCommandBuffer>& late_command_buffers
+)
+{
+	// Every object gets a level of detail, culled or not
+	object_lods.resize(game_objects.get_slot_count(), 0);
+	gpu_culling_system->write_instances(frame_index, game_objects, [&](ObjectHandle handle, const BoundingBox& world_box)
+	{
+		return select_lod(handle, world_box, camera);
+	});
+
+	// A handful of commands whatever the object count, not worth spreading over the workers. Both
+	// occlusion culling phases draw from the same buffers, the second pass just gets its own copy.
+	auto record_draws = [&]
+	{
+		VkCommandBuffer command_buffer = command_pools.begin_secondary(frame_index, job_system.get_worker_index(), recording_info);
+
+		indirect_pipeline->bind(command_buffer);
+
+		std::array<VkDescriptorSet, 3> descriptor_sets{ global_descriptor_set, joint_descriptor_set, texture_descriptor_set };
+		vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			indirect_pipeline_layout,
+			0,
+			descriptor_sets.size(),
+			descriptor_sets.data(),
+			0,
+			nullptr
+		);
+		device.get_geometry_pool().bind(command_buffer, indirect_pipeline_layout, GEOMETRY_SET);
+
+		VkDescriptorSet instance_set = gpu_culling_system->get_instance_set(frame_index);
+		vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			indirect_pipeline_layout,
+			INSTANCE_SET,
+			1,
+			&instance_set,
+			0,
+			nullptr
+		);
+
+		gpu_culling_system->draw(command_buffer, frame_index);
+
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record secondary command buffer");
+		}
+		return command_buffer;
+	};
+
+	secondary_command_buffers.push_back(record_draws());
+	if (gpu_culling_system->is_occlusion_culling())
+	{
+		late_command_buffers.push_back(record_draws());
+	}
+}
+
+bool game_engine::RenderSystem::bind_main_pipeline(
+	VkCommandBuffer command_buffer,
+	const VkDescriptorSet global_descriptor_set,
+	const VkDescriptorSet joint_descriptor_set,
+	const VkDescriptorSet texture_descriptor_set,
+	RecordingState& state
+)
+{
+	if (!pipeline->bind(command_buffer))
+	{
+		return false;
+	}
+
+	std::array<VkDescriptorSet, 3> descriptor_sets{ global_descriptor_set, joint_descriptor_set, texture_descriptor_set };
 
 	vkCmdBindDescriptorSets(
 		command_buffer,
@@ -139,43 +578,30 @@ void game_engine::RenderSystem::render_game_objects(
 		0,
 		nullptr
 	);
+	device.get_geometry_pool().bind(command_buffer, pipeline_layout, GEOMETRY_SET);
 
-	for (auto& obj : game_objects)
-	{
-		if (obj.second.gltf_model == nullptr) continue;
-		for (auto& model : obj.second.gltf_model->models)
-		{
-			PushConstantData push{};
-			if (model == nullptr) continue;
-			push.model_matrix = obj.second.transform.matrix();
-			push.color = obj.second.color;
-			push.texture_index = obj.second.gltf_model->texture_id;
-			
-			vkCmdPushConstants(
-				command_buffer,
-				pipeline_layout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(PushConstantData),
-				&push
-			);
-			model->bind(command_buffer);
-			model->draw(command_buffer);
-		}
-	}
+	// The geometry pool binds its 16-bit index buffer along with its descriptor set
+	state.index_type = VK_INDEX_TYPE_UINT16;
+	state.vertex_layout.reset();
+	state.statistics.pipeline_binds++;
+	state.statistics.descriptor_set_binds += 2;
+	state.statistics.index_buffer_binds++;
+	return true;
 }
 
-void game_engine::RenderSystem::render_wireframe_game_objects(
+bool game_engine::RenderSystem::bind_wireframe_pipeline(
 	VkCommandBuffer command_buffer,
-	game_engine::ObjectManagerSystem::ObjectMap& game_objects,
-	const Camera& camera,
 	const VkDescriptorSet global_descriptor_set,
-	const VkDescriptorSet joint_descriptor_set
+	const VkDescriptorSet joint_descriptor_set,
+	RecordingState& state
 )
 {
-	wireframe_pipeline->bind(command_buffer);
+	if (!wireframe_pipeline->bind(command_buffer))
+	{
+		return false;
+	}
 
-	std::vector<VkDescriptorSet> descriptor_sets{ global_descriptor_set, joint_descriptor_set };
+	std::array<VkDescriptorSet, 2> descriptor_sets{ global_descriptor_set, joint_descriptor_set };
 
 	vkCmdBindDescriptorSets(
 		command_buffer,
@@ -187,27 +613,226 @@ void game_engine::RenderSystem::render_wireframe_game_objects(
 		0,
 		nullptr
 	);
+	device.get_geometry_pool().bind(command_buffer, wireframe_pipeline_layout, GEOMETRY_SET);
+
+	state.index_type = VK_INDEX_TYPE_UINT16;
+	state.vertex_layout.reset();
+	state.statistics.pipeline_binds++;
+	state.statistics.descriptor_set_binds += 2;
+	state.statistics.index_buffer_binds++;
+	return true;
+}
+
+void game_engine::RenderSystem::bind_index_buffer(VkCommandBuffer command_buffer, const Model& model, RecordingState& state) const
+{
+	const GeometryAllocation& geometry = model.get_geometry();
+	if (geometry.index_count == 0 || geometry.index_type == state.index_type)
+	{
+		return;
+	}
+
+	device.get_geometry_pool().bind_index_buffer(command_buffer, geometry.index_type);
+	state.index_type = geometry.index_type;
+	state.statistics.index_buffer_binds++;
+}
+
+void game_engine::RenderSystem::build_render_queue(JobSystem* job_system, const Camera& camera, DrawPipeline draw_pipeline)
+{
+	if (job_system == nullptr)
+	{
+		for (size_t i = 0; i < draw_list.size(); i++)
+		{
+			select_lod(handles[draw_list[i]], world_boxes[i], camera);
+		}
+	}
+	else
+	{
+		job_system->parallel_for(draw_list.size(), [&](uint32_t, size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				select_lod(handles[draw_list[i]], world_boxes[i], camera);
+			}
+		});
+	}
 
-	for (auto& obj : game_objects)
+	// Objects past a model's coarsest level draw that level, and share its key
+	glm::vec3 camera_position = camera.get_inverse_view_matrix()[3];
+	instance_refs.clear();
+	render_queue.clear();
+	render_queue.reserve(draw_list.size());
+	for (uint32_t object = 0; object < draw_list.size(); object++)
 	{
-		for (auto& model : obj.second.gltf_model->models)
+		float depth = glm::length(world_boxes[object].get_center() - camera_position);
+		uint32_t object_lod = object_lods[handles[draw_list[object]].index];
+		for (const auto& model : renders[draw_list[object]].gltf_model->models)
 		{
-			PushConstantData push{};
 			if (model == nullptr) continue;
-			push.model_matrix = obj.second.transform.matrix();
-			push.color = obj.second.color;
-			push.texture_index = -1;  // No textures in wireframe mode
-			
+
+			uint32_t lod = std::min(object_lod, model->get_lod_count() - 1);
+			uint64_t key = make_draw_key(
+				draw_pipeline,
+				model->get_vertex_layout(),
+				model->get_geometry().index_type,
+				model->get_id(),
+				lod,
+				depth
+			);
+			render_queue.push(key, static_cast<uint32_t>(instance_refs.size()));
+			instance_refs.push_back({model.get(), lod, object});
+		}
+	}
+
+	if (draw_sorting)
+	{
+		auto start = std::chrono::steady_clock::now();
+		render_queue.sort(job_system);
+		render_statistics.sort_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void game_engine::RenderSystem::write_instance_groups(JobSystem* job_system, int frame_index, DescriptorAllocator& frame_descriptor_allocator)
+{
+	FrameInstances& frame = frame_instances[frame_index];
+	if (render_queue.size() > frame.capacity)
+	{
+		uint32_t capacity = frame.capacity;
+		while (capacity < render_queue.size())
+		{
+			capacity *= 2;
+		}
+		create_instance_buffer(frame, capacity);
+	}
+
+	std::span<const uint32_t> entries = render_queue.get_values();
+	auto* instances = static_cast<InstanceData*>(frame.buffer->get_mapped_memory());
+	auto write_instances = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const InstanceRef& instance_ref = instance_refs[entries[i]];
+			uint32_t object = draw_list[instance_ref.object];
+
+			InstanceData& instance = instances[i];
+			instance.model_matrix = transforms[object].matrix() * instance_ref.model->get_dequantization_matrix();
+			instance.color = renders[object].color;
+			instance.texture_index = renders[object].gltf_model->texture_id;
+		}
+	};
+	if (job_system == nullptr)
+	{
+		write_instances(0, entries.size());
+	}
+	else
+	{
+		job_system->parallel_for(entries.size(), [&](uint32_t, size_t begin, size_t end) { write_instances(begin, end); });
+	}
+	frame.buffer->flush();
+
+	// Transient, the allocator drops it once the frame slot comes around again
+	auto buffer_info = frame.buffer->descriptor_info();
+	if (!DescriptorWriter(*instance_set_layout, frame_descriptor_allocator)
+	     .write_buffer(0, &buffer_info)
+	     .build(instance_set))
+	{
+		throw std::runtime_error("Failed to build instance descriptor set");
+	}
+
+	// Sorted, every model and level of detail is a single run. Unsorted, runs only form by chance.
+	instance_groups.clear();
+	for (uint32_t i = 0; i < entries.size(); i++)
+	{
+		const InstanceRef& instance_ref = instance_refs[entries[i]];
+		if (instance_groups.empty() || instance_groups.back().model != instance_ref.model || instance_groups.back().lod != instance_ref.lod)
+		{
+			instance_groups.push_back({instance_ref.model, instance_ref.lod, i, 0});
+		}
+		instance_groups.back().instance_count++;
+	}
+}
+
+void game_engine::RenderSystem::draw_instance_groups(VkCommandBuffer command_buffer, size_t begin, size_t end, RecordingState& state) const
+{
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		pipeline_layout,
+		INSTANCE_SET,
+		1,
+		&instance_set,
+		0,
+		nullptr
+	);
+	state.statistics.descriptor_set_binds++;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const InstanceGroup& group = instance_groups[i];
+
+		if (state.vertex_layout != group.model->get_vertex_layout())
+		{
+			InstancedPushConstantData push{};
+			push.vertex_layout = group.model->get_vertex_layout();
 			vkCmdPushConstants(
 				command_buffer,
-				wireframe_pipeline_layout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				pipeline_layout,
+				VK_SHADER_STAGE_VERTEX_BIT,
 				0,
-				sizeof(PushConstantData),
+				sizeof(InstancedPushConstantData),
 				&push
 			);
-			model->bind(command_buffer);
-			model->draw(command_buffer);
+			state.vertex_layout = push.vertex_layout;
+			state.statistics.push_constant_updates++;
 		}
+		bind_index_buffer(command_buffer, *group.model, state);
+		group.model->draw(command_buffer, group.lod, group.instance_count, group.first_instance);
+
+		state.statistics.draws++;
+		state.statistics.instances += group.instance_count;
+	}
+}
+
+void game_engine::RenderSystem::draw_wireframe_entries(VkCommandBuffer command_buffer, size_t begin, size_t end, RecordingState& state) const
+{
+	std::span<const uint32_t> entries = render_queue.get_values();
+	for (size_t i = begin; i < end; i++)
+	{
+		const InstanceRef& instance_ref = instance_refs[entries[i]];
+		uint32_t object = draw_list[instance_ref.object];
+
+		// The model matrix changes with every draw, so the whole block is pushed anyway
+		PushConstantData push{};
+		push.model_matrix = transforms[object].matrix() * instance_ref.model->get_dequantization_matrix();
+		push.color = renders[object].color;
+		push.texture_index = -1;
+		push.vertex_layout = instance_ref.model->get_vertex_layout();
+		vkCmdPushConstants(
+			command_buffer,
+			wireframe_pipeline_layout,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			0,
+			sizeof(PushConstantData),
+			&push
+		);
+		bind_index_buffer(command_buffer, *instance_ref.model, state);
+		instance_ref.model->draw(command_buffer, instance_ref.lod);
+
+		state.statistics.push_constant_updates++;
+		state.statistics.draws++;
+		state.statistics.instances++;
 	}
-}
\ No newline at end of file
+}
+
+void game_engine::RenderSystem::create_instance_buffer(FrameInstances& frame, uint32_t capacity)
+{
+	frame.capacity = capacity;
+	frame.buffer = std::make_unique<Buffer>(
+		device,
+		sizeof(InstanceData),
+		capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+	);
+	frame.buffer->map();
+
+}
@@ -0,0 +1,473 @@
+// engine_tests.cpp : Checks of the CPU side engine modules against straightforward reference results,
+// no Vulkan device is needed.
+//
+// Usage: giereczka_tests [test]
+//
+// Runs every test, or only the named one. Each check that fails is reported with its test, and the exit
+// code is non-zero when any did.
+
+#include "aabb_tree.h"
+#include "job_system.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "render_queue.h"
+#include "tlsf_allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+
+namespace {
+	uint32_t failures = 0;
+	const char* current_test = "";
+
+	void check(bool condition, const std::string& message)
+	{
+		if (!condition)
+		{
+			std::cerr << current_test << ": " << message << std::endl;
+			failures++;
+		}
+	}
+
+	// Quads of a flat size by size grid in the xz plane, 2 triangles each
+	void make_grid(uint32_t size, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+	{
+		positions.clear();
+		indices.clear();
+		for (uint32_t z = 0; z <= size; z++)
+		{
+			for (uint32_t x = 0; x <= size; x++)
+			{
+				positions.push_back({static_cast<float>(x), 0.f, static_cast<float>(z)});
+			}
+		}
+		for (uint32_t z = 0; z < size; z++)
+		{
+			for (uint32_t x = 0; x < size; x++)
+			{
+				uint32_t corner = z * (size + 1) + x;
+				indices.insert(indices.end(), {corner, corner + size + 1, corner + 1});
+				indices.insert(indices.end(), {corner + 1, corner + size + 1, corner + size + 2});
+			}
+		}
+	}
+
+	// Triangles rotated to start at their smallest index, winding kept, then sorted
+	std::vector<std::array<uint32_t, 3>> canonical_triangles(std::span<const uint32_t> indices)
+	{
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			std::array<uint32_t, 3> triangle{indices[i], indices[i + 1], indices[i + 2]};
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	void test_aabb_tree()
+	{
+		std::mt19937 random{1};
+		std::uniform_real_distribution<float> position{-100.f, 100.f};
+		std::uniform_real_distribution<float> size{0.5f, 10.f};
+		auto random_box = [&]
+		{
+			glm::vec3 center{position(random), position(random), position(random)};
+			glm::vec3 extent{size(random), size(random), size(random)};
+			return game_engine::BoundingBox{center - extent, center + extent};
+		};
+
+		game_engine::AabbTree tree;
+		std::vector<game_engine::BoundingBox> boxes;
+		std::vector<uint32_t> proxies;
+		for (uint32_t i = 0; i < 2000; i++)
+		{
+			boxes.push_back(random_box());
+			proxies.push_back(tree.create_proxy(boxes.back(), i));
+		}
+
+		auto check_queries = [&](const char* stage)
+		{
+			uint32_t mismatches = 0;
+			for (uint32_t query = 0; query < 200; query++)
+			{
+				game_engine::BoundingBox query_box = random_box();
+				std::vector<uint32_t> expected;
+				for (uint32_t i = 0; i < boxes.size(); i++)
+				{
+					if (proxies[i] != game_engine::AabbTree::INVALID_NODE && boxes[i].intersects(query_box))
+					{
+						expected.push_back(i);
+					}
+				}
+				std::vector<uint32_t> found;
+				tree.query(query_box, [&](uint32_t user_data)
+				{
+					found.push_back(user_data);
+					return true;
+				});
+				std::sort(found.begin(), found.end());
+				if (found != expected) mismatches++;
+			}
+			check(mismatches == 0, std::to_string(mismatches) + " box queries " + stage + " disagree with brute force");
+		};
+
+		check_queries("after insertion");
+
+		// Small moves mostly stay inside the fat boxes, large ones reinsert
+		for (uint32_t i = 0; i < boxes.size(); i += 2)
+		{
+			glm::vec3 displacement = i % 4 == 0 ? glm::vec3{0.05f, 0.f, 0.f} : glm::vec3{position(random), 0.f, 0.f};
+			boxes[i] = {boxes[i].min + displacement, boxes[i].max + displacement};
+			tree.move_proxy(proxies[i], boxes[i], displacement);
+		}
+		for (uint32_t i = 1; i < boxes.size(); i += 3)
+		{
+			tree.destroy_proxy(proxies[i]);
+			proxies[i] = game_engine::AabbTree::INVALID_NODE;
+		}
+		check_queries("after moves and removals");
+
+		uint32_t live = static_cast<uint32_t>(std::count_if(proxies.begin(), proxies.end(), [](uint32_t proxy)
+		{
+			return proxy != game_engine::AabbTree::INVALID_NODE;
+		}));
+		check(tree.get_proxy_count() == live, "proxy count does not match the live proxies");
+		// AVL balancing keeps the height logarithmic
+		check(tree.get_height() <= 2 * static_cast<uint32_t>(std::ceil(std::log2(static_cast<float>(live)))),
+			"tree is unbalanced, height " + std::to_string(tree.get_height()));
+	}
+
+	void test_render_queue()
+	{
+		using game_engine::DrawPipeline;
+		using game_engine::VertexLayout;
+
+		uint64_t near_key = game_engine::make_draw_key(DrawPipeline::main, VertexLayout::static_mesh, VK_INDEX_TYPE_UINT16, 7, 0, 1.f);
+		uint64_t far_key = game_engine::make_draw_key(DrawPipeline::main, VertexLayout::static_mesh, VK_INDEX_TYPE_UINT16, 7, 0, 100.f);
+		uint64_t other_mesh_key = game_engine::make_draw_key(DrawPipeline::main, VertexLayout::static_mesh, VK_INDEX_TYPE_UINT16, 8, 0, 0.f);
+		uint64_t wireframe_key = game_engine::make_draw_key(DrawPipeline::wireframe, VertexLayout::static_mesh, VK_INDEX_TYPE_UINT16, 0, 0, 0.f);
+		check(near_key < far_key, "draws of a mesh are not front to back");
+		check(far_key < other_mesh_key, "depth outranks the mesh");
+		check(other_mesh_key < wireframe_key, "the mesh outranks the pipeline");
+
+		std::mt19937 random{2};
+		std::uniform_int_distribution<uint32_t> mesh{0, 1000};
+		std::uniform_int_distribution<uint32_t> lod{0, 3};
+		std::uniform_real_distribution<float> depth{0.f, 500.f};
+
+		// Below and above the size that splits the sort into chunks
+		game_engine::JobSystem job_system{4};
+		for (size_t count : {size_t{1000}, size_t{50000}})
+		{
+			for (game_engine::JobSystem* jobs : {static_cast<game_engine::JobSystem*>(nullptr), &job_system})
+			{
+				game_engine::RenderQueue queue;
+				std::vector<std::pair<uint64_t, uint32_t>> expected;
+				for (uint32_t i = 0; i < count; i++)
+				{
+					uint64_t key = game_engine::make_draw_key(
+						i % 5 == 0 ? DrawPipeline::wireframe : DrawPipeline::main,
+						i % 3 == 0 ? VertexLayout::skinned : VertexLayout::static_mesh,
+						i % 2 == 0 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16,
+						mesh(random),
+						lod(random),
+						depth(random)
+					);
+					queue.push(key, i);
+					expected.emplace_back(key, i);
+				}
+				queue.sort(jobs);
+				std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+				std::string label = std::to_string(count) + (jobs == nullptr ? " keys" : " keys on the job system");
+				bool matches = queue.size() == expected.size();
+				for (size_t i = 0; matches && i < expected.size(); i++)
+				{
+					matches = queue.get_keys()[i] == expected[i].first && queue.get_values()[i] == expected[i].second;
+				}
+				check(matches, label + " do not match a stable sort");
+			}
+		}
+	}
+
+	void test_tlsf_allocator()
+	{
+		constexpr VkDeviceSize SIZE = 1 << 20;
+		game_engine::TlsfAllocator allocator{SIZE};
+
+		struct Allocation {
+			uint32_t handle;
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+		std::vector<Allocation> allocations;
+		std::mt19937 random{3};
+		std::uniform_int_distribution<VkDeviceSize> size{1, 8192};
+		std::uniform_int_distribution<uint32_t> alignment_log2{0, 8};
+
+		auto overlaps = [&]
+		{
+			std::vector<Allocation> sorted = allocations;
+			std::sort(sorted.begin(), sorted.end(), [](const Allocation& a, const Allocation& b) { return a.offset < b.offset; });
+			for (size_t i = 1; i < sorted.size(); i++)
+			{
+				if (sorted[i - 1].offset + sorted[i - 1].size > sorted[i].offset) return true;
+			}
+			return !sorted.empty() && sorted.back().offset + sorted.back().size > allocator.get_size();
+		};
+
+		bool misaligned = false;
+		for (uint32_t step = 0; step < 5000; step++)
+		{
+			if (!allocations.empty() && random() % 3 == 0)
+			{
+				size_t index = random() % allocations.size();
+				allocator.free(allocations[index].handle);
+				allocations.erase(allocations.begin() + static_cast<std::ptrdiff_t>(index));
+				continue;
+			}
+
+			VkDeviceSize alignment = VkDeviceSize{1} << alignment_log2(random);
+			Allocation allocation{};
+			allocation.size = size(random);
+			allocation.handle = allocator.allocate(allocation.size, alignment, allocation.offset);
+			if (allocation.handle == game_engine::TlsfAllocator::INVALID_HANDLE) continue;
+			misaligned |= allocation.offset % alignment != 0;
+			allocations.push_back(allocation);
+		}
+		check(!misaligned, "an offset misses its alignment");
+		check(!overlaps(), "allocations overlap or leave the range");
+		check(allocator.get_allocation_count() == allocations.size(), "allocation count is off");
+
+		// Full, then grown: the new space has to serve a request that failed before
+		VkDeviceSize offset = 0;
+		while (allocator.allocate(4096, 1, offset) != game_engine::TlsfAllocator::INVALID_HANDLE) {}
+		check(allocator.allocate(SIZE / 2, 1, offset) == game_engine::TlsfAllocator::INVALID_HANDLE, "allocated past the range");
+		allocator.grow(SIZE * 2);
+		uint32_t handle = allocator.allocate(SIZE / 2, 1, offset);
+		// The free tail of the old range may be merged into the grown space
+		check(handle != game_engine::TlsfAllocator::INVALID_HANDLE && offset + SIZE / 2 > SIZE && offset + SIZE / 2 <= SIZE * 2,
+			"grown space is not used");
+
+		game_engine::TlsfAllocator coalescing{SIZE};
+		std::vector<uint32_t> handles;
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			handles.push_back(coalescing.allocate(SIZE / 64, 1, offset));
+		}
+		// Every other region first, then the rest, so each free merges on both sides
+		for (size_t i = 0; i < handles.size(); i += 2) coalescing.free(handles[i]);
+		for (size_t i = 1; i < handles.size(); i += 2) coalescing.free(handles[i]);
+		check(coalescing.is_empty() && coalescing.get_used_size() == 0, "freed allocator is not empty");
+		check(coalescing.get_free_region_count() == 1 && coalescing.get_largest_free_region() == SIZE,
+			"free regions were not merged");
+	}
+
+	void test_job_system()
+	{
+		game_engine::JobSystem job_system{4};
+
+		constexpr size_t COUNT = 100000;
+		std::atomic<uint64_t> sum{0};
+		std::vector<uint8_t> visits(COUNT, 0);
+		job_system.parallel_for(COUNT, [&](uint32_t, size_t begin, size_t end)
+		{
+			uint64_t local_sum = 0;
+			for (size_t i = begin; i < end; i++)
+			{
+				local_sum += i;
+				visits[i]++;
+			}
+			sum += local_sum;
+		});
+		check(sum == uint64_t{COUNT} * (COUNT - 1) / 2, "parallel_for sum is wrong");
+		check(std::all_of(visits.begin(), visits.end(), [](uint8_t count) { return count == 1; }),
+			"parallel_for did not visit every item exactly once");
+
+		// Dependents run after their dependencies, whatever worker picks them up
+		std::atomic<uint32_t> order{0};
+		uint32_t first_position = 0;
+		uint32_t second_position = 0;
+		game_engine::JobHandle first = job_system.schedule([&](uint32_t)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			first_position = order++;
+		});
+		game_engine::JobHandle dependencies[] = {first};
+		game_engine::JobHandle second = job_system.schedule([&](uint32_t) { second_position = order++; }, dependencies);
+		job_system.wait(second);
+		check(first->is_finished() && first_position == 0 && second_position == 1, "dependency ran after its dependent");
+
+		// A throwing job fails its dependents and wait rethrows
+		game_engine::JobHandle failing = job_system.schedule([](uint32_t) { throw std::runtime_error("job failed"); });
+		game_engine::JobHandle failing_dependencies[] = {failing};
+		bool skipped_ran = false;
+		game_engine::JobHandle skipped = job_system.schedule([&](uint32_t) { skipped_ran = true; }, failing_dependencies);
+		bool rethrown = false;
+		try
+		{
+			job_system.wait(skipped);
+		}
+		catch (const std::runtime_error&)
+		{
+			rethrown = true;
+		}
+		check(rethrown && !skipped_ran, "exception did not reach the dependent job");
+	}
+
+	void test_mesh_simplifier()
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		make_grid(32, positions, indices);
+
+		float error = -1.f;
+		size_t target = indices.size() / 4;
+		std::vector<uint32_t> simplified = game_engine::simplify_mesh(positions, indices, target, 1.f, &error);
+
+		check(simplified.size() % 3 == 0, "result is not a triangle list");
+		check(simplified.size() <= target, std::to_string(simplified.size()) + " indices, target " + std::to_string(target));
+		check(std::all_of(simplified.begin(), simplified.end(), [&](uint32_t index) { return index < positions.size(); }),
+			"index out of range");
+		// Collapses within a plane do not move the surface
+		check(error >= 0.f && error < 1e-3f, "a flat grid simplified with error " + std::to_string(error));
+
+		// The border never moves, so the simplified grid still covers the same area
+		float area = 0.f;
+		for (size_t i = 0; i + 2 < simplified.size(); i += 3)
+		{
+			glm::vec3 a = positions[simplified[i]];
+			glm::vec3 b = positions[simplified[i + 1]];
+			glm::vec3 c = positions[simplified[i + 2]];
+			area += glm::length(glm::cross(b - a, c - a)) * 0.5f;
+		}
+		check(std::abs(area - 32.f * 32.f) < 0.01f, "simplified grid covers " + std::to_string(area) + " instead of 1024");
+
+		// A target error of 0 still allows the free collapses, a tiny target index count then stops early
+		std::vector<uint32_t> bounded = game_engine::simplify_mesh(positions, indices, 3, 0.f, &error);
+		check(error == 0.f, "exceeded a target error of 0");
+		check(!bounded.empty(), "simplified away the whole grid");
+	}
+
+	void test_weld_vertices()
+	{
+		struct Vertex {
+			glm::vec3 position;
+			glm::vec2 uv;
+		};
+
+		std::vector<Vertex> vertices{
+			{{0.f, 0.f, 0.f}, {0.f, 0.f}},
+			{{1.f, 0.f, 0.f}, {1.f, 0.f}},
+			{{0.f, 0.f, 0.f}, {0.f, 0.f}},
+			// Same position, other uv: a seam that has to stay split
+			{{1.f, 0.f, 0.f}, {0.5f, 0.f}},
+			{{1.f, 0.f, 0.f}, {1.f, 0.f}},
+			{{0.f, 1.f, 0.f}, {0.f, 1.f}}
+		};
+
+		size_t unique_count = 0;
+		std::vector<uint32_t> remap = game_engine::weld_vertices_remap(vertices.data(), vertices.size(), sizeof(Vertex), unique_count);
+		check(unique_count == 4, std::to_string(unique_count) + " unique vertices instead of 4");
+		check(remap == std::vector<uint32_t>{0, 1, 0, 2, 1, 3}, "copies are not mapped to their first occurrence");
+
+		game_engine::remap_vertices(std::span<Vertex>(vertices), std::span<const uint32_t>(remap));
+		check(vertices[2].uv == glm::vec2{0.5f, 0.f} && vertices[3].position == glm::vec3{0.f, 1.f, 0.f},
+			"remapped vertices are out of place");
+	}
+
+	void test_vertex_cache_optimizer()
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		make_grid(64, positions, indices);
+
+		// Shuffled triangles, as exporters tend to leave them
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			triangles.push_back({indices[i], indices[i + 1], indices[i + 2]});
+		}
+		std::shuffle(triangles.begin(), triangles.end(), std::mt19937{4});
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			std::copy(triangles[i].begin(), triangles[i].end(), indices.begin() + static_cast<std::ptrdiff_t>(i * 3));
+		}
+
+		auto before = game_engine::analyze_vertex_cache(indices, positions.size());
+		std::vector<uint32_t> optimized = game_engine::optimize_vertex_cache(indices, positions.size());
+		check(canonical_triangles(optimized) == canonical_triangles(indices), "vertex cache order lost or changed triangles");
+		auto after = game_engine::analyze_vertex_cache(optimized, positions.size());
+		check(after.acmr < before.acmr && after.acmr < 1.f,
+			"ACMR " + std::to_string(before.acmr) + " -> " + std::to_string(after.acmr));
+
+		std::vector<uint32_t> reordered = game_engine::optimize_overdraw(optimized, positions);
+		check(canonical_triangles(reordered) == canonical_triangles(optimized), "overdraw order lost or changed triangles");
+
+		std::vector<uint32_t> fetch_indices = reordered;
+		std::vector<uint32_t> remap = game_engine::optimize_vertex_fetch_remap(fetch_indices, positions.size());
+		uint32_t next_new = 0;
+		bool in_order = true;
+		for (uint32_t index : fetch_indices)
+		{
+			if (index == next_new) next_new++;
+			else in_order &= index < next_new;
+		}
+		check(in_order, "vertices are not numbered in order of first use");
+
+		bool remapped = true;
+		for (size_t i = 0; i < reordered.size(); i++)
+		{
+			remapped &= remap[reordered[i]] == fetch_indices[i];
+		}
+		check(remapped, "remap table does not match the rewritten indices");
+	}
+
+	struct Test {
+		const char* name;
+		void (*function)();
+	};
+
+	constexpr Test TESTS[] = {
+		{"aabb-tree", test_aabb_tree},
+		{"render-queue", test_render_queue},
+		{"tlsf-allocator", test_tlsf_allocator},
+		{"job-system", test_job_system},
+		{"mesh-simplifier", test_mesh_simplifier},
+		{"weld-vertices", test_weld_vertices},
+		{"vertex-cache", test_vertex_cache_optimizer}
+	};
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter = argc > 1 ? argv[1] : "";
+	bool found = false;
+	for (const Test& test : TESTS)
+	{
+		if (!filter.empty() && filter != test.name) continue;
+
+		found = true;
+		current_test = test.name;
+		uint32_t failures_before = failures;
+		try
+		{
+			test.function();
+		}
+		catch (const std::exception& e)
+		{
+			check(false, std::string("threw ") + e.what());
+		}
+		std::cout << test.name << (failures == failures_before ? ": passed" : ": FAILED") << std::endl;
+	}
+
+	if (!found)
+	{
+		std::cerr << "unknown test " << filter << std::endl;
+		return EXIT_FAILURE;
+	}
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,4 +1,5 @@
 #include "texture.h"
+#include "upload_batcher.h"
 
 game_engine::Texture::Texture(Device& device, bool nearest_filter) : device{device}, file_name(""), local_buffer(nullptr), width(0), height(0), bytes_per_pixel(0), mip_levels(0), sRGB(false)
 {
@@ -12,7 +13,7 @@ game_engine::Texture::~Texture()
 	vkDestroyImage(device.get_logical_device(), texture_image, nullptr);
 	vkDestroyImageView(device.get_logical_device(), texture_image_view, nullptr);
 	vkDestroySampler(device.get_logical_device(), texture_sampler, nullptr);
-	vkFreeMemory(device.get_logical_device(), texture_image_memory, nullptr);
+	device.get_memory_allocator().free(texture_image_memory);
 }
 
 bool game_engine::Texture::init(const uint32_t width, const uint32_t height, bool sRGB, const void* data, int min_filter, int mag_filter)
@@ -76,60 +77,6 @@ bool game_engine::Texture::init(const unsigned char* data, int length, bool sRGB
 	return ok;
 }
 
-void game_engine::Texture::transition_image_layout(VkImageLayout old_layout, VkImageLayout new_layout)
-{
-	VkCommandBuffer command_buffer = device.begin_single_time_commands();
-
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = old_layout;
-	barrier.newLayout = new_layout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = texture_image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = mip_levels;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-
-	VkPipelineStageFlags source_stage;
-	VkPipelineStageFlags destination_stage;
-
-	if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else
-	{
-		throw std::invalid_argument("Unsupported layout transition");
-		return;
-	}
-	
-	vkCmdPipelineBarrier(
-		command_buffer,
-		source_stage, destination_stage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	device.end_single_time_commands(command_buffer);
-}
-
 void game_engine::Texture::create_image(VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties)
 {
 	mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
@@ -151,40 +98,18 @@ void game_engine::Texture::create_image(VkFormat format, VkImageTiling tiling, V
 	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
 	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	{
-		auto result = vkCreateImage(device.get_logical_device(), &image_info, nullptr, &texture_image);
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to create image");
-		}
-	}
-
-	VkMemoryRequirements memory_requirements;
-	vkGetImageMemoryRequirements(device.get_logical_device(), texture_image, &memory_requirements);
-
-	VkMemoryAllocateInfo alloc_info{};
-	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize = memory_requirements.size;
-	alloc_info.memoryTypeIndex = device.find_memory_type(memory_requirements.memoryTypeBits, properties);
-	{
-		auto result = vkAllocateMemory(device.get_logical_device(), &alloc_info, nullptr, &texture_image_memory);
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to allocate image memory");
-		}
-	}
-
-	vkBindImageMemory(device.get_logical_device(), texture_image, texture_image_memory, 0);
+	device.create_image_with_info(image_info, properties, texture_image, texture_image_memory);
 }
 
-void game_engine::Texture::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory)
+void game_engine::Texture::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& buffer_allocation)
 {
 	// TODO
 }
 
 bool game_engine::Texture::create()
 {
-	VkDeviceSize image_size = width * height * bytes_per_pixel;
+	// stb_image expands every file to RGBA, bytes_per_pixel is the channel count of the source
+	VkDeviceSize image_size = static_cast<VkDeviceSize>(width) * height * 4;
 
 	if (!local_buffer)
 	{
@@ -192,18 +117,16 @@ bool game_engine::Texture::create()
 		return false;
 	}
 
-	Buffer staging_buffer{
-		device,
-		image_size,
-		1,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	};
+	VkFormat format = sRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
 
-	staging_buffer.map();
-	staging_buffer.write_to_buffer(local_buffer);
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(device.get_physical_device(), format, &format_properties);
 
-	VkFormat format = sRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+	{
+		throw std::runtime_error("Texture image format does not support linear blitting");
+		return false;
+	}
 
 	create_image(
 		format,
@@ -212,17 +135,17 @@ bool game_engine::Texture::create()
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 	);
 
-	transition_image_layout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-	device.copy_buffer_to_image(
-		staging_buffer.get_buffer(),
-		texture_image,
-		static_cast<uint32_t>(width),
-		static_cast<uint32_t>(height),
-		1
-	);
-
-	generate_mipmaps();
+	// Recorded into the current upload batch, the texels are copied out before this returns
+	ImageUpload upload{};
+	upload.image = texture_image;
+	upload.width = static_cast<uint32_t>(width);
+	upload.height = static_cast<uint32_t>(height);
+	upload.mip_levels = mip_levels;
+	upload.generate_mipmaps = true;
+	upload.mip_filter = min_filter_mip;
+	upload.data = local_buffer;
+	upload.size = image_size;
+	device.get_upload_batcher().upload_image(upload);
 
 	image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
@@ -295,111 +218,6 @@ void game_engine::Texture::resize(const uint32_t width, const uint32_t height)
 	throw std::runtime_error("Not implemented");
 }
 
-void game_engine::Texture::generate_mipmaps()
-{
-	VkFormatProperties format_properties;
-	vkGetPhysicalDeviceFormatProperties(device.get_physical_device(), image_format, &format_properties);
-
-	if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
-	{
-		throw std::runtime_error("Texture image format does not support linear blitting");
-		return;
-	}
-
-	VkCommandBuffer command_buffer = device.begin_single_time_commands();
-
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = texture_image;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = 1;
-
-	int32_t mip_width = width;
-	int32_t mip_height = height;
-
-	for (uint32_t i = 1; i < mip_levels; i++)
-	{
-		barrier.subresourceRange.baseMipLevel = i - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-		vkCmdPipelineBarrier(
-			command_buffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier
-		);
-
-		VkImageBlit blit{};
-		blit.srcOffsets[0] = { 0, 0, 0 };
-		blit.srcOffsets[1] = { mip_width, mip_height, 1 };
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.mipLevel = i - 1;
-		blit.srcSubresource.baseArrayLayer = 0;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = { 0, 0, 0 };
-		blit.dstOffsets[1] = {
-			mip_width > 1 ? mip_width / 2 : 1,
-			mip_height > 1 ? mip_height / 2 : 1,
-			1
-		};
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.mipLevel = i;
-		blit.dstSubresource.baseArrayLayer = 0;
-		blit.dstSubresource.layerCount = 1;
-
-		vkCmdBlitImage(
-			command_buffer,
-			texture_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			texture_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &blit,
-			min_filter_mip
-		);
-
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		vkCmdPipelineBarrier(
-			command_buffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier
-		);
-
-		if (mip_width > 1) mip_width /= 2;
-		if (mip_height > 1) mip_height /= 2;
-	}
-
-	barrier.subresourceRange.baseMipLevel = mip_levels - 1;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-	vkCmdPipelineBarrier(
-		command_buffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	device.end_single_time_commands(command_buffer);
-}
-
 VkFilter game_engine::Texture::set_filter(int min_mag_filter)
 {
 	VkFilter filter = VK_FILTER_LINEAR;
@@ -0,0 +1,106 @@
+#include "thread_command_pools.h"
+
+game_engine::ThreadCommandPools::ThreadCommandPools(Device& device, uint32_t frame_count, uint32_t thread_count)
+	: device(device), thread_count(thread_count)
+{
+	VkCommandPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = device.find_physical_queue_families().graphics_family;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	frames.resize(frame_count);
+	for (auto& slots : frames)
+	{
+		slots.resize(thread_count);
+		for (auto& slot : slots)
+		{
+			if (vkCreateCommandPool(device.get_logical_device(), &pool_info, nullptr, &slot.command_pool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create thread command pool");
+			}
+		}
+	}
+}
+
+game_engine::ThreadCommandPools::~ThreadCommandPools()
+{
+	for (auto& slots : frames)
+	{
+		for (auto& slot : slots)
+		{
+			// Destroying the pool frees every command buffer allocated from it
+			vkDestroyCommandPool(device.get_logical_device(), slot.command_pool, nullptr);
+		}
+	}
+}
+
+void game_engine::ThreadCommandPools::reset(int frame_index)
+{
+	for (auto& slot : frames[frame_index])
+	{
+		if (slot.used == 0)
+		{
+			continue;
+		}
+
+		vkResetCommandPool(device.get_logical_device(), slot.command_pool, 0);
+		slot.used = 0;
+	}
+}
+
+VkCommandBuffer game_engine::ThreadCommandPools::begin_secondary(
+	int frame_index,
+	uint32_t thread_index,
+	const SecondaryRecordingInfo& info
+)
+{
+	assert(thread_index < thread_count && "Thread index out of range");
+
+	auto& slot = frames[frame_index][thread_index];
+	if (slot.used == slot.command_buffers.size())
+	{
+		VkCommandBufferAllocateInfo allocate_info{};
+		allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocate_info.commandPool = slot.command_pool;
+		allocate_info.commandBufferCount = 1;
+
+		VkCommandBuffer command_buffer;
+		if (vkAllocateCommandBuffers(device.get_logical_device(), &allocate_info, &command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate secondary command buffer");
+		}
+		slot.command_buffers.push_back(command_buffer);
+	}
+
+	VkCommandBuffer command_buffer = slot.command_buffers[slot.used++];
+
+	VkCommandBufferInheritanceInfo inheritance_info{};
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.renderPass = info.render_pass;
+	inheritance_info.subpass = 0;
+	inheritance_info.framebuffer = info.framebuffer;
+
+	VkCommandBufferBeginInfo begin_info{};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = &inheritance_info;
+
+	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to begin recording secondary command buffer");
+	}
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(info.extent.width);
+	viewport.height = static_cast<float>(info.extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor{ {0, 0}, info.extent };
+	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+	return command_buffer;
+}
@@ -0,0 +1,309 @@
+#include "tlsf_allocator.h"
+
+#include <bit>
+#include <cassert>
+
+game_engine::TlsfAllocator::TlsfAllocator(VkDeviceSize size) : size(size)
+{
+	assert(size > 0 && "Cannot manage an empty range");
+
+	for (auto& lists : free_lists)
+	{
+		lists.fill(INVALID_HANDLE);
+	}
+
+	uint32_t index = create_region();
+	regions[index].offset = 0;
+	regions[index].size = size;
+	insert_free_region(index);
+}
+
+uint32_t game_engine::TlsfAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	assert(std::has_single_bit(alignment) && "Alignment must be a power of two");
+	size = std::max<VkDeviceSize>(size, 1);
+
+	uint32_t index = find_free_region(size + alignment - 1);
+	if (index == INVALID_HANDLE)
+	{
+		// The good-fit search skips the request's own size class, a region in it may still fit
+		uint32_t fl, sl;
+		mapping_insert(size, fl, sl);
+		for (uint32_t candidate = free_lists[fl][sl]; candidate != INVALID_HANDLE; candidate = regions[candidate].next_free)
+		{
+			const Region& region = regions[candidate];
+			VkDeviceSize aligned = (region.offset + alignment - 1) & ~(alignment - 1);
+			if (aligned + size <= region.offset + region.size)
+			{
+				index = candidate;
+				break;
+			}
+		}
+
+		if (index == INVALID_HANDLE)
+		{
+			return INVALID_HANDLE;
+		}
+	}
+
+	remove_free_region(index);
+
+	VkDeviceSize aligned_offset = (regions[index].offset + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize padding = aligned_offset - regions[index].offset;
+	if (padding > 0)
+	{
+		uint32_t front = index;
+		index = split_region(front, padding);
+		insert_free_region(front);
+	}
+
+	if (regions[index].size - size >= MIN_REGION_SIZE)
+	{
+		uint32_t tail = split_region(index, size);
+		insert_free_region(tail);
+	}
+
+	Region& region = regions[index];
+	region.is_free = false;
+	used_size += region.size;
+	allocation_count++;
+
+	offset = region.offset;
+	return index;
+}
+
+void game_engine::TlsfAllocator::free(uint32_t handle)
+{
+	assert(handle < regions.size() && !regions[handle].is_free && "Invalid or double free");
+
+	used_size -= regions[handle].size;
+	allocation_count--;
+
+	uint32_t next = regions[handle].next_physical;
+	if (next != INVALID_HANDLE && regions[next].is_free)
+	{
+		remove_free_region(next);
+		merge_with_next(handle);
+	}
+
+	uint32_t previous = regions[handle].prev_physical;
+	if (previous != INVALID_HANDLE && regions[previous].is_free)
+	{
+		remove_free_region(previous);
+		handle = merge_with_next(previous);
+	}
+
+	insert_free_region(handle);
+}
+
+void game_engine::TlsfAllocator::grow(VkDeviceSize new_size)
+{
+	assert(new_size > size && "Can only grow the range");
+
+	// Unused regions are zero sized, so only the physically last region ends at the old size
+	uint32_t last = INVALID_HANDLE;
+	for (uint32_t index = 0; index < regions.size(); index++)
+	{
+		if (regions[index].size > 0 && regions[index].offset + regions[index].size == size)
+		{
+			last = index;
+			break;
+		}
+	}
+	assert(last != INVALID_HANDLE && "Regions do not cover the range");
+
+	if (regions[last].is_free)
+	{
+		remove_free_region(last);
+		regions[last].size += new_size - size;
+		insert_free_region(last);
+	}
+	else
+	{
+		uint32_t tail = create_region();
+		regions[tail].offset = size;
+		regions[tail].size = new_size - size;
+		regions[tail].prev_physical = last;
+		regions[last].next_physical = tail;
+		insert_free_region(tail);
+	}
+
+	size = new_size;
+}
+
+VkDeviceSize game_engine::TlsfAllocator::get_largest_free_region() const
+{
+	if (fl_bitmap == 0)
+	{
+		return 0;
+	}
+
+	uint32_t fl = 63 - std::countl_zero(fl_bitmap);
+	uint32_t sl = 31 - std::countl_zero(sl_bitmaps[fl]);
+
+	VkDeviceSize largest = 0;
+	for (uint32_t index = free_lists[fl][sl]; index != INVALID_HANDLE; index = regions[index].next_free)
+	{
+		largest = std::max(largest, regions[index].size);
+	}
+	return largest;
+}
+
+void game_engine::TlsfAllocator::mapping_insert(VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+{
+	if (size < SL_COUNT)
+	{
+		fl = 0;
+		sl = static_cast<uint32_t>(size);
+		return;
+	}
+
+	uint32_t top_bit = static_cast<uint32_t>(std::bit_width(size)) - 1;
+	sl = static_cast<uint32_t>(size >> (top_bit - SL_LOG2)) ^ SL_COUNT;
+	fl = top_bit - SL_LOG2 + 1;
+}
+
+void game_engine::TlsfAllocator::mapping_search(VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+{
+	// Round up to the next size class, so every region in the list found is large enough
+	if (size >= SL_COUNT)
+	{
+		uint32_t top_bit = static_cast<uint32_t>(std::bit_width(size)) - 1;
+		size += (VkDeviceSize{1} << (top_bit - SL_LOG2)) - 1;
+	}
+	mapping_insert(size, fl, sl);
+}
+
+uint32_t game_engine::TlsfAllocator::find_free_region(VkDeviceSize size)
+{
+	uint32_t fl, sl;
+	mapping_search(size, fl, sl);
+	if (fl >= FL_COUNT)
+	{
+		return INVALID_HANDLE;
+	}
+
+	uint32_t sl_map = sl_bitmaps[fl] & (~0u << sl);
+	if (sl_map == 0)
+	{
+		uint64_t fl_map = fl + 1 < 64 ? fl_bitmap & (~0ull << (fl + 1)) : 0;
+		if (fl_map == 0)
+		{
+			return INVALID_HANDLE;
+		}
+
+		fl = static_cast<uint32_t>(std::countr_zero(fl_map));
+		sl_map = sl_bitmaps[fl];
+	}
+
+	sl = static_cast<uint32_t>(std::countr_zero(sl_map));
+	return free_lists[fl][sl];
+}
+
+void game_engine::TlsfAllocator::insert_free_region(uint32_t index)
+{
+	uint32_t fl, sl;
+	mapping_insert(regions[index].size, fl, sl);
+
+	uint32_t head = free_lists[fl][sl];
+	regions[index].is_free = true;
+	regions[index].prev_free = INVALID_HANDLE;
+	regions[index].next_free = head;
+	if (head != INVALID_HANDLE)
+	{
+		regions[head].prev_free = index;
+	}
+
+	free_lists[fl][sl] = index;
+	fl_bitmap |= 1ull << fl;
+	sl_bitmaps[fl] |= 1u << sl;
+	free_region_count++;
+}
+
+void game_engine::TlsfAllocator::remove_free_region(uint32_t index)
+{
+	uint32_t fl, sl;
+	mapping_insert(regions[index].size, fl, sl);
+
+	Region& region = regions[index];
+	if (region.prev_free != INVALID_HANDLE)
+	{
+		regions[region.prev_free].next_free = region.next_free;
+	}
+	else
+	{
+		free_lists[fl][sl] = region.next_free;
+	}
+
+	if (region.next_free != INVALID_HANDLE)
+	{
+		regions[region.next_free].prev_free = region.prev_free;
+	}
+
+	if (free_lists[fl][sl] == INVALID_HANDLE)
+	{
+		sl_bitmaps[fl] &= ~(1u << sl);
+		if (sl_bitmaps[fl] == 0)
+		{
+			fl_bitmap &= ~(1ull << fl);
+		}
+	}
+
+	region.prev_free = INVALID_HANDLE;
+	region.next_free = INVALID_HANDLE;
+	region.is_free = false;
+	free_region_count--;
+}
+
+uint32_t game_engine::TlsfAllocator::split_region(uint32_t index, VkDeviceSize first_size)
+{
+	// create_region() may grow the vector, so no references are held across it
+	uint32_t second = create_region();
+
+	regions[second].offset = regions[index].offset + first_size;
+	regions[second].size = regions[index].size - first_size;
+	regions[second].prev_physical = index;
+	regions[second].next_physical = regions[index].next_physical;
+	if (regions[second].next_physical != INVALID_HANDLE)
+	{
+		regions[regions[second].next_physical].prev_physical = second;
+	}
+
+	regions[index].size = first_size;
+	regions[index].next_physical = second;
+	return second;
+}
+
+uint32_t game_engine::TlsfAllocator::merge_with_next(uint32_t index)
+{
+	uint32_t next = regions[index].next_physical;
+	regions[index].size += regions[next].size;
+	regions[index].next_physical = regions[next].next_physical;
+	if (regions[index].next_physical != INVALID_HANDLE)
+	{
+		regions[regions[index].next_physical].prev_physical = index;
+	}
+
+	destroy_region(next);
+	return index;
+}
+
+uint32_t game_engine::TlsfAllocator::create_region()
+{
+	if (!unused_regions.empty())
+	{
+		uint32_t index = unused_regions.back();
+		unused_regions.pop_back();
+		regions[index] = Region{};
+		return index;
+	}
+
+	regions.emplace_back();
+	return static_cast<uint32_t>(regions.size() - 1);
+}
+
+void game_engine::TlsfAllocator::destroy_region(uint32_t index)
+{
+	regions[index] = Region{};
+	unused_regions.push_back(index);
+}
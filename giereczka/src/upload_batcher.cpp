@@ -0,0 +1,700 @@
+#include "upload_batcher.h"
+
+#include <cassert>
+
+namespace {
+	// Without resizable BAR only a 256 MiB window of VRAM is host visible, too small to spend on static data
+	constexpr VkDeviceSize BAR_WINDOW_SIZE = 256ull * 1024 * 1024;
+
+	constexpr VkPipelineStageFlags SHADER_STAGES =
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	// Every stage that may read uploaded data
+	constexpr VkPipelineStageFlags READ_STAGES =
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | SHADER_STAGES;
+	constexpr VkAccessFlags READ_ACCESS =
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	VkCommandPool create_command_pool(VkDevice device, uint32_t queue_family)
+	{
+		VkCommandPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.queueFamilyIndex = queue_family;
+		pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		VkCommandPool command_pool;
+		if (vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upload command pool");
+		}
+		return command_pool;
+	}
+
+	VkCommandBuffer allocate_command_buffer(VkDevice device, VkCommandPool command_pool)
+	{
+		VkCommandBufferAllocateInfo allocate_info{};
+		allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocate_info.commandPool = command_pool;
+		allocate_info.commandBufferCount = 1;
+
+		VkCommandBuffer command_buffer;
+		if (vkAllocateCommandBuffers(device, &allocate_info, &command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate upload command buffer");
+		}
+		return command_buffer;
+	}
+
+	VkFence create_fence(VkDevice device)
+	{
+		VkFenceCreateInfo fence_info{};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		VkFence fence;
+		if (vkCreateFence(device, &fence_info, nullptr, &fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upload fence");
+		}
+		return fence;
+	}
+
+	void begin_command_buffer(VkCommandBuffer command_buffer)
+	{
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(command_buffer, &begin_info);
+	}
+}
+
+game_engine::UploadBatcher::UploadBatcher(Device& device, VkDeviceSize ring_size)
+	: device(device), ring_size(ring_size)
+{
+	QueueFamilyIndices queue_families = device.find_physical_queue_families();
+	dedicated_transfer = device.has_dedicated_transfer_queue();
+	graphics_family = queue_families.graphics_family;
+	transfer_family = dedicated_transfer ? queue_families.transfer_family : graphics_family;
+
+	const VkMemoryPropertyFlags direct_write_properties =
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	static_buffer_properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	const auto& memory_properties = device.get_memory_allocator().get_memory_properties();
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+	{
+		const VkMemoryType& type = memory_properties.memoryTypes[i];
+		if ((type.propertyFlags & direct_write_properties) == direct_write_properties &&
+			memory_properties.memoryHeaps[type.heapIndex].size > BAR_WINDOW_SIZE)
+		{
+			static_buffer_properties = direct_write_properties;
+			break;
+		}
+	}
+
+	// Image copies need offsets aligned to the texel size and to 4
+	copy_alignment = std::max<VkDeviceSize>(16, device.properties.limits.optimalBufferCopyOffsetAlignment);
+
+	device.create_buffer(
+		ring_size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		ring_buffer,
+		ring_allocation
+	);
+}
+
+game_engine::UploadBatcher::~UploadBatcher()
+{
+	// Submits whatever is still recording, every batch ends up in free_batches
+	wait_idle();
+
+	VkDevice logical_device = device.get_logical_device();
+	for (auto& batch : free_batches)
+	{
+		vkDestroyFence(logical_device, batch->transfer_fence, nullptr);
+		vkDestroyCommandPool(logical_device, batch->transfer_command_pool, nullptr);
+
+		if (dedicated_transfer)
+		{
+			vkDestroyFence(logical_device, batch->graphics_fence, nullptr);
+			vkDestroySemaphore(logical_device, batch->transfer_finished, nullptr);
+			vkDestroyCommandPool(logical_device, batch->graphics_command_pool, nullptr);
+		}
+	}
+
+	vkDestroyBuffer(logical_device, ring_buffer, nullptr);
+	device.get_memory_allocator().free(ring_allocation);
+}
+
+void game_engine::UploadBatcher::upload_buffer(Buffer& buffer, const void* data, VkDeviceSize size, VkDeviceSize offset)
+{
+	assert(offset + size <= buffer.get_buffer_size() && "Upload out of buffer bounds");
+
+	if (size == 0)
+	{
+		return;
+	}
+
+	const Allocation& allocation = buffer.get_allocation();
+	if (allocation.mapped)
+	{
+		memcpy(static_cast<char*>(allocation.mapped) + offset, data, static_cast<size_t>(size));
+		device.get_memory_allocator().flush(allocation, offset, size);
+		return;
+	}
+
+	std::lock_guard lock(mutex);
+
+	VkBuffer staging_buffer;
+	void* mapped;
+	VkDeviceSize staging_offset = allocate_staging(size, staging_buffer, mapped);
+	memcpy(mapped, data, static_cast<size_t>(size));
+
+	Batch& batch = get_recording_batch();
+
+	VkBufferCopy copy_region{};
+	copy_region.srcOffset = staging_offset;
+	copy_region.dstOffset = offset;
+	copy_region.size = size;
+	vkCmdCopyBuffer(batch.transfer_command_buffer, staging_buffer, buffer.get_buffer(), 1, &copy_region);
+
+	if (dedicated_transfer)
+	{
+		VkBufferMemoryBarrier ownership{};
+		ownership.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		ownership.srcQueueFamilyIndex = transfer_family;
+		ownership.dstQueueFamilyIndex = graphics_family;
+		ownership.buffer = buffer.get_buffer();
+		ownership.offset = offset;
+		ownership.size = size;
+		batch.buffer_transfers.push_back(ownership);
+	}
+}
+
+void game_engine::UploadBatcher::upload_image(const ImageUpload& upload)
+{
+	assert(upload.image != VK_NULL_HANDLE && upload.data && upload.size > 0 && "Invalid image upload");
+
+	std::lock_guard lock(mutex);
+
+	VkBuffer staging_buffer;
+	void* mapped;
+	VkDeviceSize staging_offset = allocate_staging(upload.size, staging_buffer, mapped);
+	memcpy(mapped, upload.data, static_cast<size_t>(upload.size));
+
+	Batch& batch = get_recording_batch();
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = upload.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = upload.mip_levels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		batch.transfer_command_buffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+
+	// Whole mip level, always a multiple of the transfer family's minImageTransferGranularity
+	VkBufferImageCopy region{};
+	region.bufferOffset = staging_offset;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { upload.width, upload.height, 1 };
+
+	vkCmdCopyBufferToImage(
+		batch.transfer_command_buffer,
+		staging_buffer,
+		upload.image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &region
+	);
+
+	if (!dedicated_transfer)
+	{
+		record_image_finish(batch.transfer_command_buffer, upload);
+		return;
+	}
+
+	// The layout stays the same across the ownership transfer, the graphics queue takes it from there
+	barrier.srcQueueFamilyIndex = transfer_family;
+	barrier.dstQueueFamilyIndex = graphics_family;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	batch.image_transfers.push_back(barrier);
+
+	ImageUpload pending = upload;
+	pending.data = nullptr;
+	batch.pending_images.push_back(pending);
+}
+
+uint64_t game_engine::UploadBatcher::flush()
+{
+	std::lock_guard lock(mutex);
+
+	if (recording)
+	{
+		submit_recording_batch();
+	}
+	submit_pending_graphics();
+	retire_completed_batches();
+
+	return next_batch_value - 1;
+}
+
+bool game_engine::UploadBatcher::is_complete(uint64_t batch_value)
+{
+	std::lock_guard lock(mutex);
+
+	retire_completed_batches();
+	return completed_batch_value >= batch_value;
+}
+
+void game_engine::UploadBatcher::wait(uint64_t batch_value)
+{
+	std::lock_guard lock(mutex);
+
+	submit_pending_graphics();
+
+	while (completed_batch_value < batch_value && !in_flight.empty())
+	{
+		Batch& oldest = *in_flight.front();
+		VkFence fence = oldest.transfer_done && dedicated_transfer ? oldest.graphics_fence : oldest.transfer_fence;
+		vkWaitForFences(device.get_logical_device(), 1, &fence, VK_TRUE, UINT64_MAX);
+		retire_completed_batches();
+	}
+}
+
+void game_engine::UploadBatcher::wait_idle()
+{
+	wait(flush());
+}
+
+void game_engine::UploadBatcher::record_image_finish(VkCommandBuffer command_buffer, const ImageUpload& upload)
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = upload.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;
+
+	uint32_t generated_levels = upload.generate_mipmaps ? upload.mip_levels : 1;
+	int32_t mip_width = static_cast<int32_t>(upload.width);
+	int32_t mip_height = static_cast<int32_t>(upload.height);
+
+	for (uint32_t i = 1; i < generated_levels; i++)
+	{
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+
+		VkImageBlit blit{};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mip_width, mip_height, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = {
+			mip_width > 1 ? mip_width / 2 : 1,
+			mip_height > 1 ? mip_height / 2 : 1,
+			1
+		};
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(
+			command_buffer,
+			upload.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit,
+			upload.mip_filter
+		);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, SHADER_STAGES,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+
+		if (mip_width > 1) mip_width /= 2;
+		if (mip_height > 1) mip_height /= 2;
+	}
+
+	// The last written level, plus any levels that were not generated
+	barrier.subresourceRange.baseMipLevel = generated_levels - 1;
+	barrier.subresourceRange.levelCount = upload.mip_levels - generated_levels + 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, SHADER_STAGES,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+}
+
+game_engine::UploadBatcher::Batch& game_engine::UploadBatcher::get_recording_batch()
+{
+	if (recording)
+	{
+		return *recording;
+	}
+
+	if (!free_batches.empty())
+	{
+		recording = std::move(free_batches.back());
+		free_batches.pop_back();
+	}
+	else
+	{
+		VkDevice logical_device = device.get_logical_device();
+
+		recording = std::make_unique<Batch>();
+		recording->transfer_command_pool = create_command_pool(logical_device, transfer_family);
+		recording->transfer_command_buffer = allocate_command_buffer(logical_device, recording->transfer_command_pool);
+		recording->transfer_fence = create_fence(logical_device);
+
+		if (dedicated_transfer)
+		{
+			recording->graphics_command_pool = create_command_pool(logical_device, graphics_family);
+			recording->graphics_command_buffer = allocate_command_buffer(logical_device, recording->graphics_command_pool);
+			recording->graphics_fence = create_fence(logical_device);
+
+			VkSemaphoreCreateInfo semaphore_info{};
+			semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &recording->transfer_finished) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create upload semaphore");
+			}
+		}
+	}
+
+	begin_command_buffer(recording->transfer_command_buffer);
+	return *recording;
+}
+
+VkDeviceSize game_engine::UploadBatcher::allocate_staging(VkDeviceSize size, VkBuffer& staging_buffer, void*& mapped)
+{
+	// Anything this large would keep draining the ring, it gets its own buffer for the batch's lifetime
+	if (size > ring_size / 4)
+	{
+		Allocation allocation;
+		device.create_buffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			staging_buffer,
+			allocation
+		);
+		mapped = allocation.mapped;
+		get_recording_batch().oversized_staging.emplace_back(staging_buffer, allocation);
+		return 0;
+	}
+
+	VkDeviceSize offset = 0;
+	VkDeviceSize consumed = 0;
+	while (true)
+	{
+		if (ring_in_use == 0)
+		{
+			ring_head = 0;
+		}
+
+		VkDeviceSize aligned = align_up(ring_head, copy_alignment);
+		if (aligned + size <= ring_size)
+		{
+			offset = aligned;
+			consumed = aligned + size - ring_head;
+		}
+		else
+		{
+			// Wrap around, the tail end of the ring is wasted until this batch completes
+			offset = 0;
+			consumed = ring_size - ring_head + size;
+		}
+
+		// Used space is the contiguous run from the oldest batch up to the head, so the free space
+		// starts at the head and this is enough to never overwrite data still being read
+		if (consumed <= ring_size - ring_in_use)
+		{
+			break;
+		}
+
+		if (recording)
+		{
+			submit_recording_batch();
+		}
+		else
+		{
+			wait_oldest_transfer();
+		}
+	}
+
+	ring_head = offset + size;
+	ring_in_use += consumed;
+	get_recording_batch().ring_bytes += consumed;
+
+	staging_buffer = ring_buffer;
+	mapped = static_cast<char*>(ring_allocation.mapped) + offset;
+	return offset;
+}
+
+void game_engine::UploadBatcher::submit_recording_batch()
+{
+	Batch& batch = *recording;
+
+	if (dedicated_transfer)
+	{
+		// Release to the graphics family, the destination stage and access are ignored here
+		for (auto& barrier : batch.buffer_transfers)
+		{
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+		}
+		for (auto& barrier : batch.image_transfers)
+		{
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+		}
+
+		vkCmdPipelineBarrier(
+			batch.transfer_command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(batch.buffer_transfers.size()), batch.buffer_transfers.data(),
+			static_cast<uint32_t>(batch.image_transfers.size()), batch.image_transfers.data()
+		);
+
+		// The graphics side is recorded now but only submitted by flush(), on the frame thread
+		begin_command_buffer(batch.graphics_command_buffer);
+
+		for (auto& barrier : batch.buffer_transfers)
+		{
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = READ_ACCESS;
+		}
+		for (auto& barrier : batch.image_transfers)
+		{
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		}
+
+		vkCmdPipelineBarrier(
+			batch.graphics_command_buffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | READ_STAGES,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(batch.buffer_transfers.size()), batch.buffer_transfers.data(),
+			static_cast<uint32_t>(batch.image_transfers.size()), batch.image_transfers.data()
+		);
+
+		for (const auto& upload : batch.pending_images)
+		{
+			record_image_finish(batch.graphics_command_buffer, upload);
+		}
+
+		if (vkEndCommandBuffer(batch.graphics_command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record upload command buffer");
+		}
+	}
+	else
+	{
+		// Make the copies visible to everything submitted after this batch
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = READ_ACCESS;
+
+		vkCmdPipelineBarrier(
+			batch.transfer_command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, READ_STAGES,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr
+		);
+	}
+
+	if (vkEndCommandBuffer(batch.transfer_command_buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to record upload command buffer");
+	}
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &batch.transfer_command_buffer;
+	if (dedicated_transfer)
+	{
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores = &batch.transfer_finished;
+	}
+
+	if (vkQueueSubmit(device.get_transfer_queue(), 1, &submit_info, batch.transfer_fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit upload command buffer");
+	}
+
+	batch.value = next_batch_value++;
+	batch.graphics_submitted = !dedicated_transfer;
+	in_flight.push_back(std::move(recording));
+}
+
+void game_engine::UploadBatcher::submit_pending_graphics()
+{
+	const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT | READ_STAGES;
+
+	for (auto& batch : in_flight)
+	{
+		if (batch->graphics_submitted)
+		{
+			continue;
+		}
+
+		VkSubmitInfo submit_info{};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.waitSemaphoreCount = 1;
+		submit_info.pWaitSemaphores = &batch->transfer_finished;
+		submit_info.pWaitDstStageMask = &wait_stage;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &batch->graphics_command_buffer;
+
+		if (vkQueueSubmit(device.get_graphics_queue(), 1, &submit_info, batch->graphics_fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit upload ownership acquire");
+		}
+		batch->graphics_submitted = true;
+	}
+}
+
+void game_engine::UploadBatcher::wait_oldest_transfer()
+{
+	for (auto& batch : in_flight)
+	{
+		if (!batch->transfer_done)
+		{
+			vkWaitForFences(device.get_logical_device(), 1, &batch->transfer_fence, VK_TRUE, UINT64_MAX);
+			retire_completed_batches();
+			return;
+		}
+	}
+
+	assert(false && "Staging ring exhausted with nothing in flight");
+}
+
+void game_engine::UploadBatcher::retire_completed_batches()
+{
+	VkDevice logical_device = device.get_logical_device();
+
+	// Each queue completes batches in submission order, the staging ring is freed as copies finish
+	for (auto& batch : in_flight)
+	{
+		if (batch->transfer_done)
+		{
+			continue;
+		}
+		if (vkGetFenceStatus(logical_device, batch->transfer_fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		batch->transfer_done = true;
+		ring_in_use -= batch->ring_bytes;
+		batch->ring_bytes = 0;
+		for (auto& [buffer, allocation] : batch->oversized_staging)
+		{
+			vkDestroyBuffer(logical_device, buffer, nullptr);
+			device.get_memory_allocator().free(allocation);
+		}
+		batch->oversized_staging.clear();
+	}
+
+	while (!in_flight.empty())
+	{
+		Batch& batch = *in_flight.front();
+		if (!batch.transfer_done || !batch.graphics_submitted)
+		{
+			break;
+		}
+		if (dedicated_transfer && vkGetFenceStatus(logical_device, batch.graphics_fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		completed_batch_value = batch.value;
+
+		vkResetFences(logical_device, 1, &batch.transfer_fence);
+		vkResetCommandPool(logical_device, batch.transfer_command_pool, 0);
+		if (dedicated_transfer)
+		{
+			vkResetFences(logical_device, 1, &batch.graphics_fence);
+			vkResetCommandPool(logical_device, batch.graphics_command_pool, 0);
+		}
+		batch.buffer_transfers.clear();
+		batch.image_transfers.clear();
+		batch.pending_images.clear();
+		batch.transfer_done = false;
+		batch.graphics_submitted = false;
+
+		free_batches.push_back(std::move(in_flight.front()));
+		in_flight.pop_front();
+	}
+}
@@ -0,0 +1,73 @@
+#include "vertex_format.h"
+
+#include <algorithm>
+
+game_engine::PositionQuantization game_engine::PositionQuantization::from_bounds(const BoundingBox& box)
+{
+	PositionQuantization quantization{};
+	if (box.is_empty())
+	{
+		return quantization;
+	}
+
+	glm::vec3 size = box.max - box.min;
+	quantization.offset = box.min;
+	quantization.scale = std::max({size.x, size.y, size.z});
+	// Flat or single point meshes still need an invertible matrix
+	if (quantization.scale <= 0.f)
+	{
+		quantization.scale = 1.f;
+	}
+	return quantization;
+}
+
+std::array<uint16_t, 3> game_engine::PositionQuantization::quantize(const glm::vec3& position) const
+{
+	glm::vec3 normalized = glm::clamp((position - offset) / scale, 0.f, 1.f);
+	glm::vec3 rounded = glm::round(normalized * 65535.f);
+	return {
+		static_cast<uint16_t>(rounded.x),
+		static_cast<uint16_t>(rounded.y),
+		static_cast<uint16_t>(rounded.z)
+	};
+}
+
+glm::mat4 game_engine::PositionQuantization::dequantization_matrix() const
+{
+	return glm::scale(glm::translate(glm::mat4{1.f}, offset), glm::vec3(scale));
+}
+
+uint32_t game_engine::get_vertex_stride(VertexLayout layout)
+{
+	return layout == VertexLayout::skinned ? sizeof(PackedSkinnedVertex) : sizeof(PackedVertex);
+}
+
+std::array<int8_t, 2> game_engine::encode_octahedral(const glm::vec3& direction)
+{
+	float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+	if (length <= 0.f)
+	{
+		return {0, 0};
+	}
+
+	glm::vec3 octahedron = direction / length;
+	glm::vec2 encoded{octahedron.x, octahedron.y};
+	// The lower half folds over the diagonals onto the corners of the square
+	if (octahedron.z < 0.f)
+	{
+		glm::vec2 sign{encoded.x >= 0.f ? 1.f : -1.f, encoded.y >= 0.f ? 1.f : -1.f};
+		encoded = (1.f - glm::abs(glm::vec2{encoded.y, encoded.x})) * sign;
+	}
+
+	glm::vec2 snorm = glm::round(glm::clamp(encoded, -1.f, 1.f) * 127.f);
+	return {static_cast<int8_t>(snorm.x), static_cast<int8_t>(snorm.y)};
+}
+
+uint16_t game_engine::pack_rgb565(const glm::vec3& color)
+{
+	glm::vec3 clamped = glm::clamp(color, 0.f, 1.f);
+	auto red = static_cast<uint16_t>(std::round(clamped.r * 31.f));
+	auto green = static_cast<uint16_t>(std::round(clamped.g * 63.f));
+	auto blue = static_cast<uint16_t>(std::round(clamped.b * 31.f));
+	return static_cast<uint16_t>(red << 11 | green << 5 | blue);
+}